@@ -41,6 +41,8 @@ public class FileDownloader : ModuleRules
 				"Slate",
 				"SlateCore",
                 "HTTP",
+                "HTTPServer",
+                "RenderCore",
                 "JsonUtilities",
                 "Json",
 				// ... add private dependencies that you statically link with here ...	
@@ -48,6 +50,20 @@ public class FileDownloader : ModuleRules
 			);
 		
 		
+		//streaming decompression of compressed transfers
+		AddEngineThirdPartyPrivateStaticDependencies(Target, "zlib");
+
+		//optional libcurl multi transport
+		if (Target.Platform == UnrealTargetPlatform.Linux || Target.Platform == UnrealTargetPlatform.Win64)
+		{
+			AddEngineThirdPartyPrivateStaticDependencies(Target, "libcurl", "OpenSSL");
+			PrivateDefinitions.Add("WITH_DOWNLOADER_CURL=1");
+		}
+		else
+		{
+			PrivateDefinitions.Add("WITH_DOWNLOADER_CURL=0");
+		}
+
 		DynamicallyLoadedModuleNames.AddRange(
 			new string[]
 			{
@@ -0,0 +1,397 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "BatchDownloadTask.h"
+#include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "HAL/PlatformFilemanager.h"
+
+static int64 FindBytes(const TArray<uint8>& InData, const uint8* InPattern, int32 InPatternSize, int64 InFrom)
+{
+	const int64 Last = (int64)InData.Num() - InPatternSize;
+	for (int64 i = InFrom; i <= Last; ++i)
+	{
+		if (InData[i] == InPattern[0] && FMemory::Memcmp(InData.GetData() + i, InPattern, InPatternSize) == 0)
+		{
+			return i;
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+BatchDownloadTask::BatchDownloadTask(const FString& InUrl, const TArray<FBatchEntry>& InEntries, int32 InGapThreshold, int32 InMaxRangesPerRequest)
+	: DownloadTask(InUrl, FPaths::ProjectSavedDir(), FPaths::GetCleanFilename(InUrl))
+	, GapThreshold(InGapThreshold)
+	, MaxRangesPerRequest(InMaxRangesPerRequest)
+{
+	int64 Total = 0;
+	for (const FBatchEntry& Entry : InEntries)
+	{
+		if (Entry.Length < 1 || Entry.Offset < 0 || Entry.DestFile.IsEmpty())
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("%s, ignore invalid batch entry : %s"), *InUrl, *Entry.DestFile);
+			continue;
+		}
+
+		Entries.Add(Entry);
+		Total += Entry.Length;
+	}
+
+	SetTotalSize(Total);
+}
+
+bool BatchDownloadTask::Start()
+{
+	SetNeedStop(false);
+
+	//the manager sets the chunk size after construction, plan once no group is written yet
+	if (CurrentGroup == 0 && IsDownloading() == false)
+	{
+		PlanGroups();
+	}
+
+	if (GetSourceUrl().IsEmpty() || Groups.Num() < 1)
+	{
+		TaskState = ETaskState::ERROR;
+		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+		return false;
+	}
+
+	if (IsDownloading())
+	{
+		return false;
+	}
+
+	//sizes are known from entries, no HEAD needed
+	EncodeUrl();
+	TaskState = ETaskState::DOWNLOADING;
+	ProcessTaskEvent(ETaskEvent::START_DOWNLOAD, TaskInfo, 0);
+
+	if (CurrentGroup >= Groups.Num())
+	{
+		OnTaskCompleted();
+		return true;
+	}
+
+	StartChunk();
+	return true;
+}
+
+void BatchDownloadTask::PlanGroups()
+{
+	Groups.Reset();
+
+	TArray<int32> Order;
+	for (int32 i = 0; i < Entries.Num(); ++i)
+	{
+		Order.Add(i);
+	}
+	Order.Sort([this](int32 A, int32 B)
+	{
+		return Entries[A].Offset < Entries[B].Offset;
+	});
+
+	//merge pieces closer than the gap threshold into one range, a range does not grow over ChunkSize
+	TArray<FRangeGroup> Spans;
+	for (int32 Index : Order)
+	{
+		const FBatchEntry& Entry = Entries[Index];
+		const int64 End = Entry.Offset + Entry.Length - 1;
+		if (Spans.Num() > 0)
+		{
+			TPair<int64, int64>& Range = Spans.Last().Ranges[0];
+			if (Entry.Offset <= Range.Value + 1 + GapThreshold && FMath::Max(End, Range.Value) - Range.Key + 1 <= ChunkSize)
+			{
+				Range.Value = FMath::Max(End, Range.Value);
+				Spans.Last().Entries.Add(Index);
+				continue;
+			}
+		}
+
+		FRangeGroup Span;
+		Span.Ranges.Emplace(Entry.Offset, End);
+		Span.Entries.Add(Index);
+		Spans.Add(MoveTemp(Span));
+	}
+
+	//pack ranges into multi-range requests
+	const int32 MaxRanges = FMath::Max(1, MaxRangesPerRequest);
+	for (FRangeGroup& Span : Spans)
+	{
+		Span.Bytes = (int32)(Span.Ranges[0].Value - Span.Ranges[0].Key + 1);
+		if (Groups.Num() > 0)
+		{
+			FRangeGroup& Last = Groups.Last();
+			if (Last.Ranges.Num() < MaxRanges && Last.Bytes + Span.Bytes <= ChunkSize)
+			{
+				Last.Ranges.Append(Span.Ranges);
+				Last.Entries.Append(Span.Entries);
+				Last.Bytes += Span.Bytes;
+				continue;
+			}
+		}
+
+		Groups.Add(MoveTemp(Span));
+	}
+
+	UE_LOG(LogFileDownloader, Log, TEXT("%s, %d batch entries in %d requests"), *GetSourceUrl(), Entries.Num(), Groups.Num());
+}
+
+void BatchDownloadTask::StartChunk()
+{
+	const FRangeGroup& Group = Groups[CurrentGroup];
+	if (AcquireBudget(Group.Bytes) == false)
+	{
+		return;
+	}
+
+	FString RangeStr = FString("bytes=");
+	for (int32 i = 0; i < Group.Ranges.Num(); ++i)
+	{
+		if (i > 0)
+		{
+			RangeStr += TEXT(",");
+		}
+		RangeStr += FString::Printf(TEXT("%lld-%lld"), Group.Ranges[i].Key, Group.Ranges[i].Value);
+	}
+
+	SendRangeRequest(RangeStr, Group.Bytes);
+}
+
+void BatchDownloadTask::OnChunkReceived(FDownloadResponsePtr InResponse)
+{
+	ProcessRequestResult(InResponse->GetContent().Num(), true);
+
+	//split the response and write pieces on a worker thread, the response keeps the data alive
+	const int32 FirstGroup = CurrentGroup;
+	RunOnWorker([this, InResponse, FirstGroup]()
+	{
+		int32 WrittenGroups = 0;
+		int32 WrittenBytes = 0;
+		int32 FailedEntries = 0;
+
+		TArray<FRangePart> Parts;
+		if (ParseResponse(InResponse, Parts))
+		{
+			//server ignored ranges and sent the whole file, it holds every remaining piece
+			const int32 LastGroup = InResponse->GetResponseCode() == 200 ? Groups.Num() : FirstGroup + 1;
+			const TArray<uint8>& Content = InResponse->GetContent();
+			IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+
+			for (int32 GroupIndex = FirstGroup; GroupIndex < LastGroup; ++GroupIndex)
+			{
+				for (int32 EntryIndex : Groups[GroupIndex].Entries)
+				{
+					const FBatchEntry& Entry = Entries[EntryIndex];
+					const FRangePart* Part = Parts.FindByPredicate([&Entry](const FRangePart& InPart)
+					{
+						return Entry.Offset >= InPart.Start && Entry.Offset + Entry.Length <= InPart.Start + InPart.Length;
+					});
+
+					if (Part == nullptr)
+					{
+						++FailedEntries;
+						continue;
+					}
+
+					PlatformFile.CreateDirectoryTree(*FPaths::GetPath(Entry.DestFile));
+					TArrayView<const uint8> Data(Content.GetData() + Part->DataOffset + (Entry.Offset - Part->Start), Entry.Length);
+					if (FFileHelper::SaveArrayToFile(Data, *Entry.DestFile))
+					{
+						WrittenBytes += Entry.Length;
+					}
+					else
+					{
+						++FailedEntries;
+					}
+				}
+				++WrittenGroups;
+			}
+		}
+		else
+		{
+			FailedEntries = Groups[FirstGroup].Entries.Num();
+		}
+
+		this->RunTaskStep([this, WrittenGroups, WrittenBytes, FailedEntries]() {
+			this->OnGroupWritten(WrittenGroups, WrittenBytes, FailedEntries);
+		});
+	});
+}
+
+void BatchDownloadTask::OnGroupWritten(int32 InWrittenGroups, int32 InWrittenBytes, int32 InFailedEntries)
+{
+	ReleaseBudget();
+	if (GetState() != ETaskState::DOWNLOADING)
+	{
+		return;
+	}
+
+	if (InFailedEntries > 0)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, %d batch entries missing in response or not written"), *GetSourceUrl(), InFailedEntries);
+		if (CurrentTryCount >= MaxTryCount)
+		{
+			TaskState = ETaskState::ERROR;
+			ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+			return;
+		}
+
+		++CurrentTryCount;
+		StartChunk();
+		return;
+	}
+
+	CurrentGroup += InWrittenGroups;
+	SetCurrentSize(GetCurrentSize() + InWrittenBytes);
+
+	if (CurrentGroup < Groups.Num())
+	{
+		ProcessTaskEvent(ETaskEvent::DOWNLOAD_UPDATE, TaskInfo, 0);
+		StartChunk();
+	}
+	else
+	{
+		OnTaskCompleted();
+	}
+}
+
+void BatchDownloadTask::OnTaskCompleted()
+{
+	//pieces are written to their destinations directly, nothing to rename
+	SetCurrentSize(GetTotalSize());
+	TaskState = ETaskState::COMPLETED;
+	ProcessTaskEvent(ETaskEvent::DOWNLOAD_COMPLETED, TaskInfo, 0);
+}
+
+bool BatchDownloadTask::CheckRangeResponse(FDownloadResponsePtr InResponse)
+{
+	return true;
+}
+
+bool BatchDownloadTask::ParseResponse(FDownloadResponsePtr InResponse, TArray<FRangePart>& OutParts)
+{
+	const TArray<uint8>& Content = InResponse->GetContent();
+	const int32 ResponseCode = InResponse->GetResponseCode();
+
+	if (ResponseCode == 200)
+	{
+		FRangePart Part;
+		Part.Length = Content.Num();
+		OutParts.Add(Part);
+		return true;
+	}
+
+	if (ResponseCode != 206)
+	{
+		return false;
+	}
+
+	//a single range is answered without multipart
+	const FString ContentType = InResponse->GetContentType();
+	if (ContentType.StartsWith(TEXT("multipart/byteranges"), ESearchCase::IgnoreCase) == false)
+	{
+		FRangePart Part;
+		int64 End = 0;
+		if (ParseContentRange(InResponse->GetHeader(TEXT("Content-Range")), Part.Start, End) == false || End - Part.Start + 1 > Content.Num())
+		{
+			return false;
+		}
+		Part.Length = End - Part.Start + 1;
+		OutParts.Add(Part);
+		return true;
+	}
+
+	const int32 BoundaryPos = ContentType.Find(TEXT("boundary="), ESearchCase::IgnoreCase);
+	if (BoundaryPos == INDEX_NONE)
+	{
+		return false;
+	}
+
+	FString Boundary = ContentType.Mid(BoundaryPos + 9);
+	int32 SemicolonPos = INDEX_NONE;
+	if (Boundary.FindChar(TEXT(';'), SemicolonPos))
+	{
+		Boundary = Boundary.Left(SemicolonPos);
+	}
+	Boundary = Boundary.TrimStartAndEnd().TrimQuotes();
+
+	const FTCHARToUTF8 Delimiter(*(FString(TEXT("--")) + Boundary));
+	const uint8* DelimiterData = reinterpret_cast<const uint8*>(Delimiter.Get());
+	static const uint8 HeaderEnd[] = { '\r', '\n', '\r', '\n' };
+
+	int64 Pos = 0;
+	while (true)
+	{
+		const int64 Found = FindBytes(Content, DelimiterData, Delimiter.Length(), Pos);
+		if (Found == INDEX_NONE)
+		{
+			break;
+		}
+
+		Pos = Found + Delimiter.Length();
+		//closing delimiter
+		if (Pos + 1 < Content.Num() && Content[Pos] == '-' && Content[Pos + 1] == '-')
+		{
+			break;
+		}
+
+		const int64 HeadersEnd = FindBytes(Content, HeaderEnd, 4, Pos);
+		if (HeadersEnd == INDEX_NONE)
+		{
+			return false;
+		}
+
+		const FUTF8ToTCHAR HeadersConv(reinterpret_cast<const ANSICHAR*>(Content.GetData() + Pos), (int32)(HeadersEnd - Pos));
+		TArray<FString> Lines;
+		FString(HeadersConv.Length(), HeadersConv.Get()).ParseIntoArrayLines(Lines);
+
+		FRangePart Part;
+		int64 End = -1;
+		for (const FString& Line : Lines)
+		{
+			if (Line.StartsWith(TEXT("Content-Range:"), ESearchCase::IgnoreCase))
+			{
+				ParseContentRange(Line.Mid(14), Part.Start, End);
+			}
+		}
+
+		Part.DataOffset = HeadersEnd + 4;
+		Part.Length = End - Part.Start + 1;
+		if (End < Part.Start || Part.DataOffset + Part.Length > Content.Num())
+		{
+			return false;
+		}
+
+		OutParts.Add(Part);
+		Pos = Part.DataOffset + Part.Length;
+	}
+
+	return OutParts.Num() > 0;
+}
+
+bool BatchDownloadTask::ParseContentRange(const FString& InValue, int64& OutStart, int64& OutEnd)
+{
+	//bytes 0-99/1234
+	FString Value = InValue.TrimStartAndEnd();
+	Value.RemoveFromStart(TEXT("bytes"), ESearchCase::IgnoreCase);
+	Value = Value.TrimStart();
+
+	FString Range;
+	FString Total;
+	if (Value.Split(TEXT("/"), &Range, &Total) == false)
+	{
+		Range = Value;
+	}
+
+	FString Start;
+	FString End;
+	if (Range.Split(TEXT("-"), &Start, &End) == false || Start.IsNumeric() == false || End.IsNumeric() == false)
+	{
+		return false;
+	}
+
+	OutStart = FCString::Atoi64(*Start);
+	OutEnd = FCString::Atoi64(*End);
+	return OutEnd >= OutStart;
+}
@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTask.h"
+
+/**
+ * a task that saves many pieces of one remote file (e.g. small assets packed in a large blob) to their own files.
+ * nearby pieces are merged when the gap between them is small, several ranges are sent in one multi-range request
+ * and the multipart/byteranges response is split back into pieces on a worker thread. no HEAD is needed.
+ */
+class BatchDownloadTask : public DownloadTask
+{
+public:
+
+	/*
+	 @Param InGapThreshold pieces closer than this are fetched as one range, gap bytes are discarded
+	 @Param InMaxRangesPerRequest ranges in one request, 1 disables multi-range requests
+	*/
+	BatchDownloadTask(const FString& InUrl, const TArray<FBatchEntry>& InEntries, int32 InGapThreshold, int32 InMaxRangesPerRequest);
+
+	virtual bool Start() override;
+
+	//pieces have no sidecar, a batch is never fresh
+	virtual void CheckFreshness(int32 InDefaultMaxAge, TFunction<void(bool bFresh)> InDone) override
+	{
+		InDone(false);
+	}
+
+protected:
+
+	//a request of the batch, ranges are inclusive
+	struct FRangeGroup
+	{
+		TArray<TPair<int64, int64>> Ranges;
+		TArray<int32> Entries;
+		int32 Bytes = 0;
+	};
+
+	//a part of a response body
+	struct FRangePart
+	{
+		int64 Start = 0;
+		int64 DataOffset = 0;
+		int64 Length = 0;
+	};
+
+	//split entries into requests by the chunk size the task runs with
+	void PlanGroups();
+
+	virtual void StartChunk() override;
+
+	virtual void OnChunkReceived(FDownloadResponsePtr InResponse) override;
+
+	//ranges of a group are found by ParseResponse, the size of a batch is not the size of the remote file
+	virtual bool CheckRangeResponse(FDownloadResponsePtr InResponse) override;
+
+	virtual void OnTaskCompleted() override;
+
+	void OnGroupWritten(int32 InWrittenGroups, int32 InWrittenBytes, int32 InFailedEntries);
+
+	//split a 206/200 response into parts, runs on a worker thread
+	static bool ParseResponse(FDownloadResponsePtr InResponse, TArray<FRangePart>& OutParts);
+
+	static bool ParseContentRange(const FString& InValue, int64& OutStart, int64& OutEnd);
+
+	TArray<FBatchEntry> Entries;
+
+	int32 GapThreshold = 0;
+
+	int32 MaxRangesPerRequest = 1;
+
+	TArray<FRangeGroup> Groups;
+
+	int32 CurrentGroup = 0;
+};
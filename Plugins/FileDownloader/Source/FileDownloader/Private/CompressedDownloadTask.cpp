@@ -0,0 +1,105 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CompressedDownloadTask.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/ScopeLock.h"
+
+CompressedDownloadTask::CompressedDownloadTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName, const FString& InCompressedSuffix)
+	: DownloadTask(InUrl, InDirectory, InFileName)
+	, CompressedSuffix(InCompressedSuffix)
+	, Inflater(FStreamInflater::GZIP_OR_ZLIB)
+{
+}
+
+int64 CompressedDownloadTask::GetOutputSize() const
+{
+	return OutputSize.load();
+}
+
+double CompressedDownloadTask::GetDecodeSeconds() const
+{
+	return DecodeSeconds.load();
+}
+
+void CompressedDownloadTask::EncodeUrl()
+{
+	DownloadTask::EncodeUrl();
+	EncodedUrl += CompressedSuffix;
+}
+
+void CompressedDownloadTask::StartDownloadChunks(bool bResume)
+{
+	//the inflater state is lost when stopped, always start from the first byte
+	Inflater.Reset();
+	OutputSize = 0;
+	DecodeSeconds = 0.0;
+	bStreaming = true;
+
+	DownloadTask::StartDownloadChunks(false);
+}
+
+void CompressedDownloadTask::OnChunkReceived(FDownloadResponsePtr InResponse)
+{
+	DataBuffer = MoveTemp(InResponse->Content);
+	ProcessRequestResult(DataBuffer.Num(), true);
+
+	//decompress & write on a worker thread, chunks of a task are handled one after another
+	RunOnWorker([this]()
+	{
+		const double StartTime = FPlatformTime::Seconds();
+		const int32 WireSize = DataBuffer.Num();
+		bool bResult = false;
+		{
+			//Stop may close the sink on game thread meanwhile
+			FScopeLock SinkScope(&this->SinkLock.Get());
+			if (this->Sink->IsOpen() == false)
+			{
+				return;
+			}
+
+			bResult = this->Inflater.IsFinished() == false && this->Inflater.Feed(DataBuffer.GetData(), WireSize, [this](const uint8* InBlock, int32 InBlockSize)
+			{
+				if (this->Sink->Write(this->OutputSize.load(), InBlock, InBlockSize) == false)
+				{
+					return false;
+				}
+				this->OutputSize += InBlockSize;
+				return true;
+			});
+		}
+		DataBuffer.Empty();
+		DecodeSeconds = DecodeSeconds.load() + (FPlatformTime::Seconds() - StartTime);
+
+		this->RunTaskStep([this, bResult, WireSize]() {
+			if (bResult)
+			{
+				this->OnWriteChunkEnd(WireSize);
+			}
+			else
+			{
+				UE_LOG(LogFileDownloader, Warning, TEXT("%s, decompress or write error !"), *this->GetFileName());
+				this->ReleaseBudget();
+				this->TaskState = ETaskState::ERROR;
+				this->ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, this->TaskInfo, -1);
+			}
+		});
+	});
+}
+
+void CompressedDownloadTask::OnTaskCompleted()
+{
+	if (bStreaming && Inflater.IsFinished() == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, compressed stream is truncated !"), *GetFileName());
+		CloseSink();
+		TaskState = ETaskState::ERROR;
+		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+		return;
+	}
+
+	Sink->Flush();
+
+	UE_LOG(LogFileDownloader, Log, TEXT("%s, %lld wire bytes decompressed to %lld bytes in %.3fs"), *GetFileName(), GetTotalSize(), GetOutputSize(), GetDecodeSeconds());
+	bStreaming = false;
+	DownloadTask::OnTaskCompleted();
+}
@@ -0,0 +1,47 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTask.h"
+#include "StreamInflater.h"
+#include <atomic>
+
+/**
+ * a task that downloads the pre-compressed sibling of a file (e.g. file.json.gz) and decompresses every chunk
+ * on a worker thread straight into the temp file while the next chunks are still arriving.
+ * current & total size count wire bytes, GetOutputSize counts decompressed bytes.
+ * a decompression stream cannot be resumed, so a stopped task starts over.
+ */
+class CompressedDownloadTask : public DownloadTask
+{
+public:
+
+	CompressedDownloadTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName, const FString& InCompressedSuffix);
+
+	virtual int64 GetOutputSize() const override;
+
+	virtual double GetDecodeSeconds() const override;
+
+protected:
+
+	virtual void EncodeUrl() override;
+
+	virtual void StartDownloadChunks(bool bResume) override;
+
+	virtual void OnChunkReceived(FDownloadResponsePtr InResponse) override;
+
+	virtual void OnTaskCompleted() override;
+
+	//appended to the source url to get the compressed file, e.g. ".gz"
+	FString CompressedSuffix;
+
+	FStreamInflater Inflater;
+
+	//true once chunks go through the inflater, false when the task completes from an exist file or cache
+	bool bStreaming = false;
+
+	std::atomic<int64> OutputSize { 0 };
+
+	std::atomic<double> DecodeSeconds { 0.0 };
+};
@@ -0,0 +1,98 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ConcurrencyController.h"
+#include "FileDownloader.h"
+
+void FConcurrencyController::Reset(int32 InInitialLimit, int32 InMinLimit, int32 InMaxLimit)
+{
+	MinLimit = FMath::Max(1, InMinLimit);
+	MaxLimit = FMath::Max(MinLimit, InMaxLimit);
+	Limit = FMath::Clamp(InInitialLimit, MinLimit, MaxLimit);
+
+	WindowTime = 0.f;
+	WindowBytes = 0;
+	WindowSucceeded = 0;
+	WindowFailed = 0;
+	LastGoodput = 0.f;
+	LastErrorRate = 0.f;
+	BaselineGoodput = 0.f;
+	bLastStepIncreased = false;
+}
+
+void FConcurrencyController::SetBounds(int32 InMinLimit, int32 InMaxLimit)
+{
+	MinLimit = FMath::Max(1, InMinLimit);
+	MaxLimit = FMath::Max(MinLimit, InMaxLimit);
+	Limit = FMath::Clamp(Limit, MinLimit, MaxLimit);
+}
+
+void FConcurrencyController::AddRequestResult(int32 InBytes, bool bSucceeded)
+{
+	WindowBytes += FMath::Max(0, InBytes);
+	if (bSucceeded)
+	{
+		++WindowSucceeded;
+	}
+	else
+	{
+		++WindowFailed;
+	}
+}
+
+int32 FConcurrencyController::Update(float DeltaTime, int32 InActiveCount)
+{
+	WindowTime += DeltaTime;
+	if (WindowTime < SampleWindow)
+	{
+		return Limit;
+	}
+
+	const int32 Requests = WindowSucceeded + WindowFailed;
+	LastGoodput = WindowBytes / WindowTime;
+	LastErrorRate = Requests > 0 ? (float)WindowFailed / Requests : 0.f;
+
+	WindowTime = 0.f;
+	WindowBytes = 0;
+	WindowSucceeded = 0;
+	WindowFailed = 0;
+
+	const int32 OldLimit = Limit;
+
+	if (LastErrorRate > MaxErrorRate)
+	{
+		//multiplicative decrease, the network or the server is overloaded
+		Limit = FMath::Max(MinLimit, Limit / 2);
+		bLastStepIncreased = false;
+		BaselineGoodput = LastGoodput;
+	}
+	else if (Requests == 0)
+	{
+		//nothing measured, keep current limit
+	}
+	else if (bLastStepIncreased && LastGoodput < BaselineGoodput * (1.f + ImproveRatio))
+	{
+		//the extra slot did not pay off, step back and hold
+		Limit = FMath::Max(MinLimit, Limit - 1);
+		bLastStepIncreased = false;
+		BaselineGoodput = LastGoodput;
+	}
+	else if (InActiveCount >= Limit && Limit < MaxLimit)
+	{
+		//additive increase, only when every slot is busy
+		BaselineGoodput = LastGoodput;
+		++Limit;
+		bLastStepIncreased = true;
+	}
+	else
+	{
+		bLastStepIncreased = false;
+		BaselineGoodput = LastGoodput;
+	}
+
+	if (OldLimit != Limit)
+	{
+		UE_LOG(LogFileDownloader, Log, TEXT("Parallel task limit %d -> %d, goodput %.0f B/s, error rate %.2f"), OldLimit, Limit, LastGoodput, LastErrorRate);
+	}
+
+	return Limit;
+}
@@ -0,0 +1,74 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * AIMD controller for the number of parallel download tasks.
+ * It samples the aggregate goodput and the request error rate every SampleWindow seconds,
+ * adds one slot while throughput keeps improving and backs off when it plateaus or errors rise.
+ */
+class FConcurrencyController
+{
+public:
+
+	void Reset(int32 InInitialLimit, int32 InMinLimit, int32 InMaxLimit);
+
+	//change user bounds without losing the measured state
+	void SetBounds(int32 InMinLimit, int32 InMaxLimit);
+
+	//feed the controller with the result of one finished request
+	void AddRequestResult(int32 InBytes, bool bSucceeded);
+
+	/*advance the controller
+	 @Param DeltaTime seconds since last update
+	 @Param InActiveCount current running tasks, the limit only grows when every slot is in use
+	 @return the new limit
+	*/
+	int32 Update(float DeltaTime, int32 InActiveCount);
+
+	int32 GetLimit() const
+	{
+		return Limit;
+	}
+
+	//goodput measured in the last window, bytes per second
+	float GetLastGoodput() const
+	{
+		return LastGoodput;
+	}
+
+	//error rate measured in the last window [0, 1]
+	float GetLastErrorRate() const
+	{
+		return LastErrorRate;
+	}
+
+	//length of a measure window, seconds
+	float SampleWindow = 2.f;
+
+	//goodput must grow by this ratio to be considered an improvement
+	float ImproveRatio = 0.05f;
+
+	//error rate above this value halves the limit
+	float MaxErrorRate = 0.1f;
+
+protected:
+
+	int32 Limit = 1;
+	int32 MinLimit = 1;
+	int32 MaxLimit = 1;
+
+	float WindowTime = 0.f;
+	int64 WindowBytes = 0;
+	int32 WindowSucceeded = 0;
+	int32 WindowFailed = 0;
+
+	float LastGoodput = 0.f;
+	float LastErrorRate = 0.f;
+
+	//goodput measured before the last increase, used to detect a plateau
+	float BaselineGoodput = 0.f;
+	bool bLastStepIncreased = false;
+};
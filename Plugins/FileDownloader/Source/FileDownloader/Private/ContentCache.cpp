@@ -0,0 +1,280 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ContentCache.h"
+#include "FileDownloader.h"
+#include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/SecureHash.h"
+#include "HAL/PlatformFilemanager.h"
+#include "GenericPlatform/GenericPlatformHttp.h"
+#include "JsonObjectConverter.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/WindowsHWrapper.h"
+#elif PLATFORM_UNIX || PLATFORM_MAC
+#include <unistd.h>
+#endif
+
+static const FString CACHE_INDEX = TEXT("CacheIndex.json");
+
+FContentCache::FContentCache(const FString& InDirectory, int64 InMaxSize)
+	: Directory(InDirectory)
+	, MaxSize(InMaxSize)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if (PlatformFile.DirectoryExists(*Directory) == false)
+	{
+		if (PlatformFile.CreateDirectoryTree(*Directory) == false)
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("Cannot create cache directory : %s"), *Directory);
+		}
+	}
+
+	LoadIndex();
+}
+
+FContentCache::~FContentCache()
+{
+	FScopeLock ScopeLock(&Lock);
+	SaveIndex();
+}
+
+FString FContentCache::MakeKey(const FString& InUrl, const FString& InETag, int64 InSize)
+{
+	//weak ETag does not promise byte identical content
+	if (InETag.IsEmpty() || InETag.StartsWith(TEXT("W/")) || InSize < 1)
+	{
+		return FString();
+	}
+
+	return FGenericPlatformHttp::GetUrlDomain(InUrl) + TEXT("|") + InETag + TEXT("|") + LexToString(InSize);
+}
+
+void FContentCache::SetMaxSize(int64 InMaxSize)
+{
+	FScopeLock ScopeLock(&Lock);
+	if (MaxSize != InMaxSize)
+	{
+		MaxSize = InMaxSize;
+		Evict();
+		SaveIndex();
+	}
+}
+
+bool FContentCache::Contains(const FString& InKey) const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Entries.Contains(InKey);
+}
+
+void FContentCache::AddMiss()
+{
+	FScopeLock ScopeLock(&Lock);
+	++MissCount;
+}
+
+bool FContentCache::Materialize(const FString& InKey, const FString& InDestFile)
+{
+	FString SourceFile;
+	int64 Size = 0;
+	{
+		FScopeLock ScopeLock(&Lock);
+		FContentCacheEntry* Entry = Entries.Find(InKey);
+		if (Entry == nullptr)
+		{
+			++MissCount;
+			return false;
+		}
+
+		Entry->LastAccess = FDateTime::UtcNow().GetTicks();
+		SourceFile = Directory / Entry->FileName;
+		Size = Entry->Size;
+	}
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	bool bResult = PlatformFile.FileSize(*SourceFile) == Size;
+	if (bResult)
+	{
+		if (PlatformFile.FileExists(*InDestFile))
+		{
+			PlatformFile.DeleteFile(*InDestFile);
+		}
+		bResult = LinkOrCopy(InDestFile, SourceFile);
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	if (bResult)
+	{
+		++HitCount;
+	}
+	else
+	{
+		//cached file is gone or broken, forget it
+		UE_LOG(LogFileDownloader, Warning, TEXT("Content cache entry unusable : %s"), *SourceFile);
+		++MissCount;
+		if (Entries.Contains(InKey))
+		{
+			TotalSize -= Entries[InKey].Size;
+			Entries.Remove(InKey);
+			PlatformFile.DeleteFile(*SourceFile);
+			SaveIndex();
+		}
+	}
+
+	return bResult;
+}
+
+bool FContentCache::Store(const FString& InKey, const FString& InSourceFile)
+{
+	if (InKey.IsEmpty() || Contains(InKey))
+	{
+		return false;
+	}
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const int64 Size = PlatformFile.FileSize(*InSourceFile);
+	if (Size < 1 || (MaxSize > 0 && Size > MaxSize))
+	{
+		return false;
+	}
+
+	FContentCacheEntry Entry;
+	Entry.Key = InKey;
+	Entry.FileName = FMD5::HashAnsiString(*InKey);
+	Entry.Size = Size;
+	Entry.LastAccess = FDateTime::UtcNow().GetTicks();
+
+	const FString CacheFile = Directory / Entry.FileName;
+	if (PlatformFile.FileExists(*CacheFile))
+	{
+		PlatformFile.DeleteFile(*CacheFile);
+	}
+
+	if (LinkOrCopy(CacheFile, InSourceFile) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Cannot store %s to content cache"), *InSourceFile);
+		return false;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	if (Entries.Contains(InKey) == false)
+	{
+		TotalSize += Size;
+		Entries.Add(InKey, Entry);
+		Evict();
+		SaveIndex();
+	}
+
+	return true;
+}
+
+int32 FContentCache::GetHitCount() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return HitCount;
+}
+
+int32 FContentCache::GetMissCount() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return MissCount;
+}
+
+int64 FContentCache::GetTotalSize() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return TotalSize;
+}
+
+bool FContentCache::LinkOrCopy(const FString& InDestFile, const FString& InSourceFile)
+{
+	const FString FullDest = FPaths::ConvertRelativePathToFull(InDestFile);
+	const FString FullSource = FPaths::ConvertRelativePathToFull(InSourceFile);
+
+#if PLATFORM_WINDOWS
+	if (::CreateHardLinkW(*FullDest, *FullSource, nullptr))
+	{
+		return true;
+	}
+#elif PLATFORM_UNIX || PLATFORM_MAC
+	if (link(TCHAR_TO_UTF8(*FullSource), TCHAR_TO_UTF8(*FullDest)) == 0)
+	{
+		return true;
+	}
+#endif
+
+	//different volume or file system without links
+	return FPlatformFileManager::Get().GetPlatformFile().CopyFile(*FullDest, *FullSource);
+}
+
+void FContentCache::LoadIndex()
+{
+	FScopeLock ScopeLock(&Lock);
+
+	FString JsonStr;
+	FContentCacheIndex Index;
+	if (FFileHelper::LoadFileToString(JsonStr, *GetIndexFileName()) == false
+		|| FJsonObjectConverter::JsonObjectStringToUStruct(JsonStr, &Index, 0, 0) == false)
+	{
+		return;
+	}
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	for (const FContentCacheEntry& Entry : Index.Entries)
+	{
+		//drop entries whose file was removed by hand
+		if (PlatformFile.FileSize(*(Directory / Entry.FileName)) == Entry.Size)
+		{
+			Entries.Add(Entry.Key, Entry);
+			TotalSize += Entry.Size;
+		}
+	}
+
+	Evict();
+}
+
+void FContentCache::SaveIndex() const
+{
+	FContentCacheIndex Index;
+	Entries.GenerateValueArray(Index.Entries);
+
+	FString JsonStr;
+	if (FJsonObjectConverter::UStructToJsonObjectString(FContentCacheIndex::StaticStruct(), &Index, JsonStr, 0, 0))
+	{
+		FFileHelper::SaveStringToFile(JsonStr, *GetIndexFileName());
+	}
+}
+
+void FContentCache::Evict()
+{
+	if (MaxSize < 1 || TotalSize <= MaxSize)
+	{
+		return;
+	}
+
+	TArray<FContentCacheEntry> SortedEntries;
+	Entries.GenerateValueArray(SortedEntries);
+	SortedEntries.Sort([](const FContentCacheEntry& A, const FContentCacheEntry& B)
+	{
+		return A.LastAccess < B.LastAccess;
+	});
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	for (const FContentCacheEntry& Entry : SortedEntries)
+	{
+		if (TotalSize <= MaxSize)
+		{
+			break;
+		}
+
+		PlatformFile.DeleteFile(*(Directory / Entry.FileName));
+		TotalSize -= Entry.Size;
+		Entries.Remove(Entry.Key);
+	}
+}
+
+FString FContentCache::GetIndexFileName() const
+{
+	return Directory / CACHE_INDEX;
+}
@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "ContentCache.generated.h"
+
+USTRUCT()
+struct FContentCacheEntry
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		FString Key;
+	UPROPERTY()
+		FString FileName;
+	UPROPERTY()
+		int64 Size = 0;
+	//last hit or store time, FDateTime ticks
+	UPROPERTY()
+		int64 LastAccess = 0;
+};
+
+USTRUCT()
+struct FContentCacheIndex
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		TArray<FContentCacheEntry> Entries;
+};
+
+/**
+ * content addressed local store, keyed by content hash or (host, ETag, size).
+ * a task whose content is already in the store is satisfied by a hard link or a file copy without any GET.
+ * least recently used entries are evicted when the store grows over MaxSize.
+ * all public functions are thread safe.
+ */
+class FContentCache
+{
+public:
+
+	FContentCache(const FString& InDirectory, int64 InMaxSize);
+
+	~FContentCache();
+
+	/*build the key of a content
+	 @return empty string if the content cannot be identified (no ETag, weak ETag or unknown size)
+	*/
+	static FString MakeKey(const FString& InUrl, const FString& InETag, int64 InSize);
+
+	void SetMaxSize(int64 InMaxSize);
+
+	bool Contains(const FString& InKey) const;
+
+	//count a lookup that did not reach Materialize
+	void AddMiss();
+
+	/*link or copy a cached content to InDestFile, counts a hit or a miss
+	 @return true if InDestFile holds the content
+	*/
+	bool Materialize(const FString& InKey, const FString& InDestFile);
+
+	//link or copy InSourceFile into the store, ignored if the key exists
+	bool Store(const FString& InKey, const FString& InSourceFile);
+
+	int32 GetHitCount() const;
+
+	int32 GetMissCount() const;
+
+	int64 GetTotalSize() const;
+
+protected:
+
+	//create a hard link, fall back to a file copy if links are not supported
+	static bool LinkOrCopy(const FString& InDestFile, const FString& InSourceFile);
+
+	void LoadIndex();
+
+	void SaveIndex() const;
+
+	//remove least recently used entries, caller must hold Lock
+	void Evict();
+
+	FString GetIndexFileName() const;
+
+	FString Directory;
+
+	int64 MaxSize = 0;
+
+	int64 TotalSize = 0;
+
+	TMap<FString, FContentCacheEntry> Entries;
+
+	int32 HitCount = 0;
+
+	int32 MissCount = 0;
+
+	mutable FCriticalSection Lock;
+};
+
+typedef TSharedPtr<FContentCache, ESPMode::ThreadSafe> FContentCachePtr;
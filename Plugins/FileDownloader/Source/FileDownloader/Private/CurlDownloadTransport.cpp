@@ -0,0 +1,420 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "CurlDownloadTransport.h"
+
+#if WITH_DOWNLOADER_CURL
+
+#include "FileDownloader.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/Event.h"
+#include "Misc/ScopeLock.h"
+#include "Async/TaskGraphInterfaces.h"
+
+#if PLATFORM_WINDOWS
+#include "Windows/WindowsHWrapper.h"
+#include "Windows/AllowWindowsPlatformTypes.h"
+#endif
+THIRD_PARTY_INCLUDES_START
+#include "curl/curl.h"
+THIRD_PARTY_INCLUDES_END
+#if PLATFORM_WINDOWS
+#include "Windows/HideWindowsPlatformTypes.h"
+#endif
+
+struct FCurlTransfer
+{
+	uint64 Handle = 0;
+
+	CURL* Easy = nullptr;
+
+	curl_slist* HeaderList = nullptr;
+
+	FDownloadRequest Request;
+
+	FOnDownloadRequestComplete OnComplete;
+
+	FDownloadResponsePtr Response;
+
+	double StartTime = 0.0;
+};
+
+static size_t OnCurlWrite(char* InData, size_t InSize, size_t InCount, void* InUserData)
+{
+	FCurlTransfer* Transfer = (FCurlTransfer*)InUserData;
+	const size_t Size = InSize * InCount;
+	TArray<uint8>& Content = Transfer->Response->Content;
+
+	//an answer larger than a TArray can hold fails the transfer
+	if ((int64)Content.Num() + (int64)Size > MAX_int32)
+	{
+		return 0;
+	}
+
+	if (Content.Num() == 0 && Transfer->Request.ExpectedSize > 0)
+	{
+		Content.Reserve((int32)FMath::Min<int64>(Transfer->Request.ExpectedSize, MAX_int32));
+	}
+
+	Content.Append((const uint8*)InData, (int32)Size);
+	return Size;
+}
+
+static size_t OnCurlHeader(char* InData, size_t InSize, size_t InCount, void* InUserData)
+{
+	FCurlTransfer* Transfer = (FCurlTransfer*)InUserData;
+	const size_t Size = InSize * InCount;
+	const FUTF8ToTCHAR Converted((const ANSICHAR*)InData, (int32)Size);
+	const FString Line = FString(Converted.Length(), Converted.Get()).TrimStartAndEnd();
+
+	//headers of a redirect or an interim response are replaced by the final ones
+	if (Line.StartsWith(TEXT("HTTP/")))
+	{
+		Transfer->Response->Headers.Reset();
+		return Size;
+	}
+
+	FString Name;
+	FString Value;
+	if (Line.Split(TEXT(":"), &Name, &Value))
+	{
+		Transfer->Response->Headers.Emplace(Name.TrimStartAndEnd(), Value.TrimStartAndEnd());
+	}
+	return Size;
+}
+
+FCurlDownloadTransport::FCurlDownloadTransport(const FCurlTransportSettings& InSettings)
+	: Settings(InSettings)
+{
+	//reference counted by libcurl, the http module may have initialized it already
+	if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("curl_global_init failed"));
+		return;
+	}
+
+	Multi = curl_multi_init();
+	if (Multi == nullptr)
+	{
+		return;
+	}
+
+#ifdef CURLPIPE_MULTIPLEX
+	curl_multi_setopt(Multi, CURLMOPT_PIPELINING, Settings.bHttp2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+#endif
+	curl_multi_setopt(Multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)FMath::Max(1, Settings.MaxConnectionsPerHost));
+	curl_multi_setopt(Multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)FMath::Max(1, Settings.MaxTotalConnections));
+	//idle connections kept for reuse by later chunks & tasks
+	curl_multi_setopt(Multi, CURLMOPT_MAXCONNECTS, (long)FMath::Max(1, Settings.MaxTotalConnections));
+
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	Thread = FRunnableThread::Create(this, TEXT("FileDownloaderCurl"), 0, TPri_AboveNormal);
+}
+
+FCurlDownloadTransport::~FCurlDownloadTransport()
+{
+	if (Thread != nullptr)
+	{
+		Thread->Kill(true);
+		delete Thread;
+		Thread = nullptr;
+	}
+
+	for (TPair<uint64, FCurlTransfer*>& It : Active)
+	{
+		DestroyTransfer(It.Value);
+	}
+	Active.Empty();
+
+	for (FCurlTransfer* Transfer : Pending)
+	{
+		delete Transfer;
+	}
+	Pending.Empty();
+
+	if (WakeEvent != nullptr)
+	{
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+		WakeEvent = nullptr;
+	}
+
+	if (Multi != nullptr)
+	{
+		curl_multi_cleanup(Multi);
+		Multi = nullptr;
+		curl_global_cleanup();
+	}
+}
+
+bool FCurlDownloadTransport::IsValid() const
+{
+	return Multi != nullptr && Thread != nullptr;
+}
+
+uint64 FCurlDownloadTransport::Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete)
+{
+	FCurlTransfer* Transfer = new FCurlTransfer();
+	Transfer->Handle = NewHandle();
+	Transfer->Request = InRequest;
+	Transfer->OnComplete = MoveTemp(InOnComplete);
+	Transfer->StartTime = FPlatformTime::Seconds();
+
+	const uint64 Handle = Transfer->Handle;
+	{
+		FScopeLock ScopeLock(&Lock);
+		Pending.Add(Transfer);
+	}
+	WakeEvent->Trigger();
+	return Handle;
+}
+
+void FCurlDownloadTransport::Cancel(uint64 InHandle)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		const int32 Index = Pending.IndexOfByPredicate([InHandle](const FCurlTransfer* InTransfer)
+		{
+			return InTransfer->Handle == InHandle;
+		});
+
+		if (Index != INDEX_NONE)
+		{
+			delete Pending[Index];
+			Pending.RemoveAtSwap(Index);
+			return;
+		}
+
+		Cancelled.Add(InHandle);
+	}
+	WakeEvent->Trigger();
+}
+
+uint32 FCurlDownloadTransport::Run()
+{
+	while (bStopping == false)
+	{
+		TArray<FCurlTransfer*> NewTransfers;
+		TArray<uint64> CancelledHandles;
+		{
+			FScopeLock ScopeLock(&Lock);
+			NewTransfers = MoveTemp(Pending);
+			CancelledHandles = MoveTemp(Cancelled);
+		}
+
+		for (uint64 Handle : CancelledHandles)
+		{
+			FCurlTransfer* Transfer = nullptr;
+			if (Active.RemoveAndCopyValue(Handle, Transfer))
+			{
+				DestroyTransfer(Transfer);
+			}
+		}
+
+		for (FCurlTransfer* Transfer : NewTransfers)
+		{
+			StartTransfer(Transfer);
+		}
+
+		if (Active.Num() < 1)
+		{
+			WakeEvent->Wait(100);
+			continue;
+		}
+
+		int32 Running = 0;
+		curl_multi_perform(Multi, &Running);
+
+		int32 Remaining = 0;
+		while (CURLMsg* Message = curl_multi_info_read(Multi, &Remaining))
+		{
+			if (Message->msg != CURLMSG_DONE)
+			{
+				continue;
+			}
+
+			FCurlTransfer* Transfer = nullptr;
+			curl_easy_getinfo(Message->easy_handle, CURLINFO_PRIVATE, (char**)&Transfer);
+			if (Transfer != nullptr)
+			{
+				FinishTransfer(Transfer, (int32)Message->data.result);
+			}
+		}
+
+		//new requests wake the thread at the latest after this wait
+		int32 Fds = 0;
+		curl_multi_wait(Multi, nullptr, 0, 10, &Fds);
+	}
+
+	return 0;
+}
+
+void FCurlDownloadTransport::Stop()
+{
+	bStopping = true;
+	if (WakeEvent != nullptr)
+	{
+		WakeEvent->Trigger();
+	}
+}
+
+void FCurlDownloadTransport::StartTransfer(FCurlTransfer* InTransfer)
+{
+	CURL* Easy = curl_easy_init();
+	if (Easy == nullptr)
+	{
+		InTransfer->Easy = nullptr;
+		FinishTransfer(InTransfer, (int32)CURLE_FAILED_INIT);
+		return;
+	}
+
+	InTransfer->Easy = Easy;
+	InTransfer->Response = MakeShareable(new FDownloadResponse());
+
+	const FDownloadRequest& Request = InTransfer->Request;
+	curl_easy_setopt(Easy, CURLOPT_URL, TCHAR_TO_UTF8(*Request.Url));
+	curl_easy_setopt(Easy, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(Easy, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(Easy, CURLOPT_MAXREDIRS, 5L);
+	curl_easy_setopt(Easy, CURLOPT_CONNECTTIMEOUT, (long)Settings.ConnectTimeoutSeconds);
+	curl_easy_setopt(Easy, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(Easy, CURLOPT_LOW_SPEED_TIME, (long)Settings.StallTimeoutSeconds);
+	curl_easy_setopt(Easy, CURLOPT_BUFFERSIZE, (long)FMath::Clamp(Settings.ReceiveBufferSize, 1024, 512 * 1024));
+	//idle pooled connections survive NAT & load balancer timeouts between chunks
+	curl_easy_setopt(Easy, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(Easy, CURLOPT_DNS_CACHE_TIMEOUT, 300L);
+
+	if (Request.Verb == TEXT("HEAD"))
+	{
+		curl_easy_setopt(Easy, CURLOPT_NOBODY, 1L);
+	}
+	else if (Request.Verb != TEXT("GET"))
+	{
+		curl_easy_setopt(Easy, CURLOPT_CUSTOMREQUEST, TCHAR_TO_UTF8(*Request.Verb));
+	}
+
+#ifdef CURL_HTTP_VERSION_2TLS
+	if (Settings.bHttp2)
+	{
+		curl_easy_setopt(Easy, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+		//wait for a connection that can multiplex instead of opening a new one
+		curl_easy_setopt(Easy, CURLOPT_PIPEWAIT, 1L);
+	}
+#endif
+
+	if (Settings.CABundlePath.IsEmpty() == false)
+	{
+		curl_easy_setopt(Easy, CURLOPT_CAINFO, TCHAR_TO_UTF8(*Settings.CABundlePath));
+	}
+
+	for (const TPair<FString, FString>& Header : Request.Headers)
+	{
+		InTransfer->HeaderList = curl_slist_append(InTransfer->HeaderList, TCHAR_TO_UTF8(*(Header.Key + TEXT(": ") + Header.Value)));
+	}
+	if (InTransfer->HeaderList != nullptr)
+	{
+		curl_easy_setopt(Easy, CURLOPT_HTTPHEADER, InTransfer->HeaderList);
+	}
+
+	curl_easy_setopt(Easy, CURLOPT_WRITEFUNCTION, &OnCurlWrite);
+	curl_easy_setopt(Easy, CURLOPT_WRITEDATA, InTransfer);
+	curl_easy_setopt(Easy, CURLOPT_HEADERFUNCTION, &OnCurlHeader);
+	curl_easy_setopt(Easy, CURLOPT_HEADERDATA, InTransfer);
+	curl_easy_setopt(Easy, CURLOPT_PRIVATE, InTransfer);
+
+	if (curl_multi_add_handle(Multi, Easy) != CURLM_OK)
+	{
+		FinishTransfer(InTransfer, (int32)CURLE_FAILED_INIT);
+		return;
+	}
+
+	Active.Add(InTransfer->Handle, InTransfer);
+}
+
+void FCurlDownloadTransport::FinishTransfer(FCurlTransfer* InTransfer, int32 InResult)
+{
+	FDownloadResponsePtr Response = InTransfer->Response;
+	bool bSucceeded = InResult == (int32)CURLE_OK && Response.IsValid();
+	double SetupSeconds = 0.0;
+	int32 NewConnections = -1;
+	if (InTransfer->Easy != nullptr)
+	{
+		//connect times are not reliably 0 for a pooled connection, the count of new connections tells reuse
+		long NumConnects = 0;
+		curl_easy_getinfo(InTransfer->Easy, CURLINFO_NUM_CONNECTS, &NumConnects);
+		NewConnections = (int32)NumConnects;
+		if (NumConnects > 0)
+		{
+			//times from the start of the transfer
+			double ConnectTime = 0.0;
+			double TlsTime = 0.0;
+			curl_easy_getinfo(InTransfer->Easy, CURLINFO_CONNECT_TIME, &ConnectTime);
+			curl_easy_getinfo(InTransfer->Easy, CURLINFO_APPCONNECT_TIME, &TlsTime);
+			SetupSeconds = FMath::Max(ConnectTime, TlsTime);
+		}
+	}
+
+	if (bSucceeded)
+	{
+		long ResponseCode = 0;
+		curl_easy_getinfo(InTransfer->Easy, CURLINFO_RESPONSE_CODE, &ResponseCode);
+		Response->ResponseCode = (int32)ResponseCode;
+		Response->SetupSeconds = SetupSeconds;
+		Response->NewConnections = NewConnections;
+	}
+	else if (InTransfer->Easy != nullptr)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, curl error %d : %s"), *InTransfer->Request.Url, InResult, UTF8_TO_TCHAR(curl_easy_strerror((CURLcode)InResult)));
+	}
+
+	AddStats(Response.IsValid() ? Response->Content.Num() : 0, FPlatformTime::Seconds() - InTransfer->StartTime, SetupSeconds, NewConnections, bSucceeded);
+
+	FOnDownloadRequestComplete OnComplete = MoveTemp(InTransfer->OnComplete);
+	const bool bGameThread = InTransfer->Request.bCompleteOnGameThread;
+	const uint64 Handle = InTransfer->Handle;
+	Active.Remove(Handle);
+	DestroyTransfer(InTransfer);
+
+	//cancelled while finishing
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (Cancelled.Remove(Handle) > 0)
+		{
+			return;
+		}
+	}
+
+	//a failed transfer has no response, like a failed FHttpModule request
+	if (bSucceeded == false)
+	{
+		Response = nullptr;
+	}
+
+	if (bGameThread)
+	{
+		FFunctionGraphTask::CreateAndDispatchWhenReady([OnComplete, Response, bSucceeded]() {
+			OnComplete(Response, bSucceeded);
+		}, TStatId(), nullptr, ENamedThreads::GameThread);
+	}
+	else
+	{
+		OnComplete(Response, bSucceeded);
+	}
+}
+
+void FCurlDownloadTransport::DestroyTransfer(FCurlTransfer* InTransfer)
+{
+	if (InTransfer->Easy != nullptr)
+	{
+		curl_multi_remove_handle(Multi, InTransfer->Easy);
+		curl_easy_cleanup(InTransfer->Easy);
+	}
+
+	if (InTransfer->HeaderList != nullptr)
+	{
+		curl_slist_free_all(InTransfer->HeaderList);
+	}
+
+	delete InTransfer;
+}
+
+#endif
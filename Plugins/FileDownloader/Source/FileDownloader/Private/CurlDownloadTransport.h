@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTransport.h"
+
+#if WITH_DOWNLOADER_CURL
+
+#include "HAL/Runnable.h"
+
+class FRunnableThread;
+class FEvent;
+struct FCurlTransfer;
+
+/**
+ * drives a libcurl multi handle on its own thread.
+ * connections are pooled by the multi handle and requests to the same HTTP/2 host share one connection,
+ * response data is written into a buffer sized from the request once and handed to the task without copy.
+ */
+class FCurlDownloadTransport : public IDownloadTransport, public FRunnable
+{
+public:
+
+	FCurlDownloadTransport(const FCurlTransportSettings& InSettings);
+
+	virtual ~FCurlDownloadTransport();
+
+	//false if libcurl or the thread could not be initialized
+	bool IsValid() const;
+
+	virtual uint64 Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete) override;
+
+	virtual void Cancel(uint64 InHandle) override;
+
+	virtual const TCHAR* GetName() const override
+	{
+		return TEXT("CurlMulti");
+	}
+
+	//FRunnable
+	virtual uint32 Run() override;
+
+	virtual void Stop() override;
+
+protected:
+
+	//curl thread only
+	void StartTransfer(FCurlTransfer* InTransfer);
+
+	void FinishTransfer(FCurlTransfer* InTransfer, int32 InResult);
+
+	void DestroyTransfer(FCurlTransfer* InTransfer);
+
+	FCurlTransportSettings Settings;
+
+	void* Multi = nullptr;
+
+	FRunnableThread* Thread = nullptr;
+
+	FEvent* WakeEvent = nullptr;
+
+	std::atomic<bool> bStopping { false };
+
+	FCriticalSection Lock;
+
+	//sent but not added to the multi handle yet
+	TArray<FCurlTransfer*> Pending;
+
+	//handles to remove from the multi handle
+	TArray<uint64> Cancelled;
+
+	//added to the multi handle, curl thread only
+	TMap<uint64, FCurlTransfer*> Active;
+};
+
+#endif
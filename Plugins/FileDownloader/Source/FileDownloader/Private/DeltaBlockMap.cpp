@@ -0,0 +1,272 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DeltaBlockMap.h"
+#include "FileDownloader.h"
+#include "Misc/SecureHash.h"
+#include "Misc/FileHelper.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Templates/UniquePtr.h"
+
+static const uint32 BLOCK_MAP_MAGIC = 0x4B424446;	//"FDBK"
+static const uint32 BLOCK_MAP_VERSION = 1;
+
+//bytes read from the local file at a time when matching
+static const int64 MATCH_READ_SIZE = 4 * 1024 * 1024;
+
+bool FDeltaBlockMap::Load(const TArray<uint8>& InData)
+{
+	FMemoryReader Reader(InData);
+	Serialize(Reader);
+
+	if (Reader.IsError() || BlockSize < 1 || FileSize < 0 || Blocks.Num() != (FileSize + BlockSize - 1) / BlockSize)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Invalid delta block map"));
+		Blocks.Reset();
+		return false;
+	}
+
+	return true;
+}
+
+bool FDeltaBlockMap::BuildFromFile(const FString& InFileName, int32 InBlockSize)
+{
+	TUniquePtr<IFileHandle> File(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*InFileName));
+	if (File.IsValid() == false || InBlockSize < 1)
+	{
+		return false;
+	}
+
+	BlockSize = InBlockSize;
+	FileSize = File->Size();
+	Blocks.Reset();
+	Blocks.SetNum((FileSize + BlockSize - 1) / BlockSize);
+
+	TArray<uint8> Buffer;
+	Buffer.SetNumUninitialized(BlockSize);
+	for (int32 i = 0; i < Blocks.Num(); ++i)
+	{
+		const int32 Length = GetBlockLength(i);
+		if (File->Read(Buffer.GetData(), Length) == false)
+		{
+			Blocks.Reset();
+			return false;
+		}
+
+		SetBlock(i, Buffer.GetData(), Length);
+	}
+
+	return true;
+}
+
+bool FDeltaBlockMap::BuildFromData(const TArray<uint8>& InData, int32 InBlockSize)
+{
+	if (InBlockSize < 1)
+	{
+		return false;
+	}
+
+	BlockSize = InBlockSize;
+	FileSize = InData.Num();
+	Blocks.Reset();
+	Blocks.SetNum((FileSize + BlockSize - 1) / BlockSize);
+	for (int32 i = 0; i < Blocks.Num(); ++i)
+	{
+		SetBlock(i, InData.GetData() + (int64)i * BlockSize, GetBlockLength(i));
+	}
+
+	return true;
+}
+
+void FDeltaBlockMap::Save(TArray<uint8>& OutData) const
+{
+	OutData.Reset();
+	FMemoryWriter Writer(OutData);
+	const_cast<FDeltaBlockMap*>(this)->Serialize(Writer);
+}
+
+bool FDeltaBlockMap::SaveToFile(const FString& InFileName) const
+{
+	TArray<uint8> Data;
+	Save(Data);
+
+	return FFileHelper::SaveArrayToFile(Data, *InFileName);
+}
+
+int64 FDeltaBlockMap::MatchFile(const FString& InLocalFile, TArray<bool>& OutPresent, TFunctionRef<bool(int32 InBlockIndex, const uint8* InData, int32 InSize)> InWriteBlock) const
+{
+	OutPresent.Init(false, Blocks.Num());
+
+	TUniquePtr<IFileHandle> File(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*InLocalFile));
+	if (File.IsValid() == false || BlockSize < 1)
+	{
+		return 0;
+	}
+
+	//only full blocks are matched, the short last block is always downloaded
+	TMultiMap<uint32, int32> RollingLookup;
+	for (int32 i = 0; i < Blocks.Num(); ++i)
+	{
+		if (GetBlockLength(i) == BlockSize)
+		{
+			RollingLookup.Add(Blocks[i].Rolling, i);
+		}
+	}
+
+	const int64 LocalSize = File->Size();
+	if (LocalSize < BlockSize || RollingLookup.Num() < 1)
+	{
+		return 0;
+	}
+
+	const int64 ReadSize = FMath::Max<int64>(MATCH_READ_SIZE, BlockSize + 1);
+	TArray<uint8> Buffer;
+	int64 BufferStart = 0;
+	int64 Pos = 0;
+	int64 MatchedBytes = 0;
+	uint32 A = 0;
+	uint32 B = 0;
+	bool bRollingValid = false;
+	TArray<int32> Candidates;
+
+	while (Pos + BlockSize <= LocalSize)
+	{
+		//keep the window and the next byte in buffer
+		const int64 NeedEnd = FMath::Min<int64>(Pos + BlockSize + 1, LocalSize);
+		if (NeedEnd > BufferStart + Buffer.Num())
+		{
+			int64 Keep = BufferStart + Buffer.Num() - Pos;
+			if (Keep > 0)
+			{
+				FMemory::Memmove(Buffer.GetData(), Buffer.GetData() + (Pos - BufferStart), Keep);
+			}
+			else
+			{
+				Keep = 0;
+				File->Seek(Pos);
+			}
+
+			const int64 ToRead = FMath::Min<int64>(ReadSize, LocalSize - Pos) - Keep;
+			Buffer.SetNumUninitialized(Keep + ToRead, false);
+			BufferStart = Pos;
+			if (ToRead > 0 && File->Read(Buffer.GetData() + Keep, ToRead) == false)
+			{
+				break;
+			}
+		}
+
+		const uint8* Window = Buffer.GetData() + (Pos - BufferStart);
+		if (bRollingValid == false)
+		{
+			const uint32 Rolling = ComputeRolling(Window, BlockSize);
+			A = Rolling & 0xffff;
+			B = Rolling >> 16;
+			bRollingValid = true;
+		}
+
+		Candidates.Reset();
+		RollingLookup.MultiFind(A | (B << 16), Candidates);
+
+		bool bFound = false;
+		if (Candidates.Num() > 0)
+		{
+			uint8 Strong[16];
+			FMD5 Md5;
+			Md5.Update(Window, BlockSize);
+			Md5.Final(Strong);
+
+			//the same data may be used by several blocks, fill all of them
+			for (int32 BlockIndex : Candidates)
+			{
+				if (OutPresent[BlockIndex] == false && FMemory::Memcmp(Strong, Blocks[BlockIndex].Strong, 16) == 0)
+				{
+					if (InWriteBlock(BlockIndex, Window, BlockSize) == false)
+					{
+						return MatchedBytes;
+					}
+					OutPresent[BlockIndex] = true;
+					MatchedBytes += BlockSize;
+					bFound = true;
+				}
+			}
+		}
+
+		if (bFound)
+		{
+			Pos += BlockSize;
+			bRollingValid = false;
+			continue;
+		}
+
+		//roll the window by one byte
+		if (Pos + BlockSize < LocalSize)
+		{
+			const uint32 Out = Window[0];
+			const uint32 In = Window[BlockSize];
+			A = (A - Out + In) & 0xffff;
+			B = (B - (uint32)BlockSize * Out + A) & 0xffff;
+		}
+		++Pos;
+	}
+
+	return MatchedBytes;
+}
+
+int32 FDeltaBlockMap::GetBlockLength(int32 InBlockIndex) const
+{
+	const int64 Start = (int64)InBlockIndex * BlockSize;
+	return (int32)FMath::Min<int64>(BlockSize, FileSize - Start);
+}
+
+uint32 FDeltaBlockMap::ComputeRolling(const uint8* InData, int32 InSize)
+{
+	uint32 A = 0;
+	uint32 B = 0;
+	for (int32 i = 0; i < InSize; ++i)
+	{
+		A += InData[i];
+		B += (uint32)(InSize - i) * InData[i];
+	}
+
+	return (A & 0xffff) | ((B & 0xffff) << 16);
+}
+
+void FDeltaBlockMap::SetBlock(int32 InBlockIndex, const uint8* InData, int32 InSize)
+{
+	Blocks[InBlockIndex].Rolling = ComputeRolling(InData, InSize);
+	FMD5 Md5;
+	Md5.Update(InData, InSize);
+	Md5.Final(Blocks[InBlockIndex].Strong);
+}
+
+void FDeltaBlockMap::Serialize(FArchive& Ar)
+{
+	uint32 Magic = BLOCK_MAP_MAGIC;
+	uint32 Version = BLOCK_MAP_VERSION;
+	int32 BlockCount = Blocks.Num();
+
+	Ar << Magic << Version << BlockSize << FileSize << BlockCount;
+	if (Magic != BLOCK_MAP_MAGIC || Version != BLOCK_MAP_VERSION || BlockCount < 0)
+	{
+		Ar.SetError();
+		return;
+	}
+
+	if (Ar.IsLoading())
+	{
+		//do not trust the count before checking it against the data size
+		if (Ar.TotalSize() - Ar.Tell() < (int64)BlockCount * 20)
+		{
+			Ar.SetError();
+			return;
+		}
+		Blocks.SetNum(BlockCount);
+	}
+
+	for (FBlock& Block : Blocks)
+	{
+		Ar << Block.Rolling;
+		Ar.Serialize(Block.Strong, 16);
+	}
+}
@@ -0,0 +1,76 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * block checksum list of a remote file, published next to the file (zsync like).
+ * every block has a weak rolling checksum and a strong MD5 hash, a local file is scanned with the rolling
+ * checksum at every byte offset so blocks are found even if data was inserted or removed before them.
+ *
+ * binary layout (little endian):
+ * uint32 Magic, uint32 Version, int32 BlockSize, int64 FileSize, int32 BlockCount, BlockCount * (uint32 Rolling, uint8[16] MD5)
+ */
+class FILEDOWNLOADER_API FDeltaBlockMap
+{
+public:
+
+	struct FBlock
+	{
+		uint32 Rolling = 0;
+		uint8 Strong[16];
+	};
+
+	//parse a downloaded block map
+	bool Load(const TArray<uint8>& InData);
+
+	//build the block map of a local file, used to publish a new version
+	bool BuildFromFile(const FString& InFileName, int32 InBlockSize);
+
+	//block map of content in memory, a stand-in server publishes it without a file
+	bool BuildFromData(const TArray<uint8>& InData, int32 InBlockSize);
+
+	void Save(TArray<uint8>& OutData) const;
+
+	bool SaveToFile(const FString& InFileName) const;
+
+	/*scan a local file for blocks of the remote file, runs on a worker thread
+	 @Param InWriteBlock called for every found block with its index & data, return false to abort
+	 @Param OutPresent flag of every block, true if found in the local file
+	 @return bytes found in the local file
+	*/
+	int64 MatchFile(const FString& InLocalFile, TArray<bool>& OutPresent, TFunctionRef<bool(int32 InBlockIndex, const uint8* InData, int32 InSize)> InWriteBlock) const;
+
+	int32 GetBlockSize() const
+	{
+		return BlockSize;
+	}
+
+	int64 GetFileSize() const
+	{
+		return FileSize;
+	}
+
+	int32 GetBlockCount() const
+	{
+		return Blocks.Num();
+	}
+
+	int32 GetBlockLength(int32 InBlockIndex) const;
+
+	static uint32 ComputeRolling(const uint8* InData, int32 InSize);
+
+protected:
+
+	//checksums of a block, Blocks has its final size
+	void SetBlock(int32 InBlockIndex, const uint8* InData, int32 InSize);
+
+	void Serialize(FArchive& Ar);
+
+	int32 BlockSize = 0;
+
+	int64 FileSize = 0;
+
+	TArray<FBlock> Blocks;
+};
@@ -0,0 +1,193 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DeltaDownloadTask.h"
+#include "DeltaBlockMap.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Templates/UniquePtr.h"
+
+DeltaDownloadTask::DeltaDownloadTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName, const FString& InBlockMapSuffix)
+	: DownloadTask(InUrl, InDirectory, InFileName)
+	, BlockMapSuffix(InBlockMapSuffix)
+{
+}
+
+int64 DeltaDownloadTask::GetDeltaSavedSize() const
+{
+	return SavedSize;
+}
+
+void DeltaDownloadTask::StartDownloadChunks(bool bResume)
+{
+	bDeltaMode = false;
+	SavedSize = 0;
+	MissingRanges.Reset();
+	NextRange = 0;
+
+	//only a changed remote file with an old local version can be updated by blocks
+	if (bResume || BlockMapSuffix.IsEmpty() || FPlatformFileManager::Get().GetPlatformFile().FileSize(*GetFullFileName()) < 1)
+	{
+		DownloadTask::StartDownloadChunks(bResume);
+		return;
+	}
+
+	//the block map is the request in flight, Stop cancels it like a chunk
+	FDownloadRequest BlockMapRequest;
+	BlockMapRequest.Url = EncodedUrl + BlockMapSuffix;
+	SendRequest(BlockMapRequest, [this](FDownloadResponsePtr InResponse, bool bSucceeded)
+	{
+		this->OnGetBlockMapCompleted(InResponse, bSucceeded);
+	});
+}
+
+void DeltaDownloadTask::OnGetBlockMapCompleted(FDownloadResponsePtr InResponse, bool bWasSuccessful)
+{
+	if (GetState() != ETaskState::DOWNLOADING || GetNeedStop())
+	{
+		return;
+	}
+
+	TSharedPtr<FDeltaBlockMap, ESPMode::ThreadSafe> BlockMap = MakeShareable(new FDeltaBlockMap());
+	if (bWasSuccessful == false || InResponse.IsValid() == false || EHttpResponseCodes::IsOk(InResponse->GetResponseCode()) == false
+		|| BlockMap->Load(InResponse->GetContent()) == false || BlockMap->GetFileSize() != GetTotalSize())
+	{
+		UE_LOG(LogFileDownloader, Log, TEXT("%s, no usable block map, download the whole file"), *GetFileName());
+		DownloadTask::StartDownloadChunks(false);
+		return;
+	}
+
+	ProcessRequestResult(InResponse->GetContent().Num(), true);
+
+	//scan the old file and copy found blocks into the temp file on a worker thread
+	const FString OldFileName = GetFullFileName();
+	const FString TempFileName = GetTempFileName();
+	RunOnWorker([this, BlockMap, OldFileName, TempFileName]()
+	{
+		TArray<bool> Present;
+		int64 MatchedSize = 0;
+		bool bSucceeded = false;
+
+		TUniquePtr<IFileHandle> TempFile(FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*TempFileName, false));
+		if (TempFile.IsValid())
+		{
+			bSucceeded = true;
+			MatchedSize = BlockMap->MatchFile(OldFileName, Present, [&TempFile, &bSucceeded, &BlockMap](int32 InBlockIndex, const uint8* InData, int32 InSize)
+			{
+				bSucceeded = TempFile->Seek((int64)InBlockIndex * BlockMap->GetBlockSize()) && TempFile->Write(InData, InSize);
+				return bSucceeded;
+			});
+		}
+		TempFile.Reset();
+
+		this->RunTaskStep([this, BlockMap, Present, MatchedSize, bSucceeded]() {
+			this->OnMatchCompleted(*BlockMap, Present, MatchedSize, bSucceeded);
+		});
+	});
+}
+
+void DeltaDownloadTask::OnMatchCompleted(const FDeltaBlockMap& InBlockMap, const TArray<bool>& InPresent, int64 InMatchedSize, bool bSucceeded)
+{
+	if (GetState() != ETaskState::DOWNLOADING || GetNeedStop())
+	{
+		return;
+	}
+
+	if (bSucceeded == false || InPresent.Num() != InBlockMap.GetBlockCount())
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, matching old file failed, download the whole file"), *GetFileName());
+		DownloadTask::StartDownloadChunks(false);
+		return;
+	}
+
+	//merge adjacent missing blocks into requests of at most ChunkSize
+	for (int32 i = 0; i < InPresent.Num(); ++i)
+	{
+		if (InPresent[i])
+		{
+			continue;
+		}
+
+		const int64 Start = (int64)i * InBlockMap.GetBlockSize();
+		const int32 Length = InBlockMap.GetBlockLength(i);
+		if (MissingRanges.Num() > 0)
+		{
+			TPair<int64, int32>& Last = MissingRanges.Last();
+			if (Last.Key + Last.Value == Start && Last.Value + Length <= ChunkSize)
+			{
+				Last.Value += Length;
+				continue;
+			}
+		}
+		MissingRanges.Emplace(Start, Length);
+	}
+
+	if (OpenSink(true) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, create temp file error !"), *GetFileName());
+		TaskState = ETaskState::ERROR;
+		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+		return;
+	}
+
+	bDeltaMode = true;
+	SavedSize = InMatchedSize;
+	SetCurrentSize(InMatchedSize);
+	UE_LOG(LogFileDownloader, Log, TEXT("%s, delta update reuses %lld of %lld bytes, %d ranges to download"), *GetFileName(), SavedSize, GetTotalSize(), MissingRanges.Num());
+
+	if (MissingRanges.Num() < 1)
+	{
+		OnTaskCompleted();
+		return;
+	}
+
+	StartChunk();
+}
+
+void DeltaDownloadTask::StartChunk()
+{
+	if (bDeltaMode == false)
+	{
+		DownloadTask::StartChunk();
+		return;
+	}
+
+	//every range is written & bytes are still missing
+	if (NextRange >= MissingRanges.Num())
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, delta ranges finished with %lld of %lld bytes"), *GetFileName(), GetCurrentSize(), GetTotalSize());
+		TaskState = ETaskState::ERROR;
+		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+		return;
+	}
+
+	const TPair<int64, int32>& Range = MissingRanges[NextRange];
+	if (AcquireBudget(Range.Value) == false)
+	{
+		return;
+	}
+
+	//NextRange moves on when the chunk is written, a retry asks for the same range again
+	ChunkOffset = Range.Key;
+	SendRangeRequest(FString::Printf(TEXT("bytes=%lld-%lld"), Range.Key, Range.Key + Range.Value - 1), Range.Value);
+}
+
+void DeltaDownloadTask::OnWriteChunkEnd(int32 DataSize)
+{
+	if (bDeltaMode && DataSize > 0)
+	{
+		++NextRange;
+	}
+
+	DownloadTask::OnWriteChunkEnd(DataSize);
+}
+
+void DeltaDownloadTask::OnTaskCompleted()
+{
+	//the new ETag is saved only now, an interrupted delta update matches the old file again on resume
+	if (bDeltaMode)
+	{
+		SaveTaskToJsonFile(FString(""));
+	}
+
+	DownloadTask::OnTaskCompleted();
+}
@@ -0,0 +1,50 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTask.h"
+
+class FDeltaBlockMap;
+
+/**
+ * a download task that updates an old local file by blocks.
+ * when the remote ETag changed and an old version exists, the block map published next to the file is downloaded,
+ * the old file is scanned on a worker thread and only blocks not found are requested with RANGE.
+ */
+class DeltaDownloadTask : public DownloadTask
+{
+public:
+
+	DeltaDownloadTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName, const FString& InBlockMapSuffix);
+
+	virtual int64 GetDeltaSavedSize() const override;
+
+protected:
+
+	virtual void StartDownloadChunks(bool bResume) override;
+
+	virtual void StartChunk() override;
+
+	virtual void OnTaskCompleted() override;
+
+	virtual void OnWriteChunkEnd(int32 DataSize) override;
+
+	void OnGetBlockMapCompleted(FDownloadResponsePtr InResponse, bool bWasSuccessful);
+
+	void OnMatchCompleted(const FDeltaBlockMap& InBlockMap, const TArray<bool>& InPresent, int64 InMatchedSize, bool bSucceeded);
+
+	//appended to the source url to get the block map, e.g. ".blocks"
+	FString BlockMapSuffix;
+
+	//byte ranges not found in the old file, start & length
+	TArray<TPair<int64, int32>> MissingRanges;
+
+	//range being downloaded, or the next one to download
+	int32 NextRange = 0;
+
+	//true after the old file has been matched, chunks come from MissingRanges
+	bool bDeltaMode = false;
+
+	int64 SavedSize = 0;
+};
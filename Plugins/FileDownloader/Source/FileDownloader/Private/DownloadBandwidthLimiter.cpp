@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DownloadBandwidthLimiter.h"
+#include "Misc/ScopeLock.h"
+
+void FDownloadBandwidthLimiter::SetRate(int64 InBytesPerSecond)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		const int64 NewRate = FMath::Max<int64>(0, InBytesPerSecond);
+		if (NewRate == Rate)
+		{
+			return;
+		}
+
+		RefillLocked();
+		Rate = NewRate;
+		Tokens = FMath::Min(Tokens, (double)Rate);
+	}
+
+	Refill();
+}
+
+int64 FDownloadBandwidthLimiter::GetRate() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Rate;
+}
+
+bool FDownloadBandwidthLimiter::TryConsume(int64 InBytes)
+{
+	FScopeLock ScopeLock(&Lock);
+	if (Rate < 1)
+	{
+		return true;
+	}
+
+	RefillLocked();
+	if (Tokens <= 0.0)
+	{
+		return false;
+	}
+
+	Tokens -= InBytes;
+	return true;
+}
+
+void FDownloadBandwidthLimiter::WaitFor(const void* InOwner, TFunction<void()> InCallback)
+{
+	FScopeLock ScopeLock(&Lock);
+	Waiters.Emplace(InOwner, MoveTemp(InCallback));
+}
+
+void FDownloadBandwidthLimiter::CancelWait(const void* InOwner)
+{
+	FScopeLock ScopeLock(&Lock);
+	Waiters.RemoveAll([InOwner](const TPair<const void*, TFunction<void()>>& Waiter)
+	{
+		return Waiter.Key == InOwner;
+	});
+}
+
+void FDownloadBandwidthLimiter::Refill()
+{
+	//wake each queued waiter at most once while tokens are left, callbacks run outside the lock
+	int32 Count = 0;
+	{
+		FScopeLock ScopeLock(&Lock);
+		RefillLocked();
+		Count = Waiters.Num();
+	}
+
+	for (int32 i = 0; i < Count; ++i)
+	{
+		TFunction<void()> Callback;
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (Waiters.Num() < 1 || (Rate > 0 && Tokens <= 0.0))
+			{
+				return;
+			}
+			Callback = MoveTemp(Waiters[0].Value);
+			Waiters.RemoveAt(0);
+		}
+
+		Callback();
+	}
+}
+
+void FDownloadBandwidthLimiter::RefillLocked()
+{
+	const double Now = FPlatformTime::Seconds();
+	if (LastRefillTime > 0.0)
+	{
+		//at most one second of rate is saved up
+		Tokens = FMath::Min(Tokens + (Now - LastRefillTime) * Rate, (double)Rate);
+	}
+	else
+	{
+		Tokens = (double)Rate;
+	}
+	LastRefillTime = Now;
+}
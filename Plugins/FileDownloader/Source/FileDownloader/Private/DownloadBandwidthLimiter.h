@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+/**
+ * token bucket shared by all tasks of the process, limits bytes requested per second.
+ * a task pays for its chunk before sending the request, tokens refill with time up to one second of rate.
+ */
+class FDownloadBandwidthLimiter
+{
+public:
+
+	//bytes per second, 0 means unlimited
+	void SetRate(int64 InBytesPerSecond);
+
+	int64 GetRate() const;
+
+	/*try to pay for bytes, granted while any token is left so a chunk larger than the bucket cannot stall, the debt is paid by later refills
+	 @return true if paid
+	*/
+	bool TryConsume(int64 InBytes);
+
+	/*queue a callback fired when tokens are refilled, the callback should call TryConsume again
+	 @Param InOwner identify the waiter, used by CancelWait
+	*/
+	void WaitFor(const void* InOwner, TFunction<void()> InCallback);
+
+	void CancelWait(const void* InOwner);
+
+	//add tokens for the time passed since the last refill and wake waiters, call it regularly
+	void Refill();
+
+protected:
+
+	//call with Lock held
+	void RefillLocked();
+
+	mutable FCriticalSection Lock;
+
+	int64 Rate = 0;
+
+	double Tokens = 0.0;
+
+	double LastRefillTime = 0.0;
+
+	TArray<TPair<const void*, TFunction<void()>>> Waiters;
+};
+
+typedef TSharedPtr<FDownloadBandwidthLimiter, ESPMode::ThreadSafe> FDownloadBandwidthLimiterPtr;
@@ -0,0 +1,181 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DownloadFinalizer.h"
+#include "FileDownloader.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Async/Async.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+#if PLATFORM_LINUX || PLATFORM_MAC
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//callbacks of a batch wait for all of its jobs, a cap keeps early jobs from waiting too long
+static const int32 MAX_FINALIZE_BATCH = 256;
+
+FDownloadFinalizer& FDownloadFinalizer::Get()
+{
+	static FDownloadFinalizer Finalizer;
+	return Finalizer;
+}
+
+void FDownloadFinalizer::Enqueue(FDownloadFinalizeJob&& InJob)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		Queue.Add(MoveTemp(InJob));
+		if (bWorking)
+		{
+			return;
+		}
+		bWorking = true;
+	}
+
+	Async(EAsyncExecution::ThreadPool, [this]()
+	{
+		ProcessBatches();
+	});
+}
+
+void FDownloadFinalizer::ProcessBatches()
+{
+	for (;;)
+	{
+		TArray<FDownloadFinalizeJob> Batch;
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (Queue.Num() < 1)
+			{
+				bWorking = false;
+				return;
+			}
+
+			const int32 Count = FMath::Min(Queue.Num(), MAX_FINALIZE_BATCH);
+			Batch.Reserve(Count);
+			for (int32 i = 0; i < Count; ++i)
+			{
+				Batch.Add(MoveTemp(Queue[i]));
+			}
+			Queue.RemoveAt(0, Count, false);
+		}
+
+		TArray<bool> Results;
+		TSet<FString> Directories;
+		IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+		for (FDownloadFinalizeJob& Job : Batch)
+		{
+			bool bSucceeded = false;
+			LockJob(Job);
+			if (Job.Sink.IsValid())
+			{
+				Job.Sink->Close();
+			}
+			UnlockJob(Job);
+
+			//hashing reads the whole file, the locks are not held meanwhile so readers of the task are not blocked
+			if (Job.Verify && Job.Verify() == false)
+			{
+				PlatformFile.DeleteFile(*Job.TempFileName);
+			}
+			else
+			{
+				LockJob(Job);
+				if (Job.BeforeMove)
+				{
+					Job.BeforeMove();
+				}
+				bSucceeded = MoveToTarget(Job);
+				UnlockJob(Job);
+			}
+
+			if (bSucceeded)
+			{
+				if (Job.AfterMove)
+				{
+					Job.AfterMove();
+				}
+				for (const FString& File : Job.DeleteOnSuccess)
+				{
+					PlatformFile.DeleteFile(*File);
+				}
+				if (Job.bSyncDirectory)
+				{
+					Directories.Add(FPaths::GetPath(Job.FileName));
+				}
+			}
+			Results.Add(bSucceeded);
+		}
+
+		//one sync per directory covers all renames of the batch
+		for (const FString& Directory : Directories)
+		{
+			SyncDirectory(Directory);
+		}
+
+		for (int32 i = 0; i < Batch.Num(); ++i)
+		{
+			if (Batch[i].OnFinalized)
+			{
+				Batch[i].OnFinalized(Results[i]);
+			}
+		}
+	}
+}
+
+void FDownloadFinalizer::LockJob(const FDownloadFinalizeJob& InJob)
+{
+	for (const TSharedRef<FCriticalSection, ESPMode::ThreadSafe>& JobLock : InJob.Locks)
+	{
+		JobLock->Lock();
+	}
+}
+
+void FDownloadFinalizer::UnlockJob(const FDownloadFinalizeJob& InJob)
+{
+	for (int32 i = InJob.Locks.Num() - 1; i >= 0; --i)
+	{
+		InJob.Locks[i]->Unlock();
+	}
+}
+
+bool FDownloadFinalizer::MoveToTarget(const FDownloadFinalizeJob& InJob)
+{
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const bool bOldExist = PlatformFile.FileExists(*InJob.FileName);
+	const bool bNewExist = PlatformFile.FileExists(*InJob.TempFileName);
+
+	if (bOldExist == false && bNewExist == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, file not exist !"), *InJob.FileName);
+		return false;
+	}
+
+	//the target is complete already if only it exists
+	if (bNewExist == false)
+	{
+		return true;
+	}
+
+	if ((bOldExist && PlatformFile.DeleteFile(*InJob.FileName) == false) || PlatformFile.MoveFile(*InJob.FileName, *InJob.TempFileName) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, cannot delete old file or rename temp file !"), *InJob.FileName);
+		return false;
+	}
+
+	return true;
+}
+
+void FDownloadFinalizer::SyncDirectory(const FString& InDirectory)
+{
+#if PLATFORM_LINUX || PLATFORM_MAC
+	//a rename is durable once the directory entry is on disk
+	const int32 Descriptor = open(TCHAR_TO_UTF8(*FPaths::ConvertRelativePathToFull(InDirectory)), O_RDONLY);
+	if (Descriptor >= 0)
+	{
+		fsync(Descriptor);
+		close(Descriptor);
+	}
+#endif
+}
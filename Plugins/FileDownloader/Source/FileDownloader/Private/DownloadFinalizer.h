@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadSink.h"
+#include "HAL/CriticalSection.h"
+
+/**
+ * a downloaded file waiting to be closed & moved to its target name
+ */
+struct FDownloadFinalizeJob
+{
+	//closed before the move, may be null
+	FDownloadSinkPtr Sink;
+
+	FString TempFileName;
+
+	//replaced by the temp file, an existing file is kept if the temp file is missing
+	FString FileName;
+
+	//deleted after a successful move, e.g. the chunk map of a streaming task
+	TArray<FString> DeleteOnSuccess;
+
+	//fsync the directory after the move, so the new name survives a power loss
+	bool bSyncDirectory = false;
+
+	//held in order while the sink is closed and again while the file is moved, owned by the job as the task may be destroyed meanwhile
+	TArray<TSharedRef<FCriticalSection, ESPMode::ThreadSafe>, TInlineAllocator<2>> Locks;
+
+	//called on the worker after the close without Locks held, false deletes the temp file & fails the job
+	TFunction<bool()> Verify;
+
+	//called on the worker with Locks held, right before the move
+	TFunction<void()> BeforeMove;
+
+	//called on the worker after a successful move, e.g. to update the sidecar
+	TFunction<void()> AfterMove;
+
+	//called on the worker once the batch of the job is done, directories included
+	TFunction<void(bool bSucceeded)> OnFinalized;
+};
+
+/**
+ * closes, renames & cleans up completed files on a worker thread, jobs queued meanwhile are done as one batch.
+ * thousands of small files finishing at once would otherwise hitch the game thread with file system calls.
+ */
+class FDownloadFinalizer
+{
+public:
+
+	static FDownloadFinalizer& Get();
+
+	void Enqueue(FDownloadFinalizeJob&& InJob);
+
+protected:
+
+	//run on a worker until the queue is empty
+	void ProcessBatches();
+
+	//lock Locks in order
+	static void LockJob(const FDownloadFinalizeJob& InJob);
+
+	//unlock Locks in reverse order
+	static void UnlockJob(const FDownloadFinalizeJob& InJob);
+
+	static bool MoveToTarget(const FDownloadFinalizeJob& InJob);
+
+	static void SyncDirectory(const FString& InDirectory);
+
+	FCriticalSection Lock;
+
+	TArray<FDownloadFinalizeJob> Queue;
+
+	//a worker is processing the queue
+	bool bWorking = false;
+};
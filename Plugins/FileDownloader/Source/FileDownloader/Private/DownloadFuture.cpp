@@ -0,0 +1,143 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DownloadFuture.h"
+#include "Misc/ScopeLock.h"
+
+void FDownloadCancellationToken::Cancel()
+{
+	TArray<TFunction<void()>> ToCall;
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (bCancelled)
+		{
+			return;
+		}
+		bCancelled = true;
+		ToCall = MoveTemp(Callbacks);
+	}
+
+	for (TFunction<void()>& Callback : ToCall)
+	{
+		Callback();
+	}
+}
+
+bool FDownloadCancellationToken::IsCancelled() const
+{
+	return bCancelled;
+}
+
+void FDownloadCancellationToken::OnCancelled(TFunction<void()> InCallback)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (bCancelled == false)
+		{
+			Callbacks.Add(MoveTemp(InCallback));
+			return;
+		}
+	}
+
+	InCallback();
+}
+
+TFuture<FDownloadResult> FDownloadCompletion::MakeFuture(FOnDownloadProgress InOnProgress)
+{
+	FScopeLock ScopeLock(&Lock);
+	if (InOnProgress)
+	{
+		ProgressCallbacks.Add(MoveTemp(InOnProgress));
+	}
+
+	TPromise<FDownloadResult>& Promise = Promises.Emplace_GetRef();
+	return Promise.GetFuture();
+}
+
+void FDownloadCompletion::NotifyProgress(int64 InCurrentSize, int64 InTotalSize)
+{
+	TArray<FOnDownloadProgress> ToCall;
+	{
+		FScopeLock ScopeLock(&Lock);
+		ToCall = ProgressCallbacks;
+	}
+
+	for (const FOnDownloadProgress& Callback : ToCall)
+	{
+		Callback(InCurrentSize, InTotalSize);
+	}
+}
+
+void FDownloadCompletion::Complete(const FDownloadResult& InResult)
+{
+	//continuations of the futures run inside SetValue, call them outside the lock
+	TArray<TPromise<FDownloadResult>> ToComplete;
+	{
+		FScopeLock ScopeLock(&Lock);
+		ToComplete = MoveTemp(Promises);
+		ProgressCallbacks.Reset();
+	}
+
+	for (TPromise<FDownloadResult>& Promise : ToComplete)
+	{
+		Promise.SetValue(InResult);
+	}
+}
+
+TFuture<TArray<FDownloadResult>> WhenAllDownloads(TArray<TFuture<FDownloadResult>> InFutures)
+{
+	struct FWhenAllState
+	{
+		TPromise<TArray<FDownloadResult>> Promise;
+		TArray<FDownloadResult> Results;
+		std::atomic<int32> Remaining { 0 };
+	};
+
+	TSharedRef<FWhenAllState, ESPMode::ThreadSafe> State = MakeShared<FWhenAllState, ESPMode::ThreadSafe>();
+	TFuture<TArray<FDownloadResult>> Future = State->Promise.GetFuture();
+	if (InFutures.Num() < 1)
+	{
+		State->Promise.SetValue(TArray<FDownloadResult>());
+		return Future;
+	}
+
+	//every future writes its own slot, the last one completes the promise
+	State->Results.SetNum(InFutures.Num());
+	State->Remaining = InFutures.Num();
+	for (int32 i = 0; i < InFutures.Num(); ++i)
+	{
+		InFutures[i].Next([State, i](FDownloadResult InResult)
+		{
+			State->Results[i] = MoveTemp(InResult);
+			if (--State->Remaining == 0)
+			{
+				State->Promise.SetValue(MoveTemp(State->Results));
+			}
+		});
+	}
+
+	return Future;
+}
+
+TFuture<FDownloadResult> WhenAnyDownload(TArray<TFuture<FDownloadResult>> InFutures)
+{
+	struct FWhenAnyState
+	{
+		TPromise<FDownloadResult> Promise;
+		std::atomic<bool> bDone { false };
+	};
+
+	TSharedRef<FWhenAnyState, ESPMode::ThreadSafe> State = MakeShared<FWhenAnyState, ESPMode::ThreadSafe>();
+	TFuture<FDownloadResult> Future = State->Promise.GetFuture();
+	for (TFuture<FDownloadResult>& It : InFutures)
+	{
+		It.Next([State](FDownloadResult InResult)
+		{
+			if (State->bDone.exchange(true) == false)
+			{
+				State->Promise.SetValue(MoveTemp(InResult));
+			}
+		});
+	}
+
+	return Future;
+}
@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DownloadManifest.h"
+#include "FileDownloader.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "JsonObjectConverter.h"
+
+static const uint32 MANIFEST_MAGIC = 0x464D4446;	//"FDMF"
+static const uint32 MANIFEST_VERSION = 1;
+
+bool FDownloadManifest::LoadFromFile(const FString& InFileName)
+{
+	Files.Reset();
+
+	TArray<uint8> Data;
+	if (FFileHelper::LoadFileToArray(Data, *InFileName) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Cannot read manifest : %s"), *InFileName);
+		return false;
+	}
+
+	if (Data.Num() >= 4 && *reinterpret_cast<const uint32*>(Data.GetData()) == MANIFEST_MAGIC)
+	{
+		FMemoryReader Reader(Data);
+		if (Serialize(Reader) == false)
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("Invalid binary manifest : %s"), *InFileName);
+			Files.Reset();
+			return false;
+		}
+		return true;
+	}
+
+	FString JsonStr;
+	FFileHelper::BufferToString(JsonStr, Data.GetData(), Data.Num());
+	if (FJsonObjectConverter::JsonObjectStringToUStruct(JsonStr, this, 0, 0) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Invalid json manifest : %s"), *InFileName);
+		return false;
+	}
+
+	return true;
+}
+
+bool FDownloadManifest::SaveToBinaryFile(const FString& InFileName) const
+{
+	TArray<uint8> Data;
+	FMemoryWriter Writer(Data);
+	if (const_cast<FDownloadManifest*>(this)->Serialize(Writer) == false)
+	{
+		return false;
+	}
+
+	return FFileHelper::SaveArrayToFile(Data, *InFileName);
+}
+
+bool FDownloadManifest::Serialize(FArchive& Ar)
+{
+	uint32 Magic = MANIFEST_MAGIC;
+	uint32 Version = MANIFEST_VERSION;
+	int32 Count = Files.Num();
+
+	Ar << Magic << Version << Count;
+	if (Magic != MANIFEST_MAGIC || Version != MANIFEST_VERSION || Count < 0)
+	{
+		return false;
+	}
+
+	if (Ar.IsLoading())
+	{
+		//every entry takes more than one byte, do not trust a count larger than the data
+		if (Count > Ar.TotalSize() - Ar.Tell())
+		{
+			return false;
+		}
+		Files.SetNum(Count);
+	}
+
+	for (FManifestEntry& Entry : Files)
+	{
+		Ar << Entry.Url << Entry.Path << Entry.Hash << Entry.ETag << Entry.Size << Entry.Priority;
+		if (Ar.IsError())
+		{
+			return false;
+		}
+	}
+
+	return Ar.IsError() == false;
+}
@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TaskInformation.h"
+#include "DownloadManifest.generated.h"
+
+/**
+ * list of files to download with their sizes, so tasks can be created without HEAD.
+ * loaded from Json {"Files":[{"Url":"", "Path":"", "Size":0, "Hash":"", "ETag":"", "Priority":0}]}
+ * or from the compact binary form written by SaveToBinaryFile.
+ */
+USTRUCT()
+struct FDownloadManifest
+{
+	GENERATED_BODY()
+
+public:
+
+	//detect the format by content, binary manifests start with a magic number
+	bool LoadFromFile(const FString& InFileName);
+
+	bool SaveToBinaryFile(const FString& InFileName) const;
+
+	UPROPERTY()
+		TArray<FManifestEntry> Files;
+
+protected:
+
+	bool Serialize(FArchive& Ar);
+};
@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DownloadMemoryBudget.h"
+#include "Misc/ScopeLock.h"
+
+void FDownloadMemoryBudget::SetLimit(int64 InLimit)
+{
+	bool bRaised = false;
+	{
+		FScopeLock ScopeLock(&Lock);
+		bRaised = Limit > 0 && (InLimit < 1 || InLimit > Limit);
+		Limit = FMath::Max<int64>(0, InLimit);
+	}
+
+	if (bRaised)
+	{
+		WakeWaiters();
+	}
+}
+
+int64 FDownloadMemoryBudget::GetLimit() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Limit;
+}
+
+bool FDownloadMemoryBudget::TryAcquire(int64 InBytes)
+{
+	FScopeLock ScopeLock(&Lock);
+	if (Limit > 0 && Used > 0 && Used + InBytes > Limit)
+	{
+		return false;
+	}
+
+	Used += InBytes;
+	Peak = FMath::Max(Peak, Used);
+	return true;
+}
+
+void FDownloadMemoryBudget::Release(int64 InBytes)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		Used = FMath::Max<int64>(0, Used - InBytes);
+	}
+
+	WakeWaiters();
+}
+
+void FDownloadMemoryBudget::WaitFor(const void* InOwner, TFunction<void()> InCallback)
+{
+	FScopeLock ScopeLock(&Lock);
+	Waiters.Emplace(InOwner, MoveTemp(InCallback));
+}
+
+void FDownloadMemoryBudget::CancelWait(const void* InOwner)
+{
+	FScopeLock ScopeLock(&Lock);
+	Waiters.RemoveAll([InOwner](const TPair<const void*, TFunction<void()>>& Waiter)
+	{
+		return Waiter.Key == InOwner;
+	});
+}
+
+int64 FDownloadMemoryBudget::GetUsed() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Used;
+}
+
+int64 FDownloadMemoryBudget::GetPeak() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Peak;
+}
+
+void FDownloadMemoryBudget::WakeWaiters()
+{
+	//wake each queued waiter at most once, a waiter that still cannot reserve queues itself again.
+	//callbacks run outside the lock
+	int32 Count = 0;
+	{
+		FScopeLock ScopeLock(&Lock);
+		Count = Waiters.Num();
+	}
+
+	for (int32 i = 0; i < Count; ++i)
+	{
+		TFunction<void()> Callback;
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (Waiters.Num() < 1 || (Limit > 0 && Used >= Limit))
+			{
+				return;
+			}
+			Callback = MoveTemp(Waiters[0].Value);
+			Waiters.RemoveAt(0);
+		}
+
+		Callback();
+	}
+}
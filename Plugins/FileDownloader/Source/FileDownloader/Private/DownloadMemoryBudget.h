@@ -0,0 +1,52 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+
+/**
+ * byte budget shared by all tasks of a manager, limits response data being held between request and disk write.
+ * a task reserves its chunk size before sending a request and releases it after the chunk is written.
+ */
+class FDownloadMemoryBudget
+{
+public:
+
+	//0 means unlimited
+	void SetLimit(int64 InLimit);
+
+	int64 GetLimit() const;
+
+	/*try to reserve bytes, one reservation is always granted when nothing is in flight so a chunk larger than the limit cannot stall
+	 @return true if reserved
+	*/
+	bool TryAcquire(int64 InBytes);
+
+	void Release(int64 InBytes);
+
+	/*queue a callback fired when bytes are released, the callback should call TryAcquire again
+	 @Param InOwner identify the waiter, used by CancelWait
+	*/
+	void WaitFor(const void* InOwner, TFunction<void()> InCallback);
+
+	void CancelWait(const void* InOwner);
+
+	int64 GetUsed() const;
+
+	int64 GetPeak() const;
+
+protected:
+
+	void WakeWaiters();
+
+	mutable FCriticalSection Lock;
+
+	int64 Limit = 0;
+	int64 Used = 0;
+	int64 Peak = 0;
+
+	TArray<TPair<const void*, TFunction<void()>>> Waiters;
+};
+
+typedef TSharedPtr<FDownloadMemoryBudget, ESPMode::ThreadSafe> FDownloadMemoryBudgetPtr;
@@ -0,0 +1,499 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DownloadSink.h"
+#include "FileDownloader.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/FileHelper.h"
+
+#if PLATFORM_LINUX || PLATFORM_MAC
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define WITH_MAPPED_SINK 1
+#else
+#define WITH_MAPPED_SINK 0
+#endif
+
+#if PLATFORM_LINUX
+#include <sys/syscall.h>
+#endif
+
+#if PLATFORM_LINUX && defined(O_DIRECT) && defined(SYNC_FILE_RANGE_WRITE)
+#define WITH_UNCACHED_SINK 1
+#else
+#define WITH_UNCACHED_SINK 0
+#endif
+
+#if WITH_UNCACHED_SINK
+//smaller files are written through the page cache, they are few pages and often read right after
+static const int64 UNCACHED_MIN_SIZE = 32 * 1024 * 1024;
+
+//offset, size & buffer of O_DIRECT writes are aligned to this, a multiple of the block size of common devices
+static const int32 DIRECT_IO_ALIGNMENT = 4096;
+
+//ioprio_set of linux/ioprio.h, glibc has no wrapper
+static const int32 DOWNLOAD_IOPRIO_WHO_PROCESS = 1;
+static const int32 DOWNLOAD_IOPRIO_CLASS_SHIFT = 13;
+static const int32 DOWNLOAD_IOPRIO_CLASS_BE = 2;
+
+//lowest best effort level, idle class could starve downloads while the game streams all the time
+static const int32 DOWNLOAD_IOPRIO_LOW = (DOWNLOAD_IOPRIO_CLASS_BE << DOWNLOAD_IOPRIO_CLASS_SHIFT) | 7;
+
+/**
+ * lowers the I/O priority of the calling thread, sinks write on pool threads shared with other work
+ */
+struct FScopedLowIoPriority
+{
+	FScopedLowIoPriority()
+		: OldPriority((int32)syscall(SYS_ioprio_get, DOWNLOAD_IOPRIO_WHO_PROCESS, 0))
+	{
+		if (OldPriority >= 0)
+		{
+			syscall(SYS_ioprio_set, DOWNLOAD_IOPRIO_WHO_PROCESS, 0, DOWNLOAD_IOPRIO_LOW);
+		}
+	}
+
+	~FScopedLowIoPriority()
+	{
+		if (OldPriority >= 0)
+		{
+			syscall(SYS_ioprio_set, DOWNLOAD_IOPRIO_WHO_PROCESS, 0, OldPriority);
+		}
+	}
+
+	int32 OldPriority;
+};
+#endif
+
+FFileSink::~FFileSink()
+{
+	FFileSink::Close();
+}
+
+bool FFileSink::Open(const FString& InFileName, bool bResume, int64 InTotalSize)
+{
+	Close();
+
+	//readable while writing, a streaming reader reads the temp file
+	File = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(*InFileName, bResume, true);
+	ResumeSize = (File != nullptr && bResume) ? File->Size() : 0;
+	return File != nullptr;
+}
+
+int64 FFileSink::GetResumeSize() const
+{
+	return ResumeSize;
+}
+
+bool FFileSink::Write(int64 InOffset, const uint8* InData, int32 InSize)
+{
+	return File != nullptr && File->Seek(InOffset) && File->Write(InData, InSize);
+}
+
+void FFileSink::Flush()
+{
+	if (File != nullptr)
+	{
+		File->Flush();
+	}
+}
+
+void FFileSink::Close()
+{
+	if (File != nullptr)
+	{
+		delete File;
+		File = nullptr;
+	}
+}
+
+bool FFileSink::IsOpen() const
+{
+	return File != nullptr;
+}
+
+FMappedFileSink::~FMappedFileSink()
+{
+	FMappedFileSink::Close();
+}
+
+bool FMappedFileSink::Open(const FString& InFileName, bool bResume, int64 InTotalSize)
+{
+	Close();
+
+#if WITH_MAPPED_SINK
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	EndFileName = InFileName + TEXT(".end");
+
+	//a marker left behind means the sink was not closed, the file is still extended to its total size
+	FString EndStr;
+	const int64 MarkedEnd = (bResume && FFileHelper::LoadFileToString(EndStr, *EndFileName)) ? FCString::Atoi64(*EndStr) : MAX_int64;
+	PlatformFile.DeleteFile(*EndFileName);
+	SavedEnd = -1;
+
+	if (InTotalSize > 0)
+	{
+		const int32 Flags = O_RDWR | O_CREAT | (bResume ? 0 : O_TRUNC);
+		FileDescriptor = open(TCHAR_TO_UTF8(*InFileName), Flags, 0644);
+		if (FileDescriptor >= 0)
+		{
+			struct stat FileStat;
+			ResumeSize = (bResume && fstat(FileDescriptor, &FileStat) == 0) ? FMath::Min3<int64>(FileStat.st_size, InTotalSize, MarkedEnd) : 0;
+			WrittenEnd = ResumeSize;
+
+			//before the file is extended, a crash right after must not resume from the total size
+			SaveWrittenEnd();
+			if (ftruncate(FileDescriptor, InTotalSize) == 0)
+			{
+				void* Mapped = mmap(nullptr, InTotalSize, PROT_READ | PROT_WRITE, MAP_SHARED, FileDescriptor, 0);
+				if (Mapped != MAP_FAILED)
+				{
+					MappedData = (uint8*)Mapped;
+					MappedSize = InTotalSize;
+					return true;
+				}
+			}
+
+			UE_LOG(LogFileDownloader, Warning, TEXT("Cannot map %s, write it by file handle"), *InFileName);
+			if (ftruncate(FileDescriptor, WrittenEnd) != 0)
+			{
+				UE_LOG(LogFileDownloader, Warning, TEXT("Cannot restore size of %s"), *InFileName);
+			}
+			close(FileDescriptor);
+			FileDescriptor = -1;
+			PlatformFile.DeleteFile(*EndFileName);
+			SavedEnd = -1;
+		}
+	}
+
+	//the file of a crashed mapped run is cut to its written data
+	if (bResume && MarkedEnd < PlatformFile.FileSize(*InFileName))
+	{
+		if (truncate(TCHAR_TO_UTF8(*InFileName), MarkedEnd) != 0)
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("Cannot cut %s to %lld bytes"), *InFileName, MarkedEnd);
+		}
+	}
+#endif
+
+	return FFileSink::Open(InFileName, bResume, InTotalSize);
+}
+
+void FMappedFileSink::SaveWrittenEnd()
+{
+	if (FFileHelper::SaveStringToFile(FString::Printf(TEXT("%lld"), WrittenEnd), *EndFileName))
+	{
+		SavedEnd = WrittenEnd;
+	}
+	else
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Cannot write %s"), *EndFileName);
+	}
+}
+
+bool FMappedFileSink::Write(int64 InOffset, const uint8* InData, int32 InSize)
+{
+	if (MappedData == nullptr)
+	{
+		return FFileSink::Write(InOffset, InData, InSize);
+	}
+
+	if (InOffset < 0 || (InOffset + InSize > MappedSize && Grow(InOffset + InSize) == false))
+	{
+		return false;
+	}
+
+	FMemory::Memcpy(MappedData + InOffset, InData, InSize);
+	WrittenEnd = FMath::Max(WrittenEnd, InOffset + InSize);
+	return true;
+}
+
+bool FMappedFileSink::Grow(int64 InMinSize)
+{
+#if WITH_MAPPED_SINK
+	//output may exceed the expected size, e.g. decompressed data
+	const int64 NewSize = FMath::Max(InMinSize, MappedSize * 2);
+	munmap(MappedData, MappedSize);
+	MappedData = nullptr;
+
+	if (ftruncate(FileDescriptor, NewSize) == 0)
+	{
+		void* Mapped = mmap(nullptr, NewSize, PROT_READ | PROT_WRITE, MAP_SHARED, FileDescriptor, 0);
+		if (Mapped != MAP_FAILED)
+		{
+			MappedData = (uint8*)Mapped;
+			MappedSize = NewSize;
+			return true;
+		}
+	}
+
+	UE_LOG(LogFileDownloader, Warning, TEXT("Cannot grow mapped file to %lld bytes"), NewSize);
+	MappedSize = 0;
+#endif
+	return false;
+}
+
+void FMappedFileSink::Flush()
+{
+#if WITH_MAPPED_SINK
+	if (MappedData != nullptr)
+	{
+		//pages are written back by the kernel, only start it here
+		msync(MappedData, MappedSize, MS_ASYNC);
+		if (WrittenEnd != SavedEnd)
+		{
+			SaveWrittenEnd();
+		}
+		return;
+	}
+#endif
+
+	FFileSink::Flush();
+}
+
+void FMappedFileSink::Close()
+{
+#if WITH_MAPPED_SINK
+	if (MappedData != nullptr)
+	{
+		munmap(MappedData, MappedSize);
+		MappedData = nullptr;
+		MappedSize = 0;
+	}
+
+	if (FileDescriptor >= 0)
+	{
+		//the size tells a resumed task how much has been written
+		if (ftruncate(FileDescriptor, WrittenEnd) == 0)
+		{
+			FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*EndFileName);
+			SavedEnd = -1;
+		}
+		else
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("Cannot cut mapped file to %lld bytes"), WrittenEnd);
+		}
+		close(FileDescriptor);
+		FileDescriptor = -1;
+	}
+#endif
+
+	FFileSink::Close();
+}
+
+bool FMappedFileSink::IsOpen() const
+{
+	return MappedData != nullptr || FFileSink::IsOpen();
+}
+
+FUncachedFileSink::~FUncachedFileSink()
+{
+	FUncachedFileSink::Close();
+}
+
+bool FUncachedFileSink::Open(const FString& InFileName, bool bResume, int64 InTotalSize)
+{
+	Close();
+
+#if WITH_UNCACHED_SINK
+	if (InTotalSize >= UNCACHED_MIN_SIZE)
+	{
+		FileDescriptor = open(TCHAR_TO_UTF8(*InFileName), O_WRONLY | O_CREAT | (bResume ? 0 : O_TRUNC), 0644);
+		if (FileDescriptor >= 0)
+		{
+			struct stat FileStat;
+			ResumeSize = (bResume && fstat(FileDescriptor, &FileStat) == 0) ? FileStat.st_size : 0;
+
+			//tmpfs & some network file systems refuse O_DIRECT, every write takes the cached path then
+			DirectDescriptor = open(TCHAR_TO_UTF8(*InFileName), O_WRONLY | O_DIRECT);
+			return true;
+		}
+
+		UE_LOG(LogFileDownloader, Warning, TEXT("Cannot open %s uncached, write it by file handle"), *InFileName);
+	}
+#endif
+
+	return FFileSink::Open(InFileName, bResume, InTotalSize);
+}
+
+bool FUncachedFileSink::Write(int64 InOffset, const uint8* InData, int32 InSize)
+{
+	if (FileDescriptor < 0)
+	{
+		return FFileSink::Write(InOffset, InData, InSize);
+	}
+
+#if WITH_UNCACHED_SINK
+	FScopedLowIoPriority LowPriority;
+
+	//chunks start at multiples of the chunk size, only the tail of a file & resumed chunks are unaligned
+	if (DirectDescriptor >= 0 && InSize > 0 && InOffset % DIRECT_IO_ALIGNMENT == 0 && InSize % DIRECT_IO_ALIGNMENT == 0)
+	{
+		if (AlignedBufferSize < InSize)
+		{
+			FMemory::Free(AlignedBuffer);
+			AlignedBuffer = (uint8*)FMemory::Malloc(InSize, DIRECT_IO_ALIGNMENT);
+			AlignedBufferSize = InSize;
+		}
+		FMemory::Memcpy(AlignedBuffer, InData, InSize);
+
+		int32 Written = 0;
+		while (Written < InSize)
+		{
+			const ssize_t Result = pwrite(DirectDescriptor, AlignedBuffer + Written, InSize - Written, InOffset + Written);
+			if (Result <= 0)
+			{
+				break;
+			}
+			Written += (int32)Result;
+		}
+
+		if (Written == InSize)
+		{
+			return true;
+		}
+
+		//e.g. a device with larger blocks, the rest of the file is written through the cache
+		UE_LOG(LogFileDownloader, Warning, TEXT("O_DIRECT write failed at %lld, continue through the page cache"), InOffset + Written);
+		close(DirectDescriptor);
+		DirectDescriptor = -1;
+		return WriteCached(InOffset + Written, InData + Written, InSize - Written);
+	}
+
+	return WriteCached(InOffset, InData, InSize);
+#else
+	return false;
+#endif
+}
+
+bool FUncachedFileSink::WriteCached(int64 InOffset, const uint8* InData, int32 InSize)
+{
+#if WITH_UNCACHED_SINK
+	int32 Written = 0;
+	while (Written < InSize)
+	{
+		const ssize_t Result = pwrite(FileDescriptor, InData + Written, InSize - Written, InOffset + Written);
+		if (Result <= 0)
+		{
+			return false;
+		}
+		Written += (int32)Result;
+	}
+
+	//dirty pages cannot be dropped, the write before has been written back meanwhile
+	DropPending();
+	sync_file_range(FileDescriptor, InOffset, InSize, SYNC_FILE_RANGE_WRITE);
+	PendingOffset = InOffset;
+	PendingSize = InSize;
+	return true;
+#else
+	return false;
+#endif
+}
+
+void FUncachedFileSink::DropPending()
+{
+#if WITH_UNCACHED_SINK
+	if (PendingSize > 0)
+	{
+		sync_file_range(FileDescriptor, PendingOffset, PendingSize, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+		posix_fadvise(FileDescriptor, PendingOffset, PendingSize, POSIX_FADV_DONTNEED);
+		PendingSize = 0;
+	}
+#endif
+}
+
+void FUncachedFileSink::Close()
+{
+#if WITH_UNCACHED_SINK
+	if (FileDescriptor >= 0)
+	{
+		DropPending();
+		close(FileDescriptor);
+		FileDescriptor = -1;
+	}
+
+	if (DirectDescriptor >= 0)
+	{
+		close(DirectDescriptor);
+		DirectDescriptor = -1;
+	}
+#endif
+
+	FMemory::Free(AlignedBuffer);
+	AlignedBuffer = nullptr;
+	AlignedBufferSize = 0;
+
+	FFileSink::Close();
+}
+
+bool FUncachedFileSink::IsOpen() const
+{
+	return FileDescriptor >= 0 || FFileSink::IsOpen();
+}
+
+bool FMemorySink::Open(const FString& InFileName, bool bResume, int64 InTotalSize)
+{
+	Data.Reset();
+	if (InTotalSize > 0)
+	{
+		Data.Reserve((int32)FMath::Min<int64>(InTotalSize, MAX_int32));
+	}
+	bOpen = true;
+	return true;
+}
+
+int64 FMemorySink::GetResumeSize() const
+{
+	return 0;
+}
+
+bool FMemorySink::Write(int64 InOffset, const uint8* InData, int32 InSize)
+{
+	if (bOpen == false || InOffset < 0 || InOffset + InSize > MAX_int32)
+	{
+		return false;
+	}
+
+	if (InOffset + InSize > Data.Num())
+	{
+		Data.SetNumZeroed((int32)(InOffset + InSize), false);
+	}
+
+	FMemory::Memcpy(Data.GetData() + InOffset, InData, InSize);
+	return true;
+}
+
+void FMemorySink::Close()
+{
+	bOpen = false;
+}
+
+bool FMemorySink::IsOpen() const
+{
+	return bOpen;
+}
+
+TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> FMemorySink::ReleaseData()
+{
+	bOpen = false;
+	return MakeShareable(new TArray<uint8>(MoveTemp(Data)));
+}
+
+FDownloadSinkPtr CreateDownloadSink(EDownloadSinkType InType)
+{
+	switch (InType)
+	{
+	case EDownloadSinkType::MEMORY:
+		return MakeShareable(new FMemorySink());
+	case EDownloadSinkType::DISCARD:
+		return MakeShareable(new FDiscardSink());
+	case EDownloadSinkType::MAPPED_FILE:
+		return MakeShareable(new FMappedFileSink());
+	case EDownloadSinkType::UNCACHED_FILE:
+		return MakeShareable(new FUncachedFileSink());
+	default:
+		return MakeShareable(new FFileSink());
+	}
+}
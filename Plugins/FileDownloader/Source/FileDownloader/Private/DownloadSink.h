@@ -0,0 +1,244 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadEvent.h"
+
+class IFileHandle;
+
+/**
+ * where a task writes downloaded data. Write is called on worker threads, one call at a time.
+ */
+class IDownloadSink
+{
+public:
+
+	virtual ~IDownloadSink() {}
+
+	/*prepare for writing
+	 @Param InFileName temp file of the task, ignored by sinks without file
+	 @Param bResume keep data written before, otherwise start empty
+	 @Param InTotalSize expected size, 0 if unknown
+	*/
+	virtual bool Open(const FString& InFileName, bool bResume, int64 InTotalSize) = 0;
+
+	//bytes kept from before when opened with bResume
+	virtual int64 GetResumeSize() const = 0;
+
+	virtual bool Write(int64 InOffset, const uint8* InData, int32 InSize) = 0;
+
+	virtual void Flush() {}
+
+	//release handles, written data stays
+	virtual void Close() = 0;
+
+	virtual bool IsOpen() const = 0;
+
+	//false if data never touches the file system
+	virtual bool IsFile() const
+	{
+		return true;
+	}
+
+	//hand over data kept in memory as an immutable shared buffer, null for file sinks
+	virtual TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> ReleaseData()
+	{
+		return nullptr;
+	}
+};
+
+typedef TSharedPtr<IDownloadSink, ESPMode::ThreadSafe> FDownloadSinkPtr;
+
+/**
+ * writes to the temp file with positional writes, the default sink
+ */
+class FFileSink : public IDownloadSink
+{
+public:
+
+	virtual ~FFileSink();
+
+	virtual bool Open(const FString& InFileName, bool bResume, int64 InTotalSize) override;
+
+	virtual int64 GetResumeSize() const override;
+
+	virtual bool Write(int64 InOffset, const uint8* InData, int32 InSize) override;
+
+	virtual void Flush() override;
+
+	virtual void Close() override;
+
+	virtual bool IsOpen() const override;
+
+protected:
+
+	IFileHandle* File = nullptr;
+
+	int64 ResumeSize = 0;
+};
+
+/**
+ * maps the temp file into memory, writes at random offsets are plain copies without seek & write calls.
+ * the file is extended to its total size while open and cut to the end of the last write when closed,
+ * so a resumed task sees the same size as with FFileSink. while open the end is kept in a marker file
+ * next to the temp file on every flush, a task resumed after a crash starts from there instead of the total size.
+ * falls back to FFileSink where mapping is not available or the total size is unknown.
+ */
+class FMappedFileSink : public FFileSink
+{
+public:
+
+	virtual ~FMappedFileSink();
+
+	virtual bool Open(const FString& InFileName, bool bResume, int64 InTotalSize) override;
+
+	virtual bool Write(int64 InOffset, const uint8* InData, int32 InSize) override;
+
+	virtual void Flush() override;
+
+	virtual void Close() override;
+
+	virtual bool IsOpen() const override;
+
+protected:
+
+	//map a larger file, the old mapping is released
+	bool Grow(int64 InMinSize);
+
+	//write WrittenEnd to the marker file
+	void SaveWrittenEnd();
+
+	int32 FileDescriptor = -1;
+
+	uint8* MappedData = nullptr;
+
+	int64 MappedSize = 0;
+
+	//end of the farthest write
+	int64 WrittenEnd = 0;
+
+	//WrittenEnd as in the marker file
+	int64 SavedEnd = -1;
+
+	FString EndFileName;
+};
+
+/**
+ * writes a large temp file without filling the page cache, so the assets the game streams stay cached.
+ * aligned writes go through O_DIRECT from an aligned buffer, others are written back & dropped from the cache
+ * with sync_file_range & posix_fadvise one write later. writes run at the lowest best effort I/O priority.
+ * falls back to FFileSink for small files, unknown sizes & other platforms than Linux.
+ */
+class FUncachedFileSink : public FFileSink
+{
+public:
+
+	virtual ~FUncachedFileSink();
+
+	virtual bool Open(const FString& InFileName, bool bResume, int64 InTotalSize) override;
+
+	virtual bool Write(int64 InOffset, const uint8* InData, int32 InSize) override;
+
+	virtual void Close() override;
+
+	virtual bool IsOpen() const override;
+
+protected:
+
+	//write through the page cache, start its write back & drop the pages of the write before
+	bool WriteCached(int64 InOffset, const uint8* InData, int32 InSize);
+
+	//wait for the write back of the pending range and drop its pages
+	void DropPending();
+
+	int32 FileDescriptor = -1;
+
+	//same file opened with O_DIRECT, -1 if the file system does not support it
+	int32 DirectDescriptor = -1;
+
+	uint8* AlignedBuffer = nullptr;
+
+	int32 AlignedBufferSize = 0;
+
+	//written through the page cache and not dropped yet
+	int64 PendingOffset = 0;
+	int64 PendingSize = 0;
+};
+
+/**
+ * keeps downloaded data in memory, small files that are parsed right away never touch the disk.
+ * data cannot be resumed, a stopped task starts over.
+ */
+class FMemorySink : public IDownloadSink
+{
+public:
+
+	virtual bool Open(const FString& InFileName, bool bResume, int64 InTotalSize) override;
+
+	virtual int64 GetResumeSize() const override;
+
+	virtual bool Write(int64 InOffset, const uint8* InData, int32 InSize) override;
+
+	virtual void Close() override;
+
+	virtual bool IsOpen() const override;
+
+	virtual bool IsFile() const override
+	{
+		return false;
+	}
+
+	virtual TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> ReleaseData() override;
+
+protected:
+
+	TArray<uint8> Data;
+
+	bool bOpen = false;
+};
+
+/**
+ * drops downloaded data, a task runs through every step without memory or disk cost
+ */
+class FDiscardSink : public IDownloadSink
+{
+public:
+
+	virtual bool Open(const FString& InFileName, bool bResume, int64 InTotalSize) override
+	{
+		bOpen = true;
+		return true;
+	}
+
+	virtual int64 GetResumeSize() const override
+	{
+		return 0;
+	}
+
+	virtual bool Write(int64 InOffset, const uint8* InData, int32 InSize) override
+	{
+		return bOpen;
+	}
+
+	virtual void Close() override
+	{
+		bOpen = false;
+	}
+
+	virtual bool IsOpen() const override
+	{
+		return bOpen;
+	}
+
+	virtual bool IsFile() const override
+	{
+		return false;
+	}
+
+protected:
+
+	bool bOpen = false;
+};
+
+FILEDOWNLOADER_API FDownloadSinkPtr CreateDownloadSink(EDownloadSinkType InType);
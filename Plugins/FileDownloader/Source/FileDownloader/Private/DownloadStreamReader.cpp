@@ -0,0 +1,376 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DownloadStreamReader.h"
+#include "FileDownloader.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/Event.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Templates/UniquePtr.h"
+#include "Async/Async.h"
+
+static const uint32 CHUNK_MAP_MAGIC = 0x4D434446;	//"FDCM"
+static const uint32 CHUNK_MAP_VERSION = 1;
+
+FDownloadStreamReader::FDownloadStreamReader()
+{
+	DataEvent = FPlatformProcess::GetSynchEventFromPool(true);
+}
+
+FDownloadStreamReader::~FDownloadStreamReader()
+{
+	FPlatformProcess::ReturnSynchEventToPool(DataEvent);
+	DataEvent = nullptr;
+}
+
+int64 FDownloadStreamReader::GetTotalSize() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return TotalSize;
+}
+
+int64 FDownloadStreamReader::GetAvailableSize(int64 InOffset) const
+{
+	FScopeLock ScopeLock(&Lock);
+	return GetAvailableSizeLocked(InOffset);
+}
+
+int64 FDownloadStreamReader::GetAvailableSizeLocked(int64 InOffset) const
+{
+	if (InOffset < 0 || InOffset >= TotalSize)
+	{
+		return 0;
+	}
+
+	if (bCompleted)
+	{
+		return TotalSize - InOffset;
+	}
+
+	int32 Index = (int32)(InOffset / ChunkSize);
+	while (Index < ChunkDone.Num() && ChunkDone[Index])
+	{
+		++Index;
+	}
+
+	return FMath::Max<int64>(0, FMath::Min<int64>((int64)Index * ChunkSize, TotalSize) - InOffset);
+}
+
+int64 FDownloadStreamReader::GetDownloadedSize() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return bCompleted ? TotalSize : DownloadedSize;
+}
+
+bool FDownloadStreamReader::IsCompleted() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return bCompleted;
+}
+
+bool FDownloadStreamReader::HasError() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return bError;
+}
+
+void FDownloadStreamReader::Seek(int64 InOffset)
+{
+	ReadHead = FMath::Max<int64>(0, InOffset);
+}
+
+int64 FDownloadStreamReader::GetReadHead() const
+{
+	return ReadHead.load();
+}
+
+int32 FDownloadStreamReader::TryRead(int64 InOffset, uint8* OutData, int32 InSize)
+{
+	int64 Available = 0;
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (bError || (TotalSize > 0 && InOffset >= TotalSize))
+		{
+			return -1;
+		}
+		Available = GetAvailableSizeLocked(InOffset);
+	}
+
+	Seek(InOffset);
+	if (Available < 1 || InSize < 1)
+	{
+		return 0;
+	}
+
+	const int32 Size = (int32)FMath::Min<int64>(InSize, Available);
+	const int32 ReadSize = ReadFromFile(InOffset, OutData, Size);
+	if (ReadSize > 0)
+	{
+		Seek(InOffset + ReadSize);
+	}
+	return ReadSize;
+}
+
+int32 FDownloadStreamReader::Read(int64 InOffset, uint8* OutData, int32 InSize, float InTimeout)
+{
+	//data is marked on game thread, waiting there would never see it
+	if (!ensureMsgf(IsInGameThread() == false, TEXT("FDownloadStreamReader::Read blocks, use TryRead or ReadAsync on game thread")))
+	{
+		return TryRead(InOffset, OutData, InSize);
+	}
+
+	Seek(InOffset);
+	const double EndTime = FPlatformTime::Seconds() + InTimeout;
+	for (;;)
+	{
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (bError || (TotalSize > 0 && InOffset >= TotalSize) || GetAvailableSizeLocked(InOffset) > 0)
+			{
+				break;
+			}
+			DataEvent->Reset();
+		}
+
+		const double WaitSeconds = EndTime - FPlatformTime::Seconds();
+		if (WaitSeconds <= 0.0)
+		{
+			return 0;
+		}
+		DataEvent->Wait(FTimespan::FromSeconds(WaitSeconds));
+	}
+
+	return TryRead(InOffset, OutData, InSize);
+}
+
+void FDownloadStreamReader::ReadAsync(int64 InOffset, int32 InSize, TFunction<void(const TArray<uint8>& InData)> InCallback)
+{
+	Seek(InOffset);
+	{
+		FScopeLock ScopeLock(&Lock);
+		PendingReads.Add({ InOffset, InSize, MoveTemp(InCallback) });
+	}
+	ServePendingReads();
+}
+
+void FDownloadStreamReader::ServePendingReads()
+{
+	TArray<FPendingRead> Ready;
+	bool bFailed = false;
+	{
+		FScopeLock ScopeLock(&Lock);
+		bFailed = bError;
+		for (int32 i = PendingReads.Num() - 1; i >= 0; --i)
+		{
+			FPendingRead& Pending = PendingReads[i];
+			//a read over the end of a known size gets the bytes up to the end
+			const int64 End = TotalSize > 0 ? FMath::Min<int64>(Pending.Offset + Pending.Size, TotalSize) : Pending.Offset + Pending.Size;
+			if (bError || (TotalSize > 0 && GetAvailableSizeLocked(Pending.Offset) >= End - Pending.Offset))
+			{
+				Pending.Size = (int32)FMath::Max<int64>(0, End - Pending.Offset);
+				Ready.Add(MoveTemp(Pending));
+				PendingReads.RemoveAt(i);
+			}
+		}
+	}
+
+	if (Ready.Num() < 1)
+	{
+		return;
+	}
+
+	TSharedRef<FDownloadStreamReader, ESPMode::ThreadSafe> Self = AsShared();
+	Async(EAsyncExecution::ThreadPool, [Self, Ready = MoveTemp(Ready), bFailed]()
+	{
+		for (const FPendingRead& Pending : Ready)
+		{
+			TArray<uint8> Data;
+			if (bFailed == false)
+			{
+				Data.SetNumUninitialized(Pending.Size);
+				if (Self->ReadFromFile(Pending.Offset, Data.GetData(), Pending.Size) != Pending.Size)
+				{
+					Data.Empty();
+				}
+			}
+
+			TFunction<void(const TArray<uint8>&)> Callback = Pending.Callback;
+			FFunctionGraphTask::CreateAndDispatchWhenReady([Callback, Data = MoveTemp(Data)]() {
+				Callback(Data);
+			}, TStatId(), nullptr, ENamedThreads::GameThread);
+		}
+	});
+}
+
+int32 FDownloadStreamReader::ReadFromFile(int64 InOffset, uint8* OutData, int32 InSize)
+{
+	FScopeLock ScopeLock(&FileLock.Get());
+
+	FString Name;
+	{
+		FScopeLock DataLock(&Lock);
+		Name = FileName;
+	}
+
+	//opened for every read so the task can move the file when completed
+	TUniquePtr<IFileHandle> File(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*Name, true));
+	if (File.IsValid() == false || File->Seek(InOffset) == false || File->Read(OutData, InSize) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Stream read error : %s at %lld"), *Name, InOffset);
+		return -1;
+	}
+
+	return InSize;
+}
+
+void FDownloadStreamReader::Reset(const FString& InFileName, int64 InTotalSize, int32 InChunkSize)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		FileName = InFileName;
+		TotalSize = FMath::Max<int64>(0, InTotalSize);
+		ChunkSize = FMath::Max(1, InChunkSize);
+		ChunkDone.Reset();
+		ChunkDone.SetNumZeroed((int32)((TotalSize + ChunkSize - 1) / ChunkSize));
+		DownloadedSize = 0;
+		bCompleted = false;
+		bError = false;
+	}
+	ServePendingReads();
+}
+
+void FDownloadStreamReader::MarkChunkDone(int32 InChunkIndex)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (ChunkDone.IsValidIndex(InChunkIndex) == false || ChunkDone[InChunkIndex])
+		{
+			return;
+		}
+		ChunkDone[InChunkIndex] = true;
+		DownloadedSize += GetChunkLength(InChunkIndex);
+		DataEvent->Trigger();
+	}
+	ServePendingReads();
+}
+
+void FDownloadStreamReader::SetCompleted(const FString& InFileName, int64 InTotalSize)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		FileName = InFileName;
+		TotalSize = FMath::Max<int64>(0, InTotalSize);
+		bCompleted = true;
+		bError = false;
+		DownloadedSize = TotalSize;
+		DataEvent->Trigger();
+	}
+	ServePendingReads();
+}
+
+void FDownloadStreamReader::SetError()
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		bError = true;
+		DataEvent->Trigger();
+	}
+	ServePendingReads();
+}
+
+int32 FDownloadStreamReader::FindChunkToDownload() const
+{
+	FScopeLock ScopeLock(&Lock);
+	if (ChunkDone.Num() < 1)
+	{
+		return INDEX_NONE;
+	}
+
+	const int32 HeadIndex = (int32)FMath::Clamp<int64>(ReadHead.load() / ChunkSize, 0, ChunkDone.Num() - 1);
+	for (int32 i = 0; i < ChunkDone.Num(); ++i)
+	{
+		const int32 Index = (HeadIndex + i) % ChunkDone.Num();
+		if (ChunkDone[Index] == false)
+		{
+			return Index;
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+int32 FDownloadStreamReader::GetChunkCount() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return ChunkDone.Num();
+}
+
+int64 FDownloadStreamReader::GetChunkOffset(int32 InChunkIndex) const
+{
+	return (int64)InChunkIndex * ChunkSize;
+}
+
+int32 FDownloadStreamReader::GetChunkLength(int32 InChunkIndex) const
+{
+	return (int32)FMath::Clamp<int64>(TotalSize - GetChunkOffset(InChunkIndex), 0, ChunkSize);
+}
+
+bool FDownloadStreamReader::LoadChunkMap(const FString& InMapFile)
+{
+	TArray<uint8> Data;
+	if (FFileHelper::LoadFileToArray(Data, *InMapFile, FILEREAD_Silent) == false)
+	{
+		return false;
+	}
+
+	FMemoryReader Reader(Data);
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	int64 MapTotalSize = 0;
+	int32 MapChunkSize = 0;
+	TArray<uint8> Done;
+	Reader << Magic << Version << MapTotalSize << MapChunkSize;
+
+	FScopeLock ScopeLock(&Lock);
+	if (Reader.IsError() || Magic != CHUNK_MAP_MAGIC || Version != CHUNK_MAP_VERSION || MapTotalSize != TotalSize || MapChunkSize != ChunkSize
+		|| Reader.TotalSize() - Reader.Tell() != ChunkDone.Num())
+	{
+		return false;
+	}
+
+	Done.SetNumUninitialized(ChunkDone.Num());
+	Reader.Serialize(Done.GetData(), Done.Num());
+
+	DownloadedSize = 0;
+	for (int32 i = 0; i < ChunkDone.Num(); ++i)
+	{
+		ChunkDone[i] = Done[i] != 0;
+		DownloadedSize += ChunkDone[i] ? GetChunkLength(i) : 0;
+	}
+	DataEvent->Trigger();
+	return true;
+}
+
+bool FDownloadStreamReader::SaveChunkMap(const FString& InMapFile) const
+{
+	TArray<uint8> Data;
+	FMemoryWriter Writer(Data);
+	uint32 Magic = CHUNK_MAP_MAGIC;
+	uint32 Version = CHUNK_MAP_VERSION;
+	{
+		FScopeLock ScopeLock(&Lock);
+		int64 MapTotalSize = TotalSize;
+		int32 MapChunkSize = ChunkSize;
+		Writer << Magic << Version << MapTotalSize << MapChunkSize;
+		for (bool bDone : ChunkDone)
+		{
+			uint8 Flag = bDone ? 1 : 0;
+			Writer << Flag;
+		}
+	}
+
+	return FFileHelper::SaveArrayToFile(Data, *InMapFile);
+}
@@ -0,0 +1,30 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * a stage attached to a task that sees the bytes of the target file in file order as chunks are written,
+ * e.g. to extract an archive while it is still downloading.
+ * Consume is called on worker threads but never concurrently, Reset is called before the first byte.
+ */
+class IDownloadStreamStage
+{
+public:
+
+	virtual ~IDownloadStreamStage() {}
+
+	virtual void Reset() = 0;
+
+	/*consume bytes of the file
+	 @Param InOffset file offset of InData, bytes before GetConsumedSize are ignored
+	 @return false if the bytes cannot be used, e.g. a gap or corrupt data
+	*/
+	virtual bool Consume(int64 InOffset, const uint8* InData, int32 InSize) = 0;
+
+	//bytes from the start of the file consumed so far
+	virtual int64 GetConsumedSize() const = 0;
+};
+
+typedef TSharedPtr<IDownloadStreamStage, ESPMode::ThreadSafe> FDownloadStreamStagePtr;
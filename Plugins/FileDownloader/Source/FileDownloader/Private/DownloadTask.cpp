@@ -4,18 +4,32 @@
 #include "Misc/Paths.h"
 #include "Misc/FileHelper.h"
 #include "HAL/PlatformFilemanager.h"
-#include "HttpModule.h"
-#include "HttpManager.h"
+#include "Interfaces/IHttpResponse.h"
 #include "GenericPlatform/GenericPlatformHttp.h"
 #include "Async/Async.h"
+#include "Misc/ScopeLock.h"
+#include "Misc/SecureHash.h"
 
 const FString TEMP_FILE_EXTERN = TEXT(".dlFile");
 const FString TASK_JSON = TEXT(".task");
 
 IPlatformFile* PlatformFile = nullptr;
 
+//first retry waits about this long, doubled by every further try
+static const double RETRY_BASE_SECONDS = 0.5;
+
+static const double RETRY_MAX_SECONDS = 30.0;
+
+//throttled, overloaded or timed out, the same request may succeed later
+static bool IsRetryableCode(int32 InCode)
+{
+	return InCode == 408 || InCode == 429 || InCode >= 500;
+}
+
 
 DownloadTask::DownloadTask()
+	: Sink(CreateDownloadSink(EDownloadSinkType::FILE))
+	, Transport(GetDefaultDownloadTransport())
 {
 	if (PlatformFile == nullptr)
 	{
@@ -96,43 +110,47 @@ const FString& DownloadTask::GetDirectory() const
 	return TaskInfo.DestDirectory;
 }
 
-void DownloadTask::SetTotalSize(int32 InTotalSize)
+void DownloadTask::SetTotalSize(int64 InTotalSize)
 {
+	FScopeLock ScopeLock(&InfoLock);
 	TaskInfo.TotalSize = InTotalSize;
 }
 
-int32 DownloadTask::GetTotalSize() const
+int64 DownloadTask::GetTotalSize() const
 {
+	FScopeLock ScopeLock(&InfoLock);
 	return TaskInfo.TotalSize;
 }
 
-void DownloadTask::SetCurrentSize(int32 InCurrentSize)
+void DownloadTask::SetCurrentSize(int64 InCurrentSize)
 {
+	FScopeLock ScopeLock(&InfoLock);
 	TaskInfo.CurrentSize = InCurrentSize;
 }
 
-int32 DownloadTask::GetCurrentSize() const
+int64 DownloadTask::GetCurrentSize() const
 {
+	FScopeLock ScopeLock(&InfoLock);
 	return TaskInfo.CurrentSize;
 }
 
 int32 DownloadTask::GetPercentage() const
 {
-	int32 Total = TaskInfo.TotalSize;
+	const int64 Total = GetTotalSize();
 	if (Total < 1)
 	{
 		return 0;
 	}
 	else
 	{
-		float progress = GetCurrentSize() / GetTotalSize();
-		return (int)(progress * 100);
+		return (int32)(GetCurrentSize() * 100 / Total);
 	}
 	
 }
 
 void DownloadTask::SetETag(const FString& ETag)
 {
+	FScopeLock ScopeLock(&InfoLock);
 	TaskInfo.ETag = ETag;
 }
 
@@ -141,6 +159,46 @@ const FString& DownloadTask::GetETag() const
 	return TaskInfo.ETag;
 }
 
+void DownloadTask::SetHash(const FString& InHash)
+{
+	TaskInfo.Hash = InHash;
+}
+
+void DownloadTask::SetPriority(int32 InPriority)
+{
+	TaskInfo.Priority = InPriority;
+}
+
+int32 DownloadTask::GetPriority() const
+{
+	return TaskInfo.Priority;
+}
+
+void DownloadTask::SetRemoteInfoKnown(bool bKnown)
+{
+	bRemoteInfoKnown = bKnown;
+}
+
+int64 DownloadTask::GetOutputSize() const
+{
+	return GetCurrentSize();
+}
+
+double DownloadTask::GetDecodeSeconds() const
+{
+	return 0.0;
+}
+
+int64 DownloadTask::GetDeltaSavedSize() const
+{
+	return 0;
+}
+
+FDownloadStreamReaderPtr DownloadTask::GetStreamReader() const
+{
+	return nullptr;
+}
+
 bool DownloadTask::Start()
 {
 	SetNeedStop(false);
@@ -165,6 +223,34 @@ bool DownloadTask::Start()
 	}
 
 
+	//size & version given by a manifest are trusted, no HEAD needed
+	bValidated = false;
+	if (bRemoteInfoKnown)
+	{
+		EncodeUrl();
+		TaskState = ETaskState::DOWNLOADING;
+		ProcessTaskEvent(ETaskEvent::START_DOWNLOAD, TaskInfo, 0);
+		OnRemoteInfoReady();
+		return true;
+	}
+
+	//the file of an earlier run is still fresh, no request needed
+	FTaskInformation Local;
+	bool bFresh = false;
+	{
+		FScopeLock ScopeLock(&InfoLock);
+		Local = LocalInfo;
+		bFresh = bLocalFresh;
+	}
+	if (bFresh && Sink->IsFile())
+	{
+		EncodeUrl();
+		TaskState = ETaskState::DOWNLOADING;
+		ProcessTaskEvent(ETaskEvent::START_DOWNLOAD, TaskInfo, 0);
+		CompleteFromLocal(Local);
+		return true;
+	}
+
 	/*every time we start download(include resume from pause), we should check task information,
 	for the remote resource may be changed during pausing*/
 	GetHead();
@@ -174,26 +260,32 @@ bool DownloadTask::Start()
 
 bool DownloadTask::Stop()
 {
-	if (Request.IsValid())
+	if (MemoryBudget.IsValid())
 	{
-		if (Request->OnProcessRequestComplete().IsBound())
-		{
-			Request->OnProcessRequestComplete().Unbind();
-		}
-
-		Request->CancelRequest();
-		Request = nullptr;
+		MemoryBudget->CancelWait(this);
 	}
+	if (BandwidthLimiter.IsValid())
+	{
+		BandwidthLimiter->CancelWait(this);
+	}
+	ReleaseBudget();
 
-	if (TargetFile)
 	{
-		delete TargetFile;
-		TargetFile = nullptr;
+		FScopeLock ScopeLock(&RequestLock);
+		//set first so a worker sends no request after the cancel
+		SetNeedStop(true);
+		++RequestSerial;
+
+		if (RequestHandle != 0)
+		{
+			Transport->Cancel(RequestHandle);
+			RequestHandle = 0;
+		}
 	}
 
-	TaskState = ETaskState::WAIT;
+	CloseSink();
 
-	SetNeedStop(true);	
+	TaskState = ETaskState::WAIT;
 	return true;
 
 	return false;
@@ -205,10 +297,19 @@ int32 DownloadTask::GetGuid() const
 }
 
 void DownloadTask::ReGenerateGUID()
+{
+	TaskInfo.GUID = NewGuid();
+}
+
+void DownloadTask::SetGuid(int32 InGuid)
+{
+	TaskInfo.GUID = InGuid;
+}
+
+int32 DownloadTask::NewGuid()
 {
 	static int32 TmpID = 0;
-	++TmpID;
-	TaskInfo.GUID = TmpID;
+	return ++TmpID;
 }
 
 bool DownloadTask::IsDownloading() const
@@ -218,6 +319,7 @@ bool DownloadTask::IsDownloading() const
 
 FTaskInformation DownloadTask::GetTaskInformation() const
 {
+	FScopeLock ScopeLock(&InfoLock);
 	return TaskInfo;
 }
 
@@ -251,350 +353,1233 @@ bool DownloadTask::SaveTaskToJsonFile(const FString& InFileName) const
 
 }
 
-void DownloadTask::GetHead()
+void DownloadTask::SetMemoryBudget(FDownloadMemoryBudgetPtr InBudget)
+{
+	MemoryBudget = InBudget;
+}
+
+void DownloadTask::SetBandwidthLimiter(FDownloadBandwidthLimiterPtr InLimiter)
+{
+	BandwidthLimiter = InLimiter;
+}
+
+void DownloadTask::SetChunkSize(int32 InChunkSize)
 {
-#if PLATFORM_IOS
-	Request = FHttpModule::Get().CreateRequest();
-#else
-	if (Request.IsValid() == false)
+	if (IsDownloading() == false && InChunkSize > 0)
 	{
-		Request = FHttpModule::Get().CreateRequest();
-		FHttpModule::Get().GetHttpManager().AddRequest(Request.ToSharedRef());
+		ChunkSize = InChunkSize;
 	}
-#endif
+}
 
+void DownloadTask::SetSyncOnFinalize(bool bSync)
+{
+	bSyncOnFinalize = bSync;
+}
 
-	EncodedUrl = GetSourceUrl();
+void DownloadTask::SetHostProfiles(FHostProfileStorePtr InProfiles)
+{
+	HostProfiles = InProfiles;
+}
 
-	//https://www.google.com/
-	static int32 URLTag = 8;
-	int32 StartSlash = GetSourceUrl().Find(FString("/"), ESearchCase::IgnoreCase, ESearchDir::FromStart, URLTag);
-	if (StartSlash > INDEX_NONE)
-	{
-		FString UrlLeft = GetSourceUrl().Left(StartSlash);
-		FString UrlRight = GetSourceUrl().Mid(StartSlash);
-		TArray<FString> UrlDirectory;
-		UrlRight.ParseIntoArray(UrlDirectory, *FString("/"));
+void DownloadTask::SetTrustETag(bool bTrust)
+{
+	bTrustETag = bTrust;
+}
 
-		EncodedUrl = UrlLeft;
+void DownloadTask::SetVerifyHash(bool bVerify)
+{
+	bVerifyHash = bVerify;
+}
 
-		for (int32 i = 0; i < UrlDirectory.Num(); ++i)
-		{
-			UrlDirectory[i] = FGenericPlatformHttp::UrlEncode(UrlDirectory[i]);
-			EncodedUrl += FString("/");
-			EncodedUrl += UrlDirectory[i];
-		}
-	}
+bool DownloadTask::IsHashVerified() const
+{
+	return bHashVerified;
+}
 
-	Request->SetVerb("HEAD");
-	Request->SetURL(EncodedUrl);
-	Request->OnProcessRequestComplete().BindRaw(this, &DownloadTask::OnGetHeadCompleted);
-	Request->ProcessRequest();
+void DownloadTask::SetRetrySeed(int32 InSeed)
+{
+	RetryRandom.Initialize(InSeed);
+}
 
-	TaskState = ETaskState::DOWNLOADING;
-	ProcessTaskEvent(ETaskEvent::START_DOWNLOAD, TaskInfo, 0);
+bool DownloadTask::IsBusy() const
+{
+	return BusySteps > 0;
 }
 
-void DownloadTask::OnGetHeadCompleted(FHttpRequestPtr InRequest, FHttpResponsePtr InResponse, bool bWasSuccessful)
+bool DownloadTask::IsHashSupported(const FString& InHash)
 {
-	//we should check return code first to ensure the URL & network is OK.
-	if (InResponse.IsValid() == false || bWasSuccessful == false)
+	if (InHash.Len() != 32 && InHash.Len() != 40)
 	{
-		UE_LOG(LogFileDownloader, Warning, TEXT("%s:%d"), UTF8_TO_TCHAR(__FUNCTION__), __LINE__);
+		return false;
+	}
 
-		if (CurrentTryCount >= MaxTryCount)
+	for (TCHAR Char : InHash)
+	{
+		if (CheckTCharIsHex(Char) == false)
 		{
-			TaskState = ETaskState::ERROR;
-			ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, InResponse.IsValid() ? InResponse->GetResponseCode() : 0);
+			return false;
 		}
-		else
-		{
-			TaskState = ETaskState::WAIT;
-			++CurrentTryCount;
+	}
+	return true;
+}
 
-			Start();
-		}
+bool DownloadTask::MatchesHash(const FString& InFileName, const FString& InHash)
+{
+	if (IsHashSupported(InHash) == false)
+	{
+		return false;
+	}
 
-		return;
+	TUniquePtr<IFileHandle> Handle(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*InFileName));
+	if (Handle.IsValid() == false)
+	{
+		return false;
 	}
-	int32 RetutnCode = InResponse->GetResponseCode();
 
-	if (EHttpResponseCodes::IsOk(RetutnCode) == false)
+	//read in blocks, files may be larger than memory allows
+	const bool bMD5 = InHash.Len() == 32;
+	FMD5 MD5;
+	FSHA1 SHA1;
+	TArray<uint8> Buffer;
+	Buffer.SetNumUninitialized(1024 * 1024);
+	for (int64 Remaining = Handle->Size(); Remaining > 0;)
 	{
-		UE_LOG(LogFileDownloader, Warning, TEXT("Http return code error : %d"), RetutnCode);
-		if (TargetFile != nullptr)
+		const int32 Size = (int32)FMath::Min<int64>(Remaining, Buffer.Num());
+		if (Handle->Read(Buffer.GetData(), Size) == false)
 		{
-			delete TargetFile;
-			TargetFile = nullptr;
+			return false;
 		}
 
-		TaskState = ETaskState::ERROR;
-		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, RetutnCode);
-		return;
+		if (bMD5)
+		{
+			MD5.Update(Buffer.GetData(), Size);
+		}
+		else
+		{
+			SHA1.Update(Buffer.GetData(), Size);
+		}
+		Remaining -= Size;
 	}
 
-	if (RetutnCode == 200)
+	uint8 Digest[20];
+	if (bMD5)
 	{
-		SetTotalSize(InResponse->GetContentLength());
+		MD5.Final(Digest);
 	}
-
-	if (TargetFile != nullptr)
+	else
 	{
-		delete TargetFile;
-		TargetFile = nullptr;
+		SHA1.Final();
+		SHA1.GetHash(Digest);
 	}
-	TargetFile = PlatformFile->OpenWrite(*FString(GetFullFileName() + TEMP_FILE_EXTERN), true);
 
-	if (TargetFile == nullptr)
+	return BytesToHex(Digest, bMD5 ? 16 : 20).Equals(InHash, ESearchCase::IgnoreCase);
+}
+
+void DownloadTask::SetContentCache(FContentCachePtr InCache)
+{
+	ContentCache = InCache;
+}
+
+void DownloadTask::SetStreamStage(FDownloadStreamStagePtr InStage)
+{
+	StreamStage = InStage;
+}
+
+void DownloadTask::SetSinkType(EDownloadSinkType InType)
+{
+	if (InType == SinkType || IsDownloading())
 	{
-		UE_LOG(LogFileDownloader, Warning, TEXT("%s, %d, create temp file error !"));
-		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, RetutnCode);
-		TaskState = ETaskState::ERROR;
 		return;
 	}
-	else
+
+	SinkType = InType;
+	Sink = CreateDownloadSink(InType);
+}
+
+EDownloadSinkType DownloadTask::GetSinkType() const
+{
+	return SinkType;
+}
+
+TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> DownloadTask::GetMemoryData() const
+{
+	return MemoryData;
+}
+
+void DownloadTask::SetRunOffGameThread(bool bOffGameThread)
+{
+	bRunOffGameThread = bOffGameThread;
+}
+
+void DownloadTask::SetTransport(FDownloadTransportPtr InTransport)
+{
+	if (InTransport.IsValid() == false || IsDownloading())
 	{
-		SetCurrentSize(TargetFile->Size());
+		return;
 	}
 
-	FString TempJsonStr;
-	FTaskInformation ExistTaskInfo;
-	if (FFileHelper::LoadFileToString(TempJsonStr, *FString(GetFullFileName() + TASK_JSON)))
+	Transport = InTransport;
+}
+
+void DownloadTask::CloseSink()
+{
+	FScopeLock ScopeLock(&SinkLock.Get());
+	if (Sink.IsValid())
 	{
-		ExistTaskInfo.DeserializeFromJsonString(TempJsonStr);
+		Sink->Close();
 	}
+}
+
+bool DownloadTask::OpenSink(bool bResume)
+{
+	FScopeLock ScopeLock(&SinkLock.Get());
+	Sink->Close();
+	return Sink->Open(GetTempFileName(), bResume, GetTotalSize());
+}
+
+void DownloadTask::GetHead()
+{
+	EncodeUrl();
+
+	//set before sending, the response may arrive on another thread right away
+	TaskState = ETaskState::DOWNLOADING;
+	ProcessTaskEvent(ETaskEvent::START_DOWNLOAD, TaskInfo, 0);
 
-	//the remote file has updated,we need to re-download
-	FString NewETag = InResponse->GetHeader("ETag");
-	SetETag(NewETag);
-	if (NewETag.IsEmpty() || NewETag != ExistTaskInfo.ETag)
+	FDownloadRequest HeadRequest;
+	HeadRequest.Verb = TEXT("HEAD");
+	HeadRequest.Url = EncodedUrl;
+
+	//an unchanged file of an earlier run is revalidated, the server answers 304 if the content is the same
+	FTaskInformation Local;
 	{
-		SetCurrentSize(0);
+		FScopeLock ScopeLock(&InfoLock);
+		if (bLocalIntact && Sink->IsFile())
+		{
+			Local = LocalInfo;
+		}
+	}
+	if (Local.ETag.IsEmpty() == false)
+	{
+		HeadRequest.Headers.Emplace(TEXT("If-None-Match"), Local.ETag);
+	}
+	if (Local.LastModified.IsEmpty() == false)
+	{
+		HeadRequest.Headers.Emplace(TEXT("If-Modified-Since"), Local.LastModified);
 	}
 
-	//if target file already exist, make this task complete. 
-	bool bExist = PlatformFile->FileExists(*GetFullFileName());
-	if (bExist && !NewETag.IsEmpty() && NewETag == ExistTaskInfo.ETag)
+	const bool bConditional = HeadRequest.Headers.Num() > 0;
+	const double SendTime = FPlatformTime::Seconds();
+	SendRequest(HeadRequest, [this, bConditional, Local, SendTime](FDownloadResponsePtr InResponse, bool bSucceeded)
 	{
-		delete TargetFile;
-		TargetFile = nullptr;
-		PlatformFile->DeleteFile(*FString(GetFullFileName() + TEMP_FILE_EXTERN));
+		//a HEAD without connection setup takes about one round trip, the http module cannot tell the setup apart
+		if (bSucceeded && InResponse.IsValid() && InResponse->NewConnections >= 0 && this->HostProfiles.IsValid())
+		{
+			this->HostProfiles->AddRtt(GetUrlHostKey(this->GetSourceUrl()), FPlatformTime::Seconds() - SendTime - InResponse->SetupSeconds);
+		}
+
+		if (bConditional && bSucceeded && InResponse.IsValid() && InResponse->GetResponseCode() == 304)
+		{
+			this->ProcessRequestResult(0, true);
+			this->UpdateFreshness(InResponse);
+			this->bValidated = true;
+			this->CompleteFromLocal(Local);
+			return;
+		}
 
-		SetCurrentSize(GetTotalSize());
+		this->OnGetHeadCompleted(InResponse, bSucceeded);
+	});
+}
 
-		OnTaskCompleted();
-		return;
+void DownloadTask::CheckFreshness(int32 InDefaultMaxAge, TFunction<void(bool bFresh)> InDone)
+{
+	if (GetFileName().IsEmpty())
+	{
+		SetFileName(FPaths::GetCleanFilename(GetSourceUrl()));
 	}
 
-	//save task info to disk
-	SaveTaskToJsonFile(FString(""));
+	//the task may be cleared before the sidecar is read, the result is then dropped
+	const FString FullFileName = GetFullFileName();
+	RunOnWorker([this, FullFileName, InDefaultMaxAge, InDone]()
+	{
+		FTaskInformation Local;
+		bool bIntact = false;
+		const bool bFresh = ReadLocalInfo(FullFileName, InDefaultMaxAge, Local, bIntact);
+		this->SetLocalInfo(Local, bIntact, bFresh);
+		InDone(bFresh);
+	});
+}
 
-	StartChunk();
-    
+void DownloadTask::SetLocalInfo(const FTaskInformation& InLocalInfo, bool bIntact, bool bFresh)
+{
+	FScopeLock ScopeLock(&InfoLock);
+	LocalInfo = InLocalInfo;
+	bLocalIntact = bIntact;
+	bLocalFresh = bFresh;
 }
 
-void DownloadTask::StartChunk()
+bool DownloadTask::ReadLocalInfo(const FString& InFullFileName, int32 InDefaultMaxAge, FTaskInformation& OutLocalInfo, bool& bOutIntact)
 {
-	//start download a chunk
-#if PLATFORM_IOS
-	Request = FHttpModule::Get().CreateRequest();
-#else
-	if (Request.IsValid() == false)
+	//only a completed & confirmed file has a local size in its sidecar
+	FString TempJsonStr;
+	bOutIntact = false;
+	if (FFileHelper::LoadFileToString(TempJsonStr, *FString(InFullFileName + TASK_JSON)) == false || OutLocalInfo.DeserializeFromJsonString(TempJsonStr) == false
+		|| OutLocalInfo.ValidatedTime < 1 || OutLocalInfo.LocalSize < 1)
 	{
-		Request = FHttpModule::Get().CreateRequest();
-		FHttpModule::Get().GetHttpManager().AddRequest(Request.ToSharedRef());
+		return false;
 	}
-#endif
-    
-	Request->SetVerb("GET");
-	Request->SetURL(EncodedUrl);
 
-	int32 StartPostion = GetCurrentSize();
-	int32 EndPosition = StartPostion + ChunkSize - 1;
-	//lastPosition = TotalSize-1 
-	if (EndPosition >= GetTotalSize())
+	//may run before any task has set up PlatformFile
+	const FFileStatData Stat = FPlatformFileManager::Get().GetPlatformFile().GetStatData(*InFullFileName);
+	bOutIntact = Stat.bIsValid && Stat.FileSize == OutLocalInfo.LocalSize && Stat.ModificationTime.ToUnixTimestamp() == OutLocalInfo.LocalModifiedTime;
+	const int32 MaxAge = OutLocalInfo.MaxAge >= 0 ? OutLocalInfo.MaxAge : InDefaultMaxAge;
+	return bOutIntact && FDateTime::UtcNow().ToUnixTimestamp() < OutLocalInfo.ValidatedTime + MaxAge;
+}
+
+void DownloadTask::CompleteFromLocal(const FTaskInformation& InLocalInfo)
+{
+	SetETag(InLocalInfo.ETag);
+	SetTotalSize(InLocalInfo.TotalSize);
 	{
-		EndPosition = GetTotalSize() - 1;
+		FScopeLock ScopeLock(&InfoLock);
+		TaskInfo.LastModified = InLocalInfo.LastModified;
 	}
+	SetCurrentSize(GetTotalSize());
+	CloseSink();
+	CompleteWithStage(GetFullFileName());
+}
 
-	if (StartPostion >= EndPosition)
+void DownloadTask::UpdateFreshness(FDownloadResponsePtr InResponse)
+{
+	//no-cache & no-store allow storing but every use must be revalidated
+	const FString CacheControl = InResponse->GetHeader(TEXT("Cache-Control")).ToLower();
+	int32 MaxAge = -1;
+	const int32 MaxAgePos = CacheControl.Find(TEXT("max-age="));
+	if (CacheControl.Contains(TEXT("no-cache")) || CacheControl.Contains(TEXT("no-store")))
 	{
-		UE_LOG(LogFileDownloader, Warning, TEXT("Error! StartPostion >= EndPosition"));
-		return;
+		MaxAge = 0;
+	}
+	else if (MaxAgePos != INDEX_NONE)
+	{
+		MaxAge = FMath::Max(0, FCString::Atoi(*CacheControl.Mid(MaxAgePos + 8)));
 	}
 
-	FString RangeStr = FString("bytes=") + FString::FromInt(StartPostion) + FString(TEXT("-")) + FString::FromInt(EndPosition);
-	Request->SetHeader(FString("Range"), RangeStr);
+	const FString LastModified = InResponse->GetHeader(TEXT("Last-Modified"));
 
-	Request->OnProcessRequestComplete().BindRaw(this, &DownloadTask::OnGetChunkCompleted);
-	Request->ProcessRequest();
+	FScopeLock ScopeLock(&InfoLock);
+	if (LastModified.IsEmpty() == false)
+	{
+		TaskInfo.LastModified = LastModified;
+	}
+	TaskInfo.MaxAge = MaxAge;
+	TaskInfo.ValidatedTime = FDateTime::UtcNow().ToUnixTimestamp();
 }
 
-FString DownloadTask::GetFullFileName() const
+void DownloadTask::EncodeUrl()
 {
-	return GetDirectory() + TEXT("/") + GetFileName();
-}
+	EncodedUrl = GetSourceUrl();
 
-void DownloadTask::OnGetChunkCompleted(FHttpRequestPtr InRequest, FHttpResponsePtr InResponse, bool bWasSuccessful)
-{
-	if (bNeedStop)
+	//https://www.google.com/
+	static int32 URLTag = 8;
+	int32 StartSlash = GetSourceUrl().Find(FString("/"), ESearchCase::IgnoreCase, ESearchDir::FromStart, URLTag);
+	if (StartSlash > INDEX_NONE)
 	{
-		TaskState = ETaskState::WAIT;
-		ProcessTaskEvent(ETaskEvent::STOP, TaskInfo, InResponse->GetResponseCode());
+		FString UrlLeft = GetSourceUrl().Left(StartSlash);
+		FString UrlRight = GetSourceUrl().Mid(StartSlash);
+		TArray<FString> UrlDirectory;
+		UrlRight.ParseIntoArray(UrlDirectory, *FString("/"));
+
+		EncodedUrl = UrlLeft;
 
-		if (TargetFile)
+		for (int32 i = 0; i < UrlDirectory.Num(); ++i)
 		{
-			delete TargetFile;
-			TargetFile = nullptr;
+			UrlDirectory[i] = FGenericPlatformHttp::UrlEncode(UrlDirectory[i]);
+			EncodedUrl += FString("/");
+			EncodedUrl += UrlDirectory[i];
 		}
-		return;
 	}
+}
 
-	if (InResponse.IsValid() == false || bWasSuccessful == false)
+void DownloadTask::OnGetHeadCompleted(FDownloadResponsePtr InResponse, bool bWasSuccessful)
+{
+	//we should check return code first to ensure the URL & network is OK.
+	const int32 RetutnCode = InResponse.IsValid() ? InResponse->GetResponseCode() : 0;
+	const bool bFailed = InResponse.IsValid() == false || bWasSuccessful == false;
+	if (bFailed || EHttpResponseCodes::IsOk(RetutnCode) == false)
 	{
-		UE_LOG(LogFileDownloader, Warning, TEXT("%s:%d"), UTF8_TO_TCHAR(__FUNCTION__), __LINE__);
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, HEAD failed, return code : %d"), *GetSourceUrl(), RetutnCode);
+		ProcessRequestResult(0, false);
 
-		if (CurrentTryCount >= MaxTryCount)
+		if ((bFailed == false && IsRetryableCode(RetutnCode) == false) || CurrentTryCount >= MaxTryCount)
 		{
+			CloseSink();
 			TaskState = ETaskState::ERROR;
-			ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, InResponse.IsValid() ? InResponse->GetResponseCode() : 0);
+			ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, RetutnCode);
 		}
 		else
 		{
-			TaskState = ETaskState::WAIT;
+			const double Delay = GetRetryDelay(InResponse);
 			++CurrentTryCount;
-
-			Start();
+			RunTaskStepAfterDelay(Delay, [this]()
+			{
+				this->GetHead();
+			});
 		}
 
 		return;
 	}
-	int32 RetCode = InResponse->GetResponseCode();
 
-	if (EHttpResponseCodes::IsOk(RetCode) == false)
+	ProcessRequestResult(0, true);
+	UpdateFreshness(InResponse);
+	bValidated = true;
+
+	if (RetutnCode == 200)
 	{
-		UE_LOG(LogFileDownloader, Warning, TEXT("%s, Return code error: %d"), *GetSourceUrl(), InResponse->GetResponseCode());
-		if (TargetFile != nullptr)
-		{
-			delete TargetFile;
-			TargetFile = nullptr;
-		}
-		TaskState = ETaskState::ERROR;
-		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, RetCode);
-		return;
+		SetTotalSize(InResponse->GetContentLength());
 	}
 
-	DataBuffer = InResponse->GetContent();
+	SetETag(InResponse->GetHeader("ETag"));
+	OnRemoteInfoReady();
+}
 
+void DownloadTask::OnRemoteInfoReady()
+{
+	//nothing on disk to reuse or resume
+	if (Sink->IsFile() == false)
+	{
+		StartDownloadChunks(false);
+		return;
+	}
 
-	//Async write chunk buffer to file 
-	Async(EAsyncExecution::ThreadPool, [this]()->int32
+	//the sidecar & the target file are checked on a worker, thousands of small tasks would hitch the game thread
+	const FString FullFileName = GetFullFileName();
+	const FString TempFileName = GetTempFileName();
+	const FString ETag = GetETag();
+	const FString Hash = GetTaskInformation().Hash;
+	RunOnWorker([this, FullFileName, TempFileName, ETag, Hash]()
 	{
-		if (this->TargetFile != nullptr)
+		FString TempJsonStr;
+		FTaskInformation ExistTaskInfo;
+		if (FFileHelper::LoadFileToString(TempJsonStr, *FString(FullFileName + TASK_JSON)))
 		{
-			this->TargetFile->Seek(this->GetCurrentSize());
-			bool bWriteRet = this->TargetFile->Write(DataBuffer.GetData(), DataBuffer.Num());
-			if (bWriteRet)
-			{
-				this->TargetFile->Flush();
-				//return to game thread
-				FFunctionGraphTask::CreateAndDispatchWhenReady([this]() {
-					this->OnWriteChunkEnd(this->DataBuffer.Num());
-				}, TStatId(), nullptr, ENamedThreads::GameThread);
-			}
-			else
-			{
-				//return to game thread
-				FFunctionGraphTask::CreateAndDispatchWhenReady([this]() {
-					UE_LOG(LogFileDownloader, Warning, TEXT("%s, %d, Async write file error !"), __FUNCTION__, __LINE__);
-					this->TaskState = ETaskState::ERROR;
-					this->ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, this->TaskInfo, -1);
-				}, TStatId(), nullptr, ENamedThreads::GameThread);
+			ExistTaskInfo.DeserializeFromJsonString(TempJsonStr);
+		}
 
-			}
+		//the remote file has updated,we need to re-download
+		const bool bSameContent = (!ETag.IsEmpty() && ETag == ExistTaskInfo.ETag)
+			|| (!Hash.IsEmpty() && Hash == ExistTaskInfo.Hash);
 
-			return 0;
+		//if target file already exist, make this task complete. 
+		const bool bExist = PlatformFile->FileExists(*FullFileName);
+		if (bExist && bSameContent)
+		{
+			PlatformFile->DeleteFile(*TempFileName);
 		}
-		else
+
+		this->RunTaskStep([this, bSameContent, bExist]() {
+			if (this->GetState() != ETaskState::DOWNLOADING || this->GetNeedStop())
+			{
+				return;
+			}
+
+			if (bExist && bSameContent)
+			{
+				this->CloseSink();
+				this->SetCurrentSize(this->GetTotalSize());
+				this->CompleteWithStage(this->GetFullFileName());
+				return;
+			}
+
+			//the same content may have been downloaded before, by this task or another one
+			if (this->TryCompleteFromCache())
+			{
+				return;
+			}
+
+			this->StartDownloadChunks(bSameContent);
+		});
+	});
+}
+
+void DownloadTask::StartDownloadChunks(bool bResume)
+{
+	if (StreamStage.IsValid())
+	{
+		{
+			FScopeLock ScopeLock(&StageLock);
+			StreamStage->Reset();
+		}
+
+		//the stage must see the bytes already downloaded before new ones
+		if (bResume && PlatformFile->FileSize(*GetTempFileName()) > 0)
+		{
+			FeedStageFromFile(GetTempFileName(), [this](bool bSucceeded)
+			{
+				if (bSucceeded == false)
+				{
+					UE_LOG(LogFileDownloader, Warning, TEXT("%s, downloaded data rejected by stage, restart"), *this->GetFileName());
+					FScopeLock ScopeLock(&this->StageLock);
+					this->StreamStage->Reset();
+				}
+				this->OpenTempFileAndStart(bSucceeded);
+			});
+			return;
+		}
+	}
+
+	OpenTempFileAndStart(bResume);
+}
+
+void DownloadTask::OpenTempFileAndStart(bool bResume)
+{
+	//a changed remote file cannot be resumed, truncate the temp file
+	if (OpenSink(bResume) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, create temp file error !"), *GetFileName());
+		TaskState = ETaskState::ERROR;
+		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+		return;
+	}
+
+	SetCurrentSize(bResume ? Sink->GetResumeSize() : 0);
+
+	//save task info to disk, data kept in memory cannot be resumed
+	if (Sink->IsFile())
+	{
+		SaveTaskToJsonFile(FString(""));
+	}
+
+	StartChunk();
+}
+
+FString DownloadTask::GetContentKey() const
+{
+	if (TaskInfo.Hash.IsEmpty() == false)
+	{
+		return FString(TEXT("hash|")) + TaskInfo.Hash;
+	}
+
+	return FContentCache::MakeKey(GetSourceUrl(), GetETag(), GetTotalSize());
+}
+
+bool DownloadTask::TryCompleteFromCache()
+{
+	if (ContentCache.IsValid() == false)
+	{
+		return false;
+	}
+
+	const FString Key = GetContentKey();
+	if (Key.IsEmpty())
+	{
+		return false;
+	}
+
+	if (ContentCache->Contains(Key) == false)
+	{
+		ContentCache->AddMiss();
+		return false;
+	}
+
+	CloseSink();
+
+	//linking is cheap but a copy of a large file is not, keep it off the game thread
+	FContentCachePtr Cache = ContentCache;
+	const FString TempFileName = GetTempFileName();
+	RunOnWorker([this, Cache, Key, TempFileName]()
+	{
+		const bool bHit = Cache->Materialize(Key, TempFileName);
+
+		this->RunTaskStep([this, bHit]() {
+			if (this->GetState() != ETaskState::DOWNLOADING || this->GetNeedStop())
+			{
+				return;
+			}
+
+			if (bHit)
+			{
+				this->SetCurrentSize(this->GetTotalSize());
+				this->SaveTaskToJsonFile(FString(""));
+				this->CompleteWithStage(this->GetTempFileName());
+			}
+			else
+			{
+				this->StartDownloadChunks(false);
+			}
+		});
+	});
+
+	return true;
+}
+
+void DownloadTask::FeedStageFromFile(const FString& InFileName, TFunction<void(bool bSucceeded)> InDone)
+{
+	FDownloadStreamStagePtr Stage = StreamStage;
+	RunOnWorker([this, Stage, InFileName, InDone]()
+	{
+		bool bResult = false;
 		{
-			return -1;
+			FScopeLock ScopeLock(&this->StageLock);
+			IFileHandle* ReadFile = PlatformFile->OpenRead(*InFileName);
+			if (ReadFile != nullptr)
+			{
+				const int64 FileSize = ReadFile->Size();
+				int64 Offset = Stage->GetConsumedSize();
+				TArray<uint8> Block;
+				Block.SetNumUninitialized(1024 * 1024);
+
+				bResult = ReadFile->Seek(Offset);
+				while (bResult && Offset < FileSize)
+				{
+					const int32 Size = (int32)FMath::Min<int64>(Block.Num(), FileSize - Offset);
+					bResult = ReadFile->Read(Block.GetData(), Size) && Stage->Consume(Offset, Block.GetData(), Size);
+					Offset += Size;
+				}
+				delete ReadFile;
+			}
 		}
+
+		this->RunTaskStep([this, bResult, InDone]() {
+			if (this->GetState() == ETaskState::DOWNLOADING && this->GetNeedStop() == false)
+			{
+				InDone(bResult);
+			}
+		});
 	});
-	
 }
 
-void DownloadTask::OnTaskCompleted()
+void DownloadTask::CompleteWithStage(const FString& InFileName)
 {
-	//release file handle, so we can change file name via IFileManager.
-	if (TargetFile != nullptr)
+	if (StreamStage.IsValid() == false)
 	{
-		delete TargetFile;
-		TargetFile = nullptr;
+		OnTaskCompleted();
+		return;
 	}
 
-	FString TmpFileName = GetFullFileName() + TEMP_FILE_EXTERN;
-	bool bOldExist = PlatformFile->FileExists(*GetFullFileName());
-	bool bNewExist = PlatformFile->FileExists(*TmpFileName);
+	{
+		FScopeLock ScopeLock(&StageLock);
+		StreamStage->Reset();
+	}
 
-	//error!
-	if (!bOldExist && !bNewExist)
+	//the file is complete, a stage failure does not fail the download
+	FeedStageFromFile(InFileName, [this](bool bSucceeded)
 	{
-		UE_LOG(LogFileDownloader, Warning, TEXT("%s, file not eixst !"), *GetFileName());
+		this->OnTaskCompleted();
+	});
+}
+
+void DownloadTask::StoreToCache()
+{
+	if (ContentCache.IsValid() == false)
+	{
+		return;
+	}
+
+	const FString Key = GetContentKey();
+	if (Key.IsEmpty() || ContentCache->Contains(Key))
+	{
+		return;
+	}
+
+	FContentCachePtr Cache = ContentCache;
+	const FString FileName = GetFullFileName();
+	Async(EAsyncExecution::ThreadPool, [Cache, Key, FileName]()
+	{
+		Cache->Store(Key, FileName);
+	});
+}
+
+void DownloadTask::StartChunk()
+{
+	const int64 StartPostion = GetCurrentSize();
+	//lastPosition = TotalSize-1, a chunk may be the whole file
+	const int64 EndPosition = FMath::Min<int64>(StartPostion + ChunkSize - 1, GetTotalSize() - 1);
+
+	//a temp file resumed at its full size only needs to be finalized
+	if (GetTotalSize() > 0 && StartPostion >= GetTotalSize())
+	{
+		OnTaskCompleted();
+		return;
+	}
+
+	//a task waiting for nothing would never end
+	if (StartPostion > EndPosition)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, nothing to request at %lld of %lld bytes"), *GetFileName(), StartPostion, GetTotalSize());
+		ReleaseBudget();
+		CloseSink();
 		TaskState = ETaskState::ERROR;
 		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
 		return;
 	}
 
-	if (!bOldExist)
+	//wait until other tasks release their chunk data
+	if (AcquireBudget((int32)(EndPosition - StartPostion + 1)) == false)
+	{
+		return;
+	}
+
+	//start download a chunk
+	ChunkOffset = StartPostion;
+
+	const FString RangeStr = FString::Printf(TEXT("bytes=%lld-%lld"), StartPostion, EndPosition);
+	SendRangeRequest(RangeStr, EndPosition - StartPostion + 1);
+}
+
+void DownloadTask::SendRequest(FDownloadRequest& InRequest, TFunction<void(FDownloadResponsePtr InResponse, bool bSucceeded)> InHandler)
+{
+	FScopeLock ScopeLock(&RequestLock);
+	if (bNeedStop)
+	{
+		ReleaseBudget();
+		return;
+	}
+
+	InRequest.bCompleteOnGameThread = bRunOffGameThread == false;
+	const uint64 Serial = ++RequestSerial;
+	TWeakPtr<DownloadTask, ESPMode::ThreadSafe> WeakThis = AsShared();
+	RequestHandle = Transport->Send(InRequest, [WeakThis, Serial, InHandler](FDownloadResponsePtr InResponse, bool bSucceeded)
 	{
-		//change temp file name to target file name.
-		if (PlatformFile->MoveFile(*GetFullFileName(), *TmpFileName))
+		//a response may race with the destruction of a stopped task
+		FDownloadTaskPtr Task = WeakThis.Pin();
+		if (Task.IsValid() == false || Task->RequestSerial != Serial)
 		{
-			UE_LOG(LogFileDownloader, Warning, TEXT("%s, completed !"), *GetFileName());
-			TaskState = ETaskState::COMPLETED;
-			ProcessTaskEvent(ETaskEvent::DOWNLOAD_COMPLETED, TaskInfo, 0);
 			return;
 		}
-		else
+
+		InHandler(InResponse, bSucceeded);
+	});
+}
+
+void DownloadTask::SendRangeRequest(const FString& InRange, int64 InExpectedSize)
+{
+	FDownloadRequest ChunkRequest;
+	ChunkRequest.Url = EncodedUrl;
+	ChunkRequest.Headers.Emplace(TEXT("Range"), InRange);
+	ChunkRequest.ExpectedSize = InExpectedSize;
+
+	//a changed remote file is then sent whole with its new ETag instead of mixing versions, weak ETags are not allowed
+	const FString ETag = GetTaskInformation().ETag;
+	if (bTrustETag && ETag.IsEmpty() == false && ETag.StartsWith(TEXT("W/")) == false)
+	{
+		ChunkRequest.Headers.Emplace(TEXT("If-Range"), ETag);
+	}
+
+	//data of peers is checked by the hash, a hash that cannot be checked keeps them out
+	const FString Hash = GetTaskInformation().Hash;
+	ChunkRequest.bAllowPeers = bAllowPeers && (Hash.IsEmpty() || IsHashSupported(Hash));
+	ChunkSendTime = FPlatformTime::Seconds();
+
+	//"bytes=first-last", the response of a single range is checked against it
+	FString First;
+	FString Last;
+	const bool bSingleRange = InRange.Contains(TEXT(",")) == false && InRange.Mid(6).Split(TEXT("-"), &First, &Last) && Last.IsEmpty() == false;
+	RangeOffset = bSingleRange ? FCString::Atoi64(*First) : 0;
+	RangeLength = bSingleRange ? FCString::Atoi64(*Last) - RangeOffset + 1 : 0;
+	SendRequest(ChunkRequest, [this](FDownloadResponsePtr InResponse, bool bSucceeded)
+	{
+		this->OnGetChunkCompleted(InResponse, bSucceeded);
+	});
+}
+
+void DownloadTask::RunTaskStep(TFunction<void()> InStep)
+{
+	if (bRunOffGameThread)
+	{
+		InStep();
+		return;
+	}
+
+	//return to game thread, the task may be destroyed before the step runs
+	TWeakPtr<DownloadTask, ESPMode::ThreadSafe> WeakThis = AsShared();
+	++BusySteps;
+	FFunctionGraphTask::CreateAndDispatchWhenReady([WeakThis, InStep]()
+	{
+		FDownloadTaskPtr Task = WeakThis.Pin();
+		if (Task.IsValid())
 		{
-			//error when changing file name.
-			UE_LOG(LogFileDownloader, Warning, TEXT("%s, Change temp file name error !"), *GetFileName());
-			TaskState = ETaskState::ERROR;
-			ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
-			return;
+			InStep();
+			--Task->BusySteps;
+		}
+	}, TStatId(), nullptr, ENamedThreads::GameThread);
+}
+
+void DownloadTask::RunOnWorker(TFunction<void()> InJob)
+{
+	TWeakPtr<DownloadTask, ESPMode::ThreadSafe> WeakThis = AsShared();
+	++BusySteps;
+	Async(EAsyncExecution::ThreadPool, [WeakThis, InJob]()
+	{
+		FDownloadTaskPtr Task = WeakThis.Pin();
+		if (Task.IsValid())
+		{
+			InJob();
+			--Task->BusySteps;
+		}
+	});
+}
+
+bool DownloadTask::AcquireBudget(int32 InBytes)
+{
+	//a waiter may be woken while the task is destroyed
+	TWeakPtr<DownloadTask, ESPMode::ThreadSafe> WeakThis = AsShared();
+	auto Restart = [WeakThis]()
+	{
+		FDownloadTaskPtr Task = WeakThis.Pin();
+		if (Task.IsValid() && Task->IsDownloading() && Task->GetNeedStop() == false)
+		{
+			Task->StartChunk();
+		}
+	};
+
+	//memory is kept while waiting for bandwidth, the restarted chunk does not reserve it again
+	if (MemoryBudget.IsValid() && ReservedBytes < 1)
+	{
+		if (MemoryBudget->TryAcquire(InBytes) == false)
+		{
+			MemoryBudget->WaitFor(this, Restart);
+			return false;
+		}
+		ReservedBytes = InBytes;
+	}
+
+	if (BandwidthLimiter.IsValid() && BandwidthLimiter->TryConsume(InBytes) == false)
+	{
+		BandwidthLimiter->WaitFor(this, Restart);
+		return false;
+	}
+
+	return true;
+}
+
+void DownloadTask::ReleaseBudget()
+{
+	if (MemoryBudget.IsValid() && ReservedBytes > 0)
+	{
+		const int32 Bytes = ReservedBytes;
+		ReservedBytes = 0;
+		MemoryBudget->Release(Bytes);
+	}
+}
+
+FString DownloadTask::GetFullFileName() const
+{
+	return GetDirectory() + TEXT("/") + GetFileName();
+}
+
+FString DownloadTask::GetTempFileName() const
+{
+	return GetFullFileName() + TEMP_FILE_EXTERN;
+}
+
+void DownloadTask::OnGetChunkCompleted(FDownloadResponsePtr InResponse, bool bWasSuccessful)
+{
+	if (HandleChunkFailure(InResponse, bWasSuccessful))
+	{
+		return;
+	}
+
+	//read before an ignored range is cut out & turned into 206
+	const int32 RetCode = InResponse->GetResponseCode();
+	if (CheckRangeResponse(InResponse) == false)
+	{
+		return;
+	}
+
+	if (HostProfiles.IsValid() && RangeLength > 0)
+	{
+		const FString Host = GetUrlHostKey(GetSourceUrl());
+		HostProfiles->SetRangeSupport(Host, RetCode == 206);
+		HostProfiles->AddChunk(Host, InResponse->Content.Num(), FPlatformTime::Seconds() - ChunkSendTime - InResponse->SetupSeconds);
+	}
+
+	OnChunkReceived(InResponse);
+}
+
+bool DownloadTask::HandleChunkFailure(FDownloadResponsePtr InResponse, bool bWasSuccessful)
+{
+	if (bNeedStop)
+	{
+		ReleaseBudget();
+		TaskState = ETaskState::WAIT;
+		ProcessTaskEvent(ETaskEvent::STOP, TaskInfo, InResponse.IsValid() ? InResponse->GetResponseCode() : 0);
+
+		CloseSink();
+		return true;
+	}
+
+	if (InResponse.IsValid() == false || bWasSuccessful == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, chunk request failed"), *GetSourceUrl());
+		ProcessRequestResult(0, false);
+		RetryChunkLater(InResponse, InResponse.IsValid() ? InResponse->GetResponseCode() : 0);
+		return true;
+	}
+	int32 RetCode = InResponse->GetResponseCode();
+
+	if (EHttpResponseCodes::IsOk(RetCode) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, Return code error: %d"), *GetSourceUrl(), InResponse->GetResponseCode());
+		ProcessRequestResult(0, false);
+		if (IsRetryableCode(RetCode))
+		{
+			RetryChunkLater(InResponse, RetCode);
+			return true;
+		}
+
+		ReleaseBudget();
+		CloseSink();
+		TaskState = ETaskState::ERROR;
+		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, RetCode);
+		return true;
+	}
+
+	return false;
+}
+
+bool DownloadTask::CheckRangeResponse(FDownloadResponsePtr InResponse)
+{
+	if (RangeLength < 1)
+	{
+		return true;
+	}
+
+	//If-Range sends the whole new file when the remote file changed since the first chunk
+	const FString ETag = InResponse->GetHeader(TEXT("ETag"));
+	const FString LocalETag = GetTaskInformation().ETag;
+	if (bTrustETag && ETag.IsEmpty() == false && LocalETag.IsEmpty() == false && ETag != LocalETag)
+	{
+		//the range was served for our If-Range, so the ETag does not identify the content on this host, the size is checked only from now
+		if (InResponse->GetResponseCode() == 206 && HostProfiles.IsValid())
+		{
+			HostProfiles->SetETagUnreliable(GetUrlHostKey(GetSourceUrl()));
+			bTrustETag = false;
 		}
+
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, ETag changed from %s to %s"), *GetSourceUrl(), *LocalETag, *ETag);
+		RestartChangedRemote();
+		return false;
 	}
-	else if (bNewExist)
+
+	TArray<uint8>& Content = InResponse->Content;
+	if (InResponse->GetResponseCode() == 200)
 	{
-		if (PlatformFile->DeleteFile(*GetFullFileName()) && PlatformFile->MoveFile(*GetFullFileName(), *TmpFileName))
+		//the range was ignored, cut it out of the whole file
+		if (Content.Num() < RangeOffset + RangeLength)
 		{
-			TaskState = ETaskState::COMPLETED;
-			ProcessTaskEvent(ETaskEvent::DOWNLOAD_COMPLETED, TaskInfo, 0);
-			return;
+			UE_LOG(LogFileDownloader, Warning, TEXT("%s, range ignored and %d bytes are too short"), *GetSourceUrl(), Content.Num());
+			RetryChunkLater(InResponse, 200);
+			return false;
+		}
+
+		Content.RemoveAt(0, (int32)RangeOffset, false);
+		Content.SetNum((int32)RangeLength, false);
+		InResponse->ResponseCode = 206;
+		return true;
+	}
+
+	//"bytes first-last/total", the total may be "*"
+	int64 First = RangeOffset;
+	int64 Last = RangeOffset + RangeLength - 1;
+	const FString ContentRange = InResponse->GetHeader(TEXT("Content-Range"));
+	FString Range;
+	FString Total;
+	FString FirstStr;
+	FString LastStr;
+	if (ContentRange.Split(TEXT("/"), &Range, &Total) && Range.TrimStartAndEnd().Mid(6).Split(TEXT("-"), &FirstStr, &LastStr))
+	{
+		First = FCString::Atoi64(*FirstStr);
+		Last = FCString::Atoi64(*LastStr);
+
+		if (Total != TEXT("*") && GetTotalSize() > 0 && FCString::Atoi64(*Total) != GetTotalSize())
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("%s, size changed to %s"), *GetSourceUrl(), *Total);
+			RestartChangedRemote();
+			return false;
+		}
+	}
+
+	//a proxy or a dropped connection may end the body early
+	if (First != RangeOffset || Last - First + 1 != RangeLength || Content.Num() != RangeLength)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, got %d bytes of %s for range %lld-%lld"), *GetSourceUrl(), Content.Num(), *ContentRange, RangeOffset, RangeOffset + RangeLength - 1);
+		RetryChunkLater(InResponse, InResponse->GetResponseCode());
+		return false;
+	}
+
+	return true;
+}
+
+void DownloadTask::RetryChunkLater(FDownloadResponsePtr InResponse, int32 InHttpCode)
+{
+	ReleaseBudget();
+
+	if (CurrentTryCount >= MaxTryCount)
+	{
+		CloseSink();
+		TaskState = ETaskState::ERROR;
+		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, InHttpCode);
+		return;
+	}
+
+	const double Delay = GetRetryDelay(InResponse);
+	++CurrentTryCount;
+
+	//the task stays downloading while waiting, Stop makes the retry a no-op
+	RunTaskStepAfterDelay(Delay, [this]()
+	{
+		this->StartChunk();
+	});
+}
+
+void DownloadTask::RestartChangedRemote()
+{
+	ReleaseBudget();
+	CloseSink();
+
+	//a server changing the file all the time must not keep the task busy forever
+	if (CurrentTryCount >= MaxTryCount)
+	{
+		TaskState = ETaskState::ERROR;
+		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+		return;
+	}
+	++CurrentTryCount;
+
+	//HEAD gets the new size & ETag, which differ from the saved task so the temp file is truncated
+	bRemoteInfoKnown = false;
+	TaskState = ETaskState::WAIT;
+	Start();
+}
+
+double DownloadTask::GetRetryDelay(FDownloadResponsePtr InResponse) const
+{
+	//only the seconds form of Retry-After, not a date
+	const FString RetryAfter = InResponse.IsValid() ? InResponse->GetHeader(TEXT("Retry-After")) : FString();
+	if (RetryAfter.IsNumeric())
+	{
+		return FMath::Clamp(FCString::Atod(*RetryAfter), 0.0, RETRY_MAX_SECONDS);
+	}
+
+	//jitter keeps tasks failing together from retrying together
+	const double Backoff = FMath::Min(RETRY_MAX_SECONDS, RETRY_BASE_SECONDS * FMath::Pow(2.0, (double)FMath::Min(CurrentTryCount, 10)));
+	return Backoff * RetryRandom.FRandRange(0.5f, 1.f);
+}
+
+void DownloadTask::RunTaskStepAfterDelay(double InSeconds, TFunction<void()> InStep)
+{
+	TWeakPtr<DownloadTask, ESPMode::ThreadSafe> WeakThis = AsShared();
+	CallAfterDownloadDelay(InSeconds, [WeakThis, InStep]()
+	{
+		FDownloadTaskPtr Task = WeakThis.Pin();
+		if (Task.IsValid() && Task->IsDownloading() && Task->GetNeedStop() == false)
+		{
+			InStep();
+		}
+	});
+}
+
+void DownloadTask::OnChunkReceived(FDownloadResponsePtr InResponse)
+{
+	DataBuffer = MoveTemp(InResponse->Content);
+	ProcessRequestResult(DataBuffer.Num(), true);
+
+
+	//Async write chunk buffer to file 
+	RunOnWorker([this]()
+	{
+		const int64 Offset = this->ChunkOffset;
+		bool bWriteRet = false;
+		{
+			//Stop may close the sink on game thread meanwhile, a mapped sink would be unmapped under the copy
+			FScopeLock SinkScope(&this->SinkLock.Get());
+			if (this->Sink->IsOpen() == false)
+			{
+				return;
+			}
+
+			bWriteRet = this->Sink->Write(Offset, DataBuffer.GetData(), DataBuffer.Num());
+			if (bWriteRet)
+			{
+				this->Sink->Flush();
+				this->OnChunkWritten(Offset, DataBuffer.Num());
+			}
+		}
+
+		//chunk data is on disk now, do not keep it until the next chunk
+		TArray<uint8> Data = MoveTemp(DataBuffer);
+		const int32 DataSize = Data.Num();
+		if (bWriteRet)
+		{
+			auto Consume = [this, Offset, &Data, DataSize]()
+			{
+				if (this->StreamStage.IsValid() && this->StreamStage->Consume(Offset, Data.GetData(), DataSize) == false)
+				{
+					UE_LOG(LogFileDownloader, Warning, TEXT("%s, stage cannot use data at %lld"), *this->GetFileName(), Offset);
+				}
+			};
+
+			//the last chunk completes the task, the stage must have all bytes before completion is reported
+			if (this->StreamStage.IsValid() && Offset + DataSize >= this->GetTotalSize())
+			{
+				{
+					FScopeLock ScopeLock(&this->StageLock);
+					Consume();
+				}
+				this->RunTaskStep([this, DataSize]() {
+					this->OnWriteChunkEnd(DataSize);
+				});
+				return;
+			}
+
+			//locked before the next chunk can be requested, so stage input stays in file order
+			FScopeLock ScopeLock(&this->StageLock);
+			//off game thread the next chunk is requested right here, not a frame later
+			this->RunTaskStep([this, DataSize]() {
+				this->OnWriteChunkEnd(DataSize);
+			});
+
+			//the stage works while the next chunk is downloading
+			Consume();
 		}
 		else
 		{
-			//error when changing file name.
-			UE_LOG(LogFileDownloader, Warning, TEXT("%s, Canot delete old file or rename temp file!"), *GetFileName());
-			TaskState = ETaskState::ERROR;
-			ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+			this->RunTaskStep([this]() {
+				UE_LOG(LogFileDownloader, Warning, TEXT("%s, %d, Async write file error !"), __FUNCTION__, __LINE__);
+				this->ReleaseBudget();
+				this->TaskState = ETaskState::ERROR;
+				this->ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, this->TaskInfo, -1);
+			});
+		}
+	});
+	
+}
+
+void DownloadTask::OnTaskCompleted()
+{
+	if (Sink->IsFile() == false)
+	{
+		CloseSink();
+		MemoryData = Sink->ReleaseData();
+		UE_LOG(LogFileDownloader, Log, TEXT("%s, completed in memory !"), *GetFileName());
+		TaskState = ETaskState::COMPLETED;
+		ProcessTaskEvent(ETaskEvent::DOWNLOAD_COMPLETED, TaskInfo, 0);
+		return;
+	}
+
+	//release file handle & change file name on a worker, batched with other completed tasks
+	FDownloadFinalizeJob Job;
+	Job.Sink = Sink;
+	Job.TempFileName = GetTempFileName();
+	Job.FileName = GetFullFileName();
+	Job.bSyncDirectory = bSyncOnFinalize;
+	Job.Locks.Add(SinkLock);
+
+	//ranges from peers or a file served to them must be exactly the file of the manifest
+	const FString Hash = GetTaskInformation().Hash;
+	bHashVerified = false;
+	bHashMismatch = false;
+	if (bVerifyHash && IsHashSupported(Hash))
+	{
+		TWeakPtr<DownloadTask, ESPMode::ThreadSafe> WeakTask = AsShared();
+		const FString TempFileName = Job.TempFileName;
+		Job.Verify = [WeakTask, TempFileName, Hash]()
+		{
+			const bool bMatch = MatchesHash(TempFileName, Hash);
+			if (FDownloadTaskPtr Task = WeakTask.Pin())
+			{
+				Task->bHashVerified = bMatch;
+				Task->bHashMismatch = bMatch == false;
+			}
+			return bMatch;
+		};
+	}
+
+	//the sidecar remembers when the server confirmed the content and how the file looked, a later run may then skip HEAD
+	if (bValidated)
+	{
+		FTaskInformation Info = GetTaskInformation();
+		const FString FileName = GetFullFileName();
+		Job.AfterMove = [Info, FileName]() mutable
+		{
+			const FFileStatData Stat = PlatformFile->GetStatData(*FileName);
+			if (Stat.bIsValid)
+			{
+				Info.LocalSize = Stat.FileSize;
+				Info.LocalModifiedTime = Stat.ModificationTime.ToUnixTimestamp();
+				FString OutStr;
+				Info.SerializeToJsonString(OutStr);
+				FFileHelper::SaveStringToFile(OutStr, *FString(FileName + TASK_JSON));
+			}
+		};
+	}
+	PrepareFinalize(Job);
+	//the task may be cleared while the job waits in the queue
+	TWeakPtr<DownloadTask, ESPMode::ThreadSafe> WeakThis = AsShared();
+	Job.OnFinalized = [WeakThis](bool bSucceeded)
+	{
+		FDownloadTaskPtr Task = WeakThis.Pin();
+		if (Task.IsValid() == false)
+		{
 			return;
 		}
+
+		DownloadTask* Self = Task.Get();
+		Task->RunTaskStep([Self, bSucceeded]() {
+			if (Self->GetState() == ETaskState::DOWNLOADING && Self->GetNeedStop() == false)
+			{
+				Self->OnTaskFinalized(bSucceeded);
+			}
+		});
+		--Task->BusySteps;
+	};
+
+	++BusySteps;
+	FDownloadFinalizer::Get().Enqueue(MoveTemp(Job));
+}
+
+void DownloadTask::PrepareFinalize(FDownloadFinalizeJob& InJob)
+{
+}
+
+void DownloadTask::OnTaskFinalized(bool bSucceeded)
+{
+	if (bHashMismatch)
+	{
+		//the temp file is deleted, the whole file is downloaded again without peers
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, does not match hash %s"), *GetSourceUrl(), *GetTaskInformation().Hash);
+		bAllowPeers = false;
+		SetCurrentSize(0);
+		RestartChangedRemote();
+		return;
 	}
 
+	if (bSucceeded == false)
+	{
+		//error when changing file name.
+		TaskState = ETaskState::ERROR;
+		ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+		return;
+	}
+
+	UE_LOG(LogFileDownloader, Log, TEXT("%s, completed !"), *GetFileName());
+	StoreToCache();
 	TaskState = ETaskState::COMPLETED;
 	ProcessTaskEvent(ETaskEvent::DOWNLOAD_COMPLETED, TaskInfo, 0);
-	return;
 }
 
 void DownloadTask::OnWriteChunkEnd(int32 DataSize)
 {
+	ReleaseBudget();
 	if (GetState() != ETaskState::DOWNLOADING)
 	{
 		return;
 	}
-	//update progress
+	//update progress, a chunk on disk means the network works again
 	SetCurrentSize(GetCurrentSize() + DataSize);
+	if (DataSize > 0)
+	{
+		CurrentTryCount = 0;
+	}
 
 	if (GetCurrentSize() < GetTotalSize())
 	{
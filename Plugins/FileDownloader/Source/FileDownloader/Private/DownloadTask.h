@@ -6,14 +6,24 @@
 #include "TaskInformation.h"
 #include "DownloadEvent.h"
 #include "FileDownloader.h"
-#include "Interfaces/IHttpRequest.h"
-#include "Interfaces/IHttpResponse.h"
+#include "DownloadMemoryBudget.h"
+#include "DownloadBandwidthLimiter.h"
+#include "ContentCache.h"
+#include "HostProfileStore.h"
+#include "DownloadStreamStage.h"
+#include "DownloadStreamReader.h"
+#include "DownloadSink.h"
+#include "DownloadTransport.h"
+#include "DownloadFinalizer.h"
+#include "HAL/CriticalSection.h"
+#include <atomic>
 
 
 /**
  * a download task, normally operated by FileDownloadManager, extreamly advise you to use FileDownloadManager.
+ * jobs on worker threads hold a weak reference, the task may be destroyed on game thread while they wait.
  */
-class DownloadTask
+class DownloadTask : public TSharedFromThis<DownloadTask, ESPMode::ThreadSafe>
 {
 public:
 	DownloadTask();
@@ -36,13 +46,13 @@ public:
 
 	virtual const FString& GetDirectory() const;
 
-	virtual void SetTotalSize(int32 InTotalSize);
+	virtual void SetTotalSize(int64 InTotalSize);
 	
-	virtual int32 GetTotalSize() const;
+	virtual int64 GetTotalSize() const;
 
-	virtual void SetCurrentSize(int32 InCurrentSize);
+	virtual void SetCurrentSize(int64 InCurrentSize);
 
-	virtual int32 GetCurrentSize() const;
+	virtual int64 GetCurrentSize() const;
 
 	virtual int32 GetPercentage() const;
 
@@ -50,6 +60,27 @@ public:
 
 	virtual const FString& GetETag() const;
 
+	virtual void SetHash(const FString& InHash);
+
+	void SetPriority(int32 InPriority);
+
+	int32 GetPriority() const;
+
+	//skip HEAD on start, TotalSize & ETag/Hash are given by a manifest
+	void SetRemoteInfoKnown(bool bKnown);
+
+	//bytes written to the target file, differs from current size when the transfer is compressed
+	virtual int64 GetOutputSize() const;
+
+	//CPU seconds spent on decompression
+	virtual double GetDecodeSeconds() const;
+
+	//bytes reused from the old local file instead of downloading, only delta tasks reuse data
+	virtual int64 GetDeltaSavedSize() const;
+
+	//reader of the file while downloading, only streaming tasks have one
+	virtual FDownloadStreamReaderPtr GetStreamReader() const;
+
 	virtual bool Start();
 
 	virtual bool Stop();
@@ -58,6 +89,12 @@ public:
 
 	void ReGenerateGUID();
 
+	//keep an id given by NewGuid, for a task created for a stored entry
+	void SetGuid(int32 InGuid);
+
+	//next task id, unique among all tasks
+	static int32 NewGuid();
+
 	virtual bool IsDownloading() const;
 
 	FTaskInformation GetTaskInformation() const;
@@ -70,6 +107,83 @@ public:
 
 	bool SaveTaskToJsonFile(const FString& InFileName) const;
 
+	/*read the sidecar of an earlier run on a worker, a completed file still fresh by max-age is completed on Start without request,
+	 an unchanged but stale one is revalidated by a conditional HEAD
+	 @Param InDefaultMaxAge seconds a file stays fresh if the server sent no max-age
+	 @Param InDone called on the worker
+	*/
+	virtual void CheckFreshness(int32 InDefaultMaxAge, TFunction<void(bool bFresh)> InDone);
+
+	//use the result of a ReadLocalInfo done before the task was created
+	void SetLocalInfo(const FTaskInformation& InLocalInfo, bool bIntact, bool bFresh);
+
+	/*read the sidecar of a completed earlier run & compare it with the file, blocking
+	 @Param bOutIntact the file matches its sidecar
+	 @return true if the file is intact and still fresh
+	*/
+	static bool ReadLocalInfo(const FString& InFullFileName, int32 InDefaultMaxAge, FTaskInformation& OutLocalInfo, bool& bOutIntact);
+
+	//share a byte budget with other tasks, chunk requests are held back while the budget is used up
+	void SetMemoryBudget(FDownloadMemoryBudgetPtr InBudget);
+
+	//share a bandwidth limit with other tasks, chunk requests are held back while its tokens are used up
+	void SetBandwidthLimiter(FDownloadBandwidthLimiterPtr InLimiter);
+
+	//share a content addressed store with other tasks, a task whose content is in the store completes without GET
+	void SetContentCache(FContentCachePtr InCache);
+
+	//feed the bytes of the target file to a stage in file order while downloading
+	void SetStreamStage(FDownloadStreamStagePtr InStage);
+
+	//where downloaded data is written, cannot be changed while downloading
+	void SetSinkType(EDownloadSinkType InType);
+
+	EDownloadSinkType GetSinkType() const;
+
+	//data of a completed task with memory sink, null otherwise
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> GetMemoryData() const;
+
+	/*run the chunk state machine on worker threads instead of returning to game thread after every write,
+	 callbacks below are then called on worker threads too
+	*/
+	void SetRunOffGameThread(bool bOffGameThread);
+
+	//transport sending the requests of this task, cannot be changed while downloading
+	void SetTransport(FDownloadTransportPtr InTransport);
+
+	//bytes requested at once, cannot be changed while downloading
+	void SetChunkSize(int32 InChunkSize);
+
+	//fsync the directory after the temp file is renamed, so a completed file survives a power loss
+	void SetSyncOnFinalize(bool bSync);
+
+	//report round trips, chunk throughput, range support & ETag trust of the host
+	void SetHostProfiles(FHostProfileStorePtr InProfiles);
+
+	//send If-Range and restart when a range comes with another ETag, off for hosts whose ETags differ for the same content
+	void SetTrustETag(bool bTrust);
+
+	//check the manifest hash of a completed file before it is moved, a mismatch is downloaded again from the origin only
+	void SetVerifyHash(bool bVerify);
+
+	//the completed file matched its manifest hash
+	bool IsHashVerified() const;
+
+	/*compare a file with a manifest hash, blocking
+	 @Param InHash MD5 or SHA-1 as hex, case insensitive
+	 @return false if the file differs, cannot be read or the hash has another form
+	*/
+	static bool MatchesHash(const FString& InFileName, const FString& InHash);
+
+	//MD5 or SHA-1 as hex
+	static bool IsHashSupported(const FString& InHash);
+
+	//seed of the jitter of retry delays, tasks are seeded from the clock otherwise
+	void SetRetrySeed(int32 InSeed);
+
+	//a step is queued or running on a worker, the game thread or the finalizer, the task waits for nothing else
+	bool IsBusy() const;
+
 	//callback for notifying download events
 	TFunction<void(ETaskEvent InEvent, const FTaskInformation& InInfo, int32 InHttpCode)> ProcessTaskEvent = [this](ETaskEvent InEvent, const FTaskInformation& InInfo, int32 InHttpCode)
 	{
@@ -80,6 +194,9 @@ public:
 		
 	};
 
+	//callback for notifying the result of every HTTP request (bytes received, request succeeded)
+	TFunction<void(int32 InBytes, bool bSucceeded)> ProcessRequestResult = [](int32 InBytes, bool bSucceeded) {};
+
 protected:
 
 	DownloadTask(const DownloadTask& rhs) = delete;
@@ -89,32 +206,209 @@ protected:
 
 	virtual void StartChunk();
 
+	//open the temp file after HEAD, resume from its size or truncate it, then request the first chunk
+	virtual void StartDownloadChunks(bool bResume);
+
+	void OpenTempFileAndStart(bool bResume);
+
+	/*feed the stage with a file from the stage's consumed size on a worker thread
+	 @Param InDone called by RunTaskStep with the result, unless the task was stopped meanwhile
+	*/
+	void FeedStageFromFile(const FString& InFileName, TFunction<void(bool bSucceeded)> InDone);
+
+	//complete a task whose file is already on disk, after the stage has seen the file
+	void CompleteWithStage(const FString& InFileName);
+
+	//key of the content in ContentCache, empty if the content cannot be identified
+	virtual FString GetContentKey() const;
+
+	//complete this task from ContentCache asynchronously, return false if the content is not cached
+	bool TryCompleteFromCache();
+
+	void StoreToCache();
+
 	virtual FString GetFullFileName() const;
 
-	virtual void OnGetHeadCompleted(FHttpRequestPtr InRequest, FHttpResponsePtr InResponse, bool bWasSuccessful);
-	virtual void OnGetChunkCompleted(FHttpRequestPtr InRequest, FHttpResponsePtr InResponse, bool bWasSuccessful);
+	FString GetTempFileName() const;
+
+	/*send a request through Transport, Stop cannot cancel in between, a response after Stop is dropped
+	 @Param InHandler called on game thread, or on a transport thread when running off game thread
+	*/
+	void SendRequest(FDownloadRequest& InRequest, TFunction<void(FDownloadResponsePtr InResponse, bool bSucceeded)> InHandler);
+
+	/*send a GET of the given "bytes=" range for the chunk in flight
+	 @Param InExpectedSize bytes of the range, lets the transport size its buffer once
+	*/
+	void SendRangeRequest(const FString& InRange, int64 InExpectedSize);
+
+	//continue the task after work on a worker thread, on game thread or right here when running off game thread
+	void RunTaskStep(TFunction<void()> InStep);
+
+	//run a job on a worker, the task is kept alive while the job runs, a job of a destroyed task is dropped
+	void RunOnWorker(TFunction<void()> InJob);
+
+	virtual void OnGetHeadCompleted(FDownloadResponsePtr InResponse, bool bWasSuccessful);
+
+	//the file of an earlier run is fresh or the server answered 304, complete without download
+	void CompleteFromLocal(const FTaskInformation& InLocalInfo);
+
+	//Last-Modified & max-age of a response that confirmed the content
+	void UpdateFreshness(FDownloadResponsePtr InResponse);
+
+	//TotalSize & ETag are known (from HEAD or manifest), complete, reuse cached content or start chunks
+	virtual void OnRemoteInfoReady();
+	virtual void OnGetChunkCompleted(FDownloadResponsePtr InResponse, bool bWasSuccessful);
 
+	//deal with stop, network failure & error code of a chunk response, return true if the response has been handled
+	bool HandleChunkFailure(FDownloadResponsePtr InResponse, bool bWasSuccessful);
+
+	/*check a response against the single range in flight, a whole file sent for a range is cut to the range
+	 @return false if the response was wrong & has been handled by a retry or restart
+	*/
+	virtual bool CheckRangeResponse(FDownloadResponsePtr InResponse);
+
+	//request the chunk in flight again after a backoff, the task fails when out of tries
+	void RetryChunkLater(FDownloadResponsePtr InResponse, int32 InHttpCode);
+
+	//the remote file changed between chunks, drop what is downloaded and start from HEAD
+	void RestartChangedRemote();
+
+	//Retry-After of a response, otherwise exponential backoff with jitter by CurrentTryCount
+	double GetRetryDelay(FDownloadResponsePtr InResponse) const;
+
+	//run a step after some seconds on game thread, dropped if the task is destroyed meanwhile
+	void RunTaskStepAfterDelay(double InSeconds, TFunction<void()> InStep);
+
+	//write the data of a successful chunk response, the data may be moved out of the response
+	virtual void OnChunkReceived(FDownloadResponsePtr InResponse);
+
+	//encode path parts of the source url into EncodedUrl
+	virtual void EncodeUrl();
+
+	//all data is written, hand the file to the finalizer, events are fired by OnTaskFinalized
 	virtual void OnTaskCompleted();
 
+	//fill the job before it is queued, e.g. with locks or files to delete
+	virtual void PrepareFinalize(FDownloadFinalizeJob& InJob);
+
+	//the temp file has been closed & moved on a worker, called by RunTaskStep unless the task was stopped meanwhile
+	virtual void OnTaskFinalized(bool bSucceeded);
+
 	virtual void OnWriteChunkEnd(int32 DataSize);
 
+	//a chunk is written & flushed, called on a worker while SinkLock is held
+	virtual void OnChunkWritten(int64 Offset, int32 DataSize)
+	{
+	}
+
+	//reserve bytes & bandwidth for the next chunk, if either is used up the chunk is started again when it is available
+	bool AcquireBudget(int32 InBytes);
+
+	void ReleaseBudget();
+
+	void CloseSink();
+
+	//reopen the sink on the temp file
+	bool OpenSink(bool bResume);
+
 	FTaskInformation TaskInfo;
 
-	ETaskState TaskState = ETaskState::WAIT;
+	std::atomic<ETaskState> TaskState { ETaskState::WAIT };
 	
 	//2MB as one section to download
 	int32 ChunkSize = 2 * 1024 * 1024;
 
 	TArray<uint8> DataBuffer;
+
+	//file offset where the chunk in flight is written
+	int64 ChunkOffset = 0;
+
+	//single range in flight as sent, RangeLength is 0 for multipart ranges
+	int64 RangeOffset = 0;
+	int64 RangeLength = 0;
 	
 	FString EncodedUrl;
 	
-	IFileHandle* TargetFile = nullptr;
+	EDownloadSinkType SinkType = EDownloadSinkType::FILE;
+
+	FDownloadSinkPtr Sink;
+
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> MemoryData;
+
+	FDownloadTransportPtr Transport;
+
+	//request in flight, 0 if none
+	uint64 RequestHandle = 0;
+
+	//increased by every request & Stop, a response of an older request is dropped
+	std::atomic<uint64> RequestSerial { 0 };
+
+	std::atomic<bool> bNeedStop { false };
 
-	FHttpRequestPtr Request = nullptr;
+	bool bRunOffGameThread = false;
 
-	bool bNeedStop = false;
+	bool bSyncOnFinalize = false;
+
+	//held by the finalizer while it closes the sink, so Stop & a restart wait for it, the finalize job owns a reference
+	TSharedRef<FCriticalSection, ESPMode::ThreadSafe> SinkLock = MakeShared<FCriticalSection, ESPMode::ThreadSafe>();
+
+	//guards RequestHandle, a request may be sent from a worker while Stop is called on game thread
+	FCriticalSection RequestLock;
+
+	//guards TaskInfo fields updated while downloading
+	mutable FCriticalSection InfoLock;
+
+	bool bRemoteInfoKnown = false;
+
+	//sidecar of a completed earlier run found by CheckFreshness, guarded by InfoLock
+	FTaskInformation LocalInfo;
+
+	//the local file matches its sidecar
+	bool bLocalIntact = false;
+
+	bool bLocalFresh = false;
+
+	//the server confirmed the content in this run, the sidecar gets the new freshness when finalized
+	bool bValidated = false;
 
 	int32 CurrentTryCount = 0;
 	int32 MaxTryCount = 5;
+
+	//jitter of retry delays
+	FRandomStream RetryRandom { (int32)FPlatformTime::Cycles() };
+
+	//steps dispatched & not done yet
+	std::atomic<int32> BusySteps { 0 };
+
+	FDownloadMemoryBudgetPtr MemoryBudget;
+
+	//bytes reserved from MemoryBudget for the chunk in flight
+	int32 ReservedBytes = 0;
+
+	FDownloadBandwidthLimiterPtr BandwidthLimiter;
+
+	FContentCachePtr ContentCache;
+
+	FHostProfileStorePtr HostProfiles;
+
+	std::atomic<bool> bTrustETag { true };
+
+	bool bVerifyHash = false;
+
+	//set by the finalizer worker
+	std::atomic<bool> bHashVerified { false };
+	std::atomic<bool> bHashMismatch { false };
+
+	//ranges may be served by peers, off once the file did not match its hash
+	std::atomic<bool> bAllowPeers { true };
+
+	//time the chunk in flight was sent
+	double ChunkSendTime = 0.0;
+
+	FDownloadStreamStagePtr StreamStage;
+
+	//keeps the stage fed in file order, held from the write of a chunk until it is consumed
+	FCriticalSection StageLock;
 };
+
+typedef TSharedPtr<DownloadTask, ESPMode::ThreadSafe> FDownloadTaskPtr;
@@ -0,0 +1,134 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DownloadTraceRecorder.h"
+#include "FileDownloader.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+
+const TCHAR* FDownloadTraceRecorder::TRACE_HEADER = TEXT("#FileDownloaderTrace 1");
+
+bool ParseDownloadRange(const FDownloadRequest& InRequest, int64& OutOffset, int64& OutLength)
+{
+	for (const TPair<FString, FString>& Header : InRequest.Headers)
+	{
+		if (Header.Key.Equals(TEXT("Range"), ESearchCase::IgnoreCase) == false)
+		{
+			continue;
+		}
+
+		FString Range = Header.Value;
+		FString Left;
+		FString Right;
+		if (Range.RemoveFromStart(TEXT("bytes=")) && Range.Contains(TEXT(",")) == false && Range.Split(TEXT("-"), &Left, &Right) && Right.IsEmpty() == false)
+		{
+			OutOffset = FCString::Atoi64(*Left);
+			OutLength = FCString::Atoi64(*Right) - OutOffset + 1;
+			return OutLength > 0;
+		}
+	}
+
+	return false;
+}
+
+FDownloadTraceRecorder::FDownloadTraceRecorder(FDownloadTransportPtr InInner, const FString& InFileName)
+	: Inner(InInner)
+	, FileName(InFileName)
+{
+	StartTime = FPlatformTime::Seconds();
+	LastFlushTime = StartTime;
+	if (FFileHelper::SaveStringToFile(FString(TRACE_HEADER) + TEXT("\n"), *FileName) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Cannot write download trace %s"), *FileName);
+	}
+}
+
+FDownloadTraceRecorder::~FDownloadTraceRecorder()
+{
+	Flush();
+}
+
+uint64 FDownloadTraceRecorder::Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete)
+{
+	int64 Offset = 0;
+	int64 Length = 0;
+	ParseDownloadRange(InRequest, Offset, Length);
+
+	int32 UrlId = 0;
+	{
+		FScopeLock ScopeLock(&Lock);
+		UrlId = GetUrlId(InRequest.Url);
+	}
+
+	const FString Verb = InRequest.Verb;
+	const double SendTime = FPlatformTime::Seconds();
+	return Inner->Send(InRequest, [this, UrlId, Verb, Offset, Length, SendTime, InOnComplete](FDownloadResponsePtr InResponse, bool bSucceeded)
+	{
+		const double Seconds = FPlatformTime::Seconds() - SendTime;
+		const int32 Code = InResponse.IsValid() ? InResponse->GetResponseCode() : 0;
+		const int64 Bytes = InResponse.IsValid() ? InResponse->Content.Num() : 0;
+
+		//size of the remote file, from the total of Content-Range or the length of a HEAD
+		int64 Size = 0;
+		if (InResponse.IsValid())
+		{
+			FString Total;
+			if (InResponse->GetHeader(TEXT("Content-Range")).Split(TEXT("/"), nullptr, &Total) && Total != TEXT("*"))
+			{
+				Size = FCString::Atoi64(*Total);
+			}
+			else if (Verb == TEXT("HEAD") || Code == 200)
+			{
+				Size = InResponse->GetContentLength();
+			}
+		}
+
+		{
+			FScopeLock ScopeLock(&Lock);
+			Buffer += FString::Printf(TEXT("R,%.4f,%d,%s,%lld,%lld,%d,%lld,%.4f,%d,%lld\n"), SendTime - StartTime, UrlId, *Verb, Offset, Length, Code, Bytes, Seconds, bSucceeded ? 1 : 0, Size);
+			ReceivedSinceFlush += Bytes;
+		}
+
+		AddStats(Bytes, Seconds, InResponse.IsValid() ? InResponse->SetupSeconds : 0.0, InResponse.IsValid() ? InResponse->NewConnections : -1, bSucceeded);
+		InOnComplete(InResponse, bSucceeded);
+	});
+}
+
+void FDownloadTraceRecorder::Cancel(uint64 InHandle)
+{
+	Inner->Cancel(InHandle);
+}
+
+void FDownloadTraceRecorder::Flush()
+{
+	FString Lines;
+	{
+		FScopeLock ScopeLock(&Lock);
+		const double Now = FPlatformTime::Seconds();
+		const double Elapsed = Now - LastFlushTime;
+		if (Elapsed > 0.0)
+		{
+			Buffer += FString::Printf(TEXT("B,%.4f,%lld\n"), Now - StartTime, (int64)(ReceivedSinceFlush / Elapsed));
+		}
+
+		Lines = MoveTemp(Buffer);
+		Buffer.Reset();
+		ReceivedSinceFlush = 0;
+		LastFlushTime = Now;
+	}
+
+	FFileHelper::SaveStringToFile(Lines, *FileName, FFileHelper::EEncodingOptions::AutoDetect, &IFileManager::Get(), FILEWRITE_Append);
+}
+
+int32 FDownloadTraceRecorder::GetUrlId(const FString& InUrl)
+{
+	const int32* Found = UrlIds.Find(InUrl);
+	if (Found != nullptr)
+	{
+		return *Found;
+	}
+
+	const int32 Id = UrlIds.Num();
+	UrlIds.Add(InUrl, Id);
+	Buffer += FString::Printf(TEXT("U,%d,%s\n"), Id, *InUrl);
+	return Id;
+}
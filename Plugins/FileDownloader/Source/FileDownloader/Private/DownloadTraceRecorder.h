@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTransport.h"
+
+/**
+ * wraps the transport of a session and records every request into a text trace, replayed by FSimulatedDownloadTransport.
+ * one line per record, times are seconds since the recorder was created:
+ * "U,id,url" first use of a url, "R,start,urlId,verb,offset,length,code,bytes,seconds,ok,size" a finished request,
+ * "B,time,bytesPerSecond" received bandwidth since the last flush
+ */
+class FILEDOWNLOADER_API FDownloadTraceRecorder : public IDownloadTransport
+{
+public:
+
+	static const TCHAR* TRACE_HEADER;
+
+	FDownloadTraceRecorder(FDownloadTransportPtr InInner, const FString& InFileName);
+
+	virtual ~FDownloadTraceRecorder();
+
+	virtual uint64 Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete) override;
+
+	virtual void Cancel(uint64 InHandle) override;
+
+	virtual const TCHAR* GetName() const override
+	{
+		return Inner->GetName();
+	}
+
+	//warm up requests are not part of the trace
+	virtual void Preconnect(const FString& InUrl) override
+	{
+		Inner->Preconnect(InUrl);
+	}
+
+	//append buffered lines & a bandwidth sample to the file
+	void Flush();
+
+	const FString& GetFileName() const
+	{
+		return FileName;
+	}
+
+protected:
+
+	//call with Lock held
+	int32 GetUrlId(const FString& InUrl);
+
+	FDownloadTransportPtr Inner;
+
+	FString FileName;
+
+	double StartTime = 0.0;
+
+	FCriticalSection Lock;
+
+	TMap<FString, int32> UrlIds;
+
+	//lines not written yet
+	FString Buffer;
+
+	int64 ReceivedSinceFlush = 0;
+
+	double LastFlushTime = 0.0;
+};
+
+/*parse "bytes=first-last" of a request
+ @Return false if the request has no single range
+*/
+FILEDOWNLOADER_API bool ParseDownloadRange(const FDownloadRequest& InRequest, int64& OutOffset, int64& OutLength);
@@ -0,0 +1,260 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "DownloadTransport.h"
+#include "CurlDownloadTransport.h"
+#include "FileDownloader.h"
+#include "HttpModule.h"
+#include "Interfaces/IHttpRequest.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Misc/ScopeLock.h"
+#include "Containers/Ticker.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Runtime/Launch/Resources/Version.h"
+
+FString FDownloadResponse::GetHeader(const FString& InName) const
+{
+	for (const TPair<FString, FString>& Header : Headers)
+	{
+		if (Header.Key.Equals(InName, ESearchCase::IgnoreCase))
+		{
+			return Header.Value;
+		}
+	}
+
+	return FString();
+}
+
+FString FDownloadResponse::GetContentType() const
+{
+	return GetHeader(TEXT("Content-Type"));
+}
+
+int64 FDownloadResponse::GetContentLength() const
+{
+	const FString Length = GetHeader(TEXT("Content-Length"));
+	return Length.IsEmpty() ? Content.Num() : FCString::Atoi64(*Length);
+}
+
+FDownloadTransportStats IDownloadTransport::GetStats() const
+{
+	FScopeLock ScopeLock(&StatsLock);
+	return Stats;
+}
+
+void IDownloadTransport::AddStats(int64 InBytes, double InSeconds, double InSetupSeconds, int32 InNewConnections, bool bSucceeded)
+{
+	FScopeLock ScopeLock(&StatsLock);
+	++Stats.Requests;
+	Stats.FailedRequests += bSucceeded ? 0 : 1;
+	Stats.ReceivedBytes += InBytes;
+	Stats.RequestSeconds += InSeconds;
+	Stats.NewConnections += FMath::Max(0, InNewConnections);
+	Stats.SetupSeconds += InSetupSeconds;
+}
+
+void IDownloadTransport::Preconnect(const FString& InUrl)
+{
+	//HEAD goes through DNS, connect & TLS like a real request, the connection is kept alive afterwards
+	FDownloadRequest Request;
+	Request.Verb = TEXT("HEAD");
+	Request.Url = InUrl;
+	Request.bCompleteOnGameThread = false;
+	Send(Request, [](FDownloadResponsePtr InResponse, bool bSucceeded) {});
+}
+
+/**
+ * sends requests with FHttpModule, ticked by the http manager of the engine
+ * requests hold a weak pointer, a request completing after the transport is destroyed is dropped
+ */
+class FHttpModuleTransport : public IDownloadTransport, public TSharedFromThis<FHttpModuleTransport, ESPMode::ThreadSafe>
+{
+public:
+
+	virtual uint64 Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete) override;
+
+	virtual void Cancel(uint64 InHandle) override;
+
+	virtual const TCHAR* GetName() const override
+	{
+		return TEXT("HttpModule");
+	}
+
+protected:
+
+	FCriticalSection Lock;
+
+	//requests in flight
+	TMap<uint64, FHttpRequestPtr> Requests;
+};
+
+uint64 FHttpModuleTransport::Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete)
+{
+	const uint64 Handle = NewHandle();
+
+	FHttpRequestPtr Request = FHttpModule::Get().CreateRequest();
+	Request->SetVerb(InRequest.Verb);
+	Request->SetURL(InRequest.Url);
+	for (const TPair<FString, FString>& Header : InRequest.Headers)
+	{
+		Request->SetHeader(Header.Key, Header.Value);
+	}
+
+#if ENGINE_MAJOR_VERSION >= 5
+	//engines before 5.0 always complete on game thread
+	Request->SetDelegateThreadPolicy(InRequest.bCompleteOnGameThread ? EHttpRequestDelegateThreadPolicy::CompleteOnGameThread : EHttpRequestDelegateThreadPolicy::CompleteOnHttpThread);
+#endif
+
+	const double StartTime = FPlatformTime::Seconds();
+	TWeakPtr<FHttpModuleTransport, ESPMode::ThreadSafe> WeakThis = AsShared();
+	Request->OnProcessRequestComplete().BindLambda([WeakThis, Handle, StartTime, InOnComplete](FHttpRequestPtr InHttpRequest, FHttpResponsePtr InHttpResponse, bool bWasSuccessful)
+	{
+		TSharedPtr<FHttpModuleTransport, ESPMode::ThreadSafe> This = WeakThis.Pin();
+		if (This.IsValid() == false)
+		{
+			return;
+		}
+
+		{
+			FScopeLock ScopeLock(&This->Lock);
+			if (This->Requests.Remove(Handle) == 0)
+			{
+				return;
+			}
+		}
+
+		FDownloadResponsePtr Response;
+		if (InHttpResponse.IsValid())
+		{
+			Response = MakeShareable(new FDownloadResponse());
+			Response->ResponseCode = InHttpResponse->GetResponseCode();
+			//IHttpResponse gives its body by const reference only, this is the one copy of this backend, tasks move it from here on
+			Response->Content = InHttpResponse->GetContent();
+			for (const FString& Header : InHttpResponse->GetAllHeaders())
+			{
+				FString Name;
+				FString Value;
+				if (Header.Split(TEXT(":"), &Name, &Value))
+				{
+					Response->Headers.Emplace(Name.TrimStartAndEnd(), Value.TrimStartAndEnd());
+				}
+			}
+		}
+
+		const bool bSucceeded = bWasSuccessful && Response.IsValid();
+		This->AddStats(Response.IsValid() ? Response->Content.Num() : 0, FPlatformTime::Seconds() - StartTime, 0.0, -1, bSucceeded);
+		InOnComplete(Response, bSucceeded);
+	});
+
+	{
+		FScopeLock ScopeLock(&Lock);
+		Requests.Add(Handle, Request);
+	}
+
+	Request->ProcessRequest();
+	return Handle;
+}
+
+void FHttpModuleTransport::Cancel(uint64 InHandle)
+{
+	FHttpRequestPtr Request;
+	{
+		FScopeLock ScopeLock(&Lock);
+		Requests.RemoveAndCopyValue(InHandle, Request);
+	}
+
+	if (Request.IsValid())
+	{
+		Request->OnProcessRequestComplete().Unbind();
+		Request->CancelRequest();
+	}
+}
+
+FDownloadTransportPtr CreateDownloadTransport(EDownloadTransportType InType, const FCurlTransportSettings& InCurlSettings)
+{
+	if (InType == EDownloadTransportType::CURL_MULTI)
+	{
+#if WITH_DOWNLOADER_CURL
+		TSharedPtr<FCurlDownloadTransport, ESPMode::ThreadSafe> Curl = MakeShareable(new FCurlDownloadTransport(InCurlSettings));
+		if (Curl->IsValid())
+		{
+			return Curl;
+		}
+#endif
+		UE_LOG(LogFileDownloader, Warning, TEXT("libcurl transport is not available, use http module"));
+	}
+
+	return MakeShareable(new FHttpModuleTransport());
+}
+
+FDownloadTransportPtr GetDefaultDownloadTransport()
+{
+	static FDownloadTransportPtr DefaultTransport = MakeShareable(new FHttpModuleTransport());
+	return DefaultTransport;
+}
+
+FString GetUrlHostKey(const FString& InUrl)
+{
+	FString Scheme = TEXT("http");
+	FString Rest = InUrl;
+	int32 SchemeEnd = InUrl.Find(TEXT("://"));
+	if (SchemeEnd != INDEX_NONE)
+	{
+		Scheme = InUrl.Left(SchemeEnd).ToLower();
+		Rest = InUrl.Mid(SchemeEnd + 3);
+	}
+
+	int32 PathStart = INDEX_NONE;
+	Rest.FindChar(TEXT('/'), PathStart);
+	FString Authority = PathStart == INDEX_NONE ? Rest : Rest.Left(PathStart);
+
+	//user info is not part of the host
+	int32 AtPos = INDEX_NONE;
+	if (Authority.FindLastChar(TEXT('@'), AtPos))
+	{
+		Authority = Authority.Mid(AtPos + 1);
+	}
+
+	//ipv6 addresses have colons inside brackets
+	int32 ColonPos = INDEX_NONE;
+	const bool bHasPort = Authority.FindLastChar(TEXT(':'), ColonPos) && ColonPos > Authority.Find(TEXT("]"));
+	if (bHasPort == false)
+	{
+		Authority += Scheme == TEXT("https") ? TEXT(":443") : TEXT(":80");
+	}
+
+	return Scheme + TEXT("://") + Authority.ToLower();
+}
+
+void CallAfterDownloadDelay(double InSeconds, TFunction<void()> InCall)
+{
+	//the core ticker of engine 4 must be used on game thread
+	if (IsInGameThread() == false)
+	{
+		FFunctionGraphTask::CreateAndDispatchWhenReady([InSeconds, InCall]()
+		{
+			CallAfterDownloadDelay(InSeconds, InCall);
+		}, TStatId(), nullptr, ENamedThreads::GameThread);
+		return;
+	}
+
+	FTickerDelegate Delegate = FTickerDelegate::CreateLambda([InCall](float DeltaTime)
+	{
+		InCall();
+		return false;
+	});
+
+#if ENGINE_MAJOR_VERSION >= 5
+	FTSTicker::GetCoreTicker().AddTicker(Delegate, (float)InSeconds);
+#else
+	FTicker::GetCoreTicker().AddTicker(Delegate, (float)InSeconds);
+#endif
+}
+
+void TickDownloadDelays(float DeltaTime)
+{
+#if ENGINE_MAJOR_VERSION >= 5
+	FTSTicker::GetCoreTicker().Tick(DeltaTime);
+#else
+	FTicker::GetCoreTicker().Tick(DeltaTime);
+#endif
+}
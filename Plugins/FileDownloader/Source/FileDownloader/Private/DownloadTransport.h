@@ -0,0 +1,182 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadEvent.h"
+#include "HAL/CriticalSection.h"
+#include <atomic>
+
+/**
+ * a request sent by a task through a transport
+ */
+struct FDownloadRequest
+{
+	FString Verb = TEXT("GET");
+
+	FString Url;
+
+	//name & value pairs, e.g. Range
+	TArray<TPair<FString, FString>> Headers;
+
+	//call back on game thread, otherwise on the thread of the transport
+	bool bCompleteOnGameThread = true;
+
+	//bytes expected in the body, lets a transport size its buffer once, 0 if unknown
+	int64 ExpectedSize = 0;
+
+	//may be served by a peer cache instead of the origin
+	bool bAllowPeers = true;
+};
+
+/**
+ * a response received by a transport, the names follow IHttpResponse
+ */
+class FILEDOWNLOADER_API FDownloadResponse
+{
+public:
+
+	int32 GetResponseCode() const
+	{
+		return ResponseCode;
+	}
+
+	//case insensitive, empty if missing
+	FString GetHeader(const FString& InName) const;
+
+	FString GetContentType() const;
+
+	//Content-Length header, size of the content if missing
+	int64 GetContentLength() const;
+
+	const TArray<uint8>& GetContent() const
+	{
+		return Content;
+	}
+
+	int32 ResponseCode = 0;
+
+	TArray<TPair<FString, FString>> Headers;
+
+	//the task may move the data out, nobody else reads a response
+	TArray<uint8> Content;
+
+	//DNS, connect & TLS handshake of a new connection, 0 if a kept alive connection was reused or the transport cannot tell
+	double SetupSeconds = 0.0;
+
+	//connections opened for the request, 0 if a kept alive one was reused, -1 if the transport cannot tell
+	int32 NewConnections = -1;
+};
+
+typedef TSharedPtr<FDownloadResponse, ESPMode::ThreadSafe> FDownloadResponsePtr;
+
+typedef TFunction<void(FDownloadResponsePtr InResponse, bool bSucceeded)> FOnDownloadRequestComplete;
+
+/**
+ * counters of a transport to compare backends on the same workload
+ */
+struct FDownloadTransportStats
+{
+	int64 Requests = 0;
+
+	int64 FailedRequests = 0;
+
+	int64 ReceivedBytes = 0;
+
+	//sum of seconds from send to completion
+	double RequestSeconds = 0.0;
+
+	//requests that opened a new connection instead of reusing one, counted by transports that can tell
+	int64 NewConnections = 0;
+
+	//part of RequestSeconds spent on DNS, connect & TLS handshake
+	double SetupSeconds = 0.0;
+};
+
+/**
+ * sends the requests of tasks, http module by default, libcurl multi where available
+ */
+class FILEDOWNLOADER_API IDownloadTransport
+{
+public:
+
+	virtual ~IDownloadTransport() {}
+
+	/*start a request
+	 @Param InOnComplete called once, never after Cancel of the request returned
+	 @Return handle for Cancel
+	*/
+	virtual uint64 Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete) = 0;
+
+	//unknown or finished handles are ignored
+	virtual void Cancel(uint64 InHandle) = 0;
+
+	virtual const TCHAR* GetName() const = 0;
+
+	//resolve the host of the url and open a connection that later requests reuse, the response is dropped
+	virtual void Preconnect(const FString& InUrl);
+
+	FDownloadTransportStats GetStats() const;
+
+protected:
+
+	uint64 NewHandle()
+	{
+		return ++LastHandle;
+	}
+
+	//@Param InNewConnections as in FDownloadResponse, -1 is not counted
+	void AddStats(int64 InBytes, double InSeconds, double InSetupSeconds, int32 InNewConnections, bool bSucceeded);
+
+	std::atomic<uint64> LastHandle { 0 };
+
+	mutable FCriticalSection StatsLock;
+
+	FDownloadTransportStats Stats;
+};
+
+typedef TSharedPtr<IDownloadTransport, ESPMode::ThreadSafe> FDownloadTransportPtr;
+
+/**
+ * options of the libcurl transport
+ */
+struct FCurlTransportSettings
+{
+	int32 MaxConnectionsPerHost = 6;
+
+	int32 MaxTotalConnections = 32;
+
+	//receive buffer of every transfer, libcurl allows 1KB to 512KB
+	int32 ReceiveBufferSize = 256 * 1024;
+
+	//multiplex requests to the same host over one connection if the server speaks HTTP/2
+	bool bHttp2 = true;
+
+	//CA bundle for https, default of libcurl if empty
+	FString CABundlePath;
+
+	int32 ConnectTimeoutSeconds = 10;
+
+	//a transfer slower than 1 byte per second for this long fails
+	int32 StallTimeoutSeconds = 30;
+};
+
+/*create a transport, falls back to the http module if the type is not available on this platform
+ @Param InType transport type
+ @Param InCurlSettings used by CURL_MULTI only
+*/
+FILEDOWNLOADER_API FDownloadTransportPtr CreateDownloadTransport(EDownloadTransportType InType, const FCurlTransportSettings& InCurlSettings);
+
+//http module transport shared by tasks not operated by a manager
+FILEDOWNLOADER_API FDownloadTransportPtr GetDefaultDownloadTransport();
+
+//"scheme://host:port" of a url in lower case, requests with the same key can share connections
+FILEDOWNLOADER_API FString GetUrlHostKey(const FString& InUrl);
+
+/*call on game thread after a delay, scheduled on the core ticker which the game loop or TickHeadless ticks
+ @Param InCall called once, may be called from any thread
+*/
+FILEDOWNLOADER_API void CallAfterDownloadDelay(double InSeconds, TFunction<void()> InCall);
+
+//tick the core ticker where no game loop runs, so delayed calls fire
+FILEDOWNLOADER_API void TickDownloadDelays(float DeltaTime);
@@ -0,0 +1,383 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FileDownloadEngineSubsystem.h"
+#include "FileDownloadManager.h"
+#include "FileDownloader.h"
+#include "DownloadMemoryBudget.h"
+#include "DownloadBandwidthLimiter.h"
+#include "DownloadTransport.h"
+#include "DownloadTraceRecorder.h"
+#include "FrameBudgetThrottle.h"
+#include "PeerCacheServer.h"
+#include "HostProfileStore.h"
+#include "RenderCore.h"
+#include "HAL/FileManager.h"
+#include "Misc/DateTime.h"
+#include "Misc/Paths.h"
+#include "Engine/Engine.h"
+
+//idle connections are closed by most servers after this, a host is warmed up again after it
+static const double HOST_WARM_SECONDS = 30.0;
+
+//buffered trace lines are appended to the file this often
+static const double TRACE_FLUSH_SECONDS = 1.0;
+
+//learned host profiles are written this often if they changed
+static const double HOST_PROFILE_SAVE_SECONDS = 30.0;
+
+UFileDownloadEngineSubsystem* UFileDownloadEngineSubsystem::Get()
+{
+	return GEngine ? GEngine->GetEngineSubsystem<UFileDownloadEngineSubsystem>() : nullptr;
+}
+
+void UFileDownloadEngineSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+	Throttle = MakeShareable(new FFrameBudgetThrottle());
+}
+
+void UFileDownloadEngineSubsystem::Deinitialize()
+{
+	//tasks still hold the shared objects, they are released with the last task
+	Managers.Reset();
+	Transport = nullptr;
+	TraceRecorder = nullptr;
+	MemoryBudget = nullptr;
+	BandwidthLimiter = nullptr;
+	PeerCacheServer = nullptr;
+	if (HostProfiles.IsValid())
+	{
+		HostProfiles->Save();
+	}
+	HostProfiles = nullptr;
+	Super::Deinitialize();
+}
+
+int32 UFileDownloadEngineSubsystem::GetRunningTaskCount() const
+{
+	int32 Count = 0;
+	for (const TWeakObjectPtr<UFileDownloadManager>& Manager : Managers)
+	{
+		if (Manager.IsValid())
+		{
+			Count += Manager->GetRunningTaskCount();
+		}
+	}
+
+	return Count;
+}
+
+int32 UFileDownloadEngineSubsystem::GetHostTaskCount(const FString& InUrl) const
+{
+	return GetHostLoad(GetUrlHostKey(InUrl));
+}
+
+void UFileDownloadEngineSubsystem::RegisterManager(UFileDownloadManager* InManager)
+{
+	Managers.AddUnique(InManager);
+}
+
+void UFileDownloadEngineSubsystem::UnregisterManager(UFileDownloadManager* InManager)
+{
+	Managers.Remove(InManager);
+}
+
+bool UFileDownloadEngineSubsystem::CanStartTask(const UFileDownloadManager* InManager) const
+{
+	const int32 SlotCount = GetEffectiveMaxParallelTask();
+	if (SlotCount < 1)
+	{
+		return true;
+	}
+
+	int32 Running = 0;
+	int32 OtherWaiting = 0;
+	for (const TWeakObjectPtr<UFileDownloadManager>& Manager : Managers)
+	{
+		if (Manager.IsValid())
+		{
+			Running += Manager->GetRunningTaskCount();
+			OtherWaiting += Manager.Get() != InManager && Manager->HasWaitingTask() ? 1 : 0;
+		}
+	}
+
+	//running tasks over a throttled limit are not stopped, they end before new ones start
+	if (Running >= SlotCount)
+	{
+		return false;
+	}
+
+	//a manager takes more than its share of slots only if no other manager is waiting for one
+	const int32 FairShare = FMath::Max(1, SlotCount / (OtherWaiting + 1));
+	return OtherWaiting == 0 || InManager->GetRunningTaskCount() < FairShare;
+}
+
+int32 UFileDownloadEngineSubsystem::GetHostLoad(const FString& InHost) const
+{
+	int32 Load = 0;
+	for (const TWeakObjectPtr<UFileDownloadManager>& Manager : Managers)
+	{
+		if (Manager.IsValid())
+		{
+			Load += Manager->GetHostLoad(InHost);
+		}
+	}
+
+	return Load;
+}
+
+bool UFileDownloadEngineSubsystem::TryWarmUpHost(const FString& InHost)
+{
+	const double Now = FPlatformTime::Seconds();
+	const double* LastWarmUp = WarmedHosts.Find(InHost);
+	if (LastWarmUp != nullptr && Now - *LastWarmUp < HOST_WARM_SECONDS)
+	{
+		return false;
+	}
+
+	WarmedHosts.Add(InHost, Now);
+	return true;
+}
+
+void UFileDownloadEngineSubsystem::TouchHost(const FString& InHost)
+{
+	WarmedHosts.Add(InHost, FPlatformTime::Seconds());
+}
+
+TSharedPtr<IDownloadTransport, ESPMode::ThreadSafe> UFileDownloadEngineSubsystem::GetTransport()
+{
+	if (Transport.IsValid() == false)
+	{
+		FCurlTransportSettings CurlSettings;
+		if (MaxConnectionsPerHost > 0)
+		{
+			CurlSettings.MaxConnectionsPerHost = MaxConnectionsPerHost;
+			CurlSettings.MaxTotalConnections = FMath::Max(CurlSettings.MaxTotalConnections, MaxConnectionsPerHost);
+		}
+		CurlSettings.ReceiveBufferSize = CurlReceiveBufferSize;
+		CurlSettings.bHttp2 = bCurlHttp2;
+		CurlSettings.CABundlePath = CurlCABundlePath;
+		Transport = CreateDownloadTransport(TransportType, CurlSettings);
+		UE_LOG(LogFileDownloader, Log, TEXT("Download transport : %s"), Transport->GetName());
+
+		if (bRecordTrace)
+		{
+			const FString Dir = TraceDirectory.IsEmpty() ? FPaths::ProjectSavedDir() / TEXT("DownloadTraces") : TraceDirectory;
+			IFileManager::Get().MakeDirectory(*Dir, true);
+			const FString FileName = Dir / FString::Printf(TEXT("DownloadTrace-%s.txt"), *FDateTime::Now().ToString());
+			TraceRecorder = MakeShareable(new FDownloadTraceRecorder(Transport, FileName));
+			Transport = TraceRecorder;
+			LastTraceFlushTime = FPlatformTime::Seconds();
+			UE_LOG(LogFileDownloader, Log, TEXT("Record download trace : %s"), *FileName);
+		}
+	}
+
+	return Transport;
+}
+
+void UFileDownloadEngineSubsystem::SetTransport(TSharedPtr<IDownloadTransport, ESPMode::ThreadSafe> InTransport)
+{
+	Transport = InTransport;
+	TraceRecorder = nullptr;
+}
+
+TSharedPtr<FDownloadMemoryBudget, ESPMode::ThreadSafe> UFileDownloadEngineSubsystem::GetMemoryBudget()
+{
+	if (MemoryBudget.IsValid() == false)
+	{
+		MemoryBudget = MakeShareable(new FDownloadMemoryBudget());
+		MemoryBudget->SetLimit(MaxInFlightBytes);
+	}
+
+	return MemoryBudget;
+}
+
+TSharedPtr<FDownloadBandwidthLimiter, ESPMode::ThreadSafe> UFileDownloadEngineSubsystem::GetBandwidthLimiter()
+{
+	if (BandwidthLimiter.IsValid() == false)
+	{
+		BandwidthLimiter = MakeShareable(new FDownloadBandwidthLimiter());
+		BandwidthLimiter->SetRate(GetEffectiveBytesPerSecond());
+	}
+
+	return BandwidthLimiter;
+}
+
+TSharedPtr<FHostProfileStore, ESPMode::ThreadSafe> UFileDownloadEngineSubsystem::GetHostProfiles()
+{
+	if (bUseHostProfiles == false)
+	{
+		return nullptr;
+	}
+
+	if (HostProfiles.IsValid() == false)
+	{
+		const FString FileName = HostProfileFile.IsEmpty() ? FPaths::ProjectSavedDir() / TEXT("FileDownloadHostProfiles.json") : HostProfileFile;
+		HostProfiles = MakeShareable(new FHostProfileStore(FileName, HostProfileMaxAgeDays));
+		LastHostProfileSaveTime = FPlatformTime::Seconds();
+		UE_LOG(LogFileDownloader, Log, TEXT("%d host profiles loaded from %s"), HostProfiles->Num(), *FileName);
+	}
+
+	return HostProfiles;
+}
+
+bool UFileDownloadEngineSubsystem::GetHostProfile(const FString& InUrl, bool& bOutRangeSupported, int32& OutChunkSize, int32& OutParallelTasks, float& OutRttMilliseconds, bool& bOutETagReliable)
+{
+	bOutRangeSupported = false;
+	OutChunkSize = 0;
+	OutParallelTasks = 0;
+	OutRttMilliseconds = 0.f;
+	bOutETagReliable = false;
+
+	TSharedPtr<FHostProfileStore, ESPMode::ThreadSafe> Profiles = GetHostProfiles();
+	const FString Host = GetUrlHostKey(InUrl);
+	FHostProfile Profile;
+	if (Profiles.IsValid() == false || Profiles->Find(Host, Profile) == false)
+	{
+		return false;
+	}
+
+	bOutRangeSupported = Profile.RangeSupport > 0;
+	OutChunkSize = Profiles->GetChunkSize(Host, 0);
+	OutParallelTasks = Profile.ParallelTasks;
+	OutRttMilliseconds = Profile.RttSeconds * 1000.f;
+	bOutETagReliable = Profile.bETagUnreliable == false;
+	return true;
+}
+
+FPeerCacheServerPtr UFileDownloadEngineSubsystem::GetPeerCacheServer()
+{
+	if (PeerCachePort < 1)
+	{
+		return nullptr;
+	}
+
+	//the port is read once, a server that cannot start is not tried again
+	if (PeerCacheServer.IsValid() == false)
+	{
+		PeerCacheServer = MakeShareable(new FPeerCacheServer(PeerCachePort));
+		PeerCacheServer->Start();
+	}
+
+	return PeerCacheServer;
+}
+
+void UFileDownloadEngineSubsystem::GetPeerCacheStats(int32& OutFiles, int64& OutRequests, int64& OutServedBytes) const
+{
+	OutFiles = 0;
+	OutRequests = 0;
+	OutServedBytes = 0;
+	if (PeerCacheServer.IsValid())
+	{
+		PeerCacheServer->GetStats(OutFiles, OutRequests, OutServedBytes);
+	}
+}
+
+void UFileDownloadEngineSubsystem::SetGameLoad(float InLoad)
+{
+	if (Throttle.IsValid())
+	{
+		Throttle->SetLoadSignal(InLoad);
+	}
+}
+
+void UFileDownloadEngineSubsystem::SetGameplayActive(bool bActive)
+{
+	if (Throttle.IsValid())
+	{
+		Throttle->SetGameplayActive(bActive);
+	}
+}
+
+void UFileDownloadEngineSubsystem::GetThrottleStats(float& OutLevel, float& OutLoad, float& OutFrameMilliseconds, int32& OutParallelTask, int64& OutBytesPerSecond) const
+{
+	OutLevel = GetThrottleLevel();
+	OutLoad = Throttle.IsValid() ? Throttle->GetLoad() : 0.f;
+	OutFrameMilliseconds = Throttle.IsValid() ? Throttle->GetAverageFrameSeconds() * 1000.f : 0.f;
+	OutParallelTask = GetEffectiveMaxParallelTask();
+	OutBytesPerSecond = GetEffectiveBytesPerSecond();
+}
+
+float UFileDownloadEngineSubsystem::GetThrottleLevel() const
+{
+	return Throttle.IsValid() ? Throttle->GetLevel() : 0.f;
+}
+
+int32 UFileDownloadEngineSubsystem::GetEffectiveMaxParallelTask() const
+{
+	const float Level = GetThrottleLevel();
+	if (MaxParallelTask < 1 || Level <= 0.f)
+	{
+		return MaxParallelTask;
+	}
+
+	const int32 MinTask = FMath::Clamp(ThrottledParallelTask, 1, MaxParallelTask);
+	return FMath::RoundToInt(FMath::Lerp((float)MaxParallelTask, (float)MinTask, Level));
+}
+
+int64 UFileDownloadEngineSubsystem::GetEffectiveBytesPerSecond() const
+{
+	const float Level = GetThrottleLevel();
+	if (Level <= 0.f || ThrottledBytesPerSecond < 1)
+	{
+		return MaxBytesPerSecond;
+	}
+
+	if (MaxBytesPerSecond > 0)
+	{
+		return (int64)FMath::Lerp((double)MaxBytesPerSecond, (double)FMath::Min(MaxBytesPerSecond, ThrottledBytesPerSecond), (double)Level);
+	}
+
+	//an unlimited rate cannot be scaled, a lower level allows proportionally more than the full throttled rate
+	return (int64)(ThrottledBytesPerSecond / Level);
+}
+
+void UFileDownloadEngineSubsystem::Tick(float DeltaTime)
+{
+	Managers.RemoveAll([](const TWeakObjectPtr<UFileDownloadManager>& Manager)
+	{
+		return Manager.IsValid() == false;
+	});
+
+	if (MemoryBudget.IsValid())
+	{
+		MemoryBudget->SetLimit(MaxInFlightBytes);
+	}
+
+	//game thread time of the last frame as the engine measured it, without the idle time of a frame rate limit or waits for rendering
+	if (Throttle.IsValid())
+	{
+		Throttle->FrameBudget = FrameTimeBudgetMs / 1000.f;
+		Throttle->Update(DeltaTime, (float)FPlatformTime::ToSeconds(GGameThreadTime));
+	}
+
+	//tokens are refilled by elapsed time, also wakes the chunks waiting for them
+	if (BandwidthLimiter.IsValid())
+	{
+		BandwidthLimiter->SetRate(GetEffectiveBytesPerSecond());
+		BandwidthLimiter->Refill();
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	if (TraceRecorder.IsValid() && Now - LastTraceFlushTime >= TRACE_FLUSH_SECONDS)
+	{
+		TraceRecorder->Flush();
+		LastTraceFlushTime = Now;
+	}
+
+	if (HostProfiles.IsValid() && Now - LastHostProfileSaveTime >= HOST_PROFILE_SAVE_SECONDS)
+	{
+		HostProfiles->Save();
+		LastHostProfileSaveTime = Now;
+	}
+}
+
+bool UFileDownloadEngineSubsystem::IsTickable() const
+{
+	return HasAnyFlags(RF_ClassDefaultObject) == false;
+}
+
+TStatId UFileDownloadEngineSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UFileDownloadEngineSubsystem, STATGROUP_Tickables);
+}
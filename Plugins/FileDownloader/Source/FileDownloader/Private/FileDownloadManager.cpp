@@ -2,7 +2,31 @@
 
 #include "FileDownloadManager.h"
 #include "DownloadTask.h"
+#include "DeltaDownloadTask.h"
+#include "BatchDownloadTask.h"
+#include "CompressedDownloadTask.h"
+#include "ZipStreamExtractor.h"
+#include "StreamingDownloadTask.h"
+#include "ConcurrencyController.h"
+#include "DownloadManifest.h"
+#include "DownloadTransport.h"
+#include "FileDownloadEngineSubsystem.h"
+#include "QueuedTaskStore.h"
+#include "PeerCacheServer.h"
+#include "PeerCacheTransport.h"
+#include "HostProfileStore.h"
 #include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "Async/Async.h"
+#include "HttpModule.h"
+#include "HttpManager.h"
+#include "HAL/PlatformProcess.h"
+#include "Async/TaskGraphInterfaces.h"
+
+UFileDownloadManager::UFileDownloadManager()
+	: QueuedTasks(MakeShareable(new FQueuedTaskStore()))
+{
+}
 
 void UFileDownloadManager::Tick(float DeltaTime)
 {
@@ -10,35 +34,90 @@ void UFileDownloadManager::Tick(float DeltaTime)
 	{
 		return;
 	}
-	static float TimeCount = 0.f;
-	TimeCount += DeltaTime;
-	if (TimeCount >= TickInterval)
+	TickTimeCount += DeltaTime;
+
+	//a throttled engine schedules less often, up to 4 times the interval, to keep game thread work off costly frames
+	UFileDownloadEngineSubsystem* Engine = UFileDownloadEngineSubsystem::Get();
+	const float ThrottleLevel = Engine ? Engine->GetThrottleLevel() : 0.f;
+	if (TickTimeCount >= TickInterval * (1.f + 3.f * ThrottleLevel))
 	{
-		TimeCount = 0.f;
+		if (ContentCache.IsValid())
+		{
+			ContentCache->SetMaxSize(MaxContentCacheSize);
+		}
+		UpdateAutoTune(TickTimeCount);
+		UpdateSpeed(TickTimeCount);
+		TickTimeCount = 0.f;
 		//broadcast event
 
-		//find task to do
-		if (CurrentDoingWorks < MaxParallelTask && TaskList.Num())
+		if (bTaskOrderDirty)
 		{
-			int32 Idx = FindTaskToDo();
-			if (Idx > INDEX_NONE)
+			SortTaskOrder();
+		}
+
+		ReleaseEndedTasks();
+
+		//connections per host, every running task holds one, connections of running hosts stay warm
+		HostLoad.Reset();
+		for (const auto& It : TaskList)
+		{
+			if (It.Value->IsDownloading())
+			{
+				const FString& Host = TaskHosts.FindRef(It.Key);
+				++HostLoad.FindOrAdd(Host);
+				if (Engine)
+				{
+					Engine->TouchHost(Host);
+				}
+			}
+		}
+
+		//fresh files complete without network, they do not wait for a slot
+		for (int32 TaskID : FreshTasks)
+		{
+			ETaskState State = ETaskState::WAIT;
+			bool bNeedStop = false;
+			if (GetTaskState(TaskID, State, bNeedStop) && State == ETaskState::WAIT && bNeedStop == false)
 			{
-				TaskList[Idx]->Start();
+				MaterializeTask(TaskID)->Start();
 				++CurrentDoingWorks;
 			}
 		}
+		FreshTasks.Reset();
+
+		//find tasks to do, fill every free slot of this manager the engine allows, one task per pass while mostly throttled
+		const int32 MaxStarts = ThrottleLevel > 0.5f ? 1 : MAX_int32;
+		int32 Starts = 0;
+		while (Starts < MaxStarts && CurrentDoingWorks < GetEffectiveParallelTask() && (TaskList.Num() || QueuedTasks->Num()) && (Engine == nullptr || Engine->CanStartTask(this)))
+		{
+			int32 Idx = FindTaskToDo();
+			if (Idx == INDEX_NONE)
+			{
+				break;
+			}
+
+			MaterializeTask(Idx)->Start();
+			++HostLoad.FindOrAdd(TaskHosts.FindRef(Idx));
+			++CurrentDoingWorks;
+			++Starts;
+		}
 	}
 }
 
 TStatId UFileDownloadManager::GetStatId() const
 {
-	return TStatId();
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UFileDownloadManager, STATGROUP_Tickables);
 }
 
 
 void UFileDownloadManager::BeginDestroy()
 {
 	StopAll();
+	StopTaskFutures();
+	if (UFileDownloadEngineSubsystem* Engine = UFileDownloadEngineSubsystem::Get())
+	{
+		Engine->UnregisterManager(this);
+	}
 	Super::BeginDestroy();
 }
 
@@ -50,6 +129,8 @@ void UFileDownloadManager::StartAll()
 	{
 		It.Value->SetNeedStop(false);
 	}
+	QueuedTasks->SetFlagAll(FQueuedTaskStore::NEED_STOP, false);
+	ResetTaskCursors();
 }
 
 void UFileDownloadManager::StartTask(int32 InIndex)
@@ -58,6 +139,13 @@ void UFileDownloadManager::StartTask(int32 InIndex)
 	{
 		TaskList[InIndex]->SetNeedStop(false);
 		bStopAll = false;
+		ResetTaskCursors();
+	}
+	else if (QueuedTasks->Contains(InIndex))
+	{
+		QueuedTasks->SetFlag(InIndex, FQueuedTaskStore::NEED_STOP, false);
+		bStopAll = false;
+		ResetTaskCursors();
 	}
 }
 
@@ -67,6 +155,7 @@ void UFileDownloadManager::StopAll()
 	{
 		It.Value->Stop();
 	}
+	QueuedTasks->SetFlagAll(FQueuedTaskStore::NEED_STOP, true);
 
 	bStopAll = true;
 	CurrentDoingWorks = 0;
@@ -88,12 +177,7 @@ int32 UFileDownloadManager::GetTotalPercent() const
 {
 	int64 CurrentSize = 0;
 	int64 TotalSize = 0;
-
-	for (const auto It : TaskList)
-	{
-		CurrentSize += It.Value->GetCurrentSize();
-		TotalSize += It.Value->GetTotalSize();
-	}
+	GetByteSize(CurrentSize, TotalSize);
 
 	if (TotalSize < 1)
 	{
@@ -106,8 +190,8 @@ int32 UFileDownloadManager::GetTotalPercent() const
 
 void UFileDownloadManager::GetByteSize(int64& OutCurrentSize, int64& OutTotalSize) const
 {
-	OutCurrentSize = 0;
-	OutTotalSize = 0;
+	//stored tasks are summed over their columns
+	QueuedTasks->GetByteSize(OutCurrentSize, OutTotalSize);
 
 	for (const auto It: TaskList)
 	{
@@ -119,12 +203,32 @@ void UFileDownloadManager::GetByteSize(int64& OutCurrentSize, int64& OutTotalSiz
 void UFileDownloadManager::Clear()
 {
 	StopAll();
+	StopTaskFutures();
 	TaskList.Reset();
+	TaskCompletions.Reset();
+	UrlToTask.Reset();
+	TaskHosts.Reset();
+	TaskOrder.Reset();
+	HostWaitLists.Reset();
+	HostHeap.Reset();
+	ParkedHosts.Reset();
+	FreshTasks.Reset();
+	QueuedTasks->Reset();
+	ActiveQueuedTasks.Reset();
+	EndedTasks.Reset();
 	ErrorCount = 0;
 }
 
 bool UFileDownloadManager::SaveTaskToJsonFile(int32 InIndex, const FString& InFileName /*= TEXT("")*/)
 {
+	if (QueuedTasks->Contains(InIndex))
+	{
+		const FTaskInformation Info = QueuedTasks->GetTaskInformation(InIndex);
+		FString OutStr;
+		Info.SerializeToJsonString(OutStr);
+		return FFileHelper::SaveStringToFile(OutStr, InFileName.IsEmpty() ? *(Info.DestDirectory / Info.FileName + TEXT(".task")) : *InFileName);
+	}
+
 	if (TaskList.Contains(InIndex) == false)
 	{
 		return false;
@@ -136,10 +240,15 @@ bool UFileDownloadManager::SaveTaskToJsonFile(int32 InIndex, const FString& InFi
 TArray<FTaskInformation> UFileDownloadManager::GetAllTaskInformation() const
 {
 	TArray<FTaskInformation> Ret;
+	Ret.Reserve(TaskList.Num() + QueuedTasks->Num());
 	for (auto It: TaskList)
 	{
 		Ret.Add(It.Value->GetTaskInformation());
 	}
+	for (int32 TaskID : QueuedTasks->GetIDs())
+	{
+		Ret.Add(QueuedTasks->GetTaskInformation(TaskID));
+	}
 
 	return Ret;
 }
@@ -152,6 +261,10 @@ FTaskInformation UFileDownloadManager::GetTaskInfo(int32 InIndex) const
 	{
 		Ret = TaskList[InIndex]->GetTaskInformation();
 	}
+	else if (QueuedTasks->Contains(InIndex))
+	{
+		Ret = QueuedTasks->GetTaskInformation(InIndex);
+	}
 
 	return Ret;
 }
@@ -164,75 +277,1275 @@ int32 UFileDownloadManager::AddTaskByUrl(const FString& InUrl, const FString& In
 		TmpDir = FPaths::ProjectSavedDir();
 	}
 
-	for (const auto It: TaskList)
+	const int32 ExistID = FindTaskByUrl(InUrl);
+	if (ExistID != INDEX_NONE)
+	{
+		//任务存在于任务列表
+		return ExistID;
+	}
+
+	if (bCompactQueuedTasks)
+	{
+		UpdateSharedServices();
+		const int32 TaskID = AddQueuedTask(InUrl, TmpDir, InFileName, bEnableDeltaUpdate ? FQueuedTaskStore::DELTA : 0);
+		ReadQueuedLocalInfos();
+		return TaskID;
+	}
+
+	const int32 TaskID = RegisterTask(CreateTask(InUrl, TmpDir, InFileName));
+	UrlToTask.Add(InUrl, TaskID);
+	return TaskID;
+}
+
+TFuture<FDownloadResult> UFileDownloadManager::AddTaskByUrlAsync(const FString& InUrl, const FString& InDirectory, const FString& InFileName, FDownloadCancellationTokenPtr InCancelToken, FOnDownloadProgress InOnProgress)
+{
+	const int32 TaskID = InUrl.IsEmpty() ? INDEX_NONE : AddTaskByUrl(InUrl, InDirectory, InFileName);
+	TFuture<FDownloadResult> Future = GetTaskFuture(TaskID, InCancelToken, MoveTemp(InOnProgress));
+	ETaskState State = ETaskState::WAIT;
+	bool bNeedStop = false;
+	if (GetTaskState(TaskID, State, bNeedStop) && State == ETaskState::WAIT)
 	{
-		if (It.Value->GetSourceUrl() == InUrl)
+		StartTask(TaskID);
+	}
+
+	return Future;
+}
+
+TFuture<FDownloadResult> UFileDownloadManager::GetTaskFuture(int32 InIndex, FDownloadCancellationTokenPtr InCancelToken, FOnDownloadProgress InOnProgress)
+{
+	FDownloadResult Result;
+	Result.TaskID = InIndex;
+
+	ETaskState State = ETaskState::WAIT;
+	bool bNeedStop = false;
+	if (GetTaskState(InIndex, State, bNeedStop) == false)
+	{
+		TPromise<FDownloadResult> Promise;
+		Promise.SetValue(Result);
+		return Promise.GetFuture();
+	}
+
+	//a stored task gets its completion when asked for
+	FDownloadCompletionPtr& Completion = TaskCompletions.FindOrAdd(InIndex);
+	if (Completion.IsValid() == false)
+	{
+		Completion = MakeShareable(new FDownloadCompletion());
+	}
+	const FDownloadCompletionPtr TaskCompletion = Completion;
+
+	TFuture<FDownloadResult> Future = TaskCompletion->MakeFuture(MoveTemp(InOnProgress));
+
+	//an ended task sends no more events
+	if (State == ETaskState::COMPLETED || State == ETaskState::ERROR)
+	{
+		Result.Event = State == ETaskState::COMPLETED ? ETaskEvent::DOWNLOAD_COMPLETED : ETaskEvent::ERROR_OCCUR;
+		Result.Info = GetTaskInfo(InIndex);
+		TaskCompletion->Complete(Result);
+		if (QueuedTasks->Contains(InIndex))
 		{
-			//任务存在于任务列表
-			return It.Value->GetGuid();
+			TaskCompletions.Remove(InIndex);
 		}
+		return Future;
 	}
 
-	TSharedPtr<DownloadTask>Task = MakeShareable(new DownloadTask(InUrl, TmpDir, InFileName));
-	Task->ReGenerateGUID();
-	Task->ProcessTaskEvent = [this](ETaskEvent InEvent, const FTaskInformation& InInfo, int32 InHpptCode)
+	if (InCancelToken.IsValid())
 	{
-		if (this != nullptr)
+		//the token may be cancelled on any thread, the task is stopped on game thread
+		TWeakObjectPtr<UFileDownloadManager> WeakThis(this);
+		InCancelToken->OnCancelled([WeakThis, InIndex, TaskCompletion]()
 		{
-			this->OnTaskEvent(InEvent, InInfo, InHpptCode);
-		}
-	};
+			FDownloadResult Stopped;
+			Stopped.TaskID = InIndex;
+			Stopped.Event = ETaskEvent::STOP;
+			TaskCompletion->Complete(Stopped);
 
-	TaskList.Add(Task->GetGuid(), Task);
-	return Task->GetGuid();
+			auto StopOnGameThread = [WeakThis, InIndex]()
+			{
+				if (WeakThis.IsValid() && WeakThis->TaskList.Contains(InIndex))
+				{
+					WeakThis->StopTask(InIndex);
+					WeakThis->TaskList[InIndex]->SetNeedStop(true);
+				}
+				else if (WeakThis.IsValid() && WeakThis->QueuedTasks->Contains(InIndex))
+				{
+					WeakThis->QueuedTasks->SetFlag(InIndex, FQueuedTaskStore::NEED_STOP, true);
+				}
+			};
+
+			if (IsInGameThread())
+			{
+				StopOnGameThread();
+			}
+			else
+			{
+				FFunctionGraphTask::CreateAndDispatchWhenReady(StopOnGameThread, TStatId(), nullptr, ENamedThreads::GameThread);
+			}
+		});
+	}
+
+	return Future;
 }
 
-bool UFileDownloadManager::SetTotalSizeByIndex(int32 InIndex, int32 InTotalSize)
+int32 UFileDownloadManager::AddTasksFromManifest(const FString& InManifestFile, const FString& InDirectory)
 {
-	if (TaskList.Contains(InIndex) && TaskList[InIndex]->GetTotalSize() < 1)
+	FDownloadManifest Manifest;
+	if (Manifest.LoadFromFile(InManifestFile) == false)
 	{
-		TaskList[InIndex]->SetTotalSize(InTotalSize);
-		return true;
+		return 0;
 	}
 
-	return false;
+	return AddTasksFromManifestEntries(Manifest.Files, InDirectory);
 }
 
-
-void UFileDownloadManager::OnTaskEvent(ETaskEvent InEvent, const FTaskInformation& InInfo, int32 InHttpCode)
+int32 UFileDownloadManager::AddTasksFromManifestEntries(const TArray<FManifestEntry>& InEntries, const FString& InDirectory)
 {
-	OnDlManagerEvent.Broadcast(InEvent, InInfo.GetGuid(), InHttpCode);
-	if (InEvent >= ETaskEvent::DOWNLOAD_COMPLETED)
+	FString RootDir = InDirectory;
+	if (RootDir.IsEmpty())
 	{
-		if (CurrentDoingWorks > 0)
+		RootDir = FPaths::ProjectSavedDir();
+	}
+
+	if (bCompactQueuedTasks)
+	{
+		UpdateSharedServices();
+		QueuedTasks->Reserve(InEntries.Num());
+	}
+	else
+	{
+		TaskList.Reserve(TaskList.Num() + InEntries.Num());
+		UrlToTask.Reserve(UrlToTask.Num() + InEntries.Num());
+	}
+	TaskOrder.Reserve(TaskOrder.Num() + InEntries.Num());
+
+	int32 AddCount = 0;
+	for (const FManifestEntry& Entry : InEntries)
+	{
+		if (Entry.Url.IsEmpty() || FindTaskByUrl(Entry.Url) != INDEX_NONE)
 		{
-			--CurrentDoingWorks;
+			continue;
 		}
 
-		if (InEvent == ETaskEvent::ERROR_OCCUR)
+		const FString RelativePath = Entry.Path.IsEmpty() ? FPaths::GetCleanFilename(Entry.Url) : Entry.Path;
+		const FString Dir = FPaths::GetPath(RelativePath).IsEmpty() ? RootDir : RootDir / FPaths::GetPath(RelativePath);
+
+		//a manifest without size still needs HEAD
+		if (bCompactQueuedTasks)
 		{
-			++ErrorCount;
+			const uint8 Flags = (bEnableDeltaUpdate ? FQueuedTaskStore::DELTA : 0) | (Entry.Size > 0 ? FQueuedTaskStore::REMOTE_INFO_KNOWN : 0);
+			const int32 TaskID = AddQueuedTask(Entry.Url, Dir, FPaths::GetCleanFilename(RelativePath), Flags);
+			QueuedTasks->SetTotalSize(TaskID, Entry.Size);
+			QueuedTasks->SetVersion(TaskID, Entry.ETag, Entry.Hash);
+			QueuedTasks->SetPriority(TaskID, Entry.Priority);
+			++AddCount;
+			continue;
 		}
 
-		if (CurrentDoingWorks < 1)
+		FDownloadTaskPtr Task = CreateTask(Entry.Url, Dir, FPaths::GetCleanFilename(RelativePath));
+		Task->SetTotalSize(Entry.Size);
+		Task->SetETag(Entry.ETag);
+		Task->SetHash(Entry.Hash);
+		Task->SetPriority(Entry.Priority);
+		Task->SetRemoteInfoKnown(Entry.Size > 0);
+
+		UrlToTask.Add(Entry.Url, RegisterTask(Task));
+		++AddCount;
+	}
+
+	ReadQueuedLocalInfos();
+	UE_LOG(LogFileDownloader, Log, TEXT("%d tasks added from manifest"), AddCount);
+	return AddCount;
+}
+
+bool UFileDownloadManager::SetTaskPriority(int32 InIndex, int32 InPriority)
+{
+	if (TaskList.Contains(InIndex))
+	{
+		TaskList[InIndex]->SetPriority(InPriority);
+	}
+	else if (QueuedTasks->Contains(InIndex))
+	{
+		QueuedTasks->SetPriority(InIndex, InPriority);
+	}
+	else
+	{
+		return false;
+	}
+
+	bTaskOrderDirty = true;
+	return true;
+}
+
+float UFileDownloadManager::GetDownloadSpeed() const
+{
+	return DownloadSpeed;
+}
+
+float UFileDownloadManager::GetEstimatedTimeRemaining() const
+{
+	int64 CurrentSize = 0;
+	int64 TotalSize = 0;
+	GetByteSize(CurrentSize, TotalSize);
+
+	if (DownloadSpeed < 1.f)
+	{
+		return CurrentSize >= TotalSize ? 0.f : -1.f;
+	}
+
+	return FMath::Max<int64>(0, TotalSize - CurrentSize) / DownloadSpeed;
+}
+
+int32 UFileDownloadManager::AddCompressedTaskByUrl(const FString& InUrl, const FString& InDirectory, const FString& InFileName)
+{
+	FString TmpDir = InDirectory;
+	if (TmpDir.IsEmpty())
+	{
+		TmpDir = FPaths::ProjectSavedDir();
+	}
+
+	//the compressed task downloads another resource than a plain task of the same url
+	const FString UrlKey = InUrl + CompressedUrlSuffix;
+	const int32 ExistID = FindTaskByUrl(UrlKey);
+	if (ExistID != INDEX_NONE)
+	{
+		return ExistID;
+	}
+
+	const int32 TaskID = RegisterTask(MakeShareable(new CompressedDownloadTask(InUrl, TmpDir, InFileName, CompressedUrlSuffix)));
+	UrlToTask.Add(UrlKey, TaskID);
+	return TaskID;
+}
+
+int32 UFileDownloadManager::AddArchiveTaskByUrl(const FString& InUrl, const FString& InExtractDirectory, const FString& InDirectory, const FString& InFileName)
+{
+	FString TmpDir = InDirectory;
+	if (TmpDir.IsEmpty())
+	{
+		TmpDir = FPaths::ProjectSavedDir();
+	}
+
+	const int32 ExistID = FindTaskByUrl(InUrl);
+	if (ExistID != INDEX_NONE)
+	{
+		return ExistID;
+	}
+
+	//the extractor needs the archive in order, delta updates write blocks out of order
+	FDownloadTaskPtr Task = MakeShareable(new DownloadTask(InUrl, TmpDir, InFileName));
+	TSharedPtr<FZipStreamExtractor, ESPMode::ThreadSafe> Extractor = MakeShareable(new FZipStreamExtractor(InExtractDirectory.IsEmpty() ? TmpDir : InExtractDirectory));
+	Task->SetStreamStage(Extractor);
+
+	const int32 TaskID = RegisterTask(Task);
+	UrlToTask.Add(InUrl, TaskID);
+
+	TWeakObjectPtr<UFileDownloadManager> WeakThis(this);
+	Extractor->OnEntryExtracted = [WeakThis, TaskID](const FString& InEntryName, const FString& InFilePath, bool bSucceeded)
+	{
+		if (WeakThis.IsValid())
 		{
-			OnAllTaskCompleted.Broadcast(ErrorCount);
-			ErrorCount = 0;
+			WeakThis->OnArchiveEntryExtracted.Broadcast(TaskID, InEntryName, InFilePath, bSucceeded);
 		}
+	};
+
+	return TaskID;
+}
+
+int32 UFileDownloadManager::AddMemoryTaskByUrl(const FString& InUrl)
+{
+	if (InUrl.IsEmpty())
+	{
+		return INDEX_NONE;
 	}
-	return ;
+
+	FDownloadTaskPtr Task = MakeShareable(new DownloadTask(InUrl, FPaths::ProjectSavedDir(), TEXT("")));
+	Task->SetSinkType(EDownloadSinkType::MEMORY);
+	return RegisterTask(Task);
 }
 
-int32 UFileDownloadManager::FindTaskToDo() const
+int32 UFileDownloadManager::AddDiscardTaskByUrl(const FString& InUrl)
 {
-	int32 ret = INDEX_NONE;
-	for (auto It: TaskList)
+	if (InUrl.IsEmpty())
+	{
+		return INDEX_NONE;
+	}
+
+	FDownloadTaskPtr Task = MakeShareable(new DownloadTask(InUrl, FPaths::ProjectSavedDir(), TEXT("")));
+	Task->SetSinkType(EDownloadSinkType::DISCARD);
+	return RegisterTask(Task);
+}
+
+bool UFileDownloadManager::GetTaskData(int32 InIndex, TArray<uint8>& OutData) const
+{
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> Data = GetTaskMemoryData(InIndex);
+	if (Data.IsValid() == false)
+	{
+		OutData.Reset();
+		return false;
+	}
+
+	OutData = *Data;
+	return true;
+}
+
+TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> UFileDownloadManager::GetTaskMemoryData(int32 InIndex) const
+{
+	if (TaskList.Contains(InIndex))
+	{
+		return TaskList[InIndex]->GetMemoryData();
+	}
+
+	return nullptr;
+}
+
+int32 UFileDownloadManager::AddStreamingTaskByUrl(const FString& InUrl, const FString& InDirectory, const FString& InFileName)
+{
+	FString TmpDir = InDirectory;
+	if (TmpDir.IsEmpty())
+	{
+		TmpDir = FPaths::ProjectSavedDir();
+	}
+
+	const int32 ExistID = FindTaskByUrl(InUrl);
+	if (ExistID != INDEX_NONE)
+	{
+		return ExistID;
+	}
+
+	const int32 TaskID = RegisterTask(MakeShareable(new StreamingDownloadTask(InUrl, TmpDir, InFileName)));
+	UrlToTask.Add(InUrl, TaskID);
+	return TaskID;
+}
+
+int32 UFileDownloadManager::ReadStream(int32 InIndex, int64 InOffset, int32 InSize, TArray<uint8>& OutData)
+{
+	OutData.Reset();
+
+	FDownloadStreamReaderPtr Reader = GetStreamReader(InIndex);
+	if (Reader.IsValid() == false || InSize < 1)
+	{
+		return -1;
+	}
+
+	OutData.SetNumUninitialized(InSize);
+	const int32 ReadSize = Reader->TryRead(InOffset, OutData.GetData(), InSize);
+	OutData.SetNum(FMath::Max(0, ReadSize));
+	return ReadSize;
+}
+
+bool UFileDownloadManager::SeekStream(int32 InIndex, int64 InOffset)
+{
+	FDownloadStreamReaderPtr Reader = GetStreamReader(InIndex);
+	if (Reader.IsValid() == false)
+	{
+		return false;
+	}
+
+	Reader->Seek(InOffset);
+	return true;
+}
+
+FDownloadStreamReaderPtr UFileDownloadManager::GetStreamReader(int32 InIndex) const
+{
+	if (TaskList.Contains(InIndex))
+	{
+		return TaskList[InIndex]->GetStreamReader();
+	}
+
+	return nullptr;
+}
+
+int32 UFileDownloadManager::AddBatchTask(const FString& InUrl, const TArray<FBatchEntry>& InEntries)
+{
+	if (InUrl.IsEmpty() || InEntries.Num() < 1)
+	{
+		return INDEX_NONE;
+	}
+
+	return RegisterTask(MakeShareable(new BatchDownloadTask(InUrl, InEntries, BatchGapThreshold, MaxRangesPerRequest)));
+}
+
+int32 UFileDownloadManager::RegisterTask(FDownloadTaskPtr Task)
+{
+	Task->ReGenerateGUID();
+	SetupTask(Task);
+
+	TaskList.Add(Task->GetGuid(), Task);
+	TaskHosts.Add(Task->GetGuid(), GetUrlHostKey(Task->GetSourceUrl()));
+	TaskOrder.Add(Task->GetGuid());
+	WarmUpHost(Task->GetSourceUrl(), TaskHosts[Task->GetGuid()]);
+	bTaskOrderDirty = true;
+
+	if (bUseFreshnessCache && Task->GetSinkType() != EDownloadSinkType::MEMORY && Task->GetSinkType() != EDownloadSinkType::DISCARD)
+	{
+		TWeakObjectPtr<UFileDownloadManager> WeakThis(this);
+		const int32 TaskID = Task->GetGuid();
+		Task->CheckFreshness(DefaultMaxAge, [WeakThis, TaskID](bool bFresh)
+		{
+			if (bFresh == false)
+			{
+				return;
+			}
+
+			FFunctionGraphTask::CreateAndDispatchWhenReady([WeakThis, TaskID]() {
+				if (WeakThis.IsValid())
+				{
+					WeakThis->FreshTasks.Add(TaskID);
+				}
+			}, TStatId(), nullptr, ENamedThreads::GameThread);
+		});
+	}
+
+	return Task->GetGuid();
+}
+
+void UFileDownloadManager::UpdateSharedServices()
+{
+	//budgets & connections are shared by all managers, without engine (early startup) tasks use the http module & no budget
+	if (UFileDownloadEngineSubsystem* Engine = UFileDownloadEngineSubsystem::Get())
+	{
+		Engine->RegisterManager(this);
+		MemoryBudget = Engine->GetMemoryBudget();
+		BandwidthLimiter = Engine->GetBandwidthLimiter();
+		Transport = Engine->GetTransport();
+		HostProfiles = Engine->GetHostProfiles();
+	}
+	else if (Transport.IsValid() == false)
+	{
+		Transport = GetDefaultDownloadTransport();
+	}
+
+	//peers are asked through the http module, the engine transport may be a stub or a recorder
+	if (PeerUrls.Num() > 0)
+	{
+		FDownloadTransportPtr Origin = Transport == PeerTransport ? PeerTransport->GetOrigin() : Transport;
+		if (PeerTransport.IsValid() == false || PeerTransport->GetOrigin() != Origin || PeerTransport->GetPeerUrls() != PeerUrls)
+		{
+			PeerTransport = MakeShareable(new FPeerCacheTransport(Origin, GetDefaultDownloadTransport(), PeerUrls));
+		}
+		Transport = PeerTransport;
+	}
+	else if (PeerTransport.IsValid())
 	{
-		if (It.Value->GetState() == ETaskState::WAIT && It.Value->GetNeedStop() == false)
+		if (Transport == PeerTransport)
 		{
-			ret = It.Key;
+			Transport = PeerTransport->GetOrigin();
 		}
+		PeerTransport = nullptr;
+	}
+
+	if (bEnableContentCache && ContentCache.IsValid() == false)
+	{
+		const FString CacheDir = ContentCacheDirectory.IsEmpty() ? FPaths::ProjectSavedDir() / TEXT("FileDownloadCache") : ContentCacheDirectory;
+		ContentCache = MakeShareable(new FContentCache(CacheDir, MaxContentCacheSize));
+	}
+}
+
+void UFileDownloadManager::SetupTask(FDownloadTaskPtr Task)
+{
+	UpdateSharedServices();
+
+	if (bUseUncachedFileSink && Task->GetSinkType() == EDownloadSinkType::FILE)
+	{
+		Task->SetSinkType(EDownloadSinkType::UNCACHED_FILE);
+	}
+	else if (bUseMappedFileSink && Task->GetSinkType() == EDownloadSinkType::FILE)
+	{
+		Task->SetSinkType(EDownloadSinkType::MAPPED_FILE);
+	}
+
+	Task->SetMemoryBudget(MemoryBudget);
+	Task->SetBandwidthLimiter(BandwidthLimiter);
+	Task->SetContentCache(bEnableContentCache ? ContentCache : nullptr);
+	Task->SetRunOffGameThread(bRunTasksOffGameThread);
+	Task->SetTransport(Transport);
+
+	//settings learned for the host in earlier sessions, ChunkSize until the host is known
+	const FString Host = GetUrlHostKey(Task->GetSourceUrl());
+	FHostProfile Profile;
+	const bool bKnownHost = HostProfiles.IsValid() && HostProfiles->Find(Host, Profile);
+	Task->SetHostProfiles(HostProfiles);
+	Task->SetChunkSize(bKnownHost ? HostProfiles->GetChunkSize(Host, ChunkSize) : ChunkSize);
+	Task->SetTrustETag(bKnownHost == false || Profile.bETagUnreliable == false);
+	Task->SetSyncOnFinalize(bSyncDirectoryOnFinalize);
+	Task->SetVerifyHash(PeerUrls.Num() > 0 || bServeToPeers);
+	if (RetrySeed != 0)
+	{
+		//the same seed & url give the same delays in every run
+		Task->SetRetrySeed((int32)HashCombine(GetTypeHash(RetrySeed), GetTypeHash(Task->GetSourceUrl())));
+	}
+
+	//tasks may call back from worker or http threads, the manager & its delegates are used on game thread only
+	//futures are completed on the thread of the task, so chained work does not wait for a frame
+	TWeakObjectPtr<UFileDownloadManager> WeakThis(this);
+	FDownloadCompletionPtr& TaskCompletion = TaskCompletions.FindOrAdd(Task->GetGuid());
+	if (TaskCompletion.IsValid() == false)
+	{
+		TaskCompletion = MakeShareable(new FDownloadCompletion());
+	}
+	FDownloadCompletionPtr Completion = TaskCompletion;
+	Task->ProcessTaskEvent = [WeakThis, Completion](ETaskEvent InEvent, const FTaskInformation& InInfo, int32 InHpptCode)
+	{
+		if (InEvent == ETaskEvent::DOWNLOAD_UPDATE)
+		{
+			Completion->NotifyProgress(InInfo.CurrentSize, InInfo.TotalSize);
+		}
+		else if (InEvent >= ETaskEvent::DOWNLOAD_COMPLETED)
+		{
+			FDownloadResult Result;
+			Result.TaskID = InInfo.GetGuid();
+			Result.Event = InEvent;
+			Result.HttpCode = InHpptCode;
+			Result.Info = InInfo;
+			Completion->Complete(Result);
+		}
+
+		if (IsInGameThread() == false)
+		{
+			const FTaskInformation Info = InInfo;
+			FFunctionGraphTask::CreateAndDispatchWhenReady([WeakThis, InEvent, Info, InHpptCode]() {
+				if (WeakThis.IsValid())
+				{
+					WeakThis->OnTaskEvent(InEvent, Info, InHpptCode);
+				}
+			}, TStatId(), nullptr, ENamedThreads::GameThread);
+			return;
+		}
+
+		if (WeakThis.IsValid())
+		{
+			WeakThis->OnTaskEvent(InEvent, InInfo, InHpptCode);
+		}
+	};
+
+	Task->ProcessRequestResult = [WeakThis](int32 InBytes, bool bSucceeded)
+	{
+		if (IsInGameThread() == false)
+		{
+			FFunctionGraphTask::CreateAndDispatchWhenReady([WeakThis, InBytes, bSucceeded]() {
+				if (WeakThis.IsValid())
+				{
+					WeakThis->OnRequestResult(InBytes, bSucceeded);
+				}
+			}, TStatId(), nullptr, ENamedThreads::GameThread);
+			return;
+		}
+
+		if (WeakThis.IsValid())
+		{
+			WeakThis->OnRequestResult(InBytes, bSucceeded);
+		}
+	};
+}
+
+int32 UFileDownloadManager::AddQueuedTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName, uint8 InFlags)
+{
+	const int32 TaskID = DownloadTask::NewGuid();
+	const FString Host = GetUrlHostKey(InUrl);
+	QueuedTasks->Add(TaskID, InUrl, InDirectory, InFileName, Host, InFlags);
+	TaskOrder.Add(TaskID);
+	WarmUpHost(InUrl, Host);
+	bTaskOrderDirty = true;
+
+	//the sidecar is read without a DownloadTask, the row keeps what an intact file needs, a fresh one also starts at once
+	if (bUseFreshnessCache)
+	{
+		LocalInfoReads.Emplace(TaskID, InDirectory + TEXT("/") + (InFileName.IsEmpty() ? FPaths::GetCleanFilename(InUrl) : InFileName));
+	}
+
+	return TaskID;
+}
+
+void UFileDownloadManager::ReadQueuedLocalInfos()
+{
+	if (LocalInfoReads.Num() < 1)
+	{
+		return;
+	}
+
+	struct FLocalInfoResult
+	{
+		int32 TaskID = 0;
+		FTaskInformation Local;
+		bool bFresh = false;
+	};
+
+	//one worker job & one game thread task per add call, the pool is shared with chunk writes & finalizing
+	TWeakObjectPtr<UFileDownloadManager> WeakThis(this);
+	TArray<TPair<int32, FString>> Reads = MoveTemp(LocalInfoReads);
+	LocalInfoReads.Reset();
+	const int32 MaxAge = DefaultMaxAge;
+	++PendingLocalInfoReads;
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Reads = MoveTemp(Reads), MaxAge]()
+	{
+		TArray<FLocalInfoResult> Results;
+		for (const TPair<int32, FString>& Read : Reads)
+		{
+			FLocalInfoResult Result;
+			bool bIntact = false;
+			Result.bFresh = DownloadTask::ReadLocalInfo(Read.Value, MaxAge, Result.Local, bIntact);
+			if (bIntact)
+			{
+				Result.TaskID = Read.Key;
+				Results.Add(MoveTemp(Result));
+			}
+		}
+
+		FFunctionGraphTask::CreateAndDispatchWhenReady([WeakThis, Results = MoveTemp(Results)]() {
+			if (WeakThis.IsValid() == false)
+			{
+				return;
+			}
+
+			--WeakThis->PendingLocalInfoReads;
+
+			//a task may have started or been cleared meanwhile
+			for (const FLocalInfoResult& Result : Results)
+			{
+				if (WeakThis->QueuedTasks->Contains(Result.TaskID))
+				{
+					WeakThis->QueuedTasks->SetLocalInfo(Result.TaskID, Result.Local, Result.bFresh);
+					if (Result.bFresh)
+					{
+						WeakThis->FreshTasks.Add(Result.TaskID);
+					}
+				}
+			}
+		}, TStatId(), nullptr, ENamedThreads::GameThread);
+	});
+}
+
+FDownloadTaskPtr UFileDownloadManager::MaterializeTask(int32 InIndex)
+{
+	if (const FDownloadTaskPtr* Exist = TaskList.Find(InIndex))
+	{
+		return *Exist;
+	}
+
+	if (QueuedTasks->Contains(InIndex) == false)
+	{
+		return nullptr;
+	}
+
+	//buffers, sink & callbacks of a task exist from here until it ends
+	const FTaskInformation Info = QueuedTasks->GetTaskInformation(InIndex);
+	FDownloadTaskPtr Task;
+	if (QueuedTasks->HasFlag(InIndex, FQueuedTaskStore::DELTA))
+	{
+		Task = MakeShareable(new DeltaDownloadTask(Info.SourceUrl, Info.DestDirectory, Info.FileName, DeltaBlockMapSuffix));
+	}
+	else
+	{
+		Task = MakeShareable(new DownloadTask(Info.SourceUrl, Info.DestDirectory, Info.FileName));
+	}
+
+	Task->SetGuid(InIndex);
+	Task->SetTotalSize(Info.TotalSize);
+	Task->SetETag(Info.ETag);
+	Task->SetHash(Info.Hash);
+	Task->SetPriority(Info.Priority);
+	Task->SetRemoteInfoKnown(QueuedTasks->HasFlag(InIndex, FQueuedTaskStore::REMOTE_INFO_KNOWN));
+	Task->SetNeedStop(QueuedTasks->HasFlag(InIndex, FQueuedTaskStore::NEED_STOP));
+	//an intact file that is not fresh is revalidated with If-None-Match
+	FTaskInformation Local;
+	if (QueuedTasks->GetLocalInfo(InIndex, Local))
+	{
+		Task->SetLocalInfo(Local, true, QueuedTasks->HasFlag(InIndex, FQueuedTaskStore::LOCAL_FRESH));
+	}
+	SetupTask(Task);
+
+	TaskList.Add(InIndex, Task);
+	TaskHosts.Add(InIndex, QueuedTasks->GetHost(InIndex));
+	UrlToTask.Add(Info.SourceUrl, InIndex);
+	ActiveQueuedTasks.Add(InIndex);
+	QueuedTasks->Remove(InIndex);
+	return Task;
+}
+
+void UFileDownloadManager::ReleaseEndedTasks()
+{
+	for (int32 TaskID : EndedTasks)
+	{
+		//a delta task keeps its saved size
+		const FDownloadTaskPtr* Task = TaskList.Find(TaskID);
+		if (Task == nullptr || (*Task)->GetDeltaSavedSize() > 0)
+		{
+			continue;
+		}
+
+		const ETaskState State = (*Task)->GetState();
+		if (State != ETaskState::COMPLETED && State != ETaskState::ERROR)
+		{
+			continue;
+		}
+
+		const FTaskInformation Info = (*Task)->GetTaskInformation();
+		QueuedTasks->Add(TaskID, Info.SourceUrl, Info.DestDirectory, Info.FileName, TaskHosts.FindRef(TaskID), 0);
+		QueuedTasks->SetState(TaskID, State);
+		QueuedTasks->SetTotalSize(TaskID, Info.TotalSize);
+		QueuedTasks->SetCurrentSize(TaskID, Info.CurrentSize);
+		QueuedTasks->SetPriority(TaskID, Info.Priority);
+		QueuedTasks->SetVersion(TaskID, Info.ETag, Info.Hash);
+
+		TaskList.Remove(TaskID);
+		TaskHosts.Remove(TaskID);
+		UrlToTask.Remove(Info.SourceUrl);
+		TaskCompletions.Remove(TaskID);
+		ActiveQueuedTasks.Remove(TaskID);
+	}
+	EndedTasks.Reset();
+}
+
+int32 UFileDownloadManager::FindTaskByUrl(const FString& InUrl) const
+{
+	if (const int32* ExistID = UrlToTask.Find(InUrl))
+	{
+		return *ExistID;
+	}
+
+	return QueuedTasks->FindByUrl(InUrl);
+}
+
+bool UFileDownloadManager::GetTaskState(int32 InIndex, ETaskState& OutState, bool& bOutNeedStop) const
+{
+	if (const FDownloadTaskPtr* Task = TaskList.Find(InIndex))
+	{
+		OutState = (*Task)->GetState();
+		bOutNeedStop = (*Task)->GetNeedStop();
+		return true;
+	}
+
+	if (QueuedTasks->Contains(InIndex))
+	{
+		OutState = QueuedTasks->GetState(InIndex);
+		bOutNeedStop = QueuedTasks->HasFlag(InIndex, FQueuedTaskStore::NEED_STOP);
+		return true;
+	}
+
+	return false;
+}
+
+const FString& UFileDownloadManager::GetTaskHost(int32 InIndex) const
+{
+	if (const FString* Host = TaskHosts.Find(InIndex))
+	{
+		return *Host;
+	}
+
+	return QueuedTasks->GetHost(InIndex);
+}
+
+bool UFileDownloadManager::SetTotalSizeByIndex(int32 InIndex, int64 InTotalSize)
+{
+	if (TaskList.Contains(InIndex) && TaskList[InIndex]->GetTotalSize() < 1)
+	{
+		TaskList[InIndex]->SetTotalSize(InTotalSize);
+		return true;
+	}
+
+	if (QueuedTasks->Contains(InIndex) && QueuedTasks->GetTotalSize(InIndex) < 1)
+	{
+		QueuedTasks->SetTotalSize(InIndex, InTotalSize);
+		return true;
+	}
+
+	return false;
+}
+
+int32 UFileDownloadManager::GetEffectiveParallelTask() const
+{
+	if (bAutoTuneParallelTask && ConcurrencyController.IsValid())
+	{
+		return ConcurrencyController->GetLimit();
+	}
+
+	return MaxParallelTask;
+}
+
+void UFileDownloadManager::GetAutoTuneStats(float& OutGoodput, float& OutErrorRate) const
+{
+	OutGoodput = 0.f;
+	OutErrorRate = 0.f;
+
+	if (ConcurrencyController.IsValid())
+	{
+		OutGoodput = ConcurrencyController->GetLastGoodput();
+		OutErrorRate = ConcurrencyController->GetLastErrorRate();
+	}
+}
+
+void UFileDownloadManager::GetInFlightBytes(int64& OutCurrentBytes, int64& OutPeakBytes) const
+{
+	OutCurrentBytes = 0;
+	OutPeakBytes = 0;
+
+	if (MemoryBudget.IsValid())
+	{
+		OutCurrentBytes = MemoryBudget->GetUsed();
+		OutPeakBytes = MemoryBudget->GetPeak();
+	}
+}
+
+void UFileDownloadManager::GetContentCacheStats(int32& OutHitCount, int32& OutMissCount, int64& OutCacheSize) const
+{
+	OutHitCount = 0;
+	OutMissCount = 0;
+	OutCacheSize = 0;
+
+	if (ContentCache.IsValid())
+	{
+		OutHitCount = ContentCache->GetHitCount();
+		OutMissCount = ContentCache->GetMissCount();
+		OutCacheSize = ContentCache->GetTotalSize();
+	}
+}
+
+bool UFileDownloadManager::GetTaskTransferStats(int32 InIndex, int64& OutWireBytes, int64& OutOutputBytes, float& OutDecodeSeconds) const
+{
+	OutWireBytes = 0;
+	OutOutputBytes = 0;
+	OutDecodeSeconds = 0.f;
+
+	if (QueuedTasks->Contains(InIndex))
+	{
+		OutWireBytes = QueuedTasks->GetTaskInformation(InIndex).CurrentSize;
+		OutOutputBytes = OutWireBytes;
+		return true;
+	}
+
+	if (TaskList.Contains(InIndex) == false)
+	{
+		return false;
+	}
+
+	const FDownloadTaskPtr& Task = TaskList[InIndex];
+	OutWireBytes = Task->GetCurrentSize();
+	OutOutputBytes = Task->GetOutputSize();
+	OutDecodeSeconds = (float)Task->GetDecodeSeconds();
+	return true;
+}
+
+int64 UFileDownloadManager::GetDeltaSavedSize(int32 InIndex) const
+{
+	if (TaskList.Contains(InIndex))
+	{
+		return TaskList[InIndex]->GetDeltaSavedSize();
+	}
+
+	return 0;
+}
+
+FString UFileDownloadManager::GetTransportStats(int64& OutRequests, int64& OutFailedRequests, int64& OutReceivedBytes, float& OutAverageRequestSeconds) const
+{
+	OutRequests = 0;
+	OutFailedRequests = 0;
+	OutReceivedBytes = 0;
+	OutAverageRequestSeconds = 0.f;
+
+	if (Transport.IsValid() == false)
+	{
+		return FString();
+	}
+
+	const FDownloadTransportStats Stats = Transport->GetStats();
+	OutRequests = Stats.Requests;
+	OutFailedRequests = Stats.FailedRequests;
+	OutReceivedBytes = Stats.ReceivedBytes;
+	OutAverageRequestSeconds = Stats.Requests > 0 ? (float)(Stats.RequestSeconds / Stats.Requests) : 0.f;
+	return Transport->GetName();
+}
+
+void UFileDownloadManager::GetConnectionStats(int64& OutNewConnections, float& OutSetupSeconds, float& OutTransferSeconds) const
+{
+	OutNewConnections = 0;
+	OutSetupSeconds = 0.f;
+	OutTransferSeconds = 0.f;
+
+	if (Transport.IsValid())
+	{
+		const FDownloadTransportStats Stats = Transport->GetStats();
+		OutNewConnections = Stats.NewConnections;
+		OutSetupSeconds = (float)Stats.SetupSeconds;
+		OutTransferSeconds = (float)(Stats.RequestSeconds - Stats.SetupSeconds);
+	}
+}
+
+void UFileDownloadManager::GetPeerStats(int64& OutPeerBytes, int64& OutOriginBytes, int64& OutPeerRequests, int64& OutFallbacks) const
+{
+	FPeerCacheStats Stats;
+	if (PeerTransport.IsValid())
+	{
+		Stats = PeerTransport->GetPeerStats();
+	}
+
+	OutPeerBytes = Stats.PeerBytes;
+	OutOriginBytes = Stats.OriginBytes;
+	OutPeerRequests = Stats.PeerRequests;
+	OutFallbacks = Stats.Fallbacks;
+}
+
+void UFileDownloadManager::ServeToPeers(const FTaskInformation& InInfo)
+{
+	UFileDownloadEngineSubsystem* Engine = UFileDownloadEngineSubsystem::Get();
+	FPeerCacheServerPtr Server = Engine ? Engine->GetPeerCacheServer() : nullptr;
+	FDownloadTaskPtr Task = TaskList.FindRef(InInfo.GetGuid());
+	if (Server.IsValid() == false || Task.IsValid() == false)
+	{
+		return;
+	}
+
+	//the file must hold exactly the bytes of the url, not decompressed or extracted ones
+	const EDownloadSinkType SinkType = Task->GetSinkType();
+	const bool bFile = SinkType == EDownloadSinkType::FILE || SinkType == EDownloadSinkType::MAPPED_FILE || SinkType == EDownloadSinkType::UNCACHED_FILE;
+	//a file with a manifest hash is served only once it matched, so a bad file does not spread to peers
+	if (bFile && Task->GetOutputSize() == InInfo.TotalSize && (InInfo.Hash.IsEmpty() || Task->IsHashVerified()))
+	{
+		Server->AddFile(InInfo.SourceUrl, InInfo.DestDirectory + TEXT("/") + InInfo.FileName, InInfo.ETag, InInfo.TotalSize);
+	}
+}
+
+void UFileDownloadManager::TickHeadless(float DeltaTime)
+{
+	//without a game loop nobody runs game thread tasks, ticks http requests, the core ticker or tickable objects
+	FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+	FHttpModule::Get().GetHttpManager().Tick(DeltaTime);
+	TickDownloadDelays(DeltaTime);
+	if (UFileDownloadEngineSubsystem* Engine = UFileDownloadEngineSubsystem::Get())
+	{
+		Engine->Tick(DeltaTime);
+	}
+	Tick(DeltaTime);
+}
+
+int32 UFileDownloadManager::GetRunningTaskCount() const
+{
+	return CurrentDoingWorks;
+}
+
+bool UFileDownloadManager::HasBusyTask() const
+{
+	if (PendingLocalInfoReads > 0)
+	{
+		return true;
+	}
+
+	for (const auto& It : TaskList)
+	{
+		if (It.Value->IsBusy())
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool UFileDownloadManager::HasWaitingTask() const
+{
+	return bStopAll == false && (bTaskOrderDirty || HostHeap.Num() > 0 || ParkedHosts.Num() > 0);
+}
+
+int32 UFileDownloadManager::GetHostLoad(const FString& InHost) const
+{
+	return HostLoad.FindRef(InHost);
+}
+
+void UFileDownloadManager::GetQueuedTaskMemory(int32& OutQueuedTasks, int64& OutBytes, int64& OutBytesPerTask) const
+{
+	OutQueuedTasks = QueuedTasks->Num();
+	OutBytes = (int64)QueuedTasks->GetAllocatedSize();
+	OutBytesPerTask = OutQueuedTasks > 0 ? OutBytes / OutQueuedTasks : 0;
+}
+
+bool UFileDownloadManager::WaitForAllTasks(float InTimeout)
+{
+	const float SleepSeconds = FMath::Clamp(TickInterval, 0.001f, 0.1f);
+	const double EndTime = FPlatformTime::Seconds() + InTimeout;
+	double LastTime = FPlatformTime::Seconds();
+
+	for (;;)
+	{
+		const double Now = FPlatformTime::Seconds();
+		TickHeadless((float)(Now - LastTime));
+		LastTime = Now;
+
+		bool bBusy = false;
+		for (const auto& It : TaskList)
+		{
+			const ETaskState State = It.Value->GetState();
+			if (State == ETaskState::DOWNLOADING || (State == ETaskState::WAIT && It.Value->GetNeedStop() == false && bStopAll == false))
+			{
+				bBusy = true;
+				break;
+			}
+		}
+		bBusy = bBusy || (bStopAll == false && QueuedTasks->HasWaitingTask());
+
+		if (bBusy == false)
+		{
+			//deliver events of the last tasks
+			FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+			return true;
+		}
+
+		if (Now >= EndTime)
+		{
+			return false;
+		}
+
+		FPlatformProcess::Sleep(SleepSeconds);
+	}
+}
+
+void UFileDownloadManager::OnTaskEvent(ETaskEvent InEvent, const FTaskInformation& InInfo, int32 InHttpCode)
+{
+	OnDlManagerEvent.Broadcast(InEvent, InInfo.GetGuid(), InHttpCode);
+	if (InEvent >= ETaskEvent::DOWNLOAD_COMPLETED)
+	{
+		if (CurrentDoingWorks > 0)
+		{
+			--CurrentDoingWorks;
+		}
+
+		if (InEvent == ETaskEvent::ERROR_OCCUR)
+		{
+			++ErrorCount;
+		}
+		else if (bServeToPeers)
+		{
+			ServeToPeers(InInfo);
+		}
+
+		//released on the next tick, the task may still be returning from the call that fired the event
+		if (ActiveQueuedTasks.Contains(InInfo.GetGuid()))
+		{
+			EndedTasks.Add(InInfo.GetGuid());
+		}
+
+		if (CurrentDoingWorks < 1)
+		{
+			OnAllTaskCompleted.Broadcast(ErrorCount);
+			ErrorCount = 0;
+		}
+	}
+	return ;
+}
+
+FDownloadTaskPtr UFileDownloadManager::CreateTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName) const
+{
+	if (bEnableDeltaUpdate)
+	{
+		return MakeShareable(new DeltaDownloadTask(InUrl, InDirectory, InFileName, DeltaBlockMapSuffix));
+	}
+
+	return MakeShareable(new DownloadTask(InUrl, InDirectory, InFileName));
+}
+
+int32 UFileDownloadManager::FindTaskToDo()
+{
+	//the host with the earliest next task goes first, so tasks still start in TaskOrder
+	//a host without a free connection in any manager is parked as a whole instead of skipping its tasks one by one
+	const UFileDownloadEngineSubsystem* Engine = UFileDownloadEngineSubsystem::Get();
+	const int32 MaxPerHost = Engine ? Engine->MaxConnectionsPerHost : 0;
+	for (int32 i = ParkedHosts.Num() - 1; i >= 0; --i)
+	{
+		const FHostWaitList& List = HostWaitLists[ParkedHosts[i]];
+		if (MaxPerHost < 1 || Engine->GetHostLoad(List.Host) < MaxPerHost)
+		{
+			HostHeap.HeapPush({ List.Positions[List.Cursor], ParkedHosts[i] });
+			ParkedHosts.RemoveAtSwap(i, 1, false);
+		}
+	}
+
+	while (HostHeap.Num() > 0)
+	{
+		FHostHeapItem Item;
+		HostHeap.HeapPop(Item, false);
+		FHostWaitList& List = HostWaitLists[Item.List];
+		const int32 TaskID = TaskOrder[List.Positions[List.Cursor]];
+
+		ETaskState State = ETaskState::WAIT;
+		bool bNeedStop = false;
+		const bool bWaiting = GetTaskState(TaskID, State, bNeedStop) && State == ETaskState::WAIT && bNeedStop == false;
+		if (bWaiting && MaxPerHost > 0 && Engine->GetHostLoad(List.Host) >= MaxPerHost)
+		{
+			ParkedHosts.Add(Item.List);
+			continue;
+		}
+
+		//a started, stopped or ended task is passed until the cursors are reset
+		if (++List.Cursor < List.Positions.Num())
+		{
+			HostHeap.HeapPush({ List.Positions[List.Cursor], Item.List });
+		}
+		if (bWaiting)
+		{
+			return TaskID;
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+void UFileDownloadManager::BuildHostWaitLists()
+{
+	HostWaitLists.Reset();
+	TMap<FString, int32> ListIndices;
+	for (int32 i = 0; i < TaskOrder.Num(); ++i)
+	{
+		const FString& Host = GetTaskHost(TaskOrder[i]);
+		const int32* Found = ListIndices.Find(Host);
+		const int32 ListIndex = Found ? *Found : HostWaitLists.AddDefaulted();
+		if (Found == nullptr)
+		{
+			HostWaitLists[ListIndex].Host = Host;
+			ListIndices.Add(Host, ListIndex);
+		}
+		HostWaitLists[ListIndex].Positions.Add(i);
+	}
+
+	ResetTaskCursors();
+}
+
+void UFileDownloadManager::ResetTaskCursors()
+{
+	HostHeap.Reset(HostWaitLists.Num());
+	ParkedHosts.Reset();
+	for (int32 i = 0; i < HostWaitLists.Num(); ++i)
+	{
+		HostWaitLists[i].Cursor = 0;
+		HostHeap.Add({ HostWaitLists[i].Positions[0], i });
+	}
+	HostHeap.Heapify();
+}
+
+void UFileDownloadManager::WarmUpHost(const FString& InUrl, const FString& InHost)
+{
+	UFileDownloadEngineSubsystem* Engine = UFileDownloadEngineSubsystem::Get();
+	if (bWarmUpHosts == false || InUrl.IsEmpty() || Transport.IsValid() == false || Engine == nullptr)
+	{
+		return;
+	}
+
+	//one request per host for all managers, later tasks & chunks reuse the kept alive connection
+	if (Engine->TryWarmUpHost(InHost))
+	{
+		Transport->Preconnect(InUrl);
+	}
+}
+
+void UFileDownloadManager::SortTaskOrder()
+{
+	//keys are read once, tasks may be rows of QueuedTasks
+	struct FOrderKey
+	{
+		int32 ID;
+		int32 Priority;
+		int64 TotalSize;
+	};
+
+	TArray<FOrderKey> Keys;
+	Keys.Reserve(TaskOrder.Num());
+	for (int32 TaskID : TaskOrder)
+	{
+		if (const FDownloadTaskPtr* Task = TaskList.Find(TaskID))
+		{
+			Keys.Add({ TaskID, (*Task)->GetPriority(), (*Task)->GetTotalSize() });
+		}
+		else
+		{
+			Keys.Add({ TaskID, QueuedTasks->GetPriority(TaskID), QueuedTasks->GetTotalSize(TaskID) });
+		}
+	}
+
+	//higher priority first, then smaller files so more files are usable early
+	Keys.Sort([](const FOrderKey& A, const FOrderKey& B)
+	{
+		if (A.Priority != B.Priority)
+		{
+			return A.Priority > B.Priority;
+		}
+		if (A.TotalSize != B.TotalSize)
+		{
+			return A.TotalSize < B.TotalSize;
+		}
+		return A.ID < B.ID;
+	});
+
+	for (int32 i = 0; i < Keys.Num(); ++i)
+	{
+		TaskOrder[i] = Keys[i].ID;
+	}
+
+	BuildHostWaitLists();
+	bTaskOrderDirty = false;
+}
+
+void UFileDownloadManager::OnRequestResult(int32 InBytes, bool bSucceeded)
+{
+	SpeedSampleBytes += FMath::Max(0, InBytes);
+
+	if (ConcurrencyController.IsValid())
+	{
+		ConcurrencyController->AddRequestResult(InBytes, bSucceeded);
+	}
+}
+
+void UFileDownloadManager::StopTaskFutures()
+{
+	for (const auto& It : TaskCompletions)
+	{
+		FDownloadResult Result;
+		Result.TaskID = It.Key;
+		Result.Event = ETaskEvent::STOP;
+		It.Value->Complete(Result);
+	}
+}
+
+void UFileDownloadManager::UpdateAutoTune(float DeltaTime)
+{
+	if (bAutoTuneParallelTask == false)
+	{
+		ConcurrencyController = nullptr;
+		return;
+	}
+
+	//created with the first task, so it starts from what it settled on for the host of that task last time
+	if (ConcurrencyController.IsValid() == false)
+	{
+		if (TaskOrder.Num() == 0)
+		{
+			return;
+		}
+
+		FHostProfile Profile;
+		const bool bKnownHost = HostProfiles.IsValid() && HostProfiles->Find(GetTaskHost(TaskOrder[0]), Profile) && Profile.ParallelTasks > 0;
+		ConcurrencyController = MakeShareable(new FConcurrencyController());
+		ConcurrencyController->Reset(bKnownHost ? Profile.ParallelTasks : MaxParallelTask, MinAutoParallelTask, MaxAutoParallelTask);
+	}
+
+	ConcurrencyController->SetBounds(MinAutoParallelTask, MaxAutoParallelTask);
+	const int32 Limit = ConcurrencyController->Update(DeltaTime, CurrentDoingWorks);
+
+	if (HostProfiles.IsValid())
+	{
+		for (const auto& It : HostLoad)
+		{
+			if (It.Value > 0)
+			{
+				HostProfiles->SetParallelTasks(It.Key, Limit);
+			}
+		}
+	}
+}
+
+void UFileDownloadManager::UpdateSpeed(float DeltaTime)
+{
+	if (DeltaTime <= 0.f)
+	{
+		return;
 	}
 
-	return ret;
+	//exponential moving average over roughly the last few seconds
+	const float Alpha = FMath::Clamp(DeltaTime / 3.f, 0.f, 1.f);
+	DownloadSpeed += (SpeedSampleBytes / DeltaTime - DownloadSpeed) * Alpha;
+	SpeedSampleBytes = 0;
 }
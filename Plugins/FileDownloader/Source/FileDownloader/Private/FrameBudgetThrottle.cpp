@@ -0,0 +1,51 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FrameBudgetThrottle.h"
+
+float FFrameBudgetThrottle::Update(float DeltaTime, float InFrameSeconds)
+{
+	if (DeltaTime <= 0.f)
+	{
+		return Level;
+	}
+
+	const float Alpha = FMath::Clamp(DeltaTime / FMath::Max(AverageSeconds, 0.001f), 0.f, 1.f);
+	AverageFrameSeconds += (FMath::Max(0.f, InFrameSeconds) - AverageFrameSeconds) * Alpha;
+
+	if (bGameplayActive == false)
+	{
+		Load = 0.f;
+		Level = 0.f;
+		return Level;
+	}
+
+	if (LoadSignal >= 0.f)
+	{
+		Load = LoadSignal;
+	}
+	else
+	{
+		Load = FrameBudget > 0.f ? AverageFrameSeconds / FrameBudget : 0.f;
+	}
+
+	if (Load > 1.f)
+	{
+		Level = FMath::Min(1.f, Level + DeltaTime / FMath::Max(RaiseSeconds, 0.001f));
+	}
+	else if (Load < LowLoad)
+	{
+		Level = FMath::Max(0.f, Level - DeltaTime / FMath::Max(ReleaseSeconds, 0.001f));
+	}
+
+	return Level;
+}
+
+void FFrameBudgetThrottle::SetLoadSignal(float InLoad)
+{
+	LoadSignal = InLoad;
+}
+
+void FFrameBudgetThrottle::SetGameplayActive(bool bActive)
+{
+	bGameplayActive = bActive;
+}
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * throttle level [0, 1] of all downloads by the cost of game frames, 0 runs at full speed.
+ * the load is the average game thread time of frames over the budget, or a load reported by the game.
+ * a load over 1 raises the level within RaiseSeconds, a load under LowLoad lowers it within ReleaseSeconds,
+ * so a single hitch does not stop downloads and the level does not oscillate. outside gameplay the level is 0.
+ */
+class FFrameBudgetThrottle
+{
+public:
+
+	/*advance the throttle
+	 @Param DeltaTime seconds since last update
+	 @Param InFrameSeconds game thread time of the last frame without the idle time of a frame rate limit
+	 @return the new level
+	*/
+	float Update(float DeltaTime, float InFrameSeconds);
+
+	//load reported by the game instead of frame time, 1 uses the whole budget, negative returns to frame time
+	void SetLoadSignal(float InLoad);
+
+	//menus & loading screens are not gameplay, downloads run at full speed there
+	void SetGameplayActive(bool bActive);
+
+	float GetLevel() const
+	{
+		return Level;
+	}
+
+	//load of the last update
+	float GetLoad() const
+	{
+		return Load;
+	}
+
+	float GetAverageFrameSeconds() const
+	{
+		return AverageFrameSeconds;
+	}
+
+	//seconds of game thread time per frame, 0 ignores frame time
+	float FrameBudget = 0.f;
+
+	//a load under this lowers the level
+	float LowLoad = 0.8f;
+
+	//seconds from level 0 to 1 while over budget
+	float RaiseSeconds = 1.f;
+
+	//seconds from level 1 to 0 while frames are cheap
+	float ReleaseSeconds = 5.f;
+
+	//frame time is averaged over about this many seconds
+	float AverageSeconds = 0.5f;
+
+protected:
+
+	float Level = 0.f;
+
+	float Load = 0.f;
+
+	float AverageFrameSeconds = 0.f;
+
+	float LoadSignal = -1.f;
+
+	bool bGameplayActive = true;
+};
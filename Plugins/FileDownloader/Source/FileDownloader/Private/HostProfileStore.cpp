@@ -0,0 +1,216 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "HostProfileStore.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+#include "JsonObjectConverter.h"
+
+//a chunk should take this long on one connection, long enough that request overhead does not matter
+static const double TARGET_CHUNK_SECONDS = 1.0;
+
+//and at least this many round trips
+static const double TARGET_CHUNK_RTTS = 8.0;
+
+static const int64 MIN_LEARNED_CHUNK_SIZE = 256 * 1024;
+
+static const int64 MAX_LEARNED_CHUNK_SIZE = 16 * 1024 * 1024;
+
+//weight of a new sample in the averages
+static const double SAMPLE_WEIGHT = 0.2;
+
+//the least recently updated hosts are dropped beyond this
+static const int32 MAX_HOST_PROFILES = 256;
+
+FHostProfileStore::FHostProfileStore(const FString& InFileName, int32 InMaxAgeDays)
+	: FileName(InFileName)
+	, MaxAgeDays(InMaxAgeDays)
+{
+	Load();
+}
+
+FHostProfileStore::~FHostProfileStore()
+{
+	Save();
+}
+
+bool FHostProfileStore::Find(const FString& InHost, FHostProfile& OutProfile) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const FHostProfile* Profile = Profiles.Find(InHost);
+	if (Profile == nullptr)
+	{
+		return false;
+	}
+
+	OutProfile = *Profile;
+	return true;
+}
+
+int32 FHostProfileStore::GetChunkSize(const FString& InHost, int32 InDefault) const
+{
+	FScopeLock ScopeLock(&Lock);
+	const FHostProfile* Profile = Profiles.Find(InHost);
+	if (Profile == nullptr)
+	{
+		return InDefault;
+	}
+
+	//every range request would get the whole file again
+	if (Profile->RangeSupport < 0)
+	{
+		return MAX_int32;
+	}
+
+	if (Profile->ConnectionBytesPerSecond < 1)
+	{
+		return InDefault;
+	}
+
+	const double Seconds = FMath::Max(TARGET_CHUNK_SECONDS, Profile->RttSeconds * TARGET_CHUNK_RTTS);
+	const int64 Size = FMath::Clamp((int64)(Profile->ConnectionBytesPerSecond * Seconds), MIN_LEARNED_CHUNK_SIZE, MAX_LEARNED_CHUNK_SIZE);
+	return (int32)Align(Size, 64 * 1024);
+}
+
+void FHostProfileStore::AddRtt(const FString& InHost, double InSeconds)
+{
+	if (InSeconds <= 0.0)
+	{
+		return;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	FHostProfile& Profile = Update(InHost);
+	Profile.RttSeconds = Profile.RttSeconds > 0.f ? (float)FMath::Lerp((double)Profile.RttSeconds, InSeconds, SAMPLE_WEIGHT) : (float)InSeconds;
+}
+
+void FHostProfileStore::AddChunk(const FString& InHost, int64 InBytes, double InSeconds)
+{
+	//tiny chunks measure the round trip, not the bandwidth
+	if (InBytes < MIN_LEARNED_CHUNK_SIZE / 4 || InSeconds <= 0.0)
+	{
+		return;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	FHostProfile& Profile = Update(InHost);
+	const double BytesPerSecond = InBytes / InSeconds;
+	Profile.ConnectionBytesPerSecond = Profile.ConnectionBytesPerSecond > 0 ? (int64)FMath::Lerp((double)Profile.ConnectionBytesPerSecond, BytesPerSecond, SAMPLE_WEIGHT) : (int64)BytesPerSecond;
+}
+
+void FHostProfileStore::SetRangeSupport(const FString& InHost, bool bSupported)
+{
+	FScopeLock ScopeLock(&Lock);
+	FHostProfile* Profile = Profiles.Find(InHost);
+	const int32 RangeSupport = Profile ? Profile->RangeSupport : 0;
+
+	//a host that served ranges keeps that, an ignored range now and then comes from a proxy
+	if (bSupported ? RangeSupport != 1 : RangeSupport == 0)
+	{
+		Update(InHost).RangeSupport = bSupported ? 1 : -1;
+	}
+}
+
+void FHostProfileStore::SetETagUnreliable(const FString& InHost)
+{
+	FScopeLock ScopeLock(&Lock);
+	Update(InHost).bETagUnreliable = true;
+}
+
+void FHostProfileStore::SetParallelTasks(const FString& InHost, int32 InParallelTasks)
+{
+	FScopeLock ScopeLock(&Lock);
+	FHostProfile* Profile = Profiles.Find(InHost);
+	if (Profile == nullptr || Profile->ParallelTasks != InParallelTasks)
+	{
+		Update(InHost).ParallelTasks = InParallelTasks;
+	}
+}
+
+void FHostProfileStore::Save()
+{
+	FHostProfileIndex Index;
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (bDirty == false)
+		{
+			return;
+		}
+
+		Expire();
+		Profiles.GenerateValueArray(Index.Profiles);
+		bDirty = false;
+	}
+
+	FString JsonStr;
+	if (FJsonObjectConverter::UStructToJsonObjectString(FHostProfileIndex::StaticStruct(), &Index, JsonStr, 0, 0))
+	{
+		FFileHelper::SaveStringToFile(JsonStr, *FileName);
+	}
+}
+
+int32 FHostProfileStore::Num() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Profiles.Num();
+}
+
+FHostProfile& FHostProfileStore::Update(const FString& InHost)
+{
+	FHostProfile& Profile = Profiles.FindOrAdd(InHost);
+	Profile.Host = InHost;
+	Profile.UpdatedTime = FDateTime::UtcNow().GetTicks();
+	bDirty = true;
+	return Profile;
+}
+
+void FHostProfileStore::Load()
+{
+	FScopeLock ScopeLock(&Lock);
+
+	FString JsonStr;
+	FHostProfileIndex Index;
+	if (FFileHelper::LoadFileToString(JsonStr, *FileName) == false
+		|| FJsonObjectConverter::JsonObjectStringToUStruct(JsonStr, &Index, 0, 0) == false)
+	{
+		return;
+	}
+
+	for (const FHostProfile& Profile : Index.Profiles)
+	{
+		Profiles.Add(Profile.Host, Profile);
+	}
+
+	const int32 Loaded = Profiles.Num();
+	Expire();
+	bDirty = Profiles.Num() != Loaded;
+}
+
+void FHostProfileStore::Expire()
+{
+	if (MaxAgeDays > 0)
+	{
+		const int64 MinTime = (FDateTime::UtcNow() - FTimespan::FromDays(MaxAgeDays)).GetTicks();
+		for (auto It = Profiles.CreateIterator(); It; ++It)
+		{
+			if (It.Value().UpdatedTime < MinTime)
+			{
+				It.RemoveCurrent();
+			}
+		}
+	}
+
+	if (Profiles.Num() > MAX_HOST_PROFILES)
+	{
+		Profiles.ValueSort([](const FHostProfile& A, const FHostProfile& B)
+		{
+			return A.UpdatedTime > B.UpdatedTime;
+		});
+
+		TArray<FString> Hosts;
+		Profiles.GenerateKeyArray(Hosts);
+		for (int32 i = MAX_HOST_PROFILES; i < Hosts.Num(); ++i)
+		{
+			Profiles.Remove(Hosts[i]);
+		}
+	}
+}
@@ -0,0 +1,105 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "HostProfileStore.generated.h"
+
+USTRUCT()
+struct FHostProfile
+{
+	GENERATED_BODY()
+
+	//host key of GetUrlHostKey
+	UPROPERTY()
+		FString Host;
+	//1 if ranges are served, -1 if range requests get the whole file, 0 if unknown
+	UPROPERTY()
+		int32 RangeSupport = 0;
+	//bytes per second of one connection, averaged over chunks
+	UPROPERTY()
+		int64 ConnectionBytesPerSecond = 0;
+	//parallel tasks auto tune settled on, 0 if unknown
+	UPROPERTY()
+		int32 ParallelTasks = 0;
+	//round trip of a HEAD without connection setup, averaged
+	UPROPERTY()
+		float RttSeconds = 0.f;
+	//a range answered for an If-Range came with another ETag, e.g. several servers behind one name
+	UPROPERTY()
+		bool bETagUnreliable = false;
+	//last update, FDateTime ticks
+	UPROPERTY()
+		int64 UpdatedTime = 0;
+};
+
+USTRUCT()
+struct FHostProfileIndex
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+		TArray<FHostProfile> Profiles;
+};
+
+/**
+ * transfer settings learned per host, kept in a json file so the next session starts from them instead of the defaults.
+ * tasks report what they see, the manager reads chunk size, range support, ETag trust & parallel tasks when it sets up tasks.
+ * profiles not updated for MaxAgeDays are dropped. all public functions are thread safe.
+ */
+class FHostProfileStore
+{
+public:
+
+	FHostProfileStore(const FString& InFileName, int32 InMaxAgeDays);
+
+	//saves changes
+	~FHostProfileStore();
+
+	bool Find(const FString& InHost, FHostProfile& OutProfile) const;
+
+	/*bytes a task of the host should request at once
+	 @Param InDefault used while the host is unknown
+	 @return the whole file for a host without range support
+	*/
+	int32 GetChunkSize(const FString& InHost, int32 InDefault) const;
+
+	void AddRtt(const FString& InHost, double InSeconds);
+
+	//a chunk of one connection was received in InSeconds, without connection setup
+	void AddChunk(const FString& InHost, int64 InBytes, double InSeconds);
+
+	void SetRangeSupport(const FString& InHost, bool bSupported);
+
+	void SetETagUnreliable(const FString& InHost);
+
+	void SetParallelTasks(const FString& InHost, int32 InParallelTasks);
+
+	//write the file if something changed since the last save
+	void Save();
+
+	int32 Num() const;
+
+protected:
+
+	//call with Lock held
+	FHostProfile& Update(const FString& InHost);
+
+	void Load();
+
+	//drop expired profiles, call with Lock held
+	void Expire();
+
+	FString FileName;
+
+	int32 MaxAgeDays = 30;
+
+	mutable FCriticalSection Lock;
+
+	TMap<FString, FHostProfile> Profiles;
+
+	bool bDirty = false;
+};
+
+typedef TSharedPtr<FHostProfileStore, ESPMode::ThreadSafe> FHostProfileStorePtr;
@@ -0,0 +1,220 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PeerCacheServer.h"
+#include "FileDownloader.h"
+#include "HttpServerModule.h"
+#include "IHttpRouter.h"
+#include "HttpServerRequest.h"
+#include "HttpServerResponse.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Paths.h"
+#include "Misc/SecureHash.h"
+#include "Async/Async.h"
+#include "Runtime/Launch/Resources/Version.h"
+
+const TCHAR* PEER_CACHE_ROUTE = TEXT("/filedownloader/peer");
+
+//a range is held in memory until it is sent, peers ask in chunks far below this
+static const int64 PEER_MAX_RANGE_SIZE = 16 * 1024 * 1024;
+
+//not in EHttpServerResponseCodes
+static const EHttpServerResponseCodes PEER_RANGE_NOT_SATISFIABLE = (EHttpServerResponseCodes)416;
+
+FString GetPeerCacheKey(const FString& InSourceUrl)
+{
+	return FMD5::HashAnsiString(*InSourceUrl.ToLower());
+}
+
+FPeerCacheServer::FPeerCacheServer(int32 InPort)
+	: Port(InPort)
+{
+}
+
+FPeerCacheServer::~FPeerCacheServer()
+{
+	if (Router.IsValid() && RouteHandle.IsValid())
+	{
+		Router->UnbindRoute(RouteHandle);
+	}
+}
+
+bool FPeerCacheServer::Start()
+{
+	if (Router.IsValid())
+	{
+		return RouteHandle.IsValid();
+	}
+
+	FHttpServerModule& HttpServer = FHttpServerModule::Get();
+	Router = HttpServer.GetHttpRouter(Port);
+	if (Router.IsValid() == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Peer cache cannot listen on port %d"), Port);
+		return false;
+	}
+
+#if ENGINE_MAJOR_VERSION > 5 || (ENGINE_MAJOR_VERSION == 5 && ENGINE_MINOR_VERSION >= 1)
+	RouteHandle = Router->BindRoute(FHttpPath(PEER_CACHE_ROUTE), EHttpServerRequestVerbs::VERB_GET, FHttpRequestHandler::CreateRaw(this, &FPeerCacheServer::HandleRequest));
+#else
+	RouteHandle = Router->BindRoute(FHttpPath(PEER_CACHE_ROUTE), EHttpServerRequestVerbs::VERB_GET, [this](const FHttpServerRequest& InRequest, const FHttpResultCallback& InOnComplete)
+	{
+		return this->HandleRequest(InRequest, InOnComplete);
+	});
+#endif
+	if (RouteHandle.IsValid() == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Peer cache route is bound already on port %d"), Port);
+		return false;
+	}
+
+	HttpServer.StartAllListeners();
+	UE_LOG(LogFileDownloader, Log, TEXT("Peer cache serves completed files on port %d"), Port);
+	return true;
+}
+
+void FPeerCacheServer::AddFile(const FString& InSourceUrl, const FString& InFileName, const FString& InETag, int64 InSize)
+{
+	//peers send If-Range, a file without a strong ETag cannot be matched to their version
+	if (InETag.IsEmpty() || InETag.StartsWith(TEXT("W/")) || InSize < 1)
+	{
+		return;
+	}
+
+	const FFileStatData Stat = IFileManager::Get().GetStatData(*InFileName);
+	if (Stat.bIsValid == false || Stat.FileSize != InSize)
+	{
+		return;
+	}
+
+	FServedFile& File = Files.FindOrAdd(GetPeerCacheKey(InSourceUrl));
+	File.FileName = InFileName;
+	File.ETag = InETag;
+	File.Size = InSize;
+	File.TimeStamp = Stat.ModificationTime;
+}
+
+void FPeerCacheServer::RemoveFile(const FString& InSourceUrl)
+{
+	Files.Remove(GetPeerCacheKey(InSourceUrl));
+}
+
+void FPeerCacheServer::GetStats(int32& OutFiles, int64& OutRequests, int64& OutServedBytes) const
+{
+	OutFiles = Files.Num();
+	OutRequests = Requests;
+	OutServedBytes = ServedBytes.load();
+}
+
+bool FPeerCacheServer::HandleRequest(const FHttpServerRequest& InRequest, const FHttpResultCallback& InOnComplete)
+{
+	++Requests;
+
+	//the key is the last part of the path
+	const FString Key = FPaths::GetCleanFilename(InRequest.RelativePath.GetPath());
+	const FServedFile* File = Files.Find(Key);
+	if (File == nullptr)
+	{
+		InOnComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::NotFound));
+		return true;
+	}
+
+	//a file changed or removed since it was completed is not served anymore
+	const FFileStatData Stat = IFileManager::Get().GetStatData(*File->FileName);
+	if (Stat.bIsValid == false || Stat.FileSize != File->Size || Stat.ModificationTime != File->TimeStamp)
+	{
+		Files.Remove(Key);
+		InOnComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::NotFound));
+		return true;
+	}
+
+	//the peer has another version of the file
+	const TArray<FString>* IfRange = InRequest.Headers.Find(TEXT("If-Range"));
+	if (IfRange && IfRange->Num() > 0 && (*IfRange)[0] != File->ETag)
+	{
+		InOnComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::PrecondFailed));
+		return true;
+	}
+
+	//a single "bytes=first-last" range, the whole file if there is none
+	int64 First = 0;
+	int64 Last = File->Size - 1;
+	const TArray<FString>* RangeHeader = InRequest.Headers.Find(TEXT("Range"));
+	const bool bRange = RangeHeader && RangeHeader->Num() > 0;
+	if (bRange)
+	{
+		FString Range = (*RangeHeader)[0];
+		FString Left;
+		FString Right;
+		if (Range.RemoveFromStart(TEXT("bytes=")) == false || Range.Contains(TEXT(",")) || Range.Split(TEXT("-"), &Left, &Right) == false || Left.IsEmpty())
+		{
+			InOnComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::BadRequest));
+			return true;
+		}
+
+		First = FCString::Atoi64(*Left);
+		Last = Right.IsEmpty() ? Last : FMath::Min(Last, FCString::Atoi64(*Right));
+	}
+
+	//a range starting at or after the end of the file
+	if (First >= File->Size)
+	{
+		TUniquePtr<FHttpServerResponse> Response = FHttpServerResponse::Error(PEER_RANGE_NOT_SATISFIABLE);
+		Response->Headers.Add(TEXT("Content-Range"), { FString::Printf(TEXT("bytes */%lld"), File->Size) });
+		InOnComplete(MoveTemp(Response));
+		return true;
+	}
+
+	const int64 Length = Last - First + 1;
+	if (First < 0 || Length < 1 || Length > PEER_MAX_RANGE_SIZE)
+	{
+		InOnComplete(FHttpServerResponse::Error(EHttpServerResponseCodes::BadRequest));
+		return true;
+	}
+
+	//the read of up to PEER_MAX_RANGE_SIZE must not hold the game thread, the answer goes back to it as the connection is ticked there
+	TWeakPtr<FPeerCacheServer, ESPMode::ThreadSafe> WeakThis = AsShared();
+	const FServedFile Served = *File;
+	Async(EAsyncExecution::ThreadPool, [WeakThis, Key, Served, First, Last, Length, bRange, InOnComplete]()
+	{
+		TArray<uint8> Data;
+		TUniquePtr<IFileHandle> Handle(FPlatformFileManager::Get().GetPlatformFile().OpenRead(*Served.FileName));
+		Data.SetNumUninitialized(Length);
+		const bool bRead = Handle.IsValid() && Handle->Seek(First) && Handle->Read(Data.GetData(), Length);
+		Handle.Reset();
+
+		TUniquePtr<FHttpServerResponse> Response;
+		if (bRead)
+		{
+			Response = FHttpServerResponse::Create(MoveTemp(Data), TEXT("application/octet-stream"));
+			Response->Headers.Add(TEXT("ETag"), { Served.ETag });
+			if (bRange)
+			{
+				Response->Code = EHttpServerResponseCodes::PartialContent;
+				Response->Headers.Add(TEXT("Content-Range"), { FString::Printf(TEXT("bytes %lld-%lld/%lld"), First, Last, Served.Size) });
+			}
+		}
+		else
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("Peer cache cannot read %s"), *Served.FileName);
+			Response = FHttpServerResponse::Error(EHttpServerResponseCodes::NotFound);
+		}
+
+		AsyncTask(ENamedThreads::GameThread, [WeakThis, Key, Length, bRead, InOnComplete, Response = MoveTemp(Response)]() mutable
+		{
+			if (FPeerCacheServerPtr Server = WeakThis.Pin())
+			{
+				if (bRead)
+				{
+					Server->ServedBytes += Length;
+				}
+				else
+				{
+					Server->Files.Remove(Key);
+				}
+			}
+			InOnComplete(MoveTemp(Response));
+		});
+	});
+	return true;
+}
@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HttpRouteHandle.h"
+#include "HttpResultCallback.h"
+#include <atomic>
+
+class IHttpRouter;
+struct FHttpServerRequest;
+
+//path of peer requests on the server, a file is "/filedownloader/peer/<key>"
+extern const TCHAR* PEER_CACHE_ROUTE;
+
+//key of the file of a source url on a peer, urls compare case insensitive like the task urls of a manager
+FString GetPeerCacheKey(const FString& InSourceUrl);
+
+/**
+ * serves completed files of this instance to other instances on the local network, over the http server of the engine.
+ * a GET of a single range is answered with 206, If-Range must match the ETag the file was downloaded with, or it is 412.
+ * a file changed or removed since it was added is not served anymore. used on game thread, where the http server runs,
+ * ranges are read & answered on a worker.
+ */
+class FPeerCacheServer : public TSharedFromThis<FPeerCacheServer, ESPMode::ThreadSafe>
+{
+public:
+
+	explicit FPeerCacheServer(int32 InPort);
+
+	~FPeerCacheServer();
+
+	//bind the route & start listening, false if the port cannot be used
+	bool Start();
+
+	/*serve a completed file to peers
+	 @Param InETag strong ETag of the origin, peers ask with it in If-Range
+	 @Param InSize size of the file on disk, checked before every answer
+	*/
+	void AddFile(const FString& InSourceUrl, const FString& InFileName, const FString& InETag, int64 InSize);
+
+	void RemoveFile(const FString& InSourceUrl);
+
+	int32 GetPort() const
+	{
+		return Port;
+	}
+
+	//files served, requests answered & bytes sent to peers
+	void GetStats(int32& OutFiles, int64& OutRequests, int64& OutServedBytes) const;
+
+protected:
+
+	struct FServedFile
+	{
+		FString FileName;
+
+		FString ETag;
+
+		int64 Size = 0;
+
+		FDateTime TimeStamp;
+	};
+
+	bool HandleRequest(const FHttpServerRequest& InRequest, const FHttpResultCallback& InOnComplete);
+
+	int32 Port = 0;
+
+	TSharedPtr<IHttpRouter> Router;
+
+	FHttpRouteHandle RouteHandle;
+
+	//peer cache key to file
+	TMap<FString, FServedFile> Files;
+
+	int64 Requests = 0;
+
+	//added on the workers answering requests
+	std::atomic<int64> ServedBytes { 0 };
+};
+
+typedef TSharedPtr<FPeerCacheServer, ESPMode::ThreadSafe> FPeerCacheServerPtr;
@@ -0,0 +1,186 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "PeerCacheTransport.h"
+#include "PeerCacheServer.h"
+#include "DownloadTraceRecorder.h"
+#include "GenericPlatform/GenericPlatformHttp.h"
+#include "Misc/ScopeLock.h"
+
+//seconds a peer that cannot be reached is not asked
+static const double PEER_SKIP_SECONDS = 30.0;
+
+FPeerCacheTransport::FPeerCacheTransport(FDownloadTransportPtr InOrigin, FDownloadTransportPtr InPeer, const TArray<FString>& InPeerUrls)
+	: Origin(InOrigin)
+	, Peer(InPeer)
+	, PeerUrls(InPeerUrls)
+{
+	PeerSkipUntil.Init(0.0, PeerUrls.Num());
+}
+
+uint64 FPeerCacheTransport::Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete)
+{
+	const uint64 Handle = NewHandle();
+	const double SendTime = FPlatformTime::Seconds();
+
+	//only a range of a known version can be asked from a peer
+	FString IfRange;
+	for (const TPair<FString, FString>& Header : InRequest.Headers)
+	{
+		if (Header.Key.Equals(TEXT("If-Range"), ESearchCase::IgnoreCase))
+		{
+			IfRange = Header.Value;
+		}
+	}
+	int64 Offset = 0;
+	int64 Length = 0;
+	const bool bPeerRequest = InRequest.bAllowPeers && InRequest.Verb == TEXT("GET") && ParseDownloadRange(InRequest, Offset, Length) && IfRange.IsEmpty() == false && IfRange.StartsWith(TEXT("W/")) == false;
+
+	int32 PeerIndex = INDEX_NONE;
+	{
+		FScopeLock ScopeLock(&Lock);
+		Requests.Add(Handle);
+		if (bPeerRequest)
+		{
+			PeerIndex = PickPeer(SendTime);
+			PeerStats.PeerRequests += PeerIndex == INDEX_NONE ? 0 : 1;
+		}
+	}
+
+	if (PeerIndex == INDEX_NONE)
+	{
+		SendToOrigin(Handle, InRequest, InOnComplete, SendTime);
+		return Handle;
+	}
+
+	//peers know files by the source url, the request has the encoded one
+	FString PeerUrl = PeerUrls[PeerIndex];
+	PeerUrl.RemoveFromEnd(TEXT("/"));
+	FDownloadRequest PeerRequest = InRequest;
+	PeerRequest.Url = PeerUrl + PEER_CACHE_ROUTE + TEXT("/") + GetPeerCacheKey(FGenericPlatformHttp::UrlDecode(InRequest.Url));
+
+	const FDownloadRequest OriginRequest = InRequest;
+	SendAttempt(Handle, 0, Peer, PeerRequest, [this, Handle, PeerIndex, OriginRequest, InOnComplete, SendTime](FDownloadResponsePtr InResponse, bool bSucceeded)
+	{
+		const int32 Code = InResponse.IsValid() ? InResponse->GetResponseCode() : 0;
+		if (bSucceeded && Code == 206)
+		{
+			const int64 Bytes = InResponse->Content.Num();
+			{
+				FScopeLock ScopeLock(&Lock);
+				if (Requests.Remove(Handle) == 0)
+				{
+					return;
+				}
+				PeerStats.PeerBytes += Bytes;
+			}
+
+			AddStats(Bytes, FPlatformTime::Seconds() - SendTime, InResponse->SetupSeconds, InResponse->NewConnections, true);
+			InOnComplete(InResponse, true);
+			return;
+		}
+
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (Requests.Contains(Handle) == false)
+			{
+				return;
+			}
+
+			//a peer without the file or with another version is asked again for the next range
+			++PeerStats.Fallbacks;
+			if (bSucceeded == false || Code == 0 || Code >= 500)
+			{
+				PeerSkipUntil[PeerIndex] = FPlatformTime::Seconds() + PEER_SKIP_SECONDS;
+			}
+		}
+
+		this->SendToOrigin(Handle, OriginRequest, InOnComplete, SendTime);
+	});
+
+	return Handle;
+}
+
+void FPeerCacheTransport::Cancel(uint64 InHandle)
+{
+	FPendingRequest Pending;
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (Requests.RemoveAndCopyValue(InHandle, Pending) == false)
+		{
+			return;
+		}
+	}
+
+	//an attempt not stored yet is dropped when it completes
+	if (Pending.Transport.IsValid())
+	{
+		Pending.Transport->Cancel(Pending.InnerHandle);
+	}
+}
+
+FPeerCacheStats FPeerCacheTransport::GetPeerStats() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return PeerStats;
+}
+
+int32 FPeerCacheTransport::PickPeer(double InNow)
+{
+	//peers take turns, so ranges of one file are spread over all of them
+	for (int32 i = 0; i < PeerUrls.Num(); ++i)
+	{
+		const int32 Index = (NextPeer + i) % PeerUrls.Num();
+		if (PeerSkipUntil[Index] <= InNow)
+		{
+			NextPeer = Index + 1;
+			return Index;
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+void FPeerCacheTransport::SendAttempt(uint64 InHandle, int32 InAttempt, FDownloadTransportPtr InTransport, const FDownloadRequest& InRequest, TFunction<void(FDownloadResponsePtr, bool)> InOnComplete)
+{
+	const uint64 InnerHandle = InTransport->Send(InRequest, MoveTemp(InOnComplete));
+
+	//the attempt may have completed & the next one started meanwhile
+	FScopeLock ScopeLock(&Lock);
+	FPendingRequest* Pending = Requests.Find(InHandle);
+	if (Pending && Pending->Attempt == InAttempt && Pending->Transport.IsValid() == false)
+	{
+		Pending->Transport = InTransport;
+		Pending->InnerHandle = InnerHandle;
+	}
+}
+
+void FPeerCacheTransport::SendToOrigin(uint64 InHandle, const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete, double InSendTime)
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		FPendingRequest* Pending = Requests.Find(InHandle);
+		if (Pending == nullptr)
+		{
+			return;
+		}
+		Pending->Transport = nullptr;
+		Pending->InnerHandle = 0;
+		Pending->Attempt = 1;
+	}
+
+	SendAttempt(InHandle, 1, Origin, InRequest, [this, InHandle, InOnComplete, InSendTime](FDownloadResponsePtr InResponse, bool bSucceeded)
+	{
+		const int64 Bytes = InResponse.IsValid() ? InResponse->Content.Num() : 0;
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (Requests.Remove(InHandle) == 0)
+			{
+				return;
+			}
+			PeerStats.OriginBytes += Bytes;
+		}
+
+		AddStats(Bytes, FPlatformTime::Seconds() - InSendTime, InResponse.IsValid() ? InResponse->SetupSeconds : 0.0, InResponse.IsValid() ? InResponse->NewConnections : -1, bSucceeded);
+		InOnComplete(InResponse, bSucceeded);
+	});
+}
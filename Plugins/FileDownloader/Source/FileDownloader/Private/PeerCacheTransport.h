@@ -0,0 +1,102 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTransport.h"
+
+/**
+ * bytes a FPeerCacheTransport got from peers and from the origin
+ */
+struct FPeerCacheStats
+{
+	int64 PeerBytes = 0;
+
+	int64 OriginBytes = 0;
+
+	//requests sent to a peer first
+	int64 PeerRequests = 0;
+
+	//of PeerRequests, sent to the origin again because the peer failed or had no such file
+	int64 Fallbacks = 0;
+};
+
+/**
+ * wraps the transport of a manager and asks instances on the local network for ranges of a file before the origin.
+ * only ranges with a strong If-Range go to peers, a peer answers for the version the origin sent in the HEAD, so data never mixes versions.
+ * HEAD & other requests go to the origin. a peer that cannot be reached is skipped for a while, a peer without the file answers 404.
+ */
+class FPeerCacheTransport : public IDownloadTransport
+{
+public:
+
+	/*
+	 @Param InOrigin transport of requests to the origin
+	 @Param InPeer transport of requests to peers
+	 @Param InPeerUrls "http://host:port" of peers running FPeerCacheServer
+	*/
+	FPeerCacheTransport(FDownloadTransportPtr InOrigin, FDownloadTransportPtr InPeer, const TArray<FString>& InPeerUrls);
+
+	virtual uint64 Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete) override;
+
+	virtual void Cancel(uint64 InHandle) override;
+
+	virtual const TCHAR* GetName() const override
+	{
+		return Origin->GetName();
+	}
+
+	virtual void Preconnect(const FString& InUrl) override
+	{
+		Origin->Preconnect(InUrl);
+	}
+
+	FPeerCacheStats GetPeerStats() const;
+
+	FDownloadTransportPtr GetOrigin() const
+	{
+		return Origin;
+	}
+
+	const TArray<FString>& GetPeerUrls() const
+	{
+		return PeerUrls;
+	}
+
+protected:
+
+	struct FPendingRequest
+	{
+		//transport of the current attempt, null until it is sent
+		FDownloadTransportPtr Transport;
+
+		uint64 InnerHandle = 0;
+
+		//0 is the peer, 1 the origin
+		int32 Attempt = 0;
+	};
+
+	//a peer that is not skipped, INDEX_NONE if none, call with Lock held
+	int32 PickPeer(double InNow);
+
+	void SendAttempt(uint64 InHandle, int32 InAttempt, FDownloadTransportPtr InTransport, const FDownloadRequest& InRequest, TFunction<void(FDownloadResponsePtr, bool)> InOnComplete);
+
+	void SendToOrigin(uint64 InHandle, const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete, double InSendTime);
+
+	FDownloadTransportPtr Origin;
+
+	FDownloadTransportPtr Peer;
+
+	TArray<FString> PeerUrls;
+
+	mutable FCriticalSection Lock;
+
+	//time until a peer is skipped after it could not be reached
+	TArray<double> PeerSkipUntil;
+
+	int32 NextPeer = 0;
+
+	TMap<uint64, FPendingRequest> Requests;
+
+	FPeerCacheStats PeerStats;
+};
@@ -0,0 +1,445 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "QueuedTaskStore.h"
+#include "Misc/Paths.h"
+
+//text of removed rows is kept until there is at least this much
+static const int32 MIN_DEAD_TEXT = 64 * 1024;
+
+bool FQueuedTaskStore::Add(int32 InID, const FString& InUrl, const FString& InDirectory, const FString& InFileName, const FString& InHost, uint8 InFlags)
+{
+	if (IDToRow.Contains(InID))
+	{
+		return false;
+	}
+
+	IDToRow.Add(InID, IDs.Num());
+	UrlHashToID.Add(GetTypeHash(InUrl), InID);
+
+	IDs.Add(InID);
+	Urls.Add(AddText(InUrl));
+	FileNames.Add(AddText(InFileName));
+	ETags.AddDefaulted();
+	Hashes.AddDefaulted();
+	Directories.Add(Intern(InDirectory));
+	Hosts.Add(Intern(InHost));
+	Priorities.Add(0);
+	TotalSizes.Add(0);
+	CurrentSizes.Add(0);
+	States.Add(ETaskState::WAIT);
+	Flags.Add(InFlags & ~(LOCAL_INTACT | LOCAL_FRESH));
+	LocalETags.AddDefaulted();
+	LocalLastModifieds.AddDefaulted();
+	LocalValidatedTimes.Add(0);
+	LocalSizes.Add(0);
+	LocalModifiedTimes.Add(0);
+	LocalMaxAges.Add(-1);
+	return true;
+}
+
+bool FQueuedTaskStore::Remove(int32 InID)
+{
+	const int32 Row = GetRow(InID);
+	if (Row == INDEX_NONE)
+	{
+		return false;
+	}
+
+	UrlHashToID.RemoveSingle(GetTypeHash(GetText(Urls[Row])), InID);
+	RemoveText(Urls[Row]);
+	RemoveText(FileNames[Row]);
+	RemoveText(ETags[Row]);
+	RemoveText(Hashes[Row]);
+	RemoveText(LocalETags[Row]);
+	RemoveText(LocalLastModifieds[Row]);
+
+	//the last row takes the place of the removed one
+	IDToRow.Remove(InID);
+	if (Row != IDs.Num() - 1)
+	{
+		IDToRow.Add(IDs.Last(), Row);
+	}
+
+	IDs.RemoveAtSwap(Row, 1, false);
+	Urls.RemoveAtSwap(Row, 1, false);
+	FileNames.RemoveAtSwap(Row, 1, false);
+	ETags.RemoveAtSwap(Row, 1, false);
+	Hashes.RemoveAtSwap(Row, 1, false);
+	Directories.RemoveAtSwap(Row, 1, false);
+	Hosts.RemoveAtSwap(Row, 1, false);
+	Priorities.RemoveAtSwap(Row, 1, false);
+	TotalSizes.RemoveAtSwap(Row, 1, false);
+	CurrentSizes.RemoveAtSwap(Row, 1, false);
+	States.RemoveAtSwap(Row, 1, false);
+	Flags.RemoveAtSwap(Row, 1, false);
+	LocalETags.RemoveAtSwap(Row, 1, false);
+	LocalLastModifieds.RemoveAtSwap(Row, 1, false);
+	LocalValidatedTimes.RemoveAtSwap(Row, 1, false);
+	LocalSizes.RemoveAtSwap(Row, 1, false);
+	LocalModifiedTimes.RemoveAtSwap(Row, 1, false);
+	LocalMaxAges.RemoveAtSwap(Row, 1, false);
+
+	if (DeadText > MIN_DEAD_TEXT && DeadText > Text.Num() / 2)
+	{
+		CompactText();
+	}
+	return true;
+}
+
+void FQueuedTaskStore::Reset()
+{
+	IDs.Empty();
+	Urls.Empty();
+	FileNames.Empty();
+	ETags.Empty();
+	Hashes.Empty();
+	Directories.Empty();
+	Hosts.Empty();
+	Priorities.Empty();
+	TotalSizes.Empty();
+	CurrentSizes.Empty();
+	States.Empty();
+	Flags.Empty();
+	LocalETags.Empty();
+	LocalLastModifieds.Empty();
+	LocalValidatedTimes.Empty();
+	LocalSizes.Empty();
+	LocalModifiedTimes.Empty();
+	LocalMaxAges.Empty();
+	Text.Empty();
+	DeadText = 0;
+	InternedStrings.Empty();
+	InternedIndices.Empty();
+	IDToRow.Empty();
+	UrlHashToID.Empty();
+}
+
+void FQueuedTaskStore::Reserve(int32 InNum)
+{
+	const int32 Num = IDs.Num() + InNum;
+	IDs.Reserve(Num);
+	Urls.Reserve(Num);
+	FileNames.Reserve(Num);
+	ETags.Reserve(Num);
+	Hashes.Reserve(Num);
+	Directories.Reserve(Num);
+	Hosts.Reserve(Num);
+	Priorities.Reserve(Num);
+	TotalSizes.Reserve(Num);
+	CurrentSizes.Reserve(Num);
+	States.Reserve(Num);
+	Flags.Reserve(Num);
+	LocalETags.Reserve(Num);
+	LocalLastModifieds.Reserve(Num);
+	LocalValidatedTimes.Reserve(Num);
+	LocalSizes.Reserve(Num);
+	LocalModifiedTimes.Reserve(Num);
+	LocalMaxAges.Reserve(Num);
+	IDToRow.Reserve(Num);
+	UrlHashToID.Reserve(Num);
+}
+
+int32 FQueuedTaskStore::Num() const
+{
+	return IDs.Num();
+}
+
+bool FQueuedTaskStore::Contains(int32 InID) const
+{
+	return IDToRow.Contains(InID);
+}
+
+int32 FQueuedTaskStore::FindByUrl(const FString& InUrl) const
+{
+	TArray<int32, TInlineAllocator<4>> Candidates;
+	UrlHashToID.MultiFind(GetTypeHash(InUrl), Candidates);
+	for (int32 ID : Candidates)
+	{
+		if (GetText(Urls[IDToRow[ID]]) == InUrl)
+		{
+			return ID;
+		}
+	}
+
+	return INDEX_NONE;
+}
+
+FTaskInformation FQueuedTaskStore::GetTaskInformation(int32 InID) const
+{
+	FTaskInformation Info;
+	const int32 Row = GetRow(InID);
+	if (Row == INDEX_NONE)
+	{
+		return Info;
+	}
+
+	Info.GUID = InID;
+	Info.SourceUrl = GetText(Urls[Row]);
+	Info.FileName = FileNames[Row].Length > 0 ? GetText(FileNames[Row]) : FPaths::GetCleanFilename(Info.SourceUrl);
+	Info.DestDirectory = InternedStrings[Directories[Row]];
+	Info.ETag = GetText(ETags[Row]);
+	Info.Hash = GetText(Hashes[Row]);
+	Info.Priority = Priorities[Row];
+	Info.TotalSize = TotalSizes[Row];
+	Info.CurrentSize = CurrentSizes[Row];
+	return Info;
+}
+
+const FString& FQueuedTaskStore::GetHost(int32 InID) const
+{
+	static const FString Empty;
+	const int32 Row = GetRow(InID);
+	return Row == INDEX_NONE ? Empty : InternedStrings[Hosts[Row]];
+}
+
+ETaskState FQueuedTaskStore::GetState(int32 InID) const
+{
+	const int32 Row = GetRow(InID);
+	return Row == INDEX_NONE ? ETaskState::WAIT : States[Row];
+}
+
+void FQueuedTaskStore::SetState(int32 InID, ETaskState InState)
+{
+	const int32 Row = GetRow(InID);
+	if (Row != INDEX_NONE)
+	{
+		States[Row] = InState;
+	}
+}
+
+bool FQueuedTaskStore::HasFlag(int32 InID, uint8 InFlag) const
+{
+	const int32 Row = GetRow(InID);
+	return Row != INDEX_NONE && (Flags[Row] & InFlag) != 0;
+}
+
+void FQueuedTaskStore::SetFlag(int32 InID, uint8 InFlag, bool bSet)
+{
+	const int32 Row = GetRow(InID);
+	if (Row != INDEX_NONE)
+	{
+		Flags[Row] = bSet ? (Flags[Row] | InFlag) : (Flags[Row] & ~InFlag);
+	}
+}
+
+void FQueuedTaskStore::SetFlagAll(uint8 InFlag, bool bSet)
+{
+	for (uint8& RowFlags : Flags)
+	{
+		RowFlags = bSet ? (RowFlags | InFlag) : (RowFlags & ~InFlag);
+	}
+}
+
+int32 FQueuedTaskStore::GetPriority(int32 InID) const
+{
+	const int32 Row = GetRow(InID);
+	return Row == INDEX_NONE ? 0 : Priorities[Row];
+}
+
+void FQueuedTaskStore::SetPriority(int32 InID, int32 InPriority)
+{
+	const int32 Row = GetRow(InID);
+	if (Row != INDEX_NONE)
+	{
+		Priorities[Row] = InPriority;
+	}
+}
+
+int64 FQueuedTaskStore::GetTotalSize(int32 InID) const
+{
+	const int32 Row = GetRow(InID);
+	return Row == INDEX_NONE ? 0 : TotalSizes[Row];
+}
+
+void FQueuedTaskStore::SetTotalSize(int32 InID, int64 InTotalSize)
+{
+	const int32 Row = GetRow(InID);
+	if (Row != INDEX_NONE)
+	{
+		TotalSizes[Row] = InTotalSize;
+	}
+}
+
+void FQueuedTaskStore::SetCurrentSize(int32 InID, int64 InCurrentSize)
+{
+	const int32 Row = GetRow(InID);
+	if (Row != INDEX_NONE)
+	{
+		CurrentSizes[Row] = InCurrentSize;
+	}
+}
+
+void FQueuedTaskStore::SetVersion(int32 InID, const FString& InETag, const FString& InHash)
+{
+	const int32 Row = GetRow(InID);
+	if (Row == INDEX_NONE)
+	{
+		return;
+	}
+
+	RemoveText(ETags[Row]);
+	RemoveText(Hashes[Row]);
+	ETags[Row] = AddText(InETag);
+	Hashes[Row] = AddText(InHash);
+}
+
+void FQueuedTaskStore::SetLocalInfo(int32 InID, const FTaskInformation& InLocalInfo, bool bFresh)
+{
+	const int32 Row = GetRow(InID);
+	if (Row == INDEX_NONE)
+	{
+		return;
+	}
+
+	RemoveText(LocalETags[Row]);
+	RemoveText(LocalLastModifieds[Row]);
+	LocalETags[Row] = AddText(InLocalInfo.ETag);
+	LocalLastModifieds[Row] = AddText(InLocalInfo.LastModified);
+	LocalValidatedTimes[Row] = InLocalInfo.ValidatedTime;
+	LocalSizes[Row] = InLocalInfo.LocalSize;
+	LocalModifiedTimes[Row] = InLocalInfo.LocalModifiedTime;
+	LocalMaxAges[Row] = InLocalInfo.MaxAge;
+	Flags[Row] |= LOCAL_INTACT;
+	Flags[Row] = bFresh ? (Flags[Row] | LOCAL_FRESH) : (Flags[Row] & ~LOCAL_FRESH);
+}
+
+bool FQueuedTaskStore::GetLocalInfo(int32 InID, FTaskInformation& OutLocalInfo) const
+{
+	const int32 Row = GetRow(InID);
+	if (Row == INDEX_NONE || (Flags[Row] & LOCAL_INTACT) == 0)
+	{
+		return false;
+	}
+
+	//queued tasks are plain files, the whole file is the local file
+	OutLocalInfo.ETag = GetText(LocalETags[Row]);
+	OutLocalInfo.LastModified = GetText(LocalLastModifieds[Row]);
+	OutLocalInfo.ValidatedTime = LocalValidatedTimes[Row];
+	OutLocalInfo.LocalSize = LocalSizes[Row];
+	OutLocalInfo.LocalModifiedTime = LocalModifiedTimes[Row];
+	OutLocalInfo.MaxAge = LocalMaxAges[Row];
+	OutLocalInfo.TotalSize = LocalSizes[Row];
+	OutLocalInfo.CurrentSize = LocalSizes[Row];
+	return true;
+}
+
+void FQueuedTaskStore::GetByteSize(int64& OutCurrentSize, int64& OutTotalSize) const
+{
+	OutCurrentSize = 0;
+	OutTotalSize = 0;
+
+	for (int64 Size : CurrentSizes)
+	{
+		OutCurrentSize += Size;
+	}
+	for (int64 Size : TotalSizes)
+	{
+		OutTotalSize += Size;
+	}
+}
+
+bool FQueuedTaskStore::HasWaitingTask() const
+{
+	for (int32 Row = 0; Row < IDs.Num(); ++Row)
+	{
+		if (States[Row] == ETaskState::WAIT && (Flags[Row] & NEED_STOP) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+SIZE_T FQueuedTaskStore::GetAllocatedSize() const
+{
+	SIZE_T Size = IDs.GetAllocatedSize() + Urls.GetAllocatedSize() + FileNames.GetAllocatedSize() + ETags.GetAllocatedSize() + Hashes.GetAllocatedSize()
+		+ Directories.GetAllocatedSize() + Hosts.GetAllocatedSize() + Priorities.GetAllocatedSize() + TotalSizes.GetAllocatedSize()
+		+ CurrentSizes.GetAllocatedSize() + States.GetAllocatedSize() + Flags.GetAllocatedSize() + Text.GetAllocatedSize()
+		+ LocalETags.GetAllocatedSize() + LocalLastModifieds.GetAllocatedSize() + LocalValidatedTimes.GetAllocatedSize()
+		+ LocalSizes.GetAllocatedSize() + LocalModifiedTimes.GetAllocatedSize() + LocalMaxAges.GetAllocatedSize()
+		+ InternedStrings.GetAllocatedSize() + InternedIndices.GetAllocatedSize() + IDToRow.GetAllocatedSize() + UrlHashToID.GetAllocatedSize();
+
+	//the interned strings are held twice, by the array & the map
+	for (const FString& String : InternedStrings)
+	{
+		Size += String.GetAllocatedSize() * 2;
+	}
+	return Size;
+}
+
+int32 FQueuedTaskStore::Intern(const FString& InString)
+{
+	if (const int32* Index = InternedIndices.Find(InString))
+	{
+		return *Index;
+	}
+
+	const int32 Index = InternedStrings.Add(InString);
+	InternedIndices.Add(InString, Index);
+	return Index;
+}
+
+FQueuedTaskStore::FTextRange FQueuedTaskStore::AddText(const FString& InString)
+{
+	FTextRange Range;
+	if (InString.IsEmpty())
+	{
+		return Range;
+	}
+
+	FTCHARToUTF8 Utf8(*InString);
+	Range.Offset = Text.Num();
+	Range.Length = Utf8.Length();
+	Text.Append(Utf8.Get(), Utf8.Length());
+	return Range;
+}
+
+FString FQueuedTaskStore::GetText(const FTextRange& InRange) const
+{
+	if (InRange.Length < 1)
+	{
+		return FString();
+	}
+
+	FUTF8ToTCHAR Converted(Text.GetData() + InRange.Offset, InRange.Length);
+	return FString(Converted.Length(), Converted.Get());
+}
+
+void FQueuedTaskStore::RemoveText(const FTextRange& InRange)
+{
+	DeadText += InRange.Length;
+}
+
+void FQueuedTaskStore::CompactText()
+{
+	TArray<ANSICHAR> OldText = MoveTemp(Text);
+	Text.Reserve(OldText.Num() - DeadText);
+
+	auto Move = [this, &OldText](FTextRange& InOutRange)
+	{
+		if (InOutRange.Length > 0)
+		{
+			const int32 Offset = Text.Num();
+			Text.Append(OldText.GetData() + InOutRange.Offset, InOutRange.Length);
+			InOutRange.Offset = Offset;
+		}
+	};
+
+	for (int32 Row = 0; Row < IDs.Num(); ++Row)
+	{
+		Move(Urls[Row]);
+		Move(FileNames[Row]);
+		Move(ETags[Row]);
+		Move(Hashes[Row]);
+		Move(LocalETags[Row]);
+		Move(LocalLastModifieds[Row]);
+	}
+	DeadText = 0;
+}
+
+int32 FQueuedTaskStore::GetRow(int32 InID) const
+{
+	const int32* Row = IDToRow.Find(InID);
+	return Row ? *Row : INDEX_NONE;
+}
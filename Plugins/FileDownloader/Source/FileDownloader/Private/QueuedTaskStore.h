@@ -0,0 +1,165 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TaskInformation.h"
+#include "DownloadEvent.h"
+
+/**
+ * plain tasks of a manager that are not running, one row per task in column arrays instead of a DownloadTask each.
+ * directories & hosts are interned, urls & names are kept as UTF-8 in one buffer, a row costs about 155 bytes with its index entries
+ * plus its url, file name & the ETag & Last-Modified of its local file. GetAllocatedSize reports the actual heap size.
+ * the manager turns a row into a DownloadTask when the task starts, and an ended task back into a row.
+ * not thread safe, used on game thread only.
+ */
+class FQueuedTaskStore
+{
+public:
+
+	//row flags
+	static const uint8 NEED_STOP = 1 << 0;
+	static const uint8 REMOTE_INFO_KNOWN = 1 << 1;
+	static const uint8 DELTA = 1 << 2;
+	static const uint8 LOCAL_INTACT = 1 << 3;
+	static const uint8 LOCAL_FRESH = 1 << 4;
+
+	/*add a waiting task
+	 @Param InFileName empty to use the file name of InUrl
+	 @return false if the id is stored already
+	*/
+	bool Add(int32 InID, const FString& InUrl, const FString& InDirectory, const FString& InFileName, const FString& InHost, uint8 InFlags);
+
+	bool Remove(int32 InID);
+
+	void Reset();
+
+	void Reserve(int32 InNum);
+
+	int32 Num() const;
+
+	bool Contains(int32 InID) const;
+
+	//id of the task of an url, INDEX_NONE if none
+	int32 FindByUrl(const FString& InUrl) const;
+
+	//all fields as a DownloadTask would report them
+	FTaskInformation GetTaskInformation(int32 InID) const;
+
+	const FString& GetHost(int32 InID) const;
+
+	ETaskState GetState(int32 InID) const;
+
+	void SetState(int32 InID, ETaskState InState);
+
+	bool HasFlag(int32 InID, uint8 InFlag) const;
+
+	void SetFlag(int32 InID, uint8 InFlag, bool bSet);
+
+	//set or clear a flag of every row
+	void SetFlagAll(uint8 InFlag, bool bSet);
+
+	int32 GetPriority(int32 InID) const;
+
+	void SetPriority(int32 InID, int32 InPriority);
+
+	int64 GetTotalSize(int32 InID) const;
+
+	void SetTotalSize(int32 InID, int64 InTotalSize);
+
+	void SetCurrentSize(int32 InID, int64 InCurrentSize);
+
+	void SetVersion(int32 InID, const FString& InETag, const FString& InHash);
+
+	//keep the revalidation fields of the sidecar of an intact local file, sets LOCAL_INTACT & LOCAL_FRESH
+	void SetLocalInfo(int32 InID, const FTaskInformation& InLocalInfo, bool bFresh);
+
+	//the sidecar fields kept by SetLocalInfo, false if the local file is not intact
+	bool GetLocalInfo(int32 InID, FTaskInformation& OutLocalInfo) const;
+
+	//sums of all rows
+	void GetByteSize(int64& OutCurrentSize, int64& OutTotalSize) const;
+
+	//some row is waiting and not stopped
+	bool HasWaitingTask() const;
+
+	//ids of all rows
+	const TArray<int32>& GetIDs() const
+	{
+		return IDs;
+	}
+
+	//heap bytes of all rows, interned strings & indexes included
+	SIZE_T GetAllocatedSize() const;
+
+protected:
+
+	//a string in Text
+	struct FTextRange
+	{
+		int32 Offset = 0;
+		int32 Length = 0;
+	};
+
+	//case sensitive, directories differing in case are different on most file systems
+	struct FInternKeyFuncs : TDefaultMapHashableKeyFuncs<FString, int32, false>
+	{
+		static bool Matches(KeyInitType A, KeyInitType B)
+		{
+			return A.Equals(B, ESearchCase::CaseSensitive);
+		}
+
+		static uint32 GetKeyHash(KeyInitType Key)
+		{
+			return FCrc::StrCrc32(*Key);
+		}
+	};
+
+	int32 Intern(const FString& InString);
+
+	FTextRange AddText(const FString& InString);
+
+	FString GetText(const FTextRange& InRange) const;
+
+	void RemoveText(const FTextRange& InRange);
+
+	//drop text of removed rows once it is most of the buffer
+	void CompactText();
+
+	int32 GetRow(int32 InID) const;
+
+	TArray<int32> IDs;
+	TArray<FTextRange> Urls;
+	TArray<FTextRange> FileNames;
+	TArray<FTextRange> ETags;
+	TArray<FTextRange> Hashes;
+	TArray<int32> Directories;
+	TArray<int32> Hosts;
+	TArray<int32> Priorities;
+	TArray<int64> TotalSizes;
+	TArray<int64> CurrentSizes;
+	TArray<ETaskState> States;
+	TArray<uint8> Flags;
+
+	//sidecar of the local file, only what a revalidation or a fresh completion needs
+	TArray<FTextRange> LocalETags;
+	TArray<FTextRange> LocalLastModifieds;
+	TArray<int64> LocalValidatedTimes;
+	TArray<int64> LocalSizes;
+	TArray<int64> LocalModifiedTimes;
+	TArray<int32> LocalMaxAges;
+
+	//UTF-8 of urls, file names, ETags, hashes & sidecar fields
+	TArray<ANSICHAR> Text;
+
+	//bytes of Text no row refers to
+	int32 DeadText = 0;
+
+	TArray<FString> InternedStrings;
+	TMap<FString, int32, FDefaultSetAllocator, FInternKeyFuncs> InternedIndices;
+
+	TMap<int32, int32> IDToRow;
+
+	//hash of the url to ids, urls compare like the keys of UrlToTask in the manager
+	TMultiMap<uint32, int32> UrlHashToID;
+};
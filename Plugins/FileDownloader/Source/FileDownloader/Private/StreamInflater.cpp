@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "StreamInflater.h"
+
+THIRD_PARTY_INCLUDES_START
+#include "zlib.h"
+THIRD_PARTY_INCLUDES_END
+
+static const int32 INFLATE_BLOCK_SIZE = 256 * 1024;
+
+FStreamInflater::FStreamInflater(int32 InWindowBits)
+	: WindowBits(InWindowBits)
+{
+	OutBuffer.SetNumUninitialized(INFLATE_BLOCK_SIZE);
+	Reset();
+}
+
+FStreamInflater::~FStreamInflater()
+{
+	if (Stream)
+	{
+		inflateEnd((z_stream*)Stream);
+		delete (z_stream*)Stream;
+		Stream = nullptr;
+	}
+}
+
+void FStreamInflater::Reset()
+{
+	if (Stream)
+	{
+		inflateEnd((z_stream*)Stream);
+	}
+	else
+	{
+		Stream = new z_stream;
+	}
+
+	z_stream* ZStream = (z_stream*)Stream;
+	FMemory::Memzero(*ZStream);
+	inflateInit2(ZStream, WindowBits);
+
+	bFinished = false;
+	TotalOut = 0;
+}
+
+bool FStreamInflater::Feed(const uint8* InData, int32 InSize, TFunctionRef<bool(const uint8* InBlock, int32 InBlockSize)> InOutput, int32* OutConsumed)
+{
+	z_stream* ZStream = (z_stream*)Stream;
+	ZStream->next_in = (Bytef*)InData;
+	ZStream->avail_in = InSize;
+
+	bool bResult = true;
+	while (bFinished == false && (ZStream->avail_in > 0 || ZStream->avail_out == 0))
+	{
+		ZStream->next_out = OutBuffer.GetData();
+		ZStream->avail_out = OutBuffer.Num();
+
+		const int32 Ret = inflate(ZStream, Z_NO_FLUSH);
+		if (Ret != Z_OK && Ret != Z_STREAM_END && Ret != Z_BUF_ERROR)
+		{
+			bResult = false;
+			break;
+		}
+
+		const int32 Produced = OutBuffer.Num() - ZStream->avail_out;
+		TotalOut += Produced;
+		if (Produced > 0 && InOutput(OutBuffer.GetData(), Produced) == false)
+		{
+			bResult = false;
+			break;
+		}
+
+		if (Ret == Z_STREAM_END)
+		{
+			bFinished = true;
+		}
+		else if (Ret == Z_BUF_ERROR || Produced == 0)
+		{
+			//no progress possible with current input
+			break;
+		}
+	}
+
+	if (OutConsumed)
+	{
+		*OutConsumed = InSize - ZStream->avail_in;
+	}
+
+	return bResult;
+}
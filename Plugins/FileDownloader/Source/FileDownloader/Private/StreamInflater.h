@@ -0,0 +1,59 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * incremental zlib inflater, input can be fed in pieces of any size as they arrive.
+ * not thread safe, feed it from one thread at a time.
+ */
+class FStreamInflater
+{
+public:
+
+	//gzip or zlib header detected automatically
+	static const int32 GZIP_OR_ZLIB = 32 + 15;
+	//raw deflate without header, used by zip entries
+	static const int32 RAW_DEFLATE = -15;
+
+	explicit FStreamInflater(int32 InWindowBits = GZIP_OR_ZLIB);
+
+	~FStreamInflater();
+
+	void Reset();
+
+	/*decompress a piece of input
+	 @Param InOutput called for every decompressed block, return false to abort
+	 @Param OutConsumed input bytes used, less than InSize only when the stream ended inside this piece
+	 @return false on corrupt data or if InOutput aborted
+	*/
+	bool Feed(const uint8* InData, int32 InSize, TFunctionRef<bool(const uint8* InBlock, int32 InBlockSize)> InOutput, int32* OutConsumed = nullptr);
+
+	//true when the end of the compressed stream has been reached
+	bool IsFinished() const
+	{
+		return bFinished;
+	}
+
+	int64 GetTotalOut() const
+	{
+		return TotalOut;
+	}
+
+	FStreamInflater(const FStreamInflater&) = delete;
+	FStreamInflater& operator=(const FStreamInflater&) = delete;
+
+protected:
+
+	int32 WindowBits = GZIP_OR_ZLIB;
+
+	//z_stream, kept opaque so zlib headers stay in the cpp
+	void* Stream = nullptr;
+
+	bool bFinished = false;
+
+	int64 TotalOut = 0;
+
+	TArray<uint8> OutBuffer;
+};
@@ -0,0 +1,112 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "StreamingDownloadTask.h"
+#include "Misc/ScopeLock.h"
+
+const FString CHUNK_MAP_EXTERN = TEXT(".map");
+
+StreamingDownloadTask::StreamingDownloadTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName)
+	: DownloadTask(InUrl, InDirectory, InFileName)
+	, Reader(MakeShareable(new FDownloadStreamReader()))
+{
+}
+
+FDownloadStreamReaderPtr StreamingDownloadTask::GetStreamReader() const
+{
+	return Reader;
+}
+
+FString StreamingDownloadTask::GetChunkMapFileName() const
+{
+	return GetTempFileName() + CHUNK_MAP_EXTERN;
+}
+
+void StreamingDownloadTask::StartDownloadChunks(bool bResume)
+{
+	Reader->Reset(GetTempFileName(), GetTotalSize(), ChunkSize);
+	CurrentChunk = INDEX_NONE;
+
+	//chunks are not written in order, the temp file size tells nothing without the chunk map
+	if (bResume && Reader->LoadChunkMap(GetChunkMapFileName()) == false)
+	{
+		bResume = false;
+	}
+
+	DownloadTask::StartDownloadChunks(bResume);
+}
+
+void StreamingDownloadTask::StartChunk()
+{
+	SetCurrentSize(Reader->GetDownloadedSize());
+
+	CurrentChunk = Reader->FindChunkToDownload();
+	if (CurrentChunk == INDEX_NONE)
+	{
+		OnTaskCompleted();
+		return;
+	}
+
+	const int32 Length = Reader->GetChunkLength(CurrentChunk);
+	if (AcquireBudget(Length) == false)
+	{
+		return;
+	}
+
+	ChunkOffset = Reader->GetChunkOffset(CurrentChunk);
+	SendRangeRequest(FString::Printf(TEXT("bytes=%lld-%lld"), ChunkOffset, ChunkOffset + Length - 1), Length);
+}
+
+void StreamingDownloadTask::OnChunkWritten(int64 Offset, int32 DataSize)
+{
+	//a short response leaves the chunk missing, it is requested again
+	if (CurrentChunk != INDEX_NONE && DataSize == Reader->GetChunkLength(CurrentChunk))
+	{
+		Reader->MarkChunkDone(CurrentChunk);
+		Reader->SaveChunkMap(GetChunkMapFileName());
+	}
+}
+
+void StreamingDownloadTask::OnWriteChunkEnd(int32 DataSize)
+{
+	if (GetState() == ETaskState::DOWNLOADING && CurrentChunk != INDEX_NONE)
+	{
+		//the chunk is marked done by OnChunkWritten
+		if (DataSize != Reader->GetChunkLength(CurrentChunk) && ++CurrentTryCount > MaxTryCount)
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("%s, chunk %d keeps returning %d bytes"), *GetFileName(), CurrentChunk, DataSize);
+			ReleaseBudget();
+			Reader->SetError();
+			TaskState = ETaskState::ERROR;
+			ProcessTaskEvent(ETaskEvent::ERROR_OCCUR, TaskInfo, -1);
+			return;
+		}
+
+		SetCurrentSize(Reader->GetDownloadedSize());
+	}
+
+	DownloadTask::OnWriteChunkEnd(0);
+}
+
+void StreamingDownloadTask::PrepareFinalize(FDownloadFinalizeJob& InJob)
+{
+	//readers wait while the temp file is moved, then read the target file
+	FDownloadStreamReaderPtr StreamReader = Reader;
+	const FString FileName = GetFullFileName();
+	const int64 TotalSize = GetTotalSize();
+	InJob.Locks.Insert(Reader->GetFileLock(), 0);
+	InJob.BeforeMove = [StreamReader, FileName, TotalSize]()
+	{
+		StreamReader->SetCompleted(FileName, TotalSize);
+	};
+	InJob.DeleteOnSuccess.Add(GetChunkMapFileName());
+}
+
+void StreamingDownloadTask::OnTaskFinalized(bool bSucceeded)
+{
+	if (bSucceeded == false)
+	{
+		Reader->SetError();
+	}
+
+	DownloadTask::OnTaskFinalized(bSucceeded);
+}
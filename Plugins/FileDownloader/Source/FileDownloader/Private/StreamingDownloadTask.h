@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTask.h"
+#include "DownloadStreamReader.h"
+
+/**
+ * a task whose file can be read while downloading through FDownloadStreamReader.
+ * chunks are downloaded from the read head of the reader instead of from the start,
+ * downloaded chunks are saved in a chunk map next to the temp file so a stopped task resumes.
+ */
+class StreamingDownloadTask : public DownloadTask
+{
+public:
+
+	StreamingDownloadTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName);
+
+	virtual FDownloadStreamReaderPtr GetStreamReader() const override;
+
+protected:
+
+	virtual void StartDownloadChunks(bool bResume) override;
+
+	virtual void StartChunk() override;
+
+	virtual void OnWriteChunkEnd(int32 DataSize) override;
+
+	//marks the chunk done & saves the chunk map on the write worker
+	virtual void OnChunkWritten(int64 Offset, int32 DataSize) override;
+
+	virtual void PrepareFinalize(FDownloadFinalizeJob& InJob) override;
+
+	virtual void OnTaskFinalized(bool bSucceeded) override;
+
+	FString GetChunkMapFileName() const;
+
+	FDownloadStreamReaderPtr Reader;
+
+	//chunk in flight
+	int32 CurrentChunk = INDEX_NONE;
+};
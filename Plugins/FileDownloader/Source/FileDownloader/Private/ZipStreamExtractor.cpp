@@ -0,0 +1,373 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "ZipStreamExtractor.h"
+#include "FileDownloader.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Paths.h"
+#include "Async/Async.h"
+
+THIRD_PARTY_INCLUDES_START
+#include "zlib.h"
+THIRD_PARTY_INCLUDES_END
+
+static const uint32 ZIP_LOCAL_HEADER_SIG = 0x04034b50;
+static const uint32 ZIP_CENTRAL_HEADER_SIG = 0x02014b50;
+static const uint32 ZIP_END_SIG = 0x06054b50;
+static const uint32 ZIP_DESCRIPTOR_SIG = 0x08074b50;
+static const int32 ZIP_LOCAL_HEADER_SIZE = 30;
+//general purpose flags
+static const uint16 ZIP_FLAG_ENCRYPTED = 1 << 0;
+static const uint16 ZIP_FLAG_DESCRIPTOR = 1 << 3;
+static const uint16 ZIP_METHOD_STORED = 0;
+static const uint16 ZIP_METHOD_DEFLATE = 8;
+
+static uint16 ReadU16(const uint8* InData)
+{
+	return (uint16)InData[0] | ((uint16)InData[1] << 8);
+}
+
+static uint32 ReadU32(const uint8* InData)
+{
+	return (uint32)InData[0] | ((uint32)InData[1] << 8) | ((uint32)InData[2] << 16) | ((uint32)InData[3] << 24);
+}
+
+FZipStreamExtractor::FZipStreamExtractor(const FString& InExtractDirectory)
+	: ExtractDirectory(InExtractDirectory)
+	, Inflater(FStreamInflater::RAW_DEFLATE)
+{
+	Reset();
+}
+
+FZipStreamExtractor::~FZipStreamExtractor()
+{
+	CloseWriter();
+}
+
+void FZipStreamExtractor::Reset()
+{
+	CloseWriter();
+	ConsumedSize = 0;
+	ExpectHeader();
+}
+
+int64 FZipStreamExtractor::GetConsumedSize() const
+{
+	return ConsumedSize;
+}
+
+bool FZipStreamExtractor::Consume(int64 InOffset, const uint8* InData, int32 InSize)
+{
+	if (InOffset > ConsumedSize)
+	{
+		return false;
+	}
+
+	//skip bytes already consumed
+	const int64 Skip = ConsumedSize - InOffset;
+	if (Skip >= InSize)
+	{
+		return true;
+	}
+	InData += Skip;
+	InSize -= (int32)Skip;
+	ConsumedSize += InSize;
+
+	while (InSize > 0 && State != EState::Done && State != EState::Error)
+	{
+		const int32 Used = State == EState::Data ? ConsumeData(InData, InSize) : ConsumePending(InData, InSize);
+		InData += Used;
+		InSize -= Used;
+	}
+
+	return State != EState::Error;
+}
+
+int32 FZipStreamExtractor::ConsumePending(const uint8* InData, int32 InSize)
+{
+	const int32 Used = FMath::Min(InSize, PendingNeed - Pending.Num());
+	Pending.Append(InData, Used);
+
+	//a handler may ask for more bytes or move to another state
+	while (Pending.Num() >= PendingNeed && (State == EState::Header || State == EState::Name || State == EState::Descriptor))
+	{
+		const int32 Need = PendingNeed;
+		const EState OldState = State;
+		if (State == EState::Header)
+		{
+			OnHeaderReady();
+		}
+		else if (State == EState::Name)
+		{
+			OnNameReady();
+		}
+		else
+		{
+			OnDescriptorReady();
+		}
+
+		if (State == OldState && PendingNeed == Need)
+		{
+			break;
+		}
+	}
+
+	return Used;
+}
+
+void FZipStreamExtractor::ExpectHeader()
+{
+	State = EState::Header;
+	Pending.Reset();
+	PendingNeed = 4;
+}
+
+void FZipStreamExtractor::OnHeaderReady()
+{
+	const uint32 Sig = ReadU32(Pending.GetData());
+	if (Sig == ZIP_CENTRAL_HEADER_SIG || Sig == ZIP_END_SIG)
+	{
+		//all entries are done, the rest is the central directory
+		State = EState::Done;
+		return;
+	}
+
+	if (Sig != ZIP_LOCAL_HEADER_SIG)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Invalid zip header at %lld"), ConsumedSize);
+		State = EState::Error;
+		return;
+	}
+
+	if (PendingNeed < ZIP_LOCAL_HEADER_SIZE)
+	{
+		PendingNeed = ZIP_LOCAL_HEADER_SIZE;
+		return;
+	}
+
+	const uint8* Header = Pending.GetData();
+	EntryFlags = ReadU16(Header + 6);
+	EntryMethod = ReadU16(Header + 8);
+	ExpectedCrc = ReadU32(Header + 14);
+	const uint32 CompressedSize = ReadU32(Header + 18);
+	NameLength = ReadU16(Header + 26);
+	const uint16 ExtraLength = ReadU16(Header + 28);
+
+	if (CompressedSize == MAX_uint32)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Zip64 archive is not supported"));
+		State = EState::Error;
+		return;
+	}
+
+	Remaining = (EntryFlags & ZIP_FLAG_DESCRIPTOR) ? -1 : CompressedSize;
+
+	State = EState::Name;
+	Pending.Reset();
+	PendingNeed = NameLength + ExtraLength;
+}
+
+void FZipStreamExtractor::OnNameReady()
+{
+	FUTF8ToTCHAR Converter((const ANSICHAR*)Pending.GetData(), NameLength);
+	EntryName = FString(Converter.Length(), Converter.Get());
+	EntryName.ReplaceInline(TEXT("\\"), TEXT("/"));
+
+	const bool bDirectory = EntryName.EndsWith(TEXT("/"));
+	//never write outside the extract directory
+	const bool bSafePath = EntryName.IsEmpty() == false && EntryName.StartsWith(TEXT("/")) == false
+		&& EntryName.Contains(TEXT(":")) == false && (TEXT("/") + EntryName + TEXT("/")).Contains(TEXT("/../")) == false;
+	const bool bSupported = (EntryFlags & ZIP_FLAG_ENCRYPTED) == 0 && (EntryMethod == ZIP_METHOD_STORED || EntryMethod == ZIP_METHOD_DEFLATE);
+
+	EntryPath = ExtractDirectory / EntryName;
+	EntryCrc = 0;
+	bFileCreated = false;
+	bEntryOk = bSafePath && bSupported && bDirectory == false;
+	bEntryReport = bDirectory == false;
+	Inflater.Reset();
+
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if (bDirectory && bSafePath)
+	{
+		PlatformFile.CreateDirectoryTree(*EntryPath);
+	}
+
+	if (bEntryOk)
+	{
+		PlatformFile.CreateDirectoryTree(*FPaths::GetPath(EntryPath));
+		Writer = PlatformFile.OpenWrite(*EntryPath);
+		bEntryOk = Writer != nullptr;
+		bFileCreated = bEntryOk;
+	}
+
+	if (bSafePath == false || bSupported == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Zip entry skipped, unsupported or unsafe : %s"), *EntryName);
+	}
+
+	//without compressed size only a deflate stream can tell where the entry ends
+	if (Remaining < 0 && EntryMethod != ZIP_METHOD_DEFLATE)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Zip entry size unknown, cannot continue : %s"), *EntryName);
+		FinishEntry(false);
+		State = EState::Error;
+		return;
+	}
+
+	State = EState::Data;
+	Pending.Reset();
+	PendingNeed = 0;
+
+	if (Remaining == 0)
+	{
+		OnEntryDataEnd();
+	}
+}
+
+int32 FZipStreamExtractor::ConsumeData(const uint8* InData, int32 InSize)
+{
+	const int32 Size = Remaining < 0 ? InSize : (int32)FMath::Min<int64>(InSize, Remaining);
+
+	//stored data or skipped entry with known size
+	if (EntryMethod != ZIP_METHOD_DEFLATE || (bEntryOk == false && Remaining >= 0))
+	{
+		WriteOutput(InData, Size);
+		Remaining -= Size;
+		if (Remaining == 0)
+		{
+			OnEntryDataEnd();
+		}
+		return Size;
+	}
+
+	int32 Consumed = 0;
+	const bool bInflated = Inflater.Feed(InData, Size, [this](const uint8* InBlock, int32 InBlockSize)
+	{
+		WriteOutput(InBlock, InBlockSize);
+		return true;
+	}, &Consumed);
+
+	if (bInflated == false || (Consumed < Size && Inflater.IsFinished() == false))
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Zip entry corrupt : %s"), *EntryName);
+		bEntryOk = false;
+		if (Remaining < 0)
+		{
+			FinishEntry(false);
+			State = EState::Error;
+			return Size;
+		}
+		//skip the rest of the entry by its compressed size
+		Remaining -= Size;
+		if (Remaining == 0)
+		{
+			OnEntryDataEnd();
+		}
+		return Size;
+	}
+
+	if (Remaining > 0)
+	{
+		Remaining -= Consumed;
+	}
+
+	if (Inflater.IsFinished())
+	{
+		if (Remaining > 0)
+		{
+			//the deflate stream ended before the compressed size, skip the rest of the entry
+			UE_LOG(LogFileDownloader, Warning, TEXT("Zip entry size mismatch : %s"), *EntryName);
+			bEntryOk = false;
+			return Consumed;
+		}
+		Remaining = 0;
+		OnEntryDataEnd();
+	}
+	else if (Remaining == 0)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Zip entry truncated : %s"), *EntryName);
+		bEntryOk = false;
+		OnEntryDataEnd();
+	}
+
+	return Consumed;
+}
+
+void FZipStreamExtractor::WriteOutput(const uint8* InData, int32 InSize)
+{
+	if (bEntryOk == false || InSize < 1)
+	{
+		return;
+	}
+
+	EntryCrc = crc32(EntryCrc, InData, InSize);
+	if (Writer->Write(InData, InSize) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Cannot write zip entry : %s"), *EntryPath);
+		bEntryOk = false;
+	}
+}
+
+void FZipStreamExtractor::OnEntryDataEnd()
+{
+	if (EntryFlags & ZIP_FLAG_DESCRIPTOR)
+	{
+		State = EState::Descriptor;
+		Pending.Reset();
+		PendingNeed = 4;
+		return;
+	}
+
+	FinishEntry(bEntryOk && EntryCrc == ExpectedCrc);
+	ExpectHeader();
+}
+
+void FZipStreamExtractor::OnDescriptorReady()
+{
+	//the signature of a data descriptor is optional
+	const bool bHasSig = ReadU32(Pending.GetData()) == ZIP_DESCRIPTOR_SIG;
+	const int32 Need = bHasSig ? 16 : 12;
+	if (PendingNeed < Need)
+	{
+		PendingNeed = Need;
+		return;
+	}
+
+	ExpectedCrc = ReadU32(Pending.GetData() + (bHasSig ? 4 : 0));
+	FinishEntry(bEntryOk && EntryCrc == ExpectedCrc);
+	ExpectHeader();
+}
+
+void FZipStreamExtractor::FinishEntry(bool bSucceeded)
+{
+	CloseWriter();
+
+	if (bEntryReport == false)
+	{
+		return;
+	}
+	bEntryReport = false;
+
+	if (bSucceeded == false && bFileCreated)
+	{
+		FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*EntryPath);
+	}
+
+	if (OnEntryExtracted)
+	{
+		TFunction<void(const FString&, const FString&, bool)> Callback = OnEntryExtracted;
+		const FString Name = EntryName;
+		const FString Path = EntryPath;
+		FFunctionGraphTask::CreateAndDispatchWhenReady([Callback, Name, Path, bSucceeded]() {
+			Callback(Name, Path, bSucceeded);
+		}, TStatId(), nullptr, ENamedThreads::GameThread);
+	}
+}
+
+void FZipStreamExtractor::CloseWriter()
+{
+	if (Writer != nullptr)
+	{
+		delete Writer;
+		Writer = nullptr;
+	}
+}
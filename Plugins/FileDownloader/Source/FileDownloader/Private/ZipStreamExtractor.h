@@ -0,0 +1,96 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadStreamStage.h"
+#include "StreamInflater.h"
+
+class IFileHandle;
+
+/**
+ * extracts the entries of a zip archive from its byte stream, entries are written as soon as their data arrives.
+ * local file headers are followed one after another, the central directory at the end is not needed.
+ * supports stored & deflate entries, zip64 and encryption are not supported.
+ */
+class FZipStreamExtractor : public IDownloadStreamStage
+{
+public:
+
+	explicit FZipStreamExtractor(const FString& InExtractDirectory);
+
+	virtual ~FZipStreamExtractor();
+
+	virtual void Reset() override;
+
+	virtual bool Consume(int64 InOffset, const uint8* InData, int32 InSize) override;
+
+	virtual int64 GetConsumedSize() const override;
+
+	//called on game thread when an entry is extracted or failed (entry name in archive, extracted file)
+	TFunction<void(const FString& InEntryName, const FString& InFilePath, bool bSucceeded)> OnEntryExtracted;
+
+protected:
+
+	enum class EState : uint8
+	{
+		Header,
+		Name,
+		Data,
+		Descriptor,
+		Done,
+		Error
+	};
+
+	//collect bytes of a header into Pending, return bytes used
+	int32 ConsumePending(const uint8* InData, int32 InSize);
+
+	//return bytes used
+	int32 ConsumeData(const uint8* InData, int32 InSize);
+
+	void OnHeaderReady();
+
+	void OnNameReady();
+
+	void OnDescriptorReady();
+
+	void OnEntryDataEnd();
+
+	void FinishEntry(bool bSucceeded);
+
+	void WriteOutput(const uint8* InData, int32 InSize);
+
+	void CloseWriter();
+
+	void ExpectHeader();
+
+	FString ExtractDirectory;
+
+	EState State = EState::Header;
+
+	int64 ConsumedSize = 0;
+
+	//header bytes collected so far & bytes needed
+	TArray<uint8> Pending;
+	int32 PendingNeed = 0;
+
+	//current entry
+	FString EntryName;
+	FString EntryPath;
+	uint16 EntryFlags = 0;
+	uint16 EntryMethod = 0;
+	uint16 NameLength = 0;
+	uint32 ExpectedCrc = 0;
+	uint32 EntryCrc = 0;
+	//compressed bytes left, -1 when the size is only known from the data descriptor
+	int64 Remaining = 0;
+	//false when the entry is skipped or failed, data is still parsed to reach the next entry
+	bool bEntryOk = false;
+	bool bEntryReport = false;
+	//a failed entry removes only the file it created
+	bool bFileCreated = false;
+
+	IFileHandle* Writer = nullptr;
+
+	FStreamInflater Inflater;
+};
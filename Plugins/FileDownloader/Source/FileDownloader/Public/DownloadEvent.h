@@ -35,4 +35,28 @@ enum class ETaskState : uint8
 	COMPLETED,
 	//error state
 	ERROR
-};
\ No newline at end of file
+};
+
+UENUM(BlueprintType)
+enum class EDownloadSinkType : uint8
+{
+	//write a temp file and rename it when completed
+	FILE,
+	//keep data in memory, nothing is written to disk
+	MEMORY,
+	//write a memory mapped temp file, fast for writes at random offsets
+	MAPPED_FILE,
+	//count the data and drop it, for replays & benchmarks
+	DISCARD,
+	//write a large temp file around the page cache at low I/O priority, so game assets stay cached, Linux only
+	UNCACHED_FILE
+};
+
+UENUM(BlueprintType)
+enum class EDownloadTransportType : uint8
+{
+	//FHttpModule of the engine
+	HTTP_MODULE,
+	//libcurl multi handle on its own thread with connection pooling & HTTP/2, Linux & Win64 only, the http module elsewhere
+	CURL_MULTI
+};
@@ -0,0 +1,93 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadEvent.h"
+#include "TaskInformation.h"
+#include "Async/Future.h"
+#include "HAL/CriticalSection.h"
+#include <atomic>
+
+/**
+ * how a task ended, value of the future returned by UFileDownloadManager::AddTaskByUrlAsync
+ */
+struct FDownloadResult
+{
+	int32 TaskID = INDEX_NONE;
+
+	//DOWNLOAD_COMPLETED, ERROR_OCCUR, or STOP if cancelled
+	ETaskEvent Event = ETaskEvent::ERROR_OCCUR;
+
+	int32 HttpCode = 0;
+
+	FTaskInformation Info;
+
+	bool IsSucceeded() const
+	{
+		return Event == ETaskEvent::DOWNLOAD_COMPLETED;
+	}
+};
+
+//current & total size of a task, called on the thread the task runs on
+typedef TFunction<void(int64 InCurrentSize, int64 InTotalSize)> FOnDownloadProgress;
+
+/**
+ * cancels the tasks it is given to, one token can be shared by a whole pipeline. thread safe
+ */
+class FILEDOWNLOADER_API FDownloadCancellationToken
+{
+public:
+
+	void Cancel();
+
+	bool IsCancelled() const;
+
+	//called once on the thread calling Cancel, at once if cancelled already
+	void OnCancelled(TFunction<void()> InCallback);
+
+protected:
+
+	std::atomic<bool> bCancelled { false };
+
+	FCriticalSection Lock;
+
+	TArray<TFunction<void()>> Callbacks;
+};
+
+typedef TSharedPtr<FDownloadCancellationToken, ESPMode::ThreadSafe> FDownloadCancellationTokenPtr;
+
+/**
+ * futures & progress callbacks waiting for one task, completed from the thread the task ends on
+ */
+class FILEDOWNLOADER_API FDownloadCompletion
+{
+public:
+
+	TFuture<FDownloadResult> MakeFuture(FOnDownloadProgress InOnProgress);
+
+	void NotifyProgress(int64 InCurrentSize, int64 InTotalSize);
+
+	//fulfill every future made so far, a restarted task can be waited for again
+	void Complete(const FDownloadResult& InResult);
+
+protected:
+
+	FCriticalSection Lock;
+
+	TArray<TPromise<FDownloadResult>> Promises;
+
+	TArray<FOnDownloadProgress> ProgressCallbacks;
+};
+
+typedef TSharedPtr<FDownloadCompletion, ESPMode::ThreadSafe> FDownloadCompletionPtr;
+
+/*a future completed when every given download has ended, results keep the order of the futures
+ @Param InFutures consumed
+*/
+FILEDOWNLOADER_API TFuture<TArray<FDownloadResult>> WhenAllDownloads(TArray<TFuture<FDownloadResult>> InFutures);
+
+/*a future completed with the result of the first download that ends, never completed if InFutures is empty
+ @Param InFutures consumed
+*/
+FILEDOWNLOADER_API TFuture<FDownloadResult> WhenAnyDownload(TArray<TFuture<FDownloadResult>> InFutures);
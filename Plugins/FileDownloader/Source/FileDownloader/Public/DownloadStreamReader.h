@@ -0,0 +1,133 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include <atomic>
+
+class FEvent;
+
+/**
+ * reads the file of a streaming task while it is still downloading, e.g. to start playback of a movie early.
+ * the file is downloaded by chunks, chunks at the read head are downloaded first, so a seek moves the download too.
+ * reading & seeking is thread safe, blocking reads must not be called on game thread.
+ */
+class FILEDOWNLOADER_API FDownloadStreamReader : public TSharedFromThis<FDownloadStreamReader, ESPMode::ThreadSafe>
+{
+public:
+
+	FDownloadStreamReader();
+
+	~FDownloadStreamReader();
+
+	int64 GetTotalSize() const;
+
+	//bytes downloaded in one piece from InOffset
+	int64 GetAvailableSize(int64 InOffset) const;
+
+	int64 GetDownloadedSize() const;
+
+	bool IsCompleted() const;
+
+	bool HasError() const;
+
+	//move the read head, chunks from here are downloaded first
+	void Seek(int64 InOffset);
+
+	int64 GetReadHead() const;
+
+	/*read downloaded bytes without waiting, the read head moves to the end of the read
+	 @return bytes read, 0 if nothing is downloaded at InOffset yet, -1 at end of file or on error
+	*/
+	int32 TryRead(int64 InOffset, uint8* OutData, int32 InSize);
+
+	/*wait until bytes at InOffset are downloaded, then read as many as are available
+	 @Param InTimeout seconds to wait at most
+	 @return bytes read, 0 on timeout, -1 at end of file or on error
+	*/
+	int32 Read(int64 InOffset, uint8* OutData, int32 InSize, float InTimeout);
+
+	/*read InSize bytes once they are all downloaded
+	 @Param InCallback called on game thread, the data is empty on error
+	*/
+	void ReadAsync(int64 InOffset, int32 InSize, TFunction<void(const TArray<uint8>& InData)> InCallback);
+
+	/************************************************************************/
+	/* used by the task                                                     */
+	/************************************************************************/
+
+	void Reset(const FString& InFileName, int64 InTotalSize, int32 InChunkSize);
+
+	void MarkChunkDone(int32 InChunkIndex);
+
+	//the file is complete and is moved to InFileName
+	void SetCompleted(const FString& InFileName, int64 InTotalSize);
+
+	void SetError();
+
+	//first missing chunk from the read head, wraps to the start, INDEX_NONE if all done
+	int32 FindChunkToDownload() const;
+
+	int32 GetChunkCount() const;
+
+	int64 GetChunkOffset(int32 InChunkIndex) const;
+
+	int32 GetChunkLength(int32 InChunkIndex) const;
+
+	bool LoadChunkMap(const FString& InMapFile);
+
+	bool SaveChunkMap(const FString& InMapFile) const;
+
+	//held while the file is read, the finalize job of the task holds it while moving the file
+	TSharedRef<FCriticalSection, ESPMode::ThreadSafe> GetFileLock() const
+	{
+		return FileLock;
+	}
+
+	FDownloadStreamReader(const FDownloadStreamReader&) = delete;
+	FDownloadStreamReader& operator=(const FDownloadStreamReader&) = delete;
+
+protected:
+
+	struct FPendingRead
+	{
+		int64 Offset;
+		int32 Size;
+		TFunction<void(const TArray<uint8>&)> Callback;
+	};
+
+	int64 GetAvailableSizeLocked(int64 InOffset) const;
+
+	int32 ReadFromFile(int64 InOffset, uint8* OutData, int32 InSize);
+
+	//start reads whose bytes have arrived, called after new data or an error
+	void ServePendingReads();
+
+	mutable FCriticalSection Lock;
+
+	TSharedRef<FCriticalSection, ESPMode::ThreadSafe> FileLock = MakeShared<FCriticalSection, ESPMode::ThreadSafe>();
+
+	FString FileName;
+
+	int64 TotalSize = 0;
+
+	int32 ChunkSize = 1;
+
+	TArray<bool> ChunkDone;
+
+	int64 DownloadedSize = 0;
+
+	bool bCompleted = false;
+
+	bool bError = false;
+
+	std::atomic<int64> ReadHead { 0 };
+
+	//triggered when data arrives, blocking reads wait for it
+	FEvent* DataEvent = nullptr;
+
+	TArray<FPendingRead> PendingReads;
+};
+
+typedef TSharedPtr<FDownloadStreamReader, ESPMode::ThreadSafe> FDownloadStreamReaderPtr;
@@ -0,0 +1,212 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadEvent.h"
+#include "Subsystems/EngineSubsystem.h"
+#include "Tickable.h"
+#include "FileDownloadEngineSubsystem.generated.h"
+
+class UFileDownloadManager;
+class FDownloadMemoryBudget;
+class FDownloadBandwidthLimiter;
+class IDownloadTransport;
+class FDownloadTraceRecorder;
+class FFrameBudgetThrottle;
+class FPeerCacheServer;
+class FHostProfileStore;
+
+/**
+ * owns what all download managers of the process share: task slots, connections per host, the transport,
+ * the memory budget and the bandwidth limit. every manager keeps its own task queue and takes slots from here.
+ * limits are read from [/Script/FileDownloader.FileDownloadEngineSubsystem] of the engine config, they can be changed at runtime
+ */
+UCLASS(config = Engine)
+class FILEDOWNLOADER_API UFileDownloadEngineSubsystem : public UEngineSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+
+	//null before the engine is created or after it is destroyed
+	static UFileDownloadEngineSubsystem* Get();
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+	/*
+	 *get tasks downloading in all managers
+	 **/
+	UFUNCTION(BlueprintCallable)
+		int32 GetRunningTaskCount() const;
+
+	/*
+	 *get tasks of all managers downloading from the host of a url
+	 **/
+	UFUNCTION(BlueprintCallable)
+		int32 GetHostTaskCount(const FString& InUrl) const;
+
+	//a manager with waiting tasks registers itself, unregistered when destroyed
+	void RegisterManager(UFileDownloadManager* InManager);
+
+	void UnregisterManager(UFileDownloadManager* InManager);
+
+	/*check for a free slot before a manager starts a task, slots are shared fairly between managers with waiting tasks
+	 @Param InManager manager starting the task
+	*/
+	bool CanStartTask(const UFileDownloadManager* InManager) const;
+
+	//running tasks of all managers for a host key
+	int32 GetHostLoad(const FString& InHost) const;
+
+	/*a manager warms up a host only once while its connections are kept alive
+	 @Return true if the host should be warmed up now
+	*/
+	bool TryWarmUpHost(const FString& InHost);
+
+	//a host with running tasks keeps its connections warm
+	void TouchHost(const FString& InHost);
+
+	//created from the settings below when first used, wrapped by the trace recorder if bRecordTrace
+	TSharedPtr<IDownloadTransport, ESPMode::ThreadSafe> GetTransport();
+
+	//replace the transport of tasks added afterwards, e.g. by a stub for benchmarks, null creates one from the settings again
+	void SetTransport(TSharedPtr<IDownloadTransport, ESPMode::ThreadSafe> InTransport);
+
+	TSharedPtr<FDownloadMemoryBudget, ESPMode::ThreadSafe> GetMemoryBudget();
+
+	TSharedPtr<FDownloadBandwidthLimiter, ESPMode::ThreadSafe> GetBandwidthLimiter();
+
+	/*
+	 *report the load of the game instead of frame time, 1 uses the whole frame budget, negative returns to frame time
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void SetGameLoad(float InLoad);
+
+	/*
+	 *downloads are throttled during gameplay only, set false in menus & loading screens
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void SetGameplayActive(bool bActive);
+
+	/*
+	 *get the throttle level [0, 1] (0 is full speed), the load it reacts to, the average game thread milliseconds per frame,
+	 *and the parallel tasks & bytes per second allowed at this level (0 means unlimited)
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void GetThrottleStats(float& OutLevel, float& OutLoad, float& OutFrameMilliseconds, int32& OutParallelTask, int64& OutBytesPerSecond) const;
+
+	//0 is full speed, 1 is throttled to ThrottledParallelTask & ThrottledBytesPerSecond
+	float GetThrottleLevel() const;
+
+	//MaxParallelTask lowered by the throttle
+	int32 GetEffectiveMaxParallelTask() const;
+
+	//MaxBytesPerSecond lowered by the throttle, 0 means unlimited
+	int64 GetEffectiveBytesPerSecond() const;
+
+	//loaded when first used, null if bUseHostProfiles is off
+	TSharedPtr<FHostProfileStore, ESPMode::ThreadSafe> GetHostProfiles();
+
+	/*
+	 *get what was learned about the host of a url in this and earlier sessions, ranges served, bytes per chunk, parallel tasks of auto tune,
+	 *round trip milliseconds and if ETags identify the content
+	 *@return false if nothing is known about the host
+	 **/
+	UFUNCTION(BlueprintCallable)
+		bool GetHostProfile(const FString& InUrl, bool& bOutRangeSupported, int32& OutChunkSize, int32& OutParallelTasks, float& OutRttMilliseconds, bool& bOutETagReliable);
+
+	//started on PeerCachePort when first used, null if PeerCachePort is 0 or the port cannot be used
+	TSharedPtr<FPeerCacheServer, ESPMode::ThreadSafe> GetPeerCacheServer();
+
+	/*
+	 *get files served to other instances on the local network, requests they sent and bytes sent to them
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void GetPeerCacheStats(int32& OutFiles, int64& OutRequests, int64& OutServedBytes) const;
+
+	/************************************************************************/
+	/* Interface for TickableObject                                         */
+	/************************************************************************/
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual TStatId GetStatId() const override;
+
+	//tasks downloading at once in all managers, 0 means unlimited
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		int32 MaxParallelTask = 0;
+	//tasks of all managers downloading from one host at once, each holds a connection, also the connection cap of the libcurl transport, 0 means unlimited
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		int32 MaxConnectionsPerHost = 0;
+	//budget of response data in flight for all tasks, new chunk requests wait while it is used up, 0 means unlimited
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		int64 MaxInFlightBytes = 0;
+	//bytes requested per second by all tasks, new chunk requests wait while it is used up, 0 means unlimited
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		int64 MaxBytesPerSecond = 0;
+	//backend sending requests, used from the first task added, CURL_MULTI falls back to HTTP_MODULE where libcurl is not available
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		EDownloadTransportType TransportType = EDownloadTransportType::HTTP_MODULE;
+	//receive buffer of every libcurl transfer, 1KB to 512KB
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		int32 CurlReceiveBufferSize = 256 * 1024;
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		bool bCurlHttp2 = true;
+	//CA bundle of the libcurl transport for https, default of libcurl if empty
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		FString CurlCABundlePath;
+	//record every request of the session into a trace for the FileDownloadReplay commandlet, read when the transport is created
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		bool bRecordTrace = false;
+	//directory of recorded traces, ../Saved/DownloadTraces if empty
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		FString TraceDirectory;
+	//game thread milliseconds per frame that downloads should not push frames over, they are throttled while frames cost more, 0 never throttles by frame time
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		float FrameTimeBudgetMs = 0.f;
+	//tasks downloading at once in all managers when fully throttled, with an unlimited MaxParallelTask only the bandwidth is throttled
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		int32 ThrottledParallelTask = 1;
+	//bytes requested per second by all tasks when fully throttled, 0 keeps the bandwidth
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		int64 ThrottledBytesPerSecond = 1024 * 1024;
+	//port serving completed files of managers with bServeToPeers to other instances on the local network, 0 serves nothing
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		int32 PeerCachePort = 0;
+	//keep range support, chunk size, parallel tasks, round trip & ETag trust learned per host on disk, new sessions start from them
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		bool bUseHostProfiles = true;
+	//file of the host profiles, ../Saved/FileDownloadHostProfiles.json if empty, read when first used
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		FString HostProfileFile;
+	//profiles of hosts not downloaded from for this many days are dropped, 0 keeps them
+	UPROPERTY(Config, EditAnywhere, BlueprintReadWrite)
+		int32 HostProfileMaxAgeDays = 30;
+
+protected:
+
+	TArray<TWeakObjectPtr<UFileDownloadManager>> Managers;
+
+	//host key to last time it was warmed up or used
+	TMap<FString, double> WarmedHosts;
+
+	TSharedPtr<IDownloadTransport, ESPMode::ThreadSafe> Transport;
+
+	//same object as Transport while recording
+	TSharedPtr<FDownloadTraceRecorder, ESPMode::ThreadSafe> TraceRecorder;
+
+	double LastTraceFlushTime = 0.0;
+
+	TSharedPtr<FDownloadMemoryBudget, ESPMode::ThreadSafe> MemoryBudget;
+
+	TSharedPtr<FDownloadBandwidthLimiter, ESPMode::ThreadSafe> BandwidthLimiter;
+
+	TSharedPtr<FFrameBudgetThrottle> Throttle;
+
+	TSharedPtr<FPeerCacheServer, ESPMode::ThreadSafe> PeerCacheServer;
+
+	TSharedPtr<FHostProfileStore, ESPMode::ThreadSafe> HostProfiles;
+
+	double LastHostProfileSaveTime = 0.0;
+};
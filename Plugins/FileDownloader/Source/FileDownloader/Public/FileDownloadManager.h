@@ -4,14 +4,25 @@
 
 #include "CoreMinimal.h"
 #include "TaskInformation.h"
+#include "DownloadStreamReader.h"
+#include "DownloadFuture.h"
 #include "Tickable.h"
 #include "FileDownloadManager.generated.h"
 
 
 class DownloadTask;
+class FConcurrencyController;
+class FDownloadMemoryBudget;
+class FContentCache;
+class IDownloadTransport;
+class FDownloadBandwidthLimiter;
+class FQueuedTaskStore;
+class FPeerCacheTransport;
+class FHostProfileStore;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_ThreeParams(FDLManagerDelegate, ETaskEvent, InEvent, int32, InTaskID, int32, InHttpCode);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnAllTaskCompleted, int32, ErrorCount);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_FourParams(FOnArchiveEntryExtracted, int32, InTaskID, const FString&, InEntryName, const FString&, InFilePath, bool, bSucceeded);
 
 /**
  * FileDownloadManager, this class is the interface of the plugin, use this class download file as far as possible (both c++ & blueprint)
@@ -22,6 +33,8 @@ class FILEDOWNLOADER_API UFileDownloadManager : public UObject, public FTickable
 	GENERATED_BODY()
 public:
 
+	UFileDownloadManager();
+
 	virtual void BeginDestroy() override;
 	/*
 	 *start download action for all task by sequence
@@ -86,8 +99,200 @@ public:
 	UFUNCTION(BlueprintCallable)
 		int32 AddTaskByUrl(const FString& InUrl, const FString& InDirectory = TEXT(""), const FString& InFileName = TEXT(""));
 
+	/*Add a task like AddTaskByUrl and start it, for chaining downloads in c++
+	 @ param : InCancelToken stops the task when cancelled, the future is completed with STOP at once
+	 @ param : InOnProgress called with current & total size on the thread the task runs on
+	 @ return : completed on the thread the task ends on, worker threads if bRunTasksOffGameThread
+	 */
+	TFuture<FDownloadResult> AddTaskByUrlAsync(const FString& InUrl, const FString& InDirectory = TEXT(""), const FString& InFileName = TEXT(""), FDownloadCancellationTokenPtr InCancelToken = nullptr, FOnDownloadProgress InOnProgress = nullptr);
+
+	/*future of an added task, completed at once if the task has ended or does not exist
+	 @ param : InCancelToken stops the task when cancelled, the future is completed with STOP at once
+	 @ param : InOnProgress called with current & total size on the thread the task runs on
+	 */
+	TFuture<FDownloadResult> GetTaskFuture(int32 InIndex, FDownloadCancellationTokenPtr InCancelToken = nullptr, FOnDownloadProgress InOnProgress = nullptr);
+
+	/*Add a task downloading the pre-compressed sibling of a file (InUrl + CompressedUrlSuffix), decompressed while downloading
+	 @ param : InUrl url of the uncompressed file, cannot be empty!
+	 @ param : InDirectory ignore this param(Default directory will be used ../Saved)
+	 @ param : InFileName ignore this param(Default file name will be used, cutting & copy name from InUrl)
+	 */
+	UFUNCTION(BlueprintCallable)
+		int32 AddCompressedTaskByUrl(const FString& InUrl, const FString& InDirectory = TEXT(""), const FString& InFileName = TEXT(""));
+
+	/*Add a task downloading a zip archive, entries are extracted while the archive is downloading and reported by OnArchiveEntryExtracted
+	 @ param : InUrl cannot be empty!
+	 @ param : InExtractDirectory entries are extracted under this directory, ignore this param(Default directory will be used ../Saved)
+	 @ param : InDirectory directory of the archive, ignore this param(Default directory will be used ../Saved)
+	 @ param : InFileName ignore this param(Default file name will be used, cutting & copy name from InUrl)
+	 */
 	UFUNCTION(BlueprintCallable)
-		bool SetTotalSizeByIndex(int32 InIndex, int32 InTotalSize);
+		int32 AddArchiveTaskByUrl(const FString& InUrl, const FString& InExtractDirectory = TEXT(""), const FString& InDirectory = TEXT(""), const FString& InFileName = TEXT(""));
+
+	/*Add a task keeping the downloaded file in memory, nothing is written to disk, get the data by GetTaskData when completed
+	 @ param : InUrl cannot be empty!
+	 */
+	UFUNCTION(BlueprintCallable)
+		int32 AddMemoryTaskByUrl(const FString& InUrl);
+
+	/*
+	 *copy the data of a completed memory task
+	 **/
+	UFUNCTION(BlueprintCallable)
+		bool GetTaskData(int32 InIndex, TArray<uint8>& OutData) const;
+
+	//data of a completed memory task without copy, null for other tasks
+	TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe> GetTaskMemoryData(int32 InIndex) const;
+
+	//add a task dropping the downloaded data, it costs neither memory nor disk, for replays & benchmarks
+	int32 AddDiscardTaskByUrl(const FString& InUrl);
+
+	/*Add a task whose file can be read while downloading, chunks under the read head are downloaded first
+	 @ param : InUrl cannot be empty!
+	 @ param : InDirectory ignore this param(Default directory will be used ../Saved)
+	 @ param : InFileName ignore this param(Default file name will be used, cutting & copy name from InUrl)
+	 */
+	UFUNCTION(BlueprintCallable)
+		int32 AddStreamingTaskByUrl(const FString& InUrl, const FString& InDirectory = TEXT(""), const FString& InFileName = TEXT(""));
+
+	/*read downloaded bytes of a streaming task without waiting
+	 @ return : bytes read, 0 if the bytes at InOffset are not downloaded yet, -1 at end of file or on error
+	 */
+	UFUNCTION(BlueprintCallable)
+		int32 ReadStream(int32 InIndex, int64 InOffset, int32 InSize, TArray<uint8>& OutData);
+
+	/*
+	 *move the read head of a streaming task, chunks from there are downloaded first
+	 **/
+	UFUNCTION(BlueprintCallable)
+		bool SeekStream(int32 InIndex, int64 InOffset);
+
+	//reader of a streaming task for blocking or async reads, null for other tasks
+	FDownloadStreamReaderPtr GetStreamReader(int32 InIndex) const;
+
+	/*Add a task saving many pieces of one remote file to their own files, pieces are fetched with few (multi-)range requests
+	 @ param : InUrl cannot be empty!
+	 @ param : InEntries offset, length & destination file of every piece
+	 @ return : task id, INDEX_NONE if nothing to download
+	 */
+	UFUNCTION(BlueprintCallable)
+		int32 AddBatchTask(const FString& InUrl, const TArray<FBatchEntry>& InEntries);
+
+	/*Add tasks for every file of a manifest (Json or binary), sizes and versions come from the manifest so no HEAD is sent
+	 @ param : InManifestFile manifest file on disk
+	 @ param : InDirectory root directory of manifest paths, ignore this param(Default directory will be used ../Saved)
+	 @ return : number of tasks added
+	 */
+	UFUNCTION(BlueprintCallable)
+		int32 AddTasksFromManifest(const FString& InManifestFile, const FString& InDirectory = TEXT(""));
+
+	UFUNCTION(BlueprintCallable)
+		int32 AddTasksFromManifestEntries(const TArray<FManifestEntry>& InEntries, const FString& InDirectory = TEXT(""));
+
+	/*
+	 *higher priority tasks are started first
+	 **/
+	UFUNCTION(BlueprintCallable)
+		bool SetTaskPriority(int32 InIndex, int32 InPriority);
+
+	/*
+	 *get average download speed of all tasks, bytes per second
+	 **/
+	UFUNCTION(BlueprintCallable)
+		float GetDownloadSpeed() const;
+
+	/*
+	 *get estimated seconds to download remaining bytes, -1 if unknown
+	 **/
+	UFUNCTION(BlueprintCallable)
+		float GetEstimatedTimeRemaining() const;
+
+	UFUNCTION(BlueprintCallable)
+		bool SetTotalSizeByIndex(int32 InIndex, int64 InTotalSize);
+
+	/*
+	 *get the number of parallel tasks currently allowed, equal to MaxParallelTask unless bAutoTuneParallelTask is on
+	 **/
+	UFUNCTION(BlueprintCallable)
+		int32 GetEffectiveParallelTask() const;
+
+	/*
+	 *get goodput (bytes per second) and request error rate [0, 1] measured by the auto tune controller
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void GetAutoTuneStats(float& OutGoodput, float& OutErrorRate) const;
+
+	/*
+	 *get bytes of response data held between request and disk write by tasks of all managers, current and peak since created
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void GetInFlightBytes(int64& OutCurrentBytes, int64& OutPeakBytes) const;
+
+	/*
+	 *get hit & miss count of the content cache, and its size on disk
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void GetContentCacheStats(int32& OutHitCount, int32& OutMissCount, int64& OutCacheSize) const;
+
+	/*
+	 *get bytes received from network, bytes written to file and CPU seconds spent on decompression of a task
+	 **/
+	UFUNCTION(BlueprintCallable)
+		bool GetTaskTransferStats(int32 InIndex, int64& OutWireBytes, int64& OutOutputBytes, float& OutDecodeSeconds) const;
+
+	/*
+	 *get bytes a delta update reused from the old local file instead of downloading
+	 **/
+	UFUNCTION(BlueprintCallable)
+		int64 GetDeltaSavedSize(int32 InIndex) const;
+
+	/*
+	 *get requests sent, failed requests, bytes received and average seconds per request of the transport shared by all managers, compare transports on the same downloads
+	 *@ return : name of the transport, empty before the first task is added
+	 **/
+	UFUNCTION(BlueprintCallable)
+		FString GetTransportStats(int64& OutRequests, int64& OutFailedRequests, int64& OutReceivedBytes, float& OutAverageRequestSeconds) const;
+
+	/*
+	 *get requests that opened a new connection, seconds spent on DNS, connect & TLS and seconds spent on the rest of requests
+	 *only the libcurl transport can tell setup from transfer, the http module transport reports all as transfer
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void GetConnectionStats(int64& OutNewConnections, float& OutSetupSeconds, float& OutTransferSeconds) const;
+
+	/*
+	 *get bytes received from peers and from the origin, ranges asked from peers and of them the ranges the origin sent after all, see PeerUrls
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void GetPeerStats(int64& OutPeerBytes, int64& OutOriginBytes, int64& OutPeerRequests, int64& OutFallbacks) const;
+
+	//pump downloads where no game loop runs (commandlets, tools), call it repeatedly on game thread
+	void TickHeadless(float DeltaTime);
+
+	/*pump downloads on the calling thread until every started task is completed, failed or stopped
+	 @Param InTimeout seconds to wait at most
+	 @Return false if timed out
+	*/
+	bool WaitForAllTasks(float InTimeout);
+
+	//tasks started & not completed yet, counted against the slots of the engine subsystem
+	int32 GetRunningTaskCount() const;
+
+	//some task is waiting for a slot
+	bool HasWaitingTask() const;
+
+	//some running task has a step queued or running or a sidecar of a stored task is being read,
+	//otherwise every task waits for a response, a delay or a budget
+	bool HasBusyTask() const;
+
+	//running tasks of this manager for a host key
+	int32 GetHostLoad(const FString& InHost) const;
+
+	/*
+	 *get tasks kept compact while not running and the heap bytes they use, see bCompactQueuedTasks
+	 **/
+	UFUNCTION(BlueprintCallable)
+		void GetQueuedTaskMemory(int32& OutQueuedTasks, int64& OutBytes, int64& OutBytesPerTask) const;
 
 
 	/************************************************************************/
@@ -99,24 +304,240 @@ public:
 	//tick interval
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 		float TickInterval = 0.1f;
+	//tasks of this manager downloading at once, UFileDownloadEngineSubsystem limits the tasks of all managers together
 	UPROPERTY(EditAnywhere, BlueprintReadWrite)
 		int32 MaxParallelTask = 5;
+	//adjust parallel tasks by measured goodput and error rate, MaxParallelTask is used as the start value
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bAutoTuneParallelTask = false;
+	//lower bound of parallel tasks when auto tune
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		int32 MinAutoParallelTask = 1;
+	//upper bound of parallel tasks when auto tune
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		int32 MaxAutoParallelTask = 16;
+	//reuse files with identical content (same host, ETag & size) via hard link or copy instead of downloading them again
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bEnableContentCache = false;
+	//directory of the content cache, ignore this (default ../Saved/FileDownloadCache)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		FString ContentCacheDirectory;
+	//least recently used contents are removed when the cache grows over this size, 0 means unlimited
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		int64 MaxContentCacheSize = 1024 * 1024 * 1024;
+	//when a remote file changed, download only the blocks not found in the old local file, needs a block map next to the file on server
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bEnableDeltaUpdate = false;
+	//appended to the file url to get its block map
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		FString DeltaBlockMapSuffix = TEXT(".blocks");
+	//bytes requested at once by a task, smaller chunks resume & share slots sooner, larger ones send fewer requests
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		int32 ChunkSize = 2 * 1024 * 1024;
+	//files completed in an earlier run complete without request while fresh by Cache-Control max-age, stale ones are revalidated by a conditional HEAD
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bUseFreshnessCache = true;
+	//seconds a completed file stays fresh if the server sent no max-age, 0 revalidates every time
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		int32 DefaultMaxAge = 0;
+	//fsync the directory after completed files are renamed, so they survive a power loss, costs a sync per directory & batch
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bSyncDirectoryOnFinalize = false;
+	//seed of the jitter of retry delays, 0 seeds every task from the clock, set it to repeat runs
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		int32 RetrySeed = 0;
+	//file tasks write a memory mapped temp file, faster for writes at random offsets (delta & streaming tasks)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bUseMappedFileSink = false;
+	//file tasks write large files around the page cache at low I/O priority, so the assets the game streams stay cached (Linux)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bUseUncachedFileSink = false;
+	//chunks are written and requested on worker threads without waiting for a frame, events are still broadcast on game thread
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bRunTasksOffGameThread = false;
+	//resolve & connect the host of a task when it is added, so its first request does not pay for DNS, TCP & TLS
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bWarmUpHosts = false;
+	//plain & manifest tasks are kept as compact rows until they start and after they end, for queues of many thousand files
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bCompactQueuedTasks = true;
+	//completed files are served to other instances on the local network, on PeerCachePort of UFileDownloadEngineSubsystem
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		bool bServeToPeers = false;
+	//"http://host:port" of instances serving to peers, ranges are asked from them first and from the origin if they do not have the file
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		TArray<FString> PeerUrls;
+	//appended to the url of a compressed task to get the gzip file
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		FString CompressedUrlSuffix = TEXT(".gz");
+	//batch pieces closer than this are fetched as one range, gap bytes are discarded
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		int32 BatchGapThreshold = 64 * 1024;
+	//ranges sent in one batch request, set 1 for servers without multipart/byteranges support
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+		int32 MaxRangesPerRequest = 16;
 	UPROPERTY(BlueprintAssignable)
 		FDLManagerDelegate OnDlManagerEvent;
 	UPROPERTY(BlueprintAssignable)
 		FOnAllTaskCompleted OnAllTaskCompleted;
+	//an entry of an archive task is extracted, it can be used before the archive completes
+	UPROPERTY(BlueprintAssignable)
+		FOnArchiveEntryExtracted OnArchiveEntryExtracted;
 
 protected:
 
 	void OnTaskEvent(ETaskEvent InEvent, const FTaskInformation& InInfo, int32 InHttpCode);
 
-	int32 FindTaskToDo() const;
+	int32 FindTaskToDo();
+
+	//one wait list per host from TaskOrder, called after TaskOrder changed
+	void BuildHostWaitLists();
+
+	//look at every task of TaskOrder again, e.g. after stopped tasks were started
+	void ResetTaskCursors();
+
+	//send a request to the host of a queued task unless it has a warm connection
+	void WarmUpHost(const FString& InUrl, const FString& InHost);
+
+	void SortTaskOrder();
+
+	void UpdateSpeed(float DeltaTime);
+
+	//create a task of the type selected by the manager settings
+	TSharedPtr<DownloadTask, ESPMode::ThreadSafe> CreateTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName) const;
+
+	//give the task an id, share budgets with it and add it to TaskList
+	int32 RegisterTask(TSharedPtr<DownloadTask, ESPMode::ThreadSafe> Task);
 
-	TMap<int32, TSharedPtr<DownloadTask>> TaskList;
+	//get budgets, transport & cache of the engine, shared by all tasks
+	void UpdateSharedServices();
+
+	//share budgets with the task and hook its callbacks
+	void SetupTask(TSharedPtr<DownloadTask, ESPMode::ThreadSafe> Task);
+
+	//add a row to QueuedTasks instead of a DownloadTask, flags of FQueuedTaskStore, call UpdateSharedServices before & ReadQueuedLocalInfos after a batch
+	int32 AddQueuedTask(const FString& InUrl, const FString& InDirectory, const FString& InFileName, uint8 InFlags);
+
+	//read the sidecars of the rows added since the last call in one worker job
+	void ReadQueuedLocalInfos();
+
+	//the task of an id, a stored task is turned into a DownloadTask, null if none
+	TSharedPtr<DownloadTask, ESPMode::ThreadSafe> MaterializeTask(int32 InIndex);
+
+	//turn ended tasks that came from QueuedTasks back into rows
+	void ReleaseEndedTasks();
+
+	//id of a task of the url, INDEX_NONE if none
+	int32 FindTaskByUrl(const FString& InUrl) const;
+
+	//state of a running or stored task, false if there is no such task
+	bool GetTaskState(int32 InIndex, ETaskState& OutState, bool& bOutNeedStop) const;
+
+	const FString& GetTaskHost(int32 InIndex) const;
+
+	void OnRequestResult(int32 InBytes, bool bSucceeded);
+
+	//complete the futures of all tasks with STOP, they would never complete otherwise
+	void StopTaskFutures();
+
+	//serve the file of a completed task to peers, plain files with a strong ETag only
+	void ServeToPeers(const FTaskInformation& InInfo);
+
+	void UpdateAutoTune(float DeltaTime);
+
+	TMap<int32, TSharedPtr<DownloadTask, ESPMode::ThreadSafe>> TaskList;
+
+	//source url to task id, detect exist tasks
+	TMap<FString, int32> UrlToTask;
+
+	//futures waiting for a task, completed from the event callback of the task
+	TMap<int32, FDownloadCompletionPtr> TaskCompletions;
+
+	//task id to host key, tasks of one host share its connections
+	TMap<int32, FString> TaskHosts;
+
+	//running tasks per host key, counted every tick
+	TMap<FString, int32> HostLoad;
+
+	//task ids in download order
+	TArray<int32> TaskOrder;
+
+	//positions in TaskOrder of the tasks of a host, positions before Cursor are not waiting
+	struct FHostWaitList
+	{
+		FString Host;
+
+		TArray<int32> Positions;
+
+		int32 Cursor = 0;
+	};
+
+	//a host in HostHeap, ordered by the position of its next task
+	struct FHostHeapItem
+	{
+		int32 Position;
+
+		int32 List;
+
+		bool operator<(const FHostHeapItem& Other) const
+		{
+			return Position < Other.Position;
+		}
+	};
+
+	TArray<FHostWaitList> HostWaitLists;
+
+	//indices of HostWaitLists with tasks left & a free connection, a min heap
+	TArray<FHostHeapItem> HostHeap;
+
+	//indices of HostWaitLists whose host has no free connection in any manager, back in HostHeap once it has
+	TArray<int32> ParkedHosts;
+
+	//tasks whose file is fresh, started on the next tick without waiting for a slot
+	TArray<int32> FreshTasks;
+
+	//rows whose sidecar is read by the next ReadQueuedLocalInfos, id & full file name
+	TArray<TPair<int32, FString>> LocalInfoReads;
+
+	//ReadQueuedLocalInfos jobs running, their rows get the local info when done
+	int32 PendingLocalInfoReads = 0;
+
+	//tasks not running, as rows instead of DownloadTasks
+	TSharedPtr<FQueuedTaskStore> QueuedTasks;
+
+	//tasks in TaskList that came from QueuedTasks
+	TSet<int32> ActiveQueuedTasks;
+
+	//of ActiveQueuedTasks, completed or failed since the last tick
+	TArray<int32> EndedTasks;
+
+	bool bTaskOrderDirty = false;
+
+	//seconds since the last scheduling pass
+	float TickTimeCount = 0.f;
+
+	int64 SpeedSampleBytes = 0;
+
+	float DownloadSpeed = 0.f;
 
 	int32 CurrentDoingWorks = 0;
 
 	bool bStopAll = false;
 
 	int32 ErrorCount = 0;
+
+	TSharedPtr<FConcurrencyController> ConcurrencyController;
+
+	TSharedPtr<FDownloadMemoryBudget, ESPMode::ThreadSafe> MemoryBudget;
+
+	TSharedPtr<FContentCache, ESPMode::ThreadSafe> ContentCache;
+
+	TSharedPtr<IDownloadTransport, ESPMode::ThreadSafe> Transport;
+
+	//wraps the engine transport while PeerUrls is set
+	TSharedPtr<FPeerCacheTransport, ESPMode::ThreadSafe> PeerTransport;
+
+	TSharedPtr<FHostProfileStore, ESPMode::ThreadSafe> HostProfiles;
+
+	TSharedPtr<FDownloadBandwidthLimiter, ESPMode::ThreadSafe> BandwidthLimiter;
 };
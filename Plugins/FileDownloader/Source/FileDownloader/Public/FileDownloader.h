@@ -16,4 +16,4 @@ public:
 	//virtual void AddTask(struct FTaskInfomation& InTaskInfo);
 };
 
-DECLARE_LOG_CATEGORY_EXTERN(LogFileDownloader, Log, All);
\ No newline at end of file
+FILEDOWNLOADER_API DECLARE_LOG_CATEGORY_EXTERN(LogFileDownloader, Log, All);
\ No newline at end of file
@@ -10,7 +10,7 @@
  * describe a task's information
  */
 USTRUCT(BlueprintType)
-struct FTaskInformation
+struct FILEDOWNLOADER_API FTaskInformation
 {
 	GENERATED_BODY()
 	
@@ -33,11 +33,76 @@ public:
 		FString SourceUrl = FString("");
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
 		FString ETag = FString("");
+	//content hash given by a manifest, MD5 or SHA-1 as hex, empty if unknown
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		FString Hash = FString("");
+	//Last-Modified of the remote file, sent as If-Modified-Since when revalidating
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		FString LastModified = FString("");
+	//max-age of Cache-Control in seconds, -1 if the server sent none
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int32 MaxAge = -1;
+	//unix time the server last confirmed the content, 0 if never
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int64 ValidatedTime = 0;
+	//size & unix modification time of the completed file, saved in the sidecar, a file changed since is not trusted
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int64 LocalSize = 0;
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int64 LocalModifiedTime = 0;
 
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
-		int32 CurrentSize = 0;
+		int64 CurrentSize = 0;
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
-		int32 TotalSize = 0;
+		int64 TotalSize = 0;
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
 		int32 GUID =0;
+	//higher priority tasks are started first
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere)
+		int32 Priority = 0;
+};
+
+/**
+ * a piece of a remote file saved as its own file, used by batch tasks
+ */
+USTRUCT(BlueprintType)
+struct FBatchEntry
+{
+	GENERATED_BODY()
+
+public:
+
+	//start of the piece in the remote file
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		int64 Offset = 0;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		int32 Length = 0;
+	//full path of the local file
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		FString DestFile;
+};
+
+/**
+ * a file listed in a download manifest
+ */
+USTRUCT(BlueprintType)
+struct FManifestEntry
+{
+	GENERATED_BODY()
+
+public:
+
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		FString Url;
+	//path relative to the download directory, file name of Url is used if empty
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		FString Path;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		int64 Size = 0;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		FString Hash;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		FString ETag;
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+		int32 Priority = 0;
 };
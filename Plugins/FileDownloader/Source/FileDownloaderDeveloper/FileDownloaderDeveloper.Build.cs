@@ -0,0 +1,40 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+using UnrealBuildTool;
+
+//commandlets & stand-in servers that measure and soak FileDownloader, never part of a shipping build
+public class FileDownloaderDeveloper : ModuleRules
+{
+	public FileDownloaderDeveloper(ReadOnlyTargetRules Target) : base(Target)
+	{
+		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+
+		PrivateIncludePaths.AddRange(
+			new string[] {
+				"FileDownloaderDeveloper/Private",
+				//transports, sinks & block maps of the runtime module
+				"FileDownloader/Private",
+			}
+			);
+
+
+		PublicDependencyModuleNames.AddRange(
+			new string[]
+			{
+				"Core",
+			}
+			);
+
+
+		PrivateDependencyModuleNames.AddRange(
+			new string[]
+			{
+				"CoreUObject",
+				"Engine",
+				"FileDownloader",
+				"Sockets",
+				"Networking",
+			}
+			);
+	}
+}
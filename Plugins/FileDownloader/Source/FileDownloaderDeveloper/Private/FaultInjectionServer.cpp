@@ -0,0 +1,227 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FaultInjectionServer.h"
+#include "FaultInjectionTransport.h"
+#include "FileDownloader.h"
+#include "Async/Async.h"
+#include "Common/TcpListener.h"
+#include "Interfaces/IPv4/IPv4Endpoint.h"
+#include "Sockets.h"
+#include "SocketSubsystem.h"
+#include "HAL/PlatformProcess.h"
+
+//a request head larger than this is not a request of a task
+static const int32 FAULT_MAX_HEAD_SIZE = 64 * 1024;
+
+//seconds between slices of a trickled body
+static const float FAULT_TRICKLE_SLICE_SECONDS = 0.05f;
+
+FFaultInjectionServer::FFaultInjectionServer(TSharedPtr<FFaultInjectionTransport, ESPMode::ThreadSafe> InFaults)
+	: Faults(InFaults)
+{
+}
+
+FFaultInjectionServer::~FFaultInjectionServer()
+{
+	bStopping = true;
+	Listener.Reset();
+
+	//connections check bStopping between waits
+	while (Connections > 0)
+	{
+		FPlatformProcess::Sleep(0.01f);
+	}
+}
+
+bool FFaultInjectionServer::Start(int32 InPort)
+{
+	Port = InPort;
+	Listener = MakeUnique<FTcpListener>(FIPv4Endpoint(FIPv4Address(127, 0, 0, 1), Port), FTimespan::FromMilliseconds(100));
+	if (Listener->IsActive() == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Fault injection server cannot listen on port %d"), Port);
+		Listener.Reset();
+		return false;
+	}
+
+	Listener->OnConnectionAccepted().BindRaw(this, &FFaultInjectionServer::OnConnectionAccepted);
+	return true;
+}
+
+FString FFaultInjectionServer::GetBaseUrl() const
+{
+	return FString::Printf(TEXT("http://127.0.0.1:%d"), Port);
+}
+
+bool FFaultInjectionServer::OnConnectionAccepted(FSocket* InSocket, const FIPv4Endpoint& InEndpoint)
+{
+	if (bStopping)
+	{
+		return false;
+	}
+
+	++Connections;
+	Async(EAsyncExecution::Thread, [this, InSocket]()
+	{
+		ServeConnection(InSocket);
+		InSocket->Close();
+		ISocketSubsystem::Get(PLATFORM_SOCKETSUBSYSTEM)->DestroySocket(InSocket);
+		--Connections;
+	});
+	return true;
+}
+
+void FFaultInjectionServer::ServeConnection(FSocket* InSocket)
+{
+	TArray<uint8> Received;
+	while (bStopping == false)
+	{
+		//requests of tasks have no body, a request ends with an empty line
+		int32 HeadEnd = INDEX_NONE;
+		for (int32 i = 0; i + 3 < Received.Num(); ++i)
+		{
+			if (Received[i] == '\r' && Received[i + 1] == '\n' && Received[i + 2] == '\r' && Received[i + 3] == '\n')
+			{
+				HeadEnd = i;
+				break;
+			}
+		}
+
+		if (HeadEnd == INDEX_NONE)
+		{
+			if (Received.Num() > FAULT_MAX_HEAD_SIZE)
+			{
+				return;
+			}
+			if (InSocket->Wait(ESocketWaitConditions::WaitForRead, FTimespan::FromMilliseconds(100)) == false)
+			{
+				continue;
+			}
+
+			uint8 Buffer[4096];
+			int32 BytesRead = 0;
+			if (InSocket->Recv(Buffer, sizeof(Buffer), BytesRead) == false || BytesRead <= 0)
+			{
+				return;
+			}
+			Received.Append(Buffer, BytesRead);
+			continue;
+		}
+
+		FUTF8ToTCHAR Converter((const ANSICHAR*)Received.GetData(), HeadEnd);
+		const FString Head(Converter.Length(), Converter.Get());
+		Received.RemoveAt(0, HeadEnd + 4, false);
+
+		//"VERB /path HTTP/1.1" and "Name: value" lines
+		TArray<FString> Lines;
+		Head.ParseIntoArrayLines(Lines);
+		TArray<FString> RequestLine;
+		if (Lines.Num() < 1 || Lines[0].ParseIntoArrayWS(RequestLine) < 2)
+		{
+			return;
+		}
+
+		TArray<TPair<FString, FString>> Headers;
+		bool bClose = false;
+		for (int32 i = 1; i < Lines.Num(); ++i)
+		{
+			FString Name;
+			FString Value;
+			if (Lines[i].Split(TEXT(":"), &Name, &Value))
+			{
+				Headers.Emplace(Name.TrimStartAndEnd(), Value.TrimStartAndEnd());
+				bClose |= Name.TrimStartAndEnd().Equals(TEXT("Connection"), ESearchCase::IgnoreCase) && Value.TrimStartAndEnd().Equals(TEXT("close"), ESearchCase::IgnoreCase);
+			}
+		}
+
+		if (SendResponse(InSocket, RequestLine[0], RequestLine[1], Headers) == false || bClose)
+		{
+			return;
+		}
+	}
+}
+
+bool FFaultInjectionServer::SendResponse(FSocket* InSocket, const FString& InVerb, const FString& InPath, const TArray<TPair<FString, FString>>& InHeaders)
+{
+	FDownloadRequest Request;
+	Request.Verb = InVerb;
+	Request.Url = GetBaseUrl() + InPath;
+	Request.Headers = InHeaders;
+
+	bool bDropped = false;
+	bool bTruncated = false;
+	FDownloadResponsePtr Response = Faults->Answer(Request, bDropped, bTruncated);
+	const bool bHead = InVerb == TEXT("HEAD");
+
+	//a dropped body is announced whole, a truncated one has no length & ends with the connection
+	FString Head = FString::Printf(TEXT("HTTP/1.1 %d %s\r\n"), Response->GetResponseCode(), Response->GetResponseCode() < 300 ? TEXT("OK") : TEXT("Error"));
+	bool bHasLength = false;
+	for (const TPair<FString, FString>& Header : Response->Headers)
+	{
+		const bool bLength = Header.Key.Equals(TEXT("Content-Length"), ESearchCase::IgnoreCase);
+		bHasLength |= bLength;
+		if (bLength == false || bTruncated == false)
+		{
+			Head += Header.Key + TEXT(": ") + Header.Value + TEXT("\r\n");
+		}
+	}
+	if (bHasLength == false && bTruncated == false)
+	{
+		Head += FString::Printf(TEXT("Content-Length: %d\r\n"), Response->Content.Num());
+	}
+	if (bDropped || bTruncated)
+	{
+		Head += TEXT("Connection: close\r\n");
+	}
+	Head += TEXT("\r\n");
+
+	FTCHARToUTF8 HeadUtf8(*Head);
+	if (SendAll(InSocket, (const uint8*)HeadUtf8.Get(), HeadUtf8.Length()) == false)
+	{
+		return false;
+	}
+
+	const TArray<uint8>& Content = Response->Content;
+	const int64 Rate = Faults->GetProfile().TrickleBytesPerSecond;
+	if (bHead == false && Rate > 0)
+	{
+		const int32 SliceSize = (int32)FMath::Max<int64>(1, (int64)(Rate * FAULT_TRICKLE_SLICE_SECONDS));
+		for (int32 Offset = 0; Offset < Content.Num() && bStopping == false; Offset += SliceSize)
+		{
+			if (SendAll(InSocket, Content.GetData() + Offset, FMath::Min(SliceSize, Content.Num() - Offset)) == false)
+			{
+				return false;
+			}
+			FPlatformProcess::Sleep(FAULT_TRICKLE_SLICE_SECONDS);
+		}
+	}
+	else if (bHead == false && SendAll(InSocket, Content.GetData(), Content.Num()) == false)
+	{
+		return false;
+	}
+
+	return bDropped == false && bTruncated == false;
+}
+
+bool FFaultInjectionServer::SendAll(FSocket* InSocket, const uint8* InData, int32 InSize)
+{
+	while (InSize > 0)
+	{
+		int32 BytesSent = 0;
+		if (InSocket->Send(InData, InSize, BytesSent) == false)
+		{
+			return false;
+		}
+
+		//a full send buffer of a non blocking socket
+		if (BytesSent <= 0)
+		{
+			InSocket->Wait(ESocketWaitConditions::WaitForWrite, FTimespan::FromMilliseconds(100));
+			continue;
+		}
+		InData += BytesSent;
+		InSize -= BytesSent;
+	}
+
+	return true;
+}
@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include <atomic>
+
+class FFaultInjectionTransport;
+class FSocket;
+class FTcpListener;
+struct FIPv4Endpoint;
+
+/**
+ * serves the files of a FFaultInjectionTransport over http on loopback, so the real transports are soaked with the same faults.
+ * HTTP/1.1 with keep alive, HEAD & GET of a single range, one thread per connection.
+ * a dropped body closes the connection after half of a body announced whole, a truncated one is sent without length
+ * and ends on a cleanly closed connection, a trickled one is sent in slices at the rate of the profile.
+ */
+class FFaultInjectionServer
+{
+public:
+
+	explicit FFaultInjectionServer(TSharedPtr<FFaultInjectionTransport, ESPMode::ThreadSafe> InFaults);
+
+	//closes the connections & waits for their threads
+	~FFaultInjectionServer();
+
+	//listen on 127.0.0.1, false if the port cannot be used
+	bool Start(int32 InPort);
+
+	//"http://127.0.0.1:port", urls of the transport are this plus the path
+	FString GetBaseUrl() const;
+
+protected:
+
+	bool OnConnectionAccepted(FSocket* InSocket, const FIPv4Endpoint& InEndpoint);
+
+	//answer requests until the client or a fault closes the connection
+	void ServeConnection(FSocket* InSocket);
+
+	//send a response, false if the connection is to be closed
+	bool SendResponse(FSocket* InSocket, const FString& InVerb, const FString& InPath, const TArray<TPair<FString, FString>>& InHeaders);
+
+	static bool SendAll(FSocket* InSocket, const uint8* InData, int32 InSize);
+
+	TSharedPtr<FFaultInjectionTransport, ESPMode::ThreadSafe> Faults;
+
+	TUniquePtr<FTcpListener> Listener;
+
+	int32 Port = 0;
+
+	std::atomic<bool> bStopping { false };
+
+	//connections being served
+	std::atomic<int32> Connections { 0 };
+};
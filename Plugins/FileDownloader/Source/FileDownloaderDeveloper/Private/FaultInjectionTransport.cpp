@@ -0,0 +1,257 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FaultInjectionTransport.h"
+#include "DeltaBlockMap.h"
+#include "Async/Async.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+
+FFaultInjectionTransport::FFaultInjectionTransport(const FDownloadFaultProfile& InProfile, int64 InFileSize, int32 InSeed)
+	: Profile(InProfile)
+	, FileSize(FMath::Max<int64>(1, InFileSize))
+	, Random(InSeed)
+{
+}
+
+uint64 FFaultInjectionTransport::Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete)
+{
+	const uint64 Handle = NewHandle();
+	const double StartTime = FPlatformTime::Seconds();
+
+	bool bSucceeded = true;
+	bool bTruncated = false;
+	FDownloadResponsePtr Response;
+	{
+		FScopeLock ScopeLock(&Lock);
+		Requests.Add(Handle);
+		Response = MakeResponse(InRequest, bSucceeded, bTruncated);
+	}
+
+	auto Answer = [this, Handle, StartTime, Response, bSucceeded, InOnComplete]()
+	{
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (Requests.Remove(Handle) == 0)
+			{
+				return;
+			}
+		}
+
+		//bytes of a dropped body were received before the drop
+		AddStats(Response->Content.Num(), FPlatformTime::Seconds() - StartTime, 0.0, -1, bSucceeded);
+		InOnComplete(bSucceeded ? Response : nullptr, bSucceeded);
+	};
+
+	//answer later like a real server, the caller may still hold its request lock
+	if (Profile.TrickleBytesPerSecond > 0 && Response->Content.Num() > 0)
+	{
+		CallAfterDownloadDelay((double)Response->Content.Num() / Profile.TrickleBytesPerSecond, MoveTemp(Answer));
+	}
+	else if (InRequest.bCompleteOnGameThread)
+	{
+		FFunctionGraphTask::CreateAndDispatchWhenReady(MoveTemp(Answer), TStatId(), nullptr, ENamedThreads::GameThread);
+	}
+	else
+	{
+		Async(EAsyncExecution::ThreadPool, MoveTemp(Answer));
+	}
+
+	return Handle;
+}
+
+void FFaultInjectionTransport::Cancel(uint64 InHandle)
+{
+	FScopeLock ScopeLock(&Lock);
+	Requests.Remove(InHandle);
+}
+
+bool FFaultInjectionTransport::VerifyFile(const FString& InUrl, const FString& InFileName) const
+{
+	TArray<uint8> Data;
+	if (FFileHelper::LoadFileToArray(Data, *InFileName) == false)
+	{
+		return false;
+	}
+
+	TArray<uint8> Expected;
+	GetFileContent(InUrl, Expected);
+	return Data == Expected;
+}
+
+void FFaultInjectionTransport::GetFileContent(const FString& InUrl, TArray<uint8>& OutContent) const
+{
+	int32 Version = 0;
+	{
+		FScopeLock ScopeLock(&Lock);
+		const FRemoteFile* File = Files.Find(InUrl);
+		Version = File ? File->Version : 0;
+	}
+
+	FillContent(InUrl, Version, 0, FileSize, OutContent);
+}
+
+FDownloadFaultStats FFaultInjectionTransport::GetFaultStats() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return FaultStats;
+}
+
+FDownloadResponsePtr FFaultInjectionTransport::Answer(const FDownloadRequest& InRequest, bool& bOutDropped, bool& bOutTruncated)
+{
+	bool bSucceeded = true;
+	bOutTruncated = false;
+	FScopeLock ScopeLock(&Lock);
+	FDownloadResponsePtr Response = MakeResponse(InRequest, bSucceeded, bOutTruncated);
+	bOutDropped = bSucceeded == false;
+	return Response;
+}
+
+FDownloadResponsePtr FFaultInjectionTransport::MakeResponse(const FDownloadRequest& InRequest, bool& bOutSucceeded, bool& bOutTruncated)
+{
+	if (Profile.BlockMapSuffix.IsEmpty() == false && InRequest.Url.EndsWith(Profile.BlockMapSuffix))
+	{
+		return MakeBlockMapResponse(InRequest.Url.LeftChop(Profile.BlockMapSuffix.Len()));
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	FRemoteFile& File = Files.FindOrAdd(InRequest.Url);
+	FDownloadResponsePtr Response = MakeShareable(new FDownloadResponse());
+
+	if (BurstLeft > 0 || Random.FRand() < Profile.ErrorBurstRate)
+	{
+		BurstLeft = BurstLeft > 0 ? BurstLeft - 1 : FMath::Max(0, Profile.ErrorBurstLength - 1);
+		Response->ResponseCode = BurstLeft % 2 ? 503 : 429;
+		if (Response->ResponseCode == 429)
+		{
+			Response->Headers.Emplace(TEXT("Retry-After"), TEXT("1"));
+		}
+		AddFault(File, Now);
+		return Response;
+	}
+
+	const bool bHead = InRequest.Verb == TEXT("HEAD");
+	bool bFault = false;
+	if (bHead == false && Random.FRand() < Profile.ETagChangeRate)
+	{
+		++File.Version;
+		bFault = true;
+	}
+
+	const FString ETag = FString::Printf(TEXT("\"v%d\""), File.Version);
+	Response->Headers.Emplace(TEXT("ETag"), ETag);
+
+	FString Range;
+	FString IfRange;
+	for (const TPair<FString, FString>& Header : InRequest.Headers)
+	{
+		if (Header.Key.Equals(TEXT("Range"), ESearchCase::IgnoreCase))
+		{
+			Range = Header.Value;
+		}
+		else if (Header.Key.Equals(TEXT("If-Range"), ESearchCase::IgnoreCase))
+		{
+			IfRange = Header.Value;
+		}
+	}
+
+	//a single "bytes=first-last" range, served only if If-Range still matches
+	int64 First = 0;
+	int64 Last = FileSize - 1;
+	FString Left;
+	FString Right;
+	const bool bRange = Range.RemoveFromStart(TEXT("bytes=")) && Range.Split(TEXT("-"), &Left, &Right) && (IfRange.IsEmpty() || IfRange == ETag);
+	if (bRange && bHead == false && File.RangeErrors < Profile.RangeErrorsPerFile)
+	{
+		++File.RangeErrors;
+		Response->ResponseCode = 503;
+		AddFault(File, Now);
+		return Response;
+	}
+	if (bRange && bHead == false && Random.FRand() < Profile.IgnoreRangeRate)
+	{
+		bFault = true;
+	}
+	else if (bRange)
+	{
+		First = FCString::Atoi64(*Left);
+		Last = Right.IsEmpty() ? Last : FMath::Min(Last, FCString::Atoi64(*Right));
+	}
+
+	const bool bPartial = First != 0 || Last != FileSize - 1;
+	Response->ResponseCode = bPartial ? 206 : 200;
+	if (bPartial)
+	{
+		Response->Headers.Emplace(TEXT("Content-Range"), FString::Printf(TEXT("bytes %lld-%lld/%lld"), First, Last, FileSize));
+	}
+
+	const int64 Length = FMath::Max<int64>(0, Last - First + 1);
+	Response->Headers.Emplace(TEXT("Content-Length"), FString::Printf(TEXT("%lld"), bHead ? FileSize : Length));
+	if (bHead == false)
+	{
+		FillContent(InRequest.Url, File.Version, First, Length, Response->Content);
+
+		if (Random.FRand() < Profile.DropRate)
+		{
+			Response->Content.SetNum(Response->Content.Num() / 2);
+			bOutSucceeded = false;
+			bFault = true;
+		}
+		else if (Random.FRand() < Profile.TruncateRate)
+		{
+			Response->Content.SetNum(Response->Content.Num() / 2);
+			bOutTruncated = true;
+			bFault = true;
+		}
+	}
+
+	if (bFault)
+	{
+		AddFault(File, Now);
+	}
+	else if (File.FaultTime > 0.0)
+	{
+		++FaultStats.Recoveries;
+		FaultStats.RecoverySeconds += Now - File.FaultTime;
+		File.FaultTime = 0.0;
+	}
+
+	return Response;
+}
+
+FDownloadResponsePtr FFaultInjectionTransport::MakeBlockMapResponse(const FString& InUrl)
+{
+	FDownloadResponsePtr Response = MakeShareable(new FDownloadResponse());
+	const FRemoteFile* File = Files.Find(InUrl);
+
+	TArray<uint8> Content;
+	FillContent(InUrl, File ? File->Version : 0, 0, FileSize, Content);
+	FDeltaBlockMap BlockMap;
+	BlockMap.BuildFromData(Content, Profile.BlockMapBlockSize);
+	BlockMap.Save(Response->Content);
+
+	Response->ResponseCode = 200;
+	Response->Headers.Emplace(TEXT("Content-Length"), FString::Printf(TEXT("%d"), Response->Content.Num()));
+	return Response;
+}
+
+void FFaultInjectionTransport::FillContent(const FString& InUrl, int32 InVersion, int64 InOffset, int64 InLength, TArray<uint8>& OutContent) const
+{
+	//every url & version has its own bytes, a file mixing versions or offsets does not verify
+	const uint32 Seed = GetTypeHash(InUrl) + (uint32)InVersion * 2654435761u;
+	OutContent.SetNumUninitialized(InLength);
+	for (int64 i = 0; i < InLength; ++i)
+	{
+		const uint32 Offset = (uint32)(InOffset + i);
+		OutContent[i] = (uint8)((Offset + (Offset >> 8) + (Offset >> 16) + Seed) & 0xff);
+	}
+}
+
+void FFaultInjectionTransport::AddFault(FRemoteFile& InFile, double InNow)
+{
+	++FaultStats.Faults;
+	if (InFile.FaultTime <= 0.0)
+	{
+		InFile.FaultTime = InNow;
+	}
+}
@@ -0,0 +1,140 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTransport.h"
+#include "Math/RandomStream.h"
+
+/**
+ * how often a FFaultInjectionTransport misbehaves, every rate is a chance per request in [0, 1]
+ */
+struct FDownloadFaultProfile
+{
+	FString Name;
+
+	//the connection drops after half of the body
+	float DropRate = 0.f;
+
+	//start a burst of 503 & 429 answers
+	float ErrorBurstRate = 0.f;
+
+	int32 ErrorBurstLength = 3;
+
+	//the file gets a new version & ETag before a GET is answered
+	float ETagChangeRate = 0.f;
+
+	//a range request is answered with 200 & the whole file
+	float IgnoreRangeRate = 0.f;
+
+	//the body ends early on a cleanly closed connection
+	float TruncateRate = 0.f;
+
+	//bodies are delivered at this rate, 0 means at once
+	int64 TrickleBytesPerSecond = 0;
+
+	//the first range requests of every file are answered with 503
+	int32 RangeErrorsPerFile = 0;
+
+	//urls ending with this serve the block map of the file for delta updates, empty serves none
+	FString BlockMapSuffix;
+
+	int32 BlockMapBlockSize = 64 * 1024;
+};
+
+/**
+ * faults injected by a FFaultInjectionTransport and how long tasks took to get a good answer afterwards
+ */
+struct FDownloadFaultStats
+{
+	int32 Faults = 0;
+
+	int32 Recoveries = 0;
+
+	//sum of seconds from the first fault of a file to its next good answer
+	double RecoverySeconds = 0.0;
+};
+
+/**
+ * a stand-in for a server without network, every url is a file of generated content.
+ * it misbehaves by a fault profile, so retry, resume & ETag handling of tasks can be soaked.
+ * answers in process as a transport, or over loopback http through FFaultInjectionServer to soak the real transports
+ */
+class FFaultInjectionTransport : public IDownloadTransport
+{
+public:
+
+	FFaultInjectionTransport(const FDownloadFaultProfile& InProfile, int64 InFileSize, int32 InSeed);
+
+	virtual uint64 Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete) override;
+
+	virtual void Cancel(uint64 InHandle) override;
+
+	virtual const TCHAR* GetName() const override
+	{
+		return TEXT("FaultInjection");
+	}
+
+	//there are no connections to open
+	virtual void Preconnect(const FString& InUrl) override {}
+
+	//the file has the content the url serves now
+	bool VerifyFile(const FString& InUrl, const FString& InFileName) const;
+
+	//the content the url serves now
+	void GetFileContent(const FString& InUrl, TArray<uint8>& OutContent) const;
+
+	FDownloadFaultStats GetFaultStats() const;
+
+	/*answer a request like Send, for a server sending it over a socket
+	 @Param bOutDropped the content is half of the body, the connection drops after it
+	 @Param bOutTruncated the content is half of the body, the connection is closed cleanly after it
+	*/
+	FDownloadResponsePtr Answer(const FDownloadRequest& InRequest, bool& bOutDropped, bool& bOutTruncated);
+
+	const FDownloadFaultProfile& GetProfile() const
+	{
+		return Profile;
+	}
+
+protected:
+
+	struct FRemoteFile
+	{
+		int32 Version = 0;
+
+		//first fault not recovered yet, 0 if none
+		double FaultTime = 0.0;
+
+		//range requests answered with 503 so far
+		int32 RangeErrors = 0;
+	};
+
+	//answer a request, call with Lock held
+	FDownloadResponsePtr MakeResponse(const FDownloadRequest& InRequest, bool& bOutSucceeded, bool& bOutTruncated);
+
+	//the block map of the current version of InUrl, call with Lock held
+	FDownloadResponsePtr MakeBlockMapResponse(const FString& InUrl);
+
+	void FillContent(const FString& InUrl, int32 InVersion, int64 InOffset, int64 InLength, TArray<uint8>& OutContent) const;
+
+	void AddFault(FRemoteFile& InFile, double InNow);
+
+	FDownloadFaultProfile Profile;
+
+	int64 FileSize = 0;
+
+	mutable FCriticalSection Lock;
+
+	FRandomStream Random;
+
+	TMap<FString, FRemoteFile> Files;
+
+	//error answers left in the current burst
+	int32 BurstLeft = 0;
+
+	FDownloadFaultStats FaultStats;
+
+	//sent & not answered yet
+	TSet<uint64> Requests;
+};
@@ -0,0 +1,222 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FileDownloadBenchmarkCommandlet.h"
+#include "FileDownloadCommandletUtils.h"
+#include "FileDownloadManager.h"
+#include "FileDownloadEngineSubsystem.h"
+#include "FileDownloader.h"
+#include "StubDownloadTransport.h"
+#include "Misc/Paths.h"
+#include "Misc/Parse.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformMemory.h"
+#include "HAL/PlatformProcess.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Misc/FileHelper.h"
+
+//size of every stub file, one chunk each
+static const int64 BENCHMARK_FILE_SIZE = 4 * 1024;
+
+//calls of the cheap operations, averaged
+static const int32 BENCHMARK_REPEAT = 10;
+
+UFileDownloadBenchmarkCommandlet::UFileDownloadBenchmarkCommandlet()
+{
+	FFileDownloadCommandletUtils::InitCommandlet(this);
+}
+
+int32 UFileDownloadBenchmarkCommandlet::Main(const FString& Params)
+{
+	UFileDownloadEngineSubsystem* Engine = FFileDownloadCommandletUtils::GetEngine(TEXT("FileDownloadBenchmark"));
+	if (Engine == nullptr)
+	{
+		return 1;
+	}
+
+	FString TaskCounts = TEXT("1000,10000,100000");
+	FParse::Value(*Params, TEXT("Tasks="), TaskCounts);
+
+	const FString OutputFile = FFileDownloadCommandletUtils::GetOutputFile(TEXT("FileDownloadBenchmark"), Params);
+
+	//-Compact=0 keeps every queued task as a DownloadTask, to compare memory per task
+	int32 Compact = 1;
+	FParse::Value(*Params, TEXT("Compact="), Compact);
+	bCompactQueuedTasks = Compact != 0;
+
+	//-Warm=0 starts without local files, no sidecar is read or kept
+	int32 Warm = 1;
+	FParse::Value(*Params, TEXT("Warm="), Warm);
+	bWarmStart = Warm != 0;
+
+	Engine->SetTransport(MakeShareable(new FStubDownloadTransport(BENCHMARK_FILE_SIZE)));
+
+	FString Csv = TEXT("Operation,Tasks,Calls,TotalMilliseconds,MicrosecondsPerCall,NanosecondsPerTask,BytesPerTask\n");
+	TArray<FString> Counts;
+	TaskCounts.ParseIntoArray(Counts, TEXT(","));
+	for (const FString& Count : Counts)
+	{
+		const int32 TaskCount = FCString::Atoi(*Count);
+		if (TaskCount > 0)
+		{
+			RunBenchmark(TaskCount, Csv);
+		}
+	}
+
+	Engine->SetTransport(nullptr);
+
+	if (FFileDownloadCommandletUtils::SaveResults(TEXT("FileDownloadBenchmark"), Csv, OutputFile) == false)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+void UFileDownloadBenchmarkCommandlet::RunBenchmark(int32 InTaskCount, FString& OutCsv)
+{
+	UFileDownloadManager* Manager = NewObject<UFileDownloadManager>();
+	Manager->AddToRoot();
+	Manager->TickInterval = 0.f;
+	Manager->bUseFreshnessCache = bWarmStart;
+	Manager->bCompactQueuedTasks = bCompactQueuedTasks;
+
+	//growth of the process memory per task, allocator caches make it a rough number for small counts
+	auto Measure = [InTaskCount, &OutCsv](const TCHAR* InName, int32 InCalls, TFunctionRef<void()> InOperation)
+	{
+		const int64 StartMemory = (int64)FPlatformMemory::GetStats().UsedPhysical;
+		const double StartTime = FPlatformTime::Seconds();
+		for (int32 i = 0; i < InCalls; ++i)
+		{
+			InOperation();
+		}
+		const double Seconds = FPlatformTime::Seconds() - StartTime;
+		const int64 UsedBytes = (int64)FPlatformMemory::GetStats().UsedPhysical - StartMemory;
+
+		const FString Row = FString::Printf(TEXT("%s,%d,%d,%.3f,%.3f,%.3f,%lld"), InName, InTaskCount, InCalls,
+			Seconds * 1000.0, Seconds * 1000000.0 / InCalls, Seconds * 1000000000.0 / InCalls / InTaskCount, FMath::Max<int64>(0, UsedBytes) / InTaskCount);
+		UE_LOG(LogFileDownloader, Display, TEXT("%s"), *Row);
+		OutCsv += Row + TEXT("\n");
+	};
+
+	TArray<FString> Urls;
+	Urls.Reserve(InTaskCount);
+	for (int32 i = 0; i < InTaskCount; ++i)
+	{
+		Urls.Add(FString::Printf(TEXT("http://benchmark.invalid/files/%d.bin"), i));
+	}
+
+	//only the few tasks started by the ticks below write their files
+	const FString Directory = FPaths::ProjectSavedDir() / TEXT("FileDownloadBenchmark");
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	if (bWarmStart)
+	{
+		WriteLocalFiles(Urls, Directory);
+	}
+
+	Measure(TEXT("AddTaskByUrl"), 1, [Manager, &Urls, &Directory]()
+	{
+		for (const FString& Url : Urls)
+		{
+			Manager->AddTaskByUrl(Url, Directory);
+		}
+	});
+
+	//the sidecars are read on workers, their fields are kept until the tasks start
+	Measure(TEXT("ReadLocalInfo"), 1, [Manager]()
+	{
+		while (Manager->HasBusyTask())
+		{
+			FPlatformProcess::Sleep(0.f);
+			FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+		}
+	});
+
+	int32 QueuedTasks = 0;
+	int64 QueuedBytes = 0;
+	int64 BytesPerTask = 0;
+	Manager->GetQueuedTaskMemory(QueuedTasks, QueuedBytes, BytesPerTask);
+	UE_LOG(LogFileDownloader, Display, TEXT("%d queued tasks use %lld bytes, %lld bytes per task"), QueuedTasks, QueuedBytes, BytesPerTask);
+	OutCsv += FString::Printf(TEXT("QueuedTaskMemory,%d,0,0,0,0,%lld\n"), InTaskCount, BytesPerTask);
+
+	//every url is found as an exist task
+	Measure(TEXT("AddTaskByUrlExisting"), 1, [Manager, &Urls, &Directory]()
+	{
+		for (const FString& Url : Urls)
+		{
+			Manager->AddTaskByUrl(Url, Directory);
+		}
+	});
+
+	Measure(TEXT("GetAllTaskInformation"), BENCHMARK_REPEAT, [Manager]()
+	{
+		Manager->GetAllTaskInformation();
+	});
+
+	Measure(TEXT("GetByteSize"), BENCHMARK_REPEAT, [Manager]()
+	{
+		int64 CurrentSize = 0;
+		int64 TotalSize = 0;
+		Manager->GetByteSize(CurrentSize, TotalSize);
+	});
+
+	Measure(TEXT("GetTotalPercent"), BENCHMARK_REPEAT, [Manager]()
+	{
+		Manager->GetTotalPercent();
+	});
+
+	//responses of the stub wait on game thread, so every tick only schedules
+	Measure(TEXT("Tick"), BENCHMARK_REPEAT, [Manager]()
+	{
+		Manager->Tick(0.01f);
+	});
+
+	//responses are handled, tasks complete & free their slots
+	Measure(TEXT("TickHeadless"), BENCHMARK_REPEAT, [Manager]()
+	{
+		Manager->TickHeadless(0.01f);
+	});
+
+	Measure(TEXT("StopAll"), 1, [Manager]()
+	{
+		Manager->StopAll();
+	});
+
+	Measure(TEXT("StartAll"), 1, [Manager]()
+	{
+		Manager->StartAll();
+	});
+
+	Measure(TEXT("Clear"), 1, [Manager]()
+	{
+		Manager->Clear();
+	});
+
+	Manager->RemoveFromRoot();
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+}
+
+void UFileDownloadBenchmarkCommandlet::WriteLocalFiles(const TArray<FString>& InUrls, const FString& InDirectory)
+{
+	//an intact file validated long ago, kept by the store & revalidated when its task starts
+	const TArray<uint8> Content = { 0 };
+	for (const FString& Url : InUrls)
+	{
+		const FString FileName = InDirectory / FPaths::GetCleanFilename(Url);
+		FFileHelper::SaveArrayToFile(Content, *FileName);
+
+		FTaskInformation Local;
+		Local.SourceUrl = Url;
+		Local.ETag = TEXT("\"benchmark-etag\"");
+		Local.LastModified = TEXT("Wed, 21 Oct 2015 07:28:00 GMT");
+		Local.MaxAge = 0;
+		Local.ValidatedTime = 1;
+		Local.LocalSize = Content.Num();
+		Local.LocalModifiedTime = IFileManager::Get().GetTimeStamp(*FileName).ToUnixTimestamp();
+		Local.TotalSize = Content.Num();
+		Local.CurrentSize = Content.Num();
+
+		FString Json;
+		Local.SerializeToJsonString(Json);
+		FFileHelper::SaveStringToFile(Json, *(FileName + TEXT(".task")));
+	}
+}
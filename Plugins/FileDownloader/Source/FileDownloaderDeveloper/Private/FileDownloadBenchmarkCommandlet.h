@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FileDownloadBenchmarkCommandlet.generated.h"
+
+/**
+ * times the bookkeeping of UFileDownloadManager at growing task counts, no network is used.
+ * UE4Editor-Cmd.exe Project -run=FileDownloadBenchmark [-Tasks=1000,10000,100000] [-Compact=1] [-Warm=1] [-Output=Path.csv]
+ * one csv row per operation & task count, default output ../Saved/Profiling/FileDownloadBenchmark.csv
+ * BytesPerTask is the growth of process memory, run with -Compact=0 to compare with a DownloadTask per queued task.
+ * QueuedTaskMemory is the heap of the queued task store per task. a warm start has an intact local file with a stale sidecar
+ * for every task, as after an earlier run, -Warm=0 starts without files
+ */
+UCLASS()
+class UFileDownloadBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+
+	UFileDownloadBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+
+	//add the tasks to a new manager and time every operation
+	void RunBenchmark(int32 InTaskCount, FString& OutCsv);
+
+	//a one byte file & its sidecar for every url
+	void WriteLocalFiles(const TArray<FString>& InUrls, const FString& InDirectory);
+
+	bool bCompactQueuedTasks = true;
+
+	bool bWarmStart = true;
+};
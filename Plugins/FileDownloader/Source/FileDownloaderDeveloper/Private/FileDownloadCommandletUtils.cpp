@@ -0,0 +1,49 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FileDownloadCommandletUtils.h"
+#include "FileDownloadEngineSubsystem.h"
+#include "FileDownloader.h"
+#include "Commandlets/Commandlet.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/Parse.h"
+
+void FFileDownloadCommandletUtils::InitCommandlet(UCommandlet* InCommandlet)
+{
+	InCommandlet->IsClient = false;
+	InCommandlet->IsServer = false;
+	InCommandlet->LogToConsole = true;
+}
+
+UFileDownloadEngineSubsystem* FFileDownloadCommandletUtils::GetEngine(const TCHAR* InName)
+{
+	UFileDownloadEngineSubsystem* Engine = UFileDownloadEngineSubsystem::Get();
+	if (Engine == nullptr)
+	{
+		UE_LOG(LogFileDownloader, Error, TEXT("%s needs the engine"), InName);
+		return nullptr;
+	}
+
+	//settings learned from real hosts would change the runs, and runs must not teach them
+	Engine->bUseHostProfiles = false;
+	return Engine;
+}
+
+FString FFileDownloadCommandletUtils::GetOutputFile(const TCHAR* InName, const FString& InParams)
+{
+	FString OutputFile = FPaths::ProjectSavedDir() / TEXT("Profiling") / FString(InName) + TEXT(".csv");
+	FParse::Value(*InParams, TEXT("Output="), OutputFile);
+	return OutputFile;
+}
+
+bool FFileDownloadCommandletUtils::SaveResults(const TCHAR* InName, const FString& InCsv, const FString& InOutputFile)
+{
+	if (FFileHelper::SaveStringToFile(InCsv, *InOutputFile) == false)
+	{
+		UE_LOG(LogFileDownloader, Error, TEXT("Cannot write %s"), *InOutputFile);
+		return false;
+	}
+
+	UE_LOG(LogFileDownloader, Display, TEXT("%s results : %s"), InName, *InOutputFile);
+	return true;
+}
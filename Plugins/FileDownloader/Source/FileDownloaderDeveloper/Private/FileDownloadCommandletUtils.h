@@ -0,0 +1,29 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UCommandlet;
+class UFileDownloadEngineSubsystem;
+
+/**
+ * setup & output shared by the commandlets that measure the plugin.
+ * results go to ../Saved/Profiling/<Name>.csv unless -Output=Path.csv is given
+ */
+class FFileDownloadCommandletUtils
+{
+public:
+
+	//no client or server, log to the console
+	static void InitCommandlet(UCommandlet* InCommandlet);
+
+	//the engine subsystem with learned host profiles off, nullptr & an error if the commandlet runs without the engine
+	static UFileDownloadEngineSubsystem* GetEngine(const TCHAR* InName);
+
+	//Saved/Profiling/<InName>.csv or the -Output= of InParams
+	static FString GetOutputFile(const TCHAR* InName, const FString& InParams);
+
+	//write the csv & log where it went, false if it cannot be written
+	static bool SaveResults(const TCHAR* InName, const FString& InCsv, const FString& InOutputFile);
+};
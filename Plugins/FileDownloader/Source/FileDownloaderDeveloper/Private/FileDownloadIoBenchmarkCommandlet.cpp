@@ -0,0 +1,182 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FileDownloadIoBenchmarkCommandlet.h"
+#include "FileDownloadCommandletUtils.h"
+#include "FileDownloader.h"
+#include "DownloadSink.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/Parse.h"
+#include "Async/Async.h"
+#include <atomic>
+
+//size of every read file
+static const int64 IO_READ_FILE_SIZE = 16 * 1024 * 1024;
+
+//bytes of a random read, about a streamed mip or audio chunk
+static const int32 IO_READ_SIZE = 64 * 1024;
+
+//bytes of a write, a chunk of a task
+static const int32 IO_WRITE_SIZE = 2 * 1024 * 1024;
+
+UFileDownloadIoBenchmarkCommandlet::UFileDownloadIoBenchmarkCommandlet()
+{
+	FFileDownloadCommandletUtils::InitCommandlet(this);
+}
+
+int32 UFileDownloadIoBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 WriteMB = (int32)(WriteSize / (1024 * 1024));
+	FParse::Value(*Params, TEXT("WriteMB="), WriteMB);
+	WriteSize = FMath::Max<int64>(1, WriteMB) * 1024 * 1024;
+
+	int32 ReadMB = 256;
+	FParse::Value(*Params, TEXT("ReadMB="), ReadMB);
+
+	FString SinkNames = TEXT("FILE,UNCACHED_FILE");
+	FParse::Value(*Params, TEXT("Sinks="), SinkNames);
+
+	const FString OutputFile = FFileDownloadCommandletUtils::GetOutputFile(TEXT("FileDownloadIoBenchmark"), Params);
+
+	Directory = FPaths::ProjectSavedDir() / TEXT("FileDownloadIoBenchmark");
+	IFileManager::Get().MakeDirectory(*Directory, true);
+
+	//random content, so no file system compresses or dedups it
+	TArray<uint8> Content;
+	Content.SetNumUninitialized((int32)IO_READ_FILE_SIZE);
+	for (int32 i = 0; i < Content.Num(); ++i)
+	{
+		Content[i] = (uint8)FMath::Rand();
+	}
+
+	const int32 ReadFileCount = FMath::Max<int32>(1, (int32)(ReadMB * 1024ll * 1024 / IO_READ_FILE_SIZE));
+	for (int32 i = 0; i < ReadFileCount; ++i)
+	{
+		const FString FileName = Directory / FString::Printf(TEXT("Asset%d.bin"), i);
+		if (FFileHelper::SaveArrayToFile(Content, *FileName) == false)
+		{
+			UE_LOG(LogFileDownloader, Error, TEXT("Cannot write %s"), *FileName);
+			return 1;
+		}
+		ReadFiles.Add(FileName);
+	}
+
+	FString Csv = TEXT("SinkType,WriteMB,WriteSeconds,WriteMBPerSecond,Reads,ReadP50Microseconds,ReadP99Microseconds,ReadMaxMicroseconds,WarmReadMilliseconds,RereadMilliseconds\n");
+	TArray<FString> Names;
+	SinkNames.ParseIntoArray(Names, TEXT(","));
+	for (const FString& Name : Names)
+	{
+		const int64 Value = StaticEnum<EDownloadSinkType>()->GetValueByNameString(Name);
+		if (Value == INDEX_NONE)
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("Unknown sink type %s"), *Name);
+			continue;
+		}
+
+		RunSink((EDownloadSinkType)Value, Name, Csv);
+	}
+
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	if (FFileDownloadCommandletUtils::SaveResults(TEXT("FileDownloadIoBenchmark"), Csv, OutputFile) == false)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+void UFileDownloadIoBenchmarkCommandlet::RunSink(EDownloadSinkType InType, const FString& InTypeName, FString& OutCsv)
+{
+	//every sink starts with the read files cached
+	const double WarmMilliseconds = ReadAll();
+
+	const FString WriteFile = Directory / TEXT("Download.bin");
+	FDownloadSinkPtr Sink = CreateDownloadSink(InType);
+	if (Sink->Open(WriteFile, false, WriteSize) == false)
+	{
+		UE_LOG(LogFileDownloader, Error, TEXT("Cannot open %s"), *WriteFile);
+		return;
+	}
+
+	std::atomic<bool> bWriting { true };
+	const int64 Size = WriteSize;
+	const double WriteStart = FPlatformTime::Seconds();
+	TFuture<bool> Writer = Async(EAsyncExecution::Thread, [Sink, Size, &bWriting]()
+	{
+		TArray<uint8> Chunk;
+		Chunk.SetNumUninitialized(IO_WRITE_SIZE);
+		for (int32 i = 0; i < Chunk.Num(); ++i)
+		{
+			Chunk[i] = (uint8)i;
+		}
+
+		bool bSucceeded = true;
+		for (int64 Offset = 0; Offset < Size && bSucceeded; Offset += IO_WRITE_SIZE)
+		{
+			bSucceeded = Sink->Write(Offset, Chunk.GetData(), (int32)FMath::Min<int64>(IO_WRITE_SIZE, Size - Offset));
+		}
+		Sink->Close();
+		bWriting = false;
+		return bSucceeded;
+	});
+
+	//random reads of the game while the download writes
+	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
+	TArray<uint8> Buffer;
+	Buffer.SetNumUninitialized(IO_READ_SIZE);
+	TArray<double> Latencies;
+	while (bWriting)
+	{
+		const FString& FileName = ReadFiles[FMath::RandRange(0, ReadFiles.Num() - 1)];
+		const int64 Offset = (int64)FMath::RandRange(0, (int32)(IO_READ_FILE_SIZE / IO_READ_SIZE) - 1) * IO_READ_SIZE;
+
+		const double ReadStart = FPlatformTime::Seconds();
+		if (IFileHandle* Handle = PlatformFile.OpenRead(*FileName))
+		{
+			Handle->Seek(Offset);
+			Handle->Read(Buffer.GetData(), IO_READ_SIZE);
+			delete Handle;
+		}
+		Latencies.Add((FPlatformTime::Seconds() - ReadStart) * 1000000.0);
+
+		FPlatformProcess::Sleep(0.001f);
+	}
+
+	const bool bWritten = Writer.Get();
+	const double WriteSeconds = FPlatformTime::Seconds() - WriteStart;
+	if (bWritten == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s failed to write %s"), *InTypeName, *WriteFile);
+	}
+
+	//files pushed out of the page cache are read from disk again
+	const double RereadMilliseconds = ReadAll();
+	IFileManager::Get().Delete(*WriteFile);
+
+	Latencies.Sort();
+	auto Percentile = [&Latencies](float InPercent)
+	{
+		return Latencies.Num() ? Latencies[FMath::Min(Latencies.Num() - 1, (int32)(Latencies.Num() * InPercent))] : 0.0;
+	};
+
+	const FString Row = FString::Printf(TEXT("%s,%lld,%.3f,%.1f,%d,%.1f,%.1f,%.1f,%.3f,%.3f"), *InTypeName, WriteSize / (1024 * 1024), WriteSeconds,
+		WriteSeconds > 0.0 ? WriteSize / (1024.0 * 1024.0) / WriteSeconds : 0.0, Latencies.Num(), Percentile(0.5f), Percentile(0.99f),
+		Latencies.Num() ? Latencies.Last() : 0.0, WarmMilliseconds, RereadMilliseconds);
+	UE_LOG(LogFileDownloader, Display, TEXT("%s"), *Row);
+	OutCsv += Row + TEXT("\n");
+}
+
+double UFileDownloadIoBenchmarkCommandlet::ReadAll() const
+{
+	const double StartTime = FPlatformTime::Seconds();
+	TArray<uint8> Data;
+	for (const FString& FileName : ReadFiles)
+	{
+		FFileHelper::LoadFileToArray(Data, *FileName);
+	}
+
+	return (FPlatformTime::Seconds() - StartTime) * 1000.0;
+}
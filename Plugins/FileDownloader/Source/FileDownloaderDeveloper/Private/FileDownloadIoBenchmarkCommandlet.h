@@ -0,0 +1,40 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "DownloadEvent.h"
+#include "FileDownloadIoBenchmarkCommandlet.generated.h"
+
+/**
+ * measures how a download writing a large file slows down reads of other files, no network is used.
+ * UE4Editor-Cmd.exe Project -run=FileDownloadIoBenchmark [-WriteMB=4096] [-ReadMB=256] [-Sinks=FILE,UNCACHED_FILE] [-Output=Path.csv]
+ * the read files stand for streamed game assets, they are read into the page cache, read at random while a sink writes,
+ * then read again completely. WriteMB above the free memory shows how much of them the write pushed out of the cache.
+ * one csv row per sink type, default output ../Saved/Profiling/FileDownloadIoBenchmark.csv
+ */
+UCLASS()
+class UFileDownloadIoBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+
+	UFileDownloadIoBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+
+	//write WriteSize through a sink of the type while reading the read files
+	void RunSink(EDownloadSinkType InType, const FString& InTypeName, FString& OutCsv);
+
+	//read every read file completely, return milliseconds
+	double ReadAll() const;
+
+	FString Directory;
+
+	TArray<FString> ReadFiles;
+
+	int64 WriteSize = 4096ll * 1024 * 1024;
+};
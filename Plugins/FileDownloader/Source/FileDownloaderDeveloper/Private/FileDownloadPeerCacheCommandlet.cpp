@@ -0,0 +1,149 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FileDownloadPeerCacheCommandlet.h"
+#include "FileDownloadCommandletUtils.h"
+#include "FileDownloadManager.h"
+#include "FileDownloadEngineSubsystem.h"
+#include "FileDownloader.h"
+#include "FaultInjectionTransport.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/Parse.h"
+
+UFileDownloadPeerCacheCommandlet::UFileDownloadPeerCacheCommandlet()
+{
+	FFileDownloadCommandletUtils::InitCommandlet(this);
+}
+
+int32 UFileDownloadPeerCacheCommandlet::Main(const FString& Params)
+{
+	UFileDownloadEngineSubsystem* Engine = FFileDownloadCommandletUtils::GetEngine(TEXT("FileDownloadPeerCache"));
+	if (Engine == nullptr)
+	{
+		return 1;
+	}
+
+	FParse::Value(*Params, TEXT("Files="), FileCount);
+	FParse::Value(*Params, TEXT("Size="), FileSize);
+	FParse::Value(*Params, TEXT("Port="), Port);
+	FParse::Value(*Params, TEXT("Timeout="), Timeout);
+
+	const FString OutputFile = FFileDownloadCommandletUtils::GetOutputFile(TEXT("FileDownloadPeerCache"), Params);
+
+	Engine->PeerCachePort = Port;
+	if (Engine->GetPeerCacheServer().IsValid() == false)
+	{
+		UE_LOG(LogFileDownloader, Error, TEXT("FileDownloadPeerCache cannot serve on port %d"), Port);
+		return 1;
+	}
+
+	//the origin is a loopback stand-in without faults, peers are asked over real http on loopback
+	TSharedPtr<FFaultInjectionTransport, ESPMode::ThreadSafe> Origin = MakeShareable(new FFaultInjectionTransport(FDownloadFaultProfile(), FileSize, 1));
+	Engine->SetTransport(Origin);
+
+	FString Csv = TEXT("Phase,Files,VerifiedFiles,Seconds,PeerBytes,OriginBytes,PeerRequests,Fallbacks,ServedBytes\n");
+
+	UFileDownloadManager* Seeder = NewObject<UFileDownloadManager>();
+	Seeder->AddToRoot();
+	Seeder->TickInterval = 0.f;
+	Seeder->bUseFreshnessCache = false;
+	Seeder->bServeToPeers = true;
+	bool bAllVerified = RunPhase(TEXT("Seed"), Seeder, FileCount / 2, Origin, Csv);
+
+	//the first peer refuses connections, its ranges fall back to the origin & it is skipped afterwards
+	UFileDownloadManager* Leecher = NewObject<UFileDownloadManager>();
+	Leecher->AddToRoot();
+	Leecher->TickInterval = 0.f;
+	Leecher->bUseFreshnessCache = false;
+	Leecher->PeerUrls.Add(TEXT("http://127.0.0.1:1"));
+	Leecher->PeerUrls.Add(FString::Printf(TEXT("http://127.0.0.1:%d"), Port));
+	bAllVerified &= RunPhase(TEXT("Peer"), Leecher, FileCount, Origin, Csv);
+
+	int64 PeerBytes = 0;
+	int64 OriginBytes = 0;
+	int64 PeerRequests = 0;
+	int64 Fallbacks = 0;
+	Leecher->GetPeerStats(PeerBytes, OriginBytes, PeerRequests, Fallbacks);
+
+	Seeder->Clear();
+	Seeder->RemoveFromRoot();
+	Leecher->Clear();
+	Leecher->RemoveFromRoot();
+	IFileManager::Get().DeleteDirectory(*(FPaths::ProjectSavedDir() / TEXT("FileDownloadPeerCache")), false, true);
+	Engine->SetTransport(nullptr);
+
+	if (FFileDownloadCommandletUtils::SaveResults(TEXT("FileDownloadPeerCache"), Csv, OutputFile) == false)
+	{
+		return 1;
+	}
+
+	if (PeerBytes < 1)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("No data came from the peer"));
+	}
+	return bAllVerified && PeerBytes > 0 ? 0 : 1;
+}
+
+bool UFileDownloadPeerCacheCommandlet::RunPhase(const FString& InPhase, UFileDownloadManager* InManager, int32 InCount, TSharedPtr<FFaultInjectionTransport, ESPMode::ThreadSafe> InOrigin, FString& OutCsv)
+{
+	const FString Directory = FPaths::ProjectSavedDir() / TEXT("FileDownloadPeerCache") / InPhase;
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	TMap<int32, FString> TaskUrls;
+	for (int32 i = 0; i < InCount; ++i)
+	{
+		const FString Url = FString::Printf(TEXT("http://origin.invalid/build/%d.bin"), i);
+		TaskUrls.Add(InManager->AddTaskByUrl(Url, Directory), Url);
+	}
+
+	int32 ServedFiles = 0;
+	int64 ServedRequests = 0;
+	int64 ServedBefore = 0;
+	UFileDownloadEngineSubsystem::Get()->GetPeerCacheStats(ServedFiles, ServedRequests, ServedBefore);
+
+	const double StartTime = FPlatformTime::Seconds();
+	InManager->StartAll();
+	if (InManager->WaitForAllTasks(Timeout) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s, timed out after %.0fs"), *InPhase, Timeout);
+	}
+	const double Seconds = FPlatformTime::Seconds() - StartTime;
+
+	int32 VerifiedFiles = 0;
+	for (const auto& It : TaskUrls)
+	{
+		const FTaskInformation Info = InManager->GetTaskInfo(It.Key);
+		if (InOrigin->VerifyFile(It.Value, Info.DestDirectory / Info.FileName))
+		{
+			++VerifiedFiles;
+		}
+		else
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("%s, %s is missing or wrong"), *InPhase, *It.Value);
+		}
+	}
+
+	int64 PeerBytes = 0;
+	int64 OriginBytes = 0;
+	int64 PeerRequests = 0;
+	int64 Fallbacks = 0;
+	InManager->GetPeerStats(PeerBytes, OriginBytes, PeerRequests, Fallbacks);
+
+	//a manager without peers gets everything from the origin
+	if (InManager->PeerUrls.Num() == 0)
+	{
+		int64 Requests = 0;
+		int64 FailedRequests = 0;
+		float AverageSeconds = 0.f;
+		InManager->GetTransportStats(Requests, FailedRequests, OriginBytes, AverageSeconds);
+	}
+
+	int64 ServedAfter = 0;
+	UFileDownloadEngineSubsystem::Get()->GetPeerCacheStats(ServedFiles, ServedRequests, ServedAfter);
+
+	const FString Row = FString::Printf(TEXT("%s,%d,%d,%.3f,%lld,%lld,%lld,%lld,%lld"), *InPhase, InCount, VerifiedFiles, Seconds,
+		PeerBytes, OriginBytes, PeerRequests, Fallbacks, ServedAfter - ServedBefore);
+	UE_LOG(LogFileDownloader, Display, TEXT("%s"), *Row);
+	OutCsv += Row + TEXT("\n");
+	return VerifiedFiles == InCount;
+}
@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FileDownloadPeerCacheCommandlet.generated.h"
+
+class FFaultInjectionTransport;
+class UFileDownloadManager;
+
+/**
+ * downloads files through the peer cache on loopback: a seeding manager serves half of the files it got from a loopback origin,
+ * then another manager downloads all files asking an unreachable peer & the seeding one first.
+ * UE4Editor-Cmd.exe Project -run=FileDownloadPeerCache [-Files=8] [-Size=8388608] [-Port=18480] [-Timeout=300] [-Output=Path.csv]
+ * writes bytes per source for both phases, returns 1 if a file is wrong or no byte came from the peer
+ * default output ../Saved/Profiling/FileDownloadPeerCache.csv
+ */
+UCLASS()
+class UFileDownloadPeerCacheCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+
+	UFileDownloadPeerCacheCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+
+	/*download files [0, InCount) into a directory of the phase & write a csv row
+	 @Return false if a file is missing or wrong
+	*/
+	bool RunPhase(const FString& InPhase, UFileDownloadManager* InManager, int32 InCount, TSharedPtr<FFaultInjectionTransport, ESPMode::ThreadSafe> InOrigin, FString& OutCsv);
+
+	int32 FileCount = 8;
+
+	int64 FileSize = 8 * 1024 * 1024;
+
+	int32 Port = 18480;
+
+	float Timeout = 300.f;
+};
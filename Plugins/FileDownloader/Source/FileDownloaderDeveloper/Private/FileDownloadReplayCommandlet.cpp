@@ -0,0 +1,164 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FileDownloadReplayCommandlet.h"
+#include "FileDownloadCommandletUtils.h"
+#include "FileDownloadManager.h"
+#include "FileDownloadEngineSubsystem.h"
+#include "FileDownloader.h"
+#include "SimulatedDownloadTransport.h"
+#include "DownloadTransport.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/Parse.h"
+
+//virtual seconds per step, the manager ticks once per step
+static const float REPLAY_STEP_SECONDS = 0.1f;
+
+UFileDownloadReplayCommandlet::UFileDownloadReplayCommandlet()
+{
+	FFileDownloadCommandletUtils::InitCommandlet(this);
+}
+
+int32 UFileDownloadReplayCommandlet::Main(const FString& Params)
+{
+	UFileDownloadEngineSubsystem* Engine = FFileDownloadCommandletUtils::GetEngine(TEXT("FileDownloadReplay"));
+	if (Engine == nullptr)
+	{
+		return 1;
+	}
+
+	FString TraceFile;
+	if (FParse::Value(*Params, TEXT("Trace="), TraceFile) == false)
+	{
+		UE_LOG(LogFileDownloader, Error, TEXT("FileDownloadReplay needs -Trace=Path"));
+		return 1;
+	}
+
+	FString ParallelList = FString::FromInt(Engine->MaxParallelTask);
+	FParse::Value(*Params, TEXT("MaxParallelTask="), ParallelList);
+	FString ChunkList = FString::FromInt(GetDefault<UFileDownloadManager>()->ChunkSize);
+	FParse::Value(*Params, TEXT("ChunkSize="), ChunkList);
+	FParse::Value(*Params, TEXT("Timeout="), Timeout);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+
+	const FString OutputFile = FFileDownloadCommandletUtils::GetOutputFile(TEXT("FileDownloadReplay"), Params);
+
+	TSharedPtr<FSimulatedDownloadTransport, ESPMode::ThreadSafe> Transport = MakeShareable(new FSimulatedDownloadTransport());
+	if (Transport->LoadTrace(TraceFile) == false)
+	{
+		return 1;
+	}
+
+	//the limiter refills in real time, a limit would mix real & virtual seconds
+	const int32 OldMaxParallelTask = Engine->MaxParallelTask;
+	const int64 OldMaxBytesPerSecond = Engine->MaxBytesPerSecond;
+	Engine->MaxBytesPerSecond = 0;
+	Engine->SetTransport(Transport);
+
+	TArray<FString> Parallels;
+	ParallelList.ParseIntoArray(Parallels, TEXT(","));
+	TArray<FString> Chunks;
+	ChunkList.ParseIntoArray(Chunks, TEXT(","));
+
+	FString Csv = TEXT("MaxParallelTask,ChunkSize,Tasks,CompletedTasks,TraceSeconds,VirtualSeconds,RealSeconds,GoodputBytesPerSecond,Requests,FailedRequests\n");
+	for (const FString& Parallel : Parallels)
+	{
+		for (const FString& Chunk : Chunks)
+		{
+			const int32 MaxParallelTask = FCString::Atoi(*Parallel);
+			const int32 ChunkSize = FCString::Atoi(*Chunk);
+			if (MaxParallelTask > 0 && ChunkSize > 0)
+			{
+				RunReplay(*Transport, MaxParallelTask, ChunkSize, Csv);
+			}
+		}
+	}
+
+	Engine->MaxParallelTask = OldMaxParallelTask;
+	Engine->MaxBytesPerSecond = OldMaxBytesPerSecond;
+	Engine->SetTransport(nullptr);
+
+	if (FFileDownloadCommandletUtils::SaveResults(TEXT("FileDownloadReplay"), Csv, OutputFile) == false)
+	{
+		return 1;
+	}
+
+	return 0;
+}
+
+void UFileDownloadReplayCommandlet::RunReplay(FSimulatedDownloadTransport& InTransport, int32 InMaxParallelTask, int32 InChunkSize, FString& OutCsv)
+{
+	UFileDownloadEngineSubsystem* Engine = UFileDownloadEngineSubsystem::Get();
+	Engine->MaxParallelTask = InMaxParallelTask;
+	InTransport.Reset();
+	const FDownloadTransportStats OldStats = InTransport.GetStats();
+
+	UFileDownloadManager* Manager = NewObject<UFileDownloadManager>();
+	Manager->AddToRoot();
+	Manager->TickInterval = 0.f;
+	Manager->MaxParallelTask = InMaxParallelTask;
+	Manager->bAutoTuneParallelTask = false;
+	Manager->ChunkSize = InChunkSize;
+	Manager->bEnableContentCache = false;
+	Manager->RetrySeed = Seed;
+
+	const TArray<FString> Urls = InTransport.GetUrls();
+	for (const FString& Url : Urls)
+	{
+		Manager->AddDiscardTaskByUrl(Url);
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	double VirtualTime = 0.0;
+	Manager->StartAll();
+	for (;;)
+	{
+		FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+		if ((Manager->GetRunningTaskCount() == 0 && Manager->HasWaitingTask() == false) || VirtualTime >= Timeout)
+		{
+			break;
+		}
+
+		//the clock stands still while a task has a step in flight, disk & worker threads run in real time
+		//afterwards every running task waits for a request in the transport, a retry delay or a budget, which only the clock moves on
+		while (Manager->HasBusyTask())
+		{
+			FPlatformProcess::Sleep(0.f);
+			FTaskGraphInterface::Get().ProcessThreadUntilIdle(ENamedThreads::GameThread);
+		}
+
+		VirtualTime += REPLAY_STEP_SECONDS;
+		InTransport.AdvanceTo(VirtualTime);
+		TickDownloadDelays(REPLAY_STEP_SECONDS);
+		Engine->Tick(REPLAY_STEP_SECONDS);
+		Manager->Tick(REPLAY_STEP_SECONDS);
+	}
+
+	if (VirtualTime >= Timeout)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("Replay of MaxParallelTask %d, ChunkSize %d timed out after %.0f virtual seconds"), InMaxParallelTask, InChunkSize, Timeout);
+	}
+
+	const double RealSeconds = FPlatformTime::Seconds() - StartTime;
+	const double Seconds = FMath::Max(InTransport.GetTime(), 0.001);
+
+	int32 CompletedTasks = 0;
+	int64 CompletedBytes = 0;
+	for (const FTaskInformation& Info : Manager->GetAllTaskInformation())
+	{
+		if (Info.TotalSize > 0 && Info.CurrentSize >= Info.TotalSize)
+		{
+			++CompletedTasks;
+			CompletedBytes += Info.TotalSize;
+		}
+	}
+
+	const FDownloadTransportStats Stats = InTransport.GetStats();
+	const FString Row = FString::Printf(TEXT("%d,%d,%d,%d,%.3f,%.3f,%.3f,%.0f,%lld,%lld"), InMaxParallelTask, InChunkSize, Urls.Num(), CompletedTasks,
+		InTransport.GetTraceSeconds(), Seconds, RealSeconds, CompletedBytes / Seconds, Stats.Requests - OldStats.Requests, Stats.FailedRequests - OldStats.FailedRequests);
+	UE_LOG(LogFileDownloader, Display, TEXT("%s"), *Row);
+	OutCsv += Row + TEXT("\n");
+
+	Manager->Clear();
+	Manager->RemoveFromRoot();
+}
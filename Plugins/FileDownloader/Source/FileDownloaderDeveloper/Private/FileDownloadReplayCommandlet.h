@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FileDownloadReplayCommandlet.generated.h"
+
+class FSimulatedDownloadTransport;
+
+/**
+ * replays a trace recorded with bRecordTrace on a virtual clock, once per setting, no network is used.
+ * UE4Editor-Cmd.exe Project -run=FileDownloadReplay -Trace=Path.txt [-MaxParallelTask=2,4,8] [-ChunkSize=1048576,2097152] [-Timeout=7200] [-Seed=1] [-Output=Path.csv]
+ * every MaxParallelTask & ChunkSize pair downloads all files of the trace, default output ../Saved/Profiling/FileDownloadReplay.csv
+ * the clock moves when no task has work in flight and retries are jittered from Seed, so a trace replays the same every run
+ */
+UCLASS()
+class UFileDownloadReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+
+	UFileDownloadReplayCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+
+	//download the files of the trace with one setting
+	void RunReplay(FSimulatedDownloadTransport& InTransport, int32 InMaxParallelTask, int32 InChunkSize, FString& OutCsv);
+
+	//virtual seconds before a replay gives up
+	float Timeout = 7200.f;
+
+	//RetrySeed of the managers
+	int32 Seed = 1;
+};
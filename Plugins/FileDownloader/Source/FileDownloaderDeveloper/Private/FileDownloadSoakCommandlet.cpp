@@ -0,0 +1,205 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "FileDownloadSoakCommandlet.h"
+#include "FileDownloadCommandletUtils.h"
+#include "FileDownloadManager.h"
+#include "FileDownloadEngineSubsystem.h"
+#include "FileDownloader.h"
+#include "FaultInjectionTransport.h"
+#include "FaultInjectionServer.h"
+#include "DownloadTransport.h"
+#include "HAL/FileManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/Parse.h"
+
+UFileDownloadSoakCommandlet::UFileDownloadSoakCommandlet()
+{
+	FFileDownloadCommandletUtils::InitCommandlet(this);
+}
+
+int32 UFileDownloadSoakCommandlet::Main(const FString& Params)
+{
+	UFileDownloadEngineSubsystem* Engine = FFileDownloadCommandletUtils::GetEngine(TEXT("FileDownloadSoak"));
+	if (Engine == nullptr)
+	{
+		return 1;
+	}
+
+	FParse::Value(*Params, TEXT("Files="), FileCount);
+	FParse::Value(*Params, TEXT("Size="), FileSize);
+	FParse::Value(*Params, TEXT("Timeout="), Timeout);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+	FParse::Value(*Params, TEXT("Port="), Port);
+	FString TransportList = TEXT("InProcess,HttpModule,Curl");
+	FParse::Value(*Params, TEXT("Transports="), TransportList);
+	TArray<FString> Transports;
+	TransportList.ParseIntoArray(Transports, TEXT(","));
+
+	const FString OutputFile = FFileDownloadCommandletUtils::GetOutputFile(TEXT("FileDownloadSoak"), Params);
+
+	TArray<FDownloadFaultProfile> Profiles;
+	Profiles.AddDefaulted_GetRef().Name = TEXT("Clean");
+	{
+		FDownloadFaultProfile& Profile = Profiles.AddDefaulted_GetRef();
+		Profile.Name = TEXT("DroppedConnections");
+		Profile.DropRate = 0.2f;
+	}
+	{
+		FDownloadFaultProfile& Profile = Profiles.AddDefaulted_GetRef();
+		Profile.Name = TEXT("SlowTrickle");
+		Profile.TrickleBytesPerSecond = 4 * 1024 * 1024;
+	}
+	{
+		FDownloadFaultProfile& Profile = Profiles.AddDefaulted_GetRef();
+		Profile.Name = TEXT("ServerErrorBursts");
+		Profile.ErrorBurstRate = 0.1f;
+		Profile.ErrorBurstLength = 3;
+	}
+	{
+		FDownloadFaultProfile& Profile = Profiles.AddDefaulted_GetRef();
+		Profile.Name = TEXT("ETagChanges");
+		Profile.ETagChangeRate = 0.1f;
+	}
+	{
+		FDownloadFaultProfile& Profile = Profiles.AddDefaulted_GetRef();
+		Profile.Name = TEXT("RangesIgnored");
+		Profile.IgnoreRangeRate = 0.3f;
+	}
+	{
+		FDownloadFaultProfile& Profile = Profiles.AddDefaulted_GetRef();
+		Profile.Name = TEXT("TruncatedBodies");
+		Profile.TruncateRate = 0.2f;
+	}
+	{
+		FDownloadFaultProfile& Profile = Profiles.AddDefaulted_GetRef();
+		Profile.Name = TEXT("Mixed");
+		Profile.DropRate = 0.05f;
+		Profile.ErrorBurstRate = 0.03f;
+		Profile.ETagChangeRate = 0.03f;
+		Profile.IgnoreRangeRate = 0.05f;
+		Profile.TruncateRate = 0.05f;
+	}
+	{
+		FDownloadFaultProfile& Profile = Profiles.AddDefaulted_GetRef();
+		Profile.Name = TEXT("DeltaRangeErrors");
+		Profile.RangeErrorsPerFile = 1;
+		Profile.BlockMapSuffix = TEXT(".blocks");
+	}
+
+	FString Csv = TEXT("Profile,Transport,Files,VerifiedFiles,Seconds,GoodputBytesPerSecond,WastedBytes,Faults,Recoveries,AverageRecoverySeconds\n");
+	bool bAllVerified = true;
+	for (const FDownloadFaultProfile& Profile : Profiles)
+	{
+		for (const FString& Transport : Transports)
+		{
+			bAllVerified &= RunProfile(Profile, Transport, Csv);
+		}
+	}
+
+	Engine->SetTransport(nullptr);
+
+	if (FFileDownloadCommandletUtils::SaveResults(TEXT("FileDownloadSoak"), Csv, OutputFile) == false)
+	{
+		return 1;
+	}
+
+	return bAllVerified ? 0 : 1;
+}
+
+bool UFileDownloadSoakCommandlet::RunProfile(const FDownloadFaultProfile& InProfile, const FString& InTransport, FString& OutCsv)
+{
+	//the real transports get the same faults over loopback http
+	TSharedPtr<FFaultInjectionTransport, ESPMode::ThreadSafe> Faults = MakeShareable(new FFaultInjectionTransport(InProfile, FileSize, Seed));
+	FDownloadTransportPtr Transport = Faults;
+	TUniquePtr<FFaultInjectionServer> Server;
+	FString BaseUrl = TEXT("http://soak.invalid");
+	if (InTransport != TEXT("InProcess"))
+	{
+		Server = MakeUnique<FFaultInjectionServer>(Faults);
+		if (Server->Start(Port) == false)
+		{
+			UE_LOG(LogFileDownloader, Error, TEXT("FileDownloadSoak cannot serve on port %d"), Port);
+			return false;
+		}
+		BaseUrl = Server->GetBaseUrl();
+		Transport = CreateDownloadTransport(InTransport == TEXT("Curl") ? EDownloadTransportType::CURL_MULTI : EDownloadTransportType::HTTP_MODULE, FCurlTransportSettings());
+	}
+	UFileDownloadEngineSubsystem::Get()->SetTransport(Transport);
+
+	const FString Directory = FPaths::ProjectSavedDir() / TEXT("FileDownloadSoak") / InProfile.Name / InTransport;
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+
+	UFileDownloadManager* Manager = NewObject<UFileDownloadManager>();
+	Manager->AddToRoot();
+	Manager->TickInterval = 0.f;
+
+	//a profile with block maps updates old local files by delta
+	const bool bDelta = InProfile.BlockMapSuffix.IsEmpty() == false;
+	Manager->bEnableDeltaUpdate = bDelta;
+	Manager->DeltaBlockMapSuffix = InProfile.BlockMapSuffix;
+
+	TMap<int32, FString> TaskUrls;
+	for (int32 i = 0; i < FileCount; ++i)
+	{
+		const FString Url = FString::Printf(TEXT("%s/%s/%d.bin"), *BaseUrl, *InProfile.Name, i);
+		const int32 TaskID = Manager->AddTaskByUrl(Url, Directory);
+		TaskUrls.Add(TaskID, Url);
+
+		//the old version differs from the served one in every fourth block
+		if (bDelta)
+		{
+			TArray<uint8> OldContent;
+			Faults->GetFileContent(Url, OldContent);
+			for (int64 Offset = 0; Offset < OldContent.Num(); Offset += 4 * InProfile.BlockMapBlockSize)
+			{
+				FMemory::Memzero(OldContent.GetData() + Offset, FMath::Min<int64>(InProfile.BlockMapBlockSize, OldContent.Num() - Offset));
+			}
+			const FTaskInformation Info = Manager->GetTaskInfo(TaskID);
+			FFileHelper::SaveArrayToFile(OldContent, *(Info.DestDirectory / Info.FileName));
+		}
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	Manager->StartAll();
+	if (Manager->WaitForAllTasks(Timeout) == false)
+	{
+		UE_LOG(LogFileDownloader, Warning, TEXT("%s over %s, timed out after %.0fs"), *InProfile.Name, Transport->GetName(), Timeout);
+	}
+	const double Seconds = FMath::Max(FPlatformTime::Seconds() - StartTime, 0.001);
+
+	int32 VerifiedFiles = 0;
+	for (const auto& It : TaskUrls)
+	{
+		const FTaskInformation Info = Manager->GetTaskInfo(It.Key);
+		if (Faults->VerifyFile(It.Value, Info.DestDirectory / Info.FileName) == false)
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("%s, %s is missing or wrong"), *InProfile.Name, *It.Value);
+		}
+		else if (bDelta && Manager->GetDeltaSavedSize(It.Key) < 1)
+		{
+			UE_LOG(LogFileDownloader, Warning, TEXT("%s, %s was not updated by delta"), *InProfile.Name, *It.Value);
+		}
+		else
+		{
+			++VerifiedFiles;
+		}
+	}
+
+	const FDownloadTransportStats Stats = Transport->GetStats();
+	const FDownloadFaultStats FaultStats = Faults->GetFaultStats();
+	const int64 UsefulBytes = VerifiedFiles * FileSize;
+	const FString Row = FString::Printf(TEXT("%s,%s,%d,%d,%.3f,%.0f,%lld,%d,%d,%.3f"), *InProfile.Name, Transport->GetName(), FileCount, VerifiedFiles, Seconds,
+		UsefulBytes / Seconds, FMath::Max<int64>(0, Stats.ReceivedBytes - UsefulBytes), FaultStats.Faults, FaultStats.Recoveries,
+		FaultStats.Recoveries > 0 ? FaultStats.RecoverySeconds / FaultStats.Recoveries : 0.0);
+	UE_LOG(LogFileDownloader, Display, TEXT("%s"), *Row);
+	OutCsv += Row + TEXT("\n");
+
+	//requests in flight are cancelled before the server closes its connections
+	Manager->Clear();
+	Manager->RemoveFromRoot();
+	UFileDownloadEngineSubsystem::Get()->SetTransport(nullptr);
+	Server.Reset();
+	IFileManager::Get().DeleteDirectory(*Directory, false, true);
+	return VerifiedFiles == FileCount;
+}
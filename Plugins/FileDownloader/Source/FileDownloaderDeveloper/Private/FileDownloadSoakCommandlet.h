@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "FileDownloadSoakCommandlet.generated.h"
+
+struct FDownloadFaultProfile;
+
+/**
+ * downloads files from a misbehaving stand-in server once per fault profile & transport, no network beyond loopback is used.
+ * UE4Editor-Cmd.exe Project -run=FileDownloadSoak [-Files=8] [-Size=5242880] [-Timeout=300] [-Seed=1] [-Transports=InProcess,HttpModule,Curl] [-Port=28657] [-Output=Path.csv]
+ * InProcess answers inside the transport, HttpModule & Curl download over http from a FFaultInjectionServer on Port.
+ * DeltaRangeErrors updates old local files by block map while the first range of every file fails once.
+ * checks every file and writes goodput, wasted bytes & recovery time per run, returns 1 if a file is wrong
+ * default output ../Saved/Profiling/FileDownloadSoak.csv
+ */
+UCLASS()
+class UFileDownloadSoakCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+
+	UFileDownloadSoakCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+protected:
+
+	//return false if a file is missing or wrong
+	bool RunProfile(const FDownloadFaultProfile& InProfile, const FString& InTransport, FString& OutCsv);
+
+	int32 FileCount = 8;
+
+	int64 FileSize = 5 * 1024 * 1024;
+
+	float Timeout = 300.f;
+
+	int32 Seed = 1;
+
+	//port of the loopback server
+	int32 Port = 28657;
+};
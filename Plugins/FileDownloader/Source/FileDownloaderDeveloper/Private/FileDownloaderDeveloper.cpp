@@ -0,0 +1,5 @@
+// Copyright 1998-2017 Epic Games, Inc. All Rights Reserved.
+
+#include "Modules/ModuleManager.h"
+
+IMPLEMENT_MODULE(FDefaultModuleImpl, FileDownloaderDeveloper)
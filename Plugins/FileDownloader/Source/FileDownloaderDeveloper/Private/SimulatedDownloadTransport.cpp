@@ -0,0 +1,326 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "SimulatedDownloadTransport.h"
+#include "DownloadTraceRecorder.h"
+#include "FileDownloader.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+
+//a flow with less left is done, rounding of rates * time must not keep it alive
+static const double FLOW_DONE_BYTES = 0.5;
+
+bool FSimulatedDownloadTransport::LoadTrace(const FString& InFileName)
+{
+	TArray<FString> Lines;
+	if (FFileHelper::LoadFileToStringArray(Lines, *InFileName) == false || Lines.Num() < 1 || Lines[0] != FDownloadTraceRecorder::TRACE_HEADER)
+	{
+		UE_LOG(LogFileDownloader, Error, TEXT("%s is not a download trace"), *InFileName);
+		return false;
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	Urls.Reset();
+	LinkBytesPerSecond = 0.0;
+	TraceSeconds = 0.0;
+
+	TMap<int32, FString> IdToUrl;
+	double FirstStart = -1.0;
+	for (const FString& Line : Lines)
+	{
+		TArray<FString> Fields;
+		Line.ParseIntoArray(Fields, TEXT(","), false);
+		if (Fields.Num() < 2)
+		{
+			continue;
+		}
+
+		if (Fields[0] == TEXT("U") && Fields.Num() >= 3)
+		{
+			//the url may have commas, it is the rest of the line
+			const FString Url = Line.Mid(Fields[0].Len() + Fields[1].Len() + 2);
+			IdToUrl.Add(FCString::Atoi(*Fields[1]), Url);
+			Urls.FindOrAdd(Url);
+		}
+		else if (Fields[0] == TEXT("R") && Fields.Num() >= 11)
+		{
+			const FString* Url = IdToUrl.Find(FCString::Atoi(*Fields[2]));
+			if (Url == nullptr)
+			{
+				continue;
+			}
+
+			FSample Sample;
+			Sample.Code = FCString::Atoi(*Fields[6]);
+			Sample.Bytes = FCString::Atoi64(*Fields[7]);
+			Sample.Seconds = FCString::Atod(*Fields[8]);
+			Sample.bSucceeded = FCString::Atoi(*Fields[9]) != 0;
+
+			FUrlTrace& Trace = Urls.FindOrAdd(*Url);
+			Trace.Size = FMath::Max(Trace.Size, FCString::Atoi64(*Fields[10]));
+			(Fields[3] == TEXT("HEAD") ? Trace.Heads : Trace.Gets).Add(Sample);
+
+			const double Start = FCString::Atod(*Fields[1]);
+			FirstStart = FirstStart < 0.0 ? Start : FMath::Min(FirstStart, Start);
+			TraceSeconds = FMath::Max(TraceSeconds, Start + Sample.Seconds);
+		}
+		else if (Fields[0] == TEXT("B") && Fields.Num() >= 3)
+		{
+			LinkBytesPerSecond = FMath::Max(LinkBytesPerSecond, FCString::Atod(*Fields[2]));
+		}
+	}
+
+	TraceSeconds -= FMath::Max(0.0, FirstStart);
+	for (auto& It : Urls)
+	{
+		double HeadSeconds = 0.0;
+		for (const FSample& Sample : It.Value.Heads)
+		{
+			HeadSeconds += Sample.Seconds;
+		}
+		It.Value.Latency = It.Value.Heads.Num() > 0 ? HeadSeconds / It.Value.Heads.Num() : 0.0;
+	}
+
+	UE_LOG(LogFileDownloader, Log, TEXT("Download trace %s : %d urls, %.0f seconds, link %.0f bytes/s"), *InFileName, Urls.Num(), TraceSeconds, LinkBytesPerSecond);
+	return true;
+}
+
+void FSimulatedDownloadTransport::Reset()
+{
+	FScopeLock ScopeLock(&Lock);
+	Now = 0.0;
+	Transfers.Reset();
+	for (auto& It : Urls)
+	{
+		It.Value.NextHead = 0;
+		It.Value.NextGet = 0;
+	}
+}
+
+uint64 FSimulatedDownloadTransport::Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete)
+{
+	const uint64 Handle = NewHandle();
+
+	FScopeLock ScopeLock(&Lock);
+	FTransfer& Transfer = Transfers.AddDefaulted_GetRef();
+	Transfer.Handle = Handle;
+	Transfer.Request = InRequest;
+	Transfer.OnComplete = MoveTemp(InOnComplete);
+	Transfer.StartTime = Now;
+	Transfer.EndTime = Now;
+
+	FUrlTrace* Trace = Urls.Find(InRequest.Url);
+	if (Trace == nullptr)
+	{
+		Transfer.Sample.Code = 404;
+		Transfer.Sample.bSucceeded = true;
+		return Handle;
+	}
+
+	Transfer.Size = Trace->Size;
+	const bool bHead = InRequest.Verb == TEXT("HEAD");
+	TArray<FSample>& Samples = bHead ? Trace->Heads : Trace->Gets;
+	int32& Next = bHead ? Trace->NextHead : Trace->NextGet;
+	if (Samples.Num() > 0)
+	{
+		Transfer.Sample = Samples[Next++ % Samples.Num()];
+	}
+	else
+	{
+		Transfer.Sample.Code = bHead ? 200 : 206;
+		Transfer.Sample.bSucceeded = true;
+	}
+
+	//HEAD & failures take the recorded time, data of a good GET flows through the link
+	const bool bGoodGet = bHead == false && Transfer.Sample.bSucceeded && Transfer.Sample.Code >= 200 && Transfer.Sample.Code < 300;
+	if (bGoodGet == false)
+	{
+		Transfer.EndTime = Now + Transfer.Sample.Seconds;
+		return Handle;
+	}
+
+	int64 Offset = 0;
+	int64 Length = Trace->Size;
+	ParseDownloadRange(InRequest, Offset, Length);
+	Transfer.bFlow = true;
+	Transfer.ReadyTime = Now + Trace->Latency;
+	Transfer.RemainingBytes = (double)FMath::Max<int64>(0, FMath::Min(Length, Trace->Size - Offset));
+	Transfer.RateCap = Transfer.Sample.Seconds > 0.0 && Transfer.Sample.Bytes > 0 ? Transfer.Sample.Bytes / Transfer.Sample.Seconds : 0.0;
+	return Handle;
+}
+
+void FSimulatedDownloadTransport::Cancel(uint64 InHandle)
+{
+	FScopeLock ScopeLock(&Lock);
+	Transfers.RemoveAll([InHandle](const FTransfer& Transfer)
+	{
+		return Transfer.Handle == InHandle;
+	});
+}
+
+void FSimulatedDownloadTransport::AdvanceTo(double InTime)
+{
+	for (;;)
+	{
+		TArray<FTransfer> Done;
+		{
+			FScopeLock ScopeLock(&Lock);
+			UpdateRatesLocked();
+
+			//next time a timer ends, a flow starts or a flow ends
+			double NextTime = InTime;
+			for (const FTransfer& Transfer : Transfers)
+			{
+				if (Transfer.bFlow == false)
+				{
+					NextTime = FMath::Min(NextTime, Transfer.EndTime);
+				}
+				else if (Transfer.ReadyTime > Now)
+				{
+					NextTime = FMath::Min(NextTime, Transfer.ReadyTime);
+				}
+				else if (Transfer.Rate > 0.0)
+				{
+					NextTime = FMath::Min(NextTime, Now + Transfer.RemainingBytes / Transfer.Rate);
+				}
+			}
+
+			NextTime = FMath::Max(NextTime, Now);
+			const double Elapsed = NextTime - Now;
+			for (int32 i = Transfers.Num() - 1; i >= 0; --i)
+			{
+				//a flow ending at NextTime is done even if rounding leaves a few bytes
+				FTransfer& Transfer = Transfers[i];
+				const bool bFlowEnds = Transfer.Rate > 0.0 && Now + Transfer.RemainingBytes / Transfer.Rate <= NextTime;
+				Transfer.RemainingBytes -= Transfer.Rate * Elapsed;
+				const bool bDone = Transfer.bFlow ? Transfer.ReadyTime <= NextTime && (bFlowEnds || Transfer.RemainingBytes <= FLOW_DONE_BYTES) : Transfer.EndTime <= NextTime;
+				if (bDone)
+				{
+					Done.Add(MoveTemp(Transfer));
+					Transfers.RemoveAt(i);
+				}
+			}
+
+			Now = NextTime;
+			if (Done.Num() < 1 && Now >= InTime)
+			{
+				return;
+			}
+		}
+
+		//in send order, callbacks may send the next requests
+		for (int32 i = Done.Num() - 1; i >= 0; --i)
+		{
+			FTransfer& Transfer = Done[i];
+			FDownloadResponsePtr Response = MakeResponse(Transfer);
+			const bool bSucceeded = Transfer.Sample.bSucceeded;
+			AddStats(Response.IsValid() ? Response->Content.Num() : 0, GetTime() - Transfer.StartTime, 0.0, -1, bSucceeded);
+			Transfer.OnComplete(Response, bSucceeded);
+		}
+	}
+}
+
+double FSimulatedDownloadTransport::GetTime() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Now;
+}
+
+int32 FSimulatedDownloadTransport::GetPendingCount() const
+{
+	FScopeLock ScopeLock(&Lock);
+	return Transfers.Num();
+}
+
+TArray<FString> FSimulatedDownloadTransport::GetUrls() const
+{
+	FScopeLock ScopeLock(&Lock);
+	TArray<FString> Result;
+	for (const auto& It : Urls)
+	{
+		if (It.Value.Size > 0)
+		{
+			Result.Add(It.Key);
+		}
+	}
+
+	return Result;
+}
+
+void FSimulatedDownloadTransport::UpdateRatesLocked()
+{
+	TArray<FTransfer*> Flows;
+	for (FTransfer& Transfer : Transfers)
+	{
+		Transfer.Rate = 0.0;
+		if (Transfer.bFlow && Transfer.ReadyTime <= Now)
+		{
+			Flows.Add(&Transfer);
+		}
+	}
+
+	if (LinkBytesPerSecond <= 0.0)
+	{
+		for (FTransfer* Flow : Flows)
+		{
+			Flow->Rate = Flow->RateCap > 0.0 ? Flow->RateCap : TNumericLimits<float>::Max();
+		}
+		return;
+	}
+
+	//max-min fair share, flows capped below their share leave the rest to the others
+	Flows.Sort([](const FTransfer& A, const FTransfer& B)
+	{
+		const double CapA = A.RateCap > 0.0 ? A.RateCap : TNumericLimits<float>::Max();
+		const double CapB = B.RateCap > 0.0 ? B.RateCap : TNumericLimits<float>::Max();
+		return CapA < CapB;
+	});
+
+	double Left = LinkBytesPerSecond;
+	for (int32 i = 0; i < Flows.Num(); ++i)
+	{
+		const double Share = Left / (Flows.Num() - i);
+		Flows[i]->Rate = Flows[i]->RateCap > 0.0 ? FMath::Min(Flows[i]->RateCap, Share) : Share;
+		Left -= Flows[i]->Rate;
+	}
+}
+
+FDownloadResponsePtr FSimulatedDownloadTransport::MakeResponse(const FTransfer& InTransfer) const
+{
+	//a failure without code never got a response
+	if (InTransfer.Sample.Code == 0)
+	{
+		return nullptr;
+	}
+
+	FDownloadResponsePtr Response = MakeShareable(new FDownloadResponse());
+	Response->ResponseCode = InTransfer.Sample.Code;
+	if (InTransfer.Sample.Code < 200 || InTransfer.Sample.Code >= 300)
+	{
+		return Response;
+	}
+
+	Response->Headers.Emplace(TEXT("ETag"), TEXT("\"replay\""));
+	Response->Headers.Emplace(TEXT("Accept-Ranges"), TEXT("bytes"));
+	if (InTransfer.Request.Verb == TEXT("HEAD"))
+	{
+		Response->Headers.Emplace(TEXT("Content-Length"), FString::Printf(TEXT("%lld"), InTransfer.Size));
+		return Response;
+	}
+
+	int64 Offset = 0;
+	int64 Length = InTransfer.Size;
+	if (ParseDownloadRange(InTransfer.Request, Offset, Length))
+	{
+		Length = FMath::Max<int64>(0, FMath::Min(Length, InTransfer.Size - Offset));
+		Response->ResponseCode = 206;
+		Response->Headers.Emplace(TEXT("Content-Range"), FString::Printf(TEXT("bytes %lld-%lld/%lld"), Offset, Offset + Length - 1, InTransfer.Size));
+	}
+	else
+	{
+		Response->ResponseCode = 200;
+	}
+
+	Response->Headers.Emplace(TEXT("Content-Length"), FString::Printf(TEXT("%lld"), Length));
+	Response->Content.SetNumZeroed(Length);
+	return Response;
+}
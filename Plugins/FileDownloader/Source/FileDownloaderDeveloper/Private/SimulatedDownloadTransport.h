@@ -0,0 +1,126 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTransport.h"
+
+/**
+ * answers requests from a trace of FDownloadTraceRecorder on a virtual clock, no network is used.
+ * the n-th request of a url replays the n-th recorded request of the same verb: failures keep their code & duration,
+ * GET data flows at the recorded rate of that request, all flows share the peak bandwidth of the trace.
+ * a request does not complete until AdvanceTo moves the clock past its end, callbacks run inside AdvanceTo
+ */
+class FSimulatedDownloadTransport : public IDownloadTransport
+{
+public:
+
+	//false if the file is missing or not a trace
+	bool LoadTrace(const FString& InFileName);
+
+	virtual uint64 Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete) override;
+
+	virtual void Cancel(uint64 InHandle) override;
+
+	virtual const TCHAR* GetName() const override
+	{
+		return TEXT("Simulated");
+	}
+
+	virtual void Preconnect(const FString& InUrl) override {}
+
+	//move the virtual clock forward and complete the requests ending before it
+	void AdvanceTo(double InTime);
+
+	double GetTime() const;
+
+	//requests sent & not completed
+	int32 GetPendingCount() const;
+
+	//urls of the trace with a known size
+	TArray<FString> GetUrls() const;
+
+	//seconds from the first request to the end of the last one in the trace
+	double GetTraceSeconds() const
+	{
+		return TraceSeconds;
+	}
+
+	//start the clock & the samples of every url from the beginning
+	void Reset();
+
+protected:
+
+	struct FSample
+	{
+		int32 Code = 0;
+
+		int64 Bytes = 0;
+
+		double Seconds = 0.0;
+
+		bool bSucceeded = false;
+	};
+
+	struct FUrlTrace
+	{
+		int64 Size = 0;
+
+		TArray<FSample> Heads;
+
+		TArray<FSample> Gets;
+
+		//mean HEAD time, a GET waits this long for its first byte
+		double Latency = 0.0;
+
+		int32 NextHead = 0;
+
+		int32 NextGet = 0;
+	};
+
+	struct FTransfer
+	{
+		uint64 Handle = 0;
+
+		FDownloadRequest Request;
+
+		FOnDownloadRequestComplete OnComplete;
+
+		FSample Sample;
+
+		int64 Size = 0;
+
+		double StartTime = 0.0;
+
+		//a timer completes at EndTime, a flow starts at ReadyTime and completes when no byte remains
+		bool bFlow = false;
+
+		double EndTime = 0.0;
+
+		double ReadyTime = 0.0;
+
+		double RemainingBytes = 0.0;
+
+		double RateCap = 0.0;
+
+		double Rate = 0.0;
+	};
+
+	//share the link between the flows started before Now, call with Lock held
+	void UpdateRatesLocked();
+
+	FDownloadResponsePtr MakeResponse(const FTransfer& InTransfer) const;
+
+	TMap<FString, FUrlTrace> Urls;
+
+	//bytes per second of the link, 0 means only the rates of the requests limit
+	double LinkBytesPerSecond = 0.0;
+
+	double TraceSeconds = 0.0;
+
+	mutable FCriticalSection Lock;
+
+	double Now = 0.0;
+
+	TArray<FTransfer> Transfers;
+};
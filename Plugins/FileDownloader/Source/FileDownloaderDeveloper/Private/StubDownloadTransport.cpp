@@ -0,0 +1,94 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#include "StubDownloadTransport.h"
+#include "Async/Async.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Misc/ScopeLock.h"
+
+FStubDownloadTransport::FStubDownloadTransport(int64 InContentSize)
+	: ContentSize(FMath::Max<int64>(0, InContentSize))
+{
+}
+
+uint64 FStubDownloadTransport::Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete)
+{
+	const uint64 Handle = NewHandle();
+	{
+		FScopeLock ScopeLock(&Lock);
+		Requests.Add(Handle);
+	}
+
+	//answer later like a real transport, the caller may still hold its request lock
+	FDownloadResponsePtr Response = MakeResponse(InRequest);
+	auto Answer = [this, Handle, Response, InOnComplete]()
+	{
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (Requests.Remove(Handle) == 0)
+			{
+				return;
+			}
+		}
+
+		AddStats(Response->Content.Num(), 0.0, 0.0, -1, true);
+		InOnComplete(Response, true);
+	};
+
+	if (InRequest.bCompleteOnGameThread)
+	{
+		FFunctionGraphTask::CreateAndDispatchWhenReady(MoveTemp(Answer), TStatId(), nullptr, ENamedThreads::GameThread);
+	}
+	else
+	{
+		Async(EAsyncExecution::ThreadPool, MoveTemp(Answer));
+	}
+
+	return Handle;
+}
+
+void FStubDownloadTransport::Cancel(uint64 InHandle)
+{
+	FScopeLock ScopeLock(&Lock);
+	Requests.Remove(InHandle);
+}
+
+FDownloadResponsePtr FStubDownloadTransport::MakeResponse(const FDownloadRequest& InRequest) const
+{
+	FDownloadResponsePtr Response = MakeShareable(new FDownloadResponse());
+	Response->Headers.Emplace(TEXT("ETag"), TEXT("\"stub\""));
+
+	FString Range;
+	for (const TPair<FString, FString>& Header : InRequest.Headers)
+	{
+		if (Header.Key.Equals(TEXT("Range"), ESearchCase::IgnoreCase))
+		{
+			Range = Header.Value;
+		}
+	}
+
+	//"bytes=first-last", a single range only
+	int64 First = 0;
+	int64 Last = ContentSize - 1;
+	FString Left;
+	FString Right;
+	if (Range.RemoveFromStart(TEXT("bytes=")) && Range.Split(TEXT("-"), &Left, &Right))
+	{
+		First = FCString::Atoi64(*Left);
+		Last = Right.IsEmpty() ? Last : FMath::Min(Last, FCString::Atoi64(*Right));
+		Response->ResponseCode = 206;
+		Response->Headers.Emplace(TEXT("Content-Range"), FString::Printf(TEXT("bytes %lld-%lld/%lld"), First, Last, ContentSize));
+	}
+	else
+	{
+		Response->ResponseCode = 200;
+	}
+
+	const int64 Length = FMath::Max<int64>(0, Last - First + 1);
+	Response->Headers.Emplace(TEXT("Content-Length"), FString::Printf(TEXT("%lld"), InRequest.Verb == TEXT("HEAD") ? ContentSize : Length));
+	if (InRequest.Verb != TEXT("HEAD"))
+	{
+		Response->Content.SetNumZeroed(Length);
+	}
+
+	return Response;
+}
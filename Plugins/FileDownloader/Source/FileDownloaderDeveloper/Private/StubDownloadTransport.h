@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DownloadTransport.h"
+
+/**
+ * answers every request itself without network, for benchmarks of the bookkeeping around tasks.
+ * HEAD gets the content size, GET gets zeros for the requested range
+ */
+class FStubDownloadTransport : public IDownloadTransport
+{
+public:
+
+	//size & ETag of every remote file
+	FStubDownloadTransport(int64 InContentSize);
+
+	virtual uint64 Send(const FDownloadRequest& InRequest, FOnDownloadRequestComplete InOnComplete) override;
+
+	virtual void Cancel(uint64 InHandle) override;
+
+	virtual const TCHAR* GetName() const override
+	{
+		return TEXT("Stub");
+	}
+
+	//the stub has no connections to open
+	virtual void Preconnect(const FString& InUrl) override {}
+
+protected:
+
+	FDownloadResponsePtr MakeResponse(const FDownloadRequest& InRequest) const;
+
+	int64 ContentSize = 0;
+
+	FCriticalSection Lock;
+
+	//sent & not answered yet
+	TSet<uint64> Requests;
+};